@@ -1,46 +1,89 @@
 #[path = "../tests/shp_utils.rs"]
 mod shp_utils;
 
-use criterion::{Criterion, criterion_group, criterion_main};
+use criterion::{Criterion, Throughput, criterion_group, criterion_main};
 use pathfinding::prelude::dijkstra;
 use rand::{Rng, SeedableRng, rngs::StdRng};
-use routingkit_cch::{CCH, CCHMetric, CCHQuery, compute_order_inertial};
+use routingkit_cch::{
+    AllocationOptions, CCH, CCHMapMatcher, CCHMetric, CCHMetricPartialUpdater, CCHMetricReplicas,
+    CCHQuery, CCHQueryArena, CCHQueryCache, CH, CHBatchQuery, CHQuery, CompressedCCH,
+    CompressedCCHMetric, CompressedCCHQuery, HubLabels, MapMatchConfig, MappedCH, MappedCHQuery,
+    NodeRenumbering, QuantizedCCHMetric, QuantizedCCHQuery, SpatialIndex, WeightWidth,
+    compute_order_inertial, numa_node_count, pin_current_thread_to_numa_node,
+};
+use std::collections::HashMap;
+use std::time::{Duration, Instant};
+
+const CITIES: [&str; 5] = ["beijing", "chengdu", "cityindia", "harbin", "porto"];
+
+/// Road graph of one city as loaded from `data/{city}_data/map/*.shp`.
+struct CityGraph {
+    node_count: usize,
+    tail: Vec<u32>,
+    head: Vec<u32>,
+    weights: Vec<u32>,
+    order: Vec<u32>,
+    lat: Vec<f32>,
+    lon: Vec<f32>,
+}
+
+fn load_city(city: &str) -> Option<CityGraph> {
+    let (Ok(edges), Ok(nodes)) = (
+        shp_utils::load_edges(&format!("data/{city}_data/map/edges.shp")),
+        shp_utils::load_nodes(&format!("data/{city}_data/map/nodes.shp")),
+    ) else {
+        eprintln!("Failed to load data for city: {}", city);
+        return None;
+    };
+    let shp_utils::GraphArrays {
+        osmids: _,
+        xs,
+        ys,
+        tail,
+        head,
+        weight,
+    } = shp_utils::build_graph_arrays(&nodes, &edges).unwrap();
+    let node_count = nodes.len();
+
+    let tail = tail.into_iter().map(|x| x as u32).collect::<Vec<u32>>();
+    let head = head.into_iter().map(|x| x as u32).collect::<Vec<u32>>();
+    let weights = weight
+        .into_iter()
+        .map(|x| (x * 1e3) as u32)
+        .collect::<Vec<u32>>();
+    let lat = xs.into_iter().map(|x| x as f32).collect::<Vec<f32>>();
+    let lon = ys.into_iter().map(|x| x as f32).collect::<Vec<f32>>();
+
+    eprintln!("Graph has {} nodes, {} edges.", node_count, tail.len());
+
+    eprintln!("Computing order...");
+    let order = compute_order_inertial(node_count as u32, &tail, &head, &lat, &lon);
+    Some(CityGraph {
+        node_count,
+        tail,
+        head,
+        weights,
+        order,
+        lat,
+        lon,
+    })
+}
 
 fn bench_pathfinding(c: &mut Criterion) {
-    for city in ["beijing", "chengdu", "cityindia", "harbin", "porto"] {
+    for city in CITIES {
         let mut group = c.benchmark_group(city);
         eprintln!("====\nComparing with pathfinding for city: {}\n====", city);
-        let (Ok(edges), Ok(nodes)) = (
-            shp_utils::load_edges(&format!("data/{city}_data/map/edges.shp")),
-            shp_utils::load_nodes(&format!("data/{city}_data/map/nodes.shp")),
-        ) else {
-            eprintln!("Failed to load data for city: {}", city);
-            continue;
-        };
-        let shp_utils::GraphArrays {
-            osmids: _,
-            xs,
-            ys,
+        let Some(CityGraph {
+            node_count,
             tail,
             head,
-            weight,
-        } = shp_utils::build_graph_arrays(&nodes, &edges).unwrap();
-        let node_count = nodes.len();
-
-        let tail = tail.into_iter().map(|x| x as u32).collect::<Vec<u32>>();
-        let head = head.into_iter().map(|x| x as u32).collect::<Vec<u32>>();
-        let weights = weight
-            .into_iter()
-            .map(|x| (x * 1e3) as u32)
-            .collect::<Vec<u32>>();
-        let lat = xs.into_iter().map(|x| x as f32).collect::<Vec<f32>>();
-        let lon = ys.into_iter().map(|x| x as f32).collect::<Vec<f32>>();
-
-        eprintln!("Graph has {} nodes, {} edges.", node_count, tail.len());
-
-        // Compute simple degree order as a baseline (fast). Could use inertial order with coords if provided.
-        eprintln!("Computing order...");
-        let order = compute_order_inertial(node_count as u32, &tail, &head, &lat, &lon);
+            weights,
+            order,
+            ..
+        }) = load_city(city)
+        else {
+            continue;
+        };
 
         eprintln!("Building CCH...");
         let cch = CCH::new(&order, &tail, &head, |_| {}, false);
@@ -86,5 +129,1084 @@ fn bench_pathfinding(c: &mut Criterion) {
     }
 }
 
-criterion_group!(benches, bench_pathfinding);
+/// Many sources (couriers) to one target (pickup) per iteration: the dedicated many-to-one
+/// path against RoutingKit's pinned-source sweep. Throughput is reported in distances.
+fn bench_many_to_one(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/many_to_one"));
+        let Some(CityGraph {
+            node_count,
+            tail,
+            head,
+            weights,
+            order,
+            ..
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+        let metric = CCHMetric::new(&cch, weights);
+        let mut query = CCHQuery::new(&metric);
+
+        let mut rng = StdRng::seed_from_u64(42);
+        let sources: Vec<u32> = (0..node_count.min(50_000))
+            .map(|_| rng.gen_range(0..node_count) as u32)
+            .collect();
+        let mut dists = vec![0u32; sources.len()];
+        group.throughput(Throughput::Elements(sources.len() as u64));
+
+        query.pin_many_to_one_sources(&sources);
+        let mut rng = StdRng::seed_from_u64(7);
+        group.bench_function("many_to_one", |b| {
+            b.iter(|| {
+                let target = rng.gen_range(0..node_count) as u32;
+                query.many_to_one_no_alloc(target, &mut dists);
+            })
+        });
+
+        query.pin_sources(&sources);
+        let mut rng = StdRng::seed_from_u64(7);
+        group.bench_function("pinned_sources", |b| {
+            b.iter(|| {
+                let target = rng.gen_range(0..node_count) as u32;
+                query.reset_target();
+                query.add_target(target, 0);
+                let res = query.run_to_pinned_sources();
+                res.get_distances_to_sources_no_alloc(&mut dists);
+            })
+        });
+
+        group.finish();
+    }
+}
+
+/// Cost of moving one vehicle in a pinned fleet: remove + add of a single pinned target
+/// against re-pinning the whole fleet (ours and RoutingKit's selection).
+fn bench_pinned_target_updates(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/pinned_updates"));
+        let Some(CityGraph {
+            node_count,
+            tail,
+            head,
+            weights,
+            order,
+            ..
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+        let metric = CCHMetric::new(&cch, weights);
+        let mut query = CCHQuery::new(&metric);
+
+        let mut rng = StdRng::seed_from_u64(42);
+        let mut fleet: Vec<u32> = (0..node_count.min(10_000))
+            .map(|_| rng.gen_range(0..node_count) as u32)
+            .collect();
+        query.pin_one_to_many_targets(&fleet);
+        group.bench_function("move_one_vehicle", |b| {
+            b.iter(|| {
+                let vehicle = rng.gen_range(0..fleet.len());
+                fleet[vehicle] = rng.gen_range(0..node_count) as u32;
+                query.remove_pinned_target(vehicle as u32);
+                query.add_pinned_target(fleet[vehicle]);
+            })
+        });
+
+        group.sample_size(10);
+        group.bench_function("repin_fleet", |b| {
+            b.iter(|| {
+                let vehicle = rng.gen_range(0..fleet.len());
+                fleet[vehicle] = rng.gen_range(0..node_count) as u32;
+                query.pin_one_to_many_targets(&fleet);
+            })
+        });
+        group.bench_function("repin_fleet_routingkit", |b| {
+            b.iter(|| {
+                let vehicle = rng.gen_range(0..fleet.len());
+                fleet[vehicle] = rng.gen_range(0..node_count) as u32;
+                query.pin_targets(&fleet);
+            })
+        });
+
+        group.finish();
+    }
+}
+
+/// Random point-to-point queries and one-to-many sweeps over a pinned fleet, with input ids,
+/// rank ids and Hilbert ids. Criterion only reports time; for cache misses run e.g.
+/// `perf stat -e cache-misses,cache-references cargo bench -- renumbering/<mode>`.
+fn bench_renumbering(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/renumbering"));
+        let Some(CityGraph {
+            node_count,
+            tail,
+            head,
+            weights,
+            order,
+            lat,
+            lon,
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        let modes = [
+            ("input_ids", None),
+            ("rank", Some(NodeRenumbering::Rank)),
+            (
+                "hilbert",
+                Some(NodeRenumbering::Hilbert {
+                    latitude: &lat,
+                    longitude: &lon,
+                }),
+            ),
+        ];
+        for (name, renumbering) in modes {
+            let (cch, new_id) = match renumbering {
+                Some(r) => CCH::new_renumbered(&order, &tail, &head, |_| {}, false, r),
+                None => (
+                    CCH::new(&order, &tail, &head, |_| {}, false),
+                    (0..node_count as u32).collect(),
+                ),
+            };
+            let metric = CCHMetric::new(&cch, weights.clone());
+            let mut query = CCHQuery::new(&metric);
+
+            let mut rng = StdRng::seed_from_u64(42);
+            group.bench_function(format!("{name}/point_to_point"), |b| {
+                b.iter(|| {
+                    let s = new_id[rng.gen_range(0..node_count)];
+                    let t = new_id[rng.gen_range(0..node_count)];
+                    query.add_source(s, 0);
+                    query.add_target(t, 0);
+                    let res = query.run();
+                    let _ = (res.distance(), res.node_path());
+                })
+            });
+
+            let mut rng = StdRng::seed_from_u64(42);
+            let fleet: Vec<u32> = (0..node_count.min(10_000))
+                .map(|_| new_id[rng.gen_range(0..node_count)])
+                .collect();
+            let mut dists = vec![0u32; fleet.len()];
+            query.pin_one_to_many_targets(&fleet);
+            group.bench_function(format!("{name}/one_to_many"), |b| {
+                b.iter(|| {
+                    let s = new_id[rng.gen_range(0..node_count)];
+                    query.one_to_many_no_alloc(s, &mut dists);
+                })
+            });
+        }
+        group.finish();
+    }
+}
+
+/// Topology memory and distance query time of the full index against [`CompressedCCH`]
+/// (rank-renumbered, so the compressed form also drops the rank map).
+fn bench_compressed(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/compressed"));
+        let Some(CityGraph {
+            node_count,
+            tail,
+            head,
+            weights,
+            order,
+            ..
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        let (cch, new_id) =
+            CCH::new_renumbered(&order, &tail, &head, |_| {}, false, NodeRenumbering::Rank);
+        let metric = CCHMetric::new(&cch, weights);
+        let compressed = CompressedCCH::new(&cch);
+        let compressed_metric = CompressedCCHMetric::new(&compressed, &metric);
+        let arc_count = tail.len() as f64;
+        eprintln!(
+            "{city}: topology {:.1} MB ({:.2} B/input arc) -> compressed {:.1} MB ({:.2} B/input arc)",
+            cch.memory_bytes() as f64 / 1e6,
+            cch.memory_bytes() as f64 / arc_count,
+            compressed.memory_bytes() as f64 / 1e6,
+            compressed.memory_bytes() as f64 / arc_count,
+        );
+
+        let mut query = CCHQuery::new(&metric);
+        let mut rng = StdRng::seed_from_u64(42);
+        group.bench_function("full", |b| {
+            b.iter(|| {
+                let s = new_id[rng.gen_range(0..node_count)];
+                let t = new_id[rng.gen_range(0..node_count)];
+                query.add_source(s, 0);
+                query.add_target(t, 0);
+                query.run().distance()
+            })
+        });
+        let mut compressed_query = CompressedCCHQuery::new(&compressed_metric);
+        let mut rng = StdRng::seed_from_u64(42);
+        group.bench_function("compressed", |b| {
+            b.iter(|| {
+                let s = new_id[rng.gen_range(0..node_count)];
+                let t = new_id[rng.gen_range(0..node_count)];
+                compressed_query.distance(s, t)
+            })
+        });
+        group.finish();
+    }
+}
+
+/// Per-metric memory and distance query time of 32-bit against 16/24-bit metrics.
+fn bench_quantized(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/quantized"));
+        let Some(CityGraph {
+            node_count,
+            tail,
+            head,
+            weights,
+            order,
+            ..
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        // Deciseconds-like resolution so that input weights fit 16 bits.
+        let weights: Vec<u32> = weights.iter().map(|&w| (w / 100).max(1)).collect();
+        let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+        let metric = CCHMetric::new(&cch, weights.clone());
+        let mut query = CCHQuery::new(&metric);
+        eprintln!(
+            "{city}: 32-bit metric {:.1} MB",
+            metric.memory_bytes() as f64 / 1e6
+        );
+        let mut rng = StdRng::seed_from_u64(42);
+        group.bench_function("bits32", |b| {
+            b.iter(|| {
+                query.add_source(rng.gen_range(0..node_count) as u32, 0);
+                query.add_target(rng.gen_range(0..node_count) as u32, 0);
+                query.run().distance()
+            })
+        });
+
+        for (name, width) in [
+            ("bits16", WeightWidth::Bits16),
+            ("bits24", WeightWidth::Bits24),
+        ] {
+            let quantized = QuantizedCCHMetric::new(&cch, &weights, width);
+            eprintln!(
+                "{city}: {name} metric {:.1} MB",
+                quantized.memory_bytes() as f64 / 1e6
+            );
+            let mut query = QuantizedCCHQuery::new(&quantized);
+            let mut rng = StdRng::seed_from_u64(42);
+            group.bench_function(name, |b| {
+                b.iter(|| {
+                    let s = rng.gen_range(0..node_count) as u32;
+                    let t = rng.gen_range(0..node_count) as u32;
+                    query.distance(s, t)
+                })
+            });
+        }
+        group.finish();
+    }
+}
+
+/// Time `iters` random point-to-point queries on `metric` from a thread pinned to NUMA `node`.
+fn timed_queries_on_node(metric: &CCHMetric, node: u32, node_count: usize, iters: u64) -> Duration {
+    std::thread::scope(|scope| {
+        scope
+            .spawn(|| {
+                pin_current_thread_to_numa_node(node);
+                let mut query = CCHQuery::new(metric);
+                let mut rng = StdRng::seed_from_u64(42);
+                let start = Instant::now();
+                for _ in 0..iters {
+                    query.add_source(rng.gen_range(0..node_count) as u32, 0);
+                    query.add_target(rng.gen_range(0..node_count) as u32, 0);
+                    std::hint::black_box(query.run().distance());
+                }
+                start.elapsed()
+            })
+            .join()
+            .unwrap()
+    })
+}
+
+fn bench_memory_placement(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/memory_placement"));
+        let Some(CityGraph {
+            node_count,
+            tail,
+            head,
+            weights,
+            order,
+            ..
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        // Separate hierarchies so that the huge page advice only applies to the second one.
+        for (name, transparent_huge_pages) in [("default_pages", false), ("huge_pages", true)] {
+            let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+            let metric = CCHMetric::new(&cch, weights.clone());
+            let replicas = CCHMetricReplicas::new(
+                &metric,
+                AllocationOptions {
+                    transparent_huge_pages,
+                    numa_replicas: false,
+                },
+            );
+            let mut query = replicas.query();
+            let mut rng = StdRng::seed_from_u64(42);
+            group.bench_function(name, |b| {
+                b.iter(|| {
+                    query.add_source(rng.gen_range(0..node_count) as u32, 0);
+                    query.add_target(rng.gen_range(0..node_count) as u32, 0);
+                    query.run().distance()
+                })
+            });
+        }
+
+        // The original metric lives on the node of the main thread; every other node reads it
+        // remotely unless it uses its replica.
+        let numa_nodes = numa_node_count();
+        if numa_nodes > 1 {
+            let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+            let metric = CCHMetric::new(&cch, weights.clone());
+            let replicas = CCHMetricReplicas::new(
+                &metric,
+                AllocationOptions {
+                    transparent_huge_pages: false,
+                    numa_replicas: true,
+                },
+            );
+            for node in 0..numa_nodes {
+                group.bench_function(format!("node{node}/shared"), |b| {
+                    b.iter_custom(|iters| timed_queries_on_node(&metric, node, node_count, iters))
+                });
+                group.bench_function(format!("node{node}/replica"), |b| {
+                    b.iter_custom(|iters| {
+                        timed_queries_on_node(replicas.for_node(node), node, node_count, iters)
+                    })
+                });
+            }
+        }
+        group.finish();
+    }
+}
+
+fn bench_query_arena(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/short_lived_queries"));
+        let Some(CityGraph {
+            node_count,
+            tail,
+            head,
+            weights,
+            order,
+            ..
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+        let metric = CCHMetric::new(&cch, weights);
+
+        // One query object per request, as a per-request handler would create it.
+        let mut rng = StdRng::seed_from_u64(42);
+        group.bench_function("new_query_per_request", |b| {
+            b.iter(|| {
+                let mut query = CCHQuery::new(&metric);
+                query.add_source(rng.gen_range(0..node_count) as u32, 0);
+                query.add_target(rng.gen_range(0..node_count) as u32, 0);
+                query.run().distance()
+            })
+        });
+
+        let arena = CCHQueryArena::new(&metric, 1);
+        let mut rng = StdRng::seed_from_u64(42);
+        group.bench_function("arena_query_per_request", |b| {
+            b.iter(|| {
+                let mut query = arena.query().unwrap();
+                query.run(
+                    rng.gen_range(0..node_count) as u32,
+                    rng.gen_range(0..node_count) as u32,
+                )
+            })
+        });
+        group.finish();
+    }
+}
+
+/// Back-to-back queries between the endpoints of a single arc, where resetting the previous
+/// query's labels is a large share of the work.
+fn bench_short_queries(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/back_to_back_short_queries"));
+        let Some(CityGraph {
+            tail,
+            head,
+            weights,
+            order,
+            ..
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        let mut rng = StdRng::seed_from_u64(42);
+        let pairs: Vec<(u32, u32)> = (0..1024)
+            .map(|_| {
+                let a = rng.gen_range(0..tail.len());
+                (tail[a], head[a])
+            })
+            .collect();
+        let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+        let mut metric = CCHMetric::new(&cch, weights.clone());
+        let ch = metric.build_contraction_hierarchy_using_perfect_witness_search();
+        let quantized = QuantizedCCHMetric::new(&cch, &weights, WeightWidth::Bits24);
+
+        let mut query = CCHQuery::new(&metric);
+        let mut i = 0;
+        group.bench_function("cch_query", |b| {
+            b.iter(|| {
+                let (s, t) = pairs[i % pairs.len()];
+                i += 1;
+                query.reset();
+                query.add_source(s, 0);
+                query.add_target(t, 0);
+                query.run().distance()
+            })
+        });
+
+        let mut query = CHQuery::new(&ch);
+        let mut i = 0;
+        group.bench_function("ch_query", |b| {
+            b.iter(|| {
+                let (s, t) = pairs[i % pairs.len()];
+                i += 1;
+                query.reset();
+                query.add_source(s, 0);
+                query.add_target(t, 0);
+                query.run().distance()
+            })
+        });
+
+        // Runs on the generation-stamped elimination tree search.
+        let mut query = QuantizedCCHQuery::new(&quantized);
+        let mut i = 0;
+        group.bench_function("quantized_cch_query", |b| {
+            b.iter(|| {
+                let (s, t) = pairs[i % pairs.len()];
+                i += 1;
+                query.distance(s, t)
+            })
+        });
+        group.finish();
+    }
+}
+
+/// Latency of traffic-style partial updates of 1k / 10k / 100k arcs, map vs. array API.
+fn bench_partial_updates(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/partial_updates"));
+        let Some(CityGraph {
+            tail,
+            head,
+            weights,
+            order,
+            ..
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+        let mut metric = CCHMetric::new(&cch, weights.clone());
+        let mut updater = CCHMetricPartialUpdater::new(&cch);
+        let mut rng = StdRng::seed_from_u64(42);
+
+        for count in [1_000, 10_000, 100_000] {
+            if count > tail.len() {
+                continue;
+            }
+            let arc_ids: Vec<u32> = (0..count)
+                .map(|_| rng.gen_range(0..tail.len()) as u32)
+                .collect();
+            // Alternate between two weight sets so that every iteration changes the arcs.
+            let slower: Vec<u32> = arc_ids.iter().map(|&a| weights[a as usize] * 2).collect();
+            let original: Vec<u32> = arc_ids.iter().map(|&a| weights[a as usize]).collect();
+            let maps: [HashMap<u32, u32>; 2] = [&slower, &original]
+                .map(|w| arc_ids.iter().copied().zip(w.iter().copied()).collect());
+
+            let mut i = 0;
+            group.bench_function(format!("map/{count}"), |b| {
+                b.iter(|| {
+                    updater.apply(&mut metric, &maps[i % 2]);
+                    i += 1;
+                })
+            });
+            let mut i = 0;
+            group.bench_function(format!("arrays/{count}"), |b| {
+                b.iter(|| {
+                    let w = if i % 2 == 0 { &slower } else { &original };
+                    updater.apply_arrays(&mut metric, &arc_ids, w);
+                    i += 1;
+                })
+            });
+            updater.apply_arrays(&mut metric, &arc_ids, &original);
+        }
+        group.finish();
+    }
+}
+
+/// Build time of the sequential and the parallel CH builder (with the `openmp` feature), and
+/// query speed on both results.
+fn bench_ch_build(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/ch_build"));
+        let Some(CityGraph {
+            node_count,
+            tail,
+            head,
+            weights,
+            ..
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        let start = Instant::now();
+        let sequential = CH::build(node_count as u32, &tail, &head, &weights, |_| {}, 500);
+        eprintln!("{city}: CH::build took {:?}", start.elapsed());
+        #[cfg(feature = "openmp")]
+        let builds = {
+            let start = Instant::now();
+            let parallel =
+                CH::build_parallel(node_count as u32, &tail, &head, &weights, |_| {}, 500, 0);
+            eprintln!("{city}: CH::build_parallel took {:?}", start.elapsed());
+            [("sequential", sequential), ("parallel", parallel)]
+        };
+        #[cfg(not(feature = "openmp"))]
+        let builds = [("sequential", sequential)];
+
+        for (name, ch) in &builds {
+            let mut query = CHQuery::new(ch);
+            let mut rng = StdRng::seed_from_u64(42);
+            group.bench_function(format!("{name}/query"), |b| {
+                b.iter(|| {
+                    query.reset();
+                    query.add_source(rng.gen_range(0..node_count) as u32, 0);
+                    query.add_target(rng.gen_range(0..node_count) as u32, 0);
+                    query.run().distance()
+                })
+            });
+        }
+        group.finish();
+    }
+}
+
+/// Perfect witness CH extraction from a customized metric, sequential vs. all threads (with the
+/// `openmp` feature).
+fn bench_perfect_ch(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/perfect_ch"));
+        group.sample_size(10);
+        let Some(CityGraph {
+            tail,
+            head,
+            weights,
+            order,
+            ..
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+        let mut metric = CCHMetric::new(&cch, weights);
+        group.bench_function("sequential", |b| {
+            b.iter(|| metric.build_contraction_hierarchy_using_perfect_witness_search())
+        });
+        #[cfg(feature = "openmp")]
+        group.bench_function("parallel", |b| {
+            b.iter(|| metric.build_contraction_hierarchy_using_perfect_witness_search_parallel(0))
+        });
+        group.finish();
+    }
+}
+
+/// Startup (heap load vs. mapping) and query speed of a CH file in both formats.
+fn bench_mapped_ch(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/mapped_ch"));
+        group.sample_size(10);
+        let Some(CityGraph {
+            node_count,
+            tail,
+            head,
+            weights,
+            order,
+            ..
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        let dir = std::env::temp_dir();
+        let heap_file = dir.join(format!("{city}.ch")).to_str().unwrap().to_owned();
+        let mapped_file = dir
+            .join(format!("{city}.rkch"))
+            .to_str()
+            .unwrap()
+            .to_owned();
+        let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+        let mut metric = CCHMetric::new(&cch, weights);
+        let ch = metric.build_contraction_hierarchy_using_perfect_witness_search();
+        ch.save_file(&heap_file);
+        ch.save_mapped_file(&mapped_file).unwrap();
+
+        group.bench_function("open/heap", |b| b.iter(|| CH::load_file(&heap_file)));
+        group.bench_function("open/mapped", |b| {
+            b.iter(|| unsafe { MappedCH::open_unchecked(&mapped_file) }.unwrap())
+        });
+        group.bench_function("open/mapped_validated", |b| {
+            b.iter(|| MappedCH::open(&mapped_file).unwrap())
+        });
+
+        let mapped = MappedCH::open(&mapped_file).unwrap();
+        let mut query = CHQuery::new(&ch);
+        let mut rng = StdRng::seed_from_u64(42);
+        group.bench_function("query/heap", |b| {
+            b.iter(|| {
+                query.reset();
+                query.add_source(rng.gen_range(0..node_count) as u32, 0);
+                query.add_target(rng.gen_range(0..node_count) as u32, 0);
+                query.run().distance()
+            })
+        });
+        let mut query = MappedCHQuery::new(&mapped);
+        let mut rng = StdRng::seed_from_u64(42);
+        group.bench_function("query/mapped", |b| {
+            b.iter(|| {
+                query.run(
+                    rng.gen_range(0..node_count) as u32,
+                    rng.gen_range(0..node_count) as u32,
+                )
+            })
+        });
+        group.finish();
+        let _ = std::fs::remove_file(&heap_file);
+        let _ = std::fs::remove_file(&mapped_file);
+    }
+}
+
+/// Matrices and one-to-all distances on a perfect CH (buckets / PHAST) against the CCH
+/// (pinned one-to-many / pinned-target sweep), to pick the engine per workload.
+fn bench_ch_batch(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/ch_batch"));
+        group.sample_size(10);
+        let Some(CityGraph {
+            node_count,
+            tail,
+            head,
+            weights,
+            order,
+            ..
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+        let mut metric = CCHMetric::new(&cch, weights);
+        let ch = metric.build_contraction_hierarchy_using_perfect_witness_search();
+        let mut cch_query = CCHQuery::new(&metric);
+        let mut batch = CHBatchQuery::new(&ch);
+        let mut rng = StdRng::seed_from_u64(42);
+
+        for size in [10usize, 100, 1_000] {
+            let sources: Vec<u32> = (0..size)
+                .map(|_| rng.gen_range(0..node_count) as u32)
+                .collect();
+            let targets: Vec<u32> = (0..size)
+                .map(|_| rng.gen_range(0..node_count) as u32)
+                .collect();
+            let mut dists = vec![0; size * size];
+            group.throughput(Throughput::Elements((size * size) as u64));
+            group.bench_function(format!("matrix/ch_buckets/{size}"), |b| {
+                b.iter(|| batch.matrix_no_alloc(&sources, &targets, &mut dists))
+            });
+            group.bench_function(format!("matrix/cch_pinned/{size}"), |b| {
+                b.iter(|| {
+                    cch_query.pin_one_to_many_targets(&targets);
+                    for (&s, row) in sources.iter().zip(dists.chunks_mut(size)) {
+                        cch_query.one_to_many_no_alloc(s, row);
+                    }
+                })
+            });
+        }
+
+        let all: Vec<u32> = (0..node_count as u32).collect();
+        let mut dists = vec![0; node_count];
+        group.throughput(Throughput::Elements(node_count as u64));
+        group.bench_function("one_to_all/ch_phast", |b| {
+            b.iter(|| batch.one_to_all_no_alloc(rng.gen_range(0..node_count) as u32, &mut dists))
+        });
+        cch_query.pin_targets(&all);
+        group.bench_function("one_to_all/cch_pinned_targets", |b| {
+            b.iter(|| {
+                cch_query.reset_source();
+                cch_query.add_source(rng.gen_range(0..node_count) as u32, 0);
+                cch_query
+                    .run_to_pinned_targets()
+                    .get_distances_to_targets_no_alloc(&mut dists)
+            })
+        });
+        group.finish();
+    }
+}
+
+/// Hub labels from a perfect CH: build time per thread count, label size, and query latency
+/// against the CH they were built from.
+fn bench_hub_labels(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/hub_labels"));
+        group.sample_size(10);
+        let Some(CityGraph {
+            node_count,
+            tail,
+            head,
+            weights,
+            order,
+            ..
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+        let mut metric = CCHMetric::new(&cch, weights);
+        let ch = metric.build_contraction_hierarchy_using_perfect_witness_search();
+
+        group.bench_function("build/1_thread", |b| b.iter(|| HubLabels::build(&ch, 1)));
+        group.bench_function("build/all_threads", |b| b.iter(|| HubLabels::build(&ch, 0)));
+        let labels = HubLabels::build(&ch, 0);
+        eprintln!(
+            "{city}: {} label entries ({:.1} per node and side), {:.1} MB",
+            labels.entry_count(),
+            labels.entry_count() as f64 / (2 * node_count) as f64,
+            labels.memory_bytes() as f64 / 1e6,
+        );
+
+        let mut rng = StdRng::seed_from_u64(42);
+        let pairs: Vec<(u32, u32)> = (0..10_000)
+            .map(|_| {
+                (
+                    rng.gen_range(0..node_count) as u32,
+                    rng.gen_range(0..node_count) as u32,
+                )
+            })
+            .collect();
+        group.throughput(Throughput::Elements(pairs.len() as u64));
+        group.bench_function("query/hub_labels", |b| {
+            b.iter(|| {
+                for &(s, t) in &pairs {
+                    std::hint::black_box(labels.distance(s, t));
+                }
+            })
+        });
+        let mut query = CHQuery::new(&ch);
+        group.bench_function("query/ch", |b| {
+            b.iter(|| {
+                for &(s, t) in &pairs {
+                    query.reset();
+                    query.add_source(s, 0);
+                    query.add_target(t, 0);
+                    std::hint::black_box(query.run().distance());
+                }
+            })
+        });
+        group.finish();
+    }
+}
+
+/// Index construction and batch snapping of random points in the bounding box of the city.
+fn bench_spatial_index(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/spatial_index"));
+        group.sample_size(10);
+        let Some(CityGraph {
+            tail,
+            head,
+            lat,
+            lon,
+            ..
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        group.bench_function("build", |b| {
+            b.iter(|| SpatialIndex::new(&lat, &lon, &tail, &head))
+        });
+        let index = SpatialIndex::new(&lat, &lon, &tail, &head);
+
+        let mut rng = StdRng::seed_from_u64(42);
+        let (min_lat, max_lat) = lat
+            .iter()
+            .fold((f32::MAX, f32::MIN), |(a, b), &x| (a.min(x), b.max(x)));
+        let (min_lon, max_lon) = lon
+            .iter()
+            .fold((f32::MAX, f32::MIN), |(a, b), &x| (a.min(x), b.max(x)));
+        let points = 100_000;
+        let lats: Vec<f32> = (0..points)
+            .map(|_| rng.gen_range(min_lat..=max_lat))
+            .collect();
+        let lons: Vec<f32> = (0..points)
+            .map(|_| rng.gen_range(min_lon..=max_lon))
+            .collect();
+        group.throughput(Throughput::Elements(points as u64));
+        for threads in [1, 0] {
+            let name = if threads == 1 {
+                "1_thread"
+            } else {
+                "all_threads"
+            };
+            group.bench_function(format!("nearest_nodes_k4/{name}"), |b| {
+                b.iter(|| index.nearest_nodes_batch(&lats, &lons, 4, f32::INFINITY, threads))
+            });
+            group.bench_function(format!("nearest_arc/{name}"), |b| {
+                b.iter(|| index.nearest_arcs_batch(&lats, &lons, f32::INFINITY, threads))
+            });
+        }
+        group.finish();
+    }
+}
+
+/// Tours through random stops: one `run_via` call against a query and two path extractions
+/// per leg.
+fn bench_run_via(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/run_via"));
+        group.sample_size(10);
+        let Some(CityGraph {
+            node_count,
+            tail,
+            head,
+            weights,
+            order,
+            ..
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+        let metric = CCHMetric::new(&cch, weights);
+        let mut query = CCHQuery::new(&metric);
+        let mut rng = StdRng::seed_from_u64(42);
+
+        for stops in [20usize, 100] {
+            let points: Vec<u32> = (0..stops)
+                .map(|_| rng.gen_range(0..node_count) as u32)
+                .collect();
+            group.throughput(Throughput::Elements(stops as u64 - 1));
+            group.bench_function(format!("run_via/{stops}"), |b| {
+                b.iter(|| query.run_via(&points))
+            });
+            group.bench_function(format!("per_leg/{stops}"), |b| {
+                b.iter(|| {
+                    let mut nodes = vec![points[0]];
+                    let mut arcs = vec![];
+                    for leg in points.windows(2) {
+                        query.reset();
+                        query.add_source(leg[0], 0);
+                        query.add_target(leg[1], 0);
+                        let result = query.run();
+                        nodes.extend(result.node_path().into_iter().skip(1));
+                        arcs.extend(result.arc_path());
+                    }
+                    (nodes, arcs)
+                })
+            });
+        }
+        group.finish();
+    }
+}
+
+/// Map matching of synthetic GPS traces: a noisy point on every second arc of a random route,
+/// five candidate arcs within 50 m per point. Reported per trace on one thread.
+fn bench_map_matching(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/map_matching"));
+        group.sample_size(10);
+        let Some(CityGraph {
+            node_count,
+            tail,
+            head,
+            weights,
+            order,
+            lat,
+            lon,
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+        let metric = CCHMetric::new(&cch, weights.clone());
+        let index = SpatialIndex::new(&lat, &lon, &tail, &head);
+        let mut query = CCHQuery::new(&metric);
+        let mut rng = StdRng::seed_from_u64(42);
+
+        // Convert weights to meters with the average weight per meter of the arcs.
+        let great_circle = |a: usize, b: usize| {
+            let (lat1, lon1) = ((lat[a] as f64).to_radians(), (lon[a] as f64).to_radians());
+            let (lat2, lon2) = ((lat[b] as f64).to_radians(), (lon[b] as f64).to_radians());
+            let h = ((lat2 - lat1) / 2.0).sin().powi(2)
+                + lat1.cos() * lat2.cos() * ((lon2 - lon1) / 2.0).sin().powi(2);
+            2.0 * 6_371_000.0 * h.sqrt().min(1.0).asin()
+        };
+        let meters: f64 = (0..tail.len())
+            .map(|a| great_circle(tail[a] as usize, head[a] as usize))
+            .sum();
+        let config = MapMatchConfig {
+            weight_per_meter: weights.iter().map(|&w| w as f64).sum::<f64>() / meters.max(1.0),
+            ..MapMatchConfig::default()
+        };
+
+        let mut traces = vec![];
+        while traces.len() < 100 {
+            let (s, t) = (
+                rng.gen_range(0..node_count) as u32,
+                rng.gen_range(0..node_count) as u32,
+            );
+            let route = query.run_via(&[s, t]);
+            let (mut lats, mut lons) = (vec![], vec![]);
+            for &a in route.arcs.iter().step_by(2).take(200) {
+                let (t, h) = (tail[a as usize] as usize, head[a as usize] as usize);
+                lats.push((lat[t] + lat[h]) / 2.0 + rng.gen_range(-0.0001..0.0001));
+                lons.push((lon[t] + lon[h]) / 2.0 + rng.gen_range(-0.0001..0.0001));
+            }
+            if lats.len() < 2 {
+                continue;
+            }
+            let candidates: Vec<_> = lats
+                .iter()
+                .zip(&lons)
+                .map(|(&la, &lo)| index.nearest_arcs(la, lo, 5, 50.0))
+                .collect();
+            traces.push((lats, lons, candidates));
+        }
+        let points: usize = traces.iter().map(|(lats, _, _)| lats.len()).sum();
+        eprintln!("{} traces, {} points", traces.len(), points);
+
+        let mut matcher = CCHMapMatcher::new(&metric);
+        group.throughput(Throughput::Elements(traces.len() as u64));
+        group.bench_function("match_trace/1_thread", |b| {
+            b.iter(|| {
+                traces
+                    .iter()
+                    .map(|(lats, lons, candidates)| {
+                        matcher.match_trace(lats, lons, candidates, &config)
+                    })
+                    .collect::<Vec<_>>()
+            })
+        });
+        group.finish();
+    }
+}
+
+/// Repeated OD pairs: 80% of the queries hit 1000 hot pairs, the rest are random. Plain
+/// queries against the same stream through a `CCHQueryCache`.
+fn bench_query_cache(c: &mut Criterion) {
+    for city in CITIES {
+        let mut group = c.benchmark_group(format!("{city}/query_cache"));
+        group.sample_size(10);
+        let Some(CityGraph {
+            node_count,
+            tail,
+            head,
+            weights,
+            order,
+            ..
+        }) = load_city(city)
+        else {
+            continue;
+        };
+        let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+        let metric = CCHMetric::new(&cch, weights);
+        let mut query = CCHQuery::new(&metric);
+        let mut rng = StdRng::seed_from_u64(42);
+        let mut random_pair = || {
+            (
+                rng.gen_range(0..node_count) as u32,
+                rng.gen_range(0..node_count) as u32,
+            )
+        };
+        let hot: Vec<(u32, u32)> = (0..1_000).map(|_| random_pair()).collect();
+        let pairs: Vec<(u32, u32)> = (0..10_000)
+            .map(|i| {
+                if i % 5 == 0 {
+                    random_pair()
+                } else {
+                    hot[i * 7919 % hot.len()]
+                }
+            })
+            .collect();
+        group.throughput(Throughput::Elements(pairs.len() as u64));
+        group.bench_function("uncached", |b| {
+            b.iter(|| {
+                pairs
+                    .iter()
+                    .map(|&(s, t)| {
+                        query.add_source(s, 0);
+                        query.add_target(t, 0);
+                        query.run().distance()
+                    })
+                    .collect::<Vec<_>>()
+            })
+        });
+        let cache = CCHQueryCache::new(4_096, 0);
+        group.bench_function("distance", |b| {
+            b.iter(|| {
+                pairs
+                    .iter()
+                    .map(|&(s, t)| cache.distance(&mut query, s, t))
+                    .collect::<Vec<_>>()
+            })
+        });
+        eprintln!("distance hit rate: {:.3}", cache.stats().hit_rate());
+        let cache = CCHQueryCache::new(4_096, 0);
+        group.bench_function("route", |b| {
+            b.iter(|| {
+                pairs
+                    .iter()
+                    .map(|&(s, t)| cache.route(&mut query, s, t))
+                    .collect::<Vec<_>>()
+            })
+        });
+        eprintln!("route hit rate: {:.3}", cache.stats().hit_rate());
+        group.finish();
+    }
+}
+
+criterion_group!(
+    benches,
+    bench_pathfinding,
+    bench_many_to_one,
+    bench_pinned_target_updates,
+    bench_renumbering,
+    bench_compressed,
+    bench_quantized,
+    bench_memory_placement,
+    bench_query_arena,
+    bench_short_queries,
+    bench_partial_updates,
+    bench_ch_build,
+    bench_perfect_ch,
+    bench_mapped_ch,
+    bench_ch_batch,
+    bench_hub_labels,
+    bench_spatial_index,
+    bench_run_via,
+    bench_map_matching,
+    bench_query_cache
+);
 criterion_main!(benches);
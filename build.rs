@@ -98,6 +98,39 @@ const RK_ALLOW: &[&str] = &[
     "inverted_down_graph.cpp",
 ];
 
+// =============================
+// Wrapper sources
+// =============================
+const WRAPPER_HEADERS: &[&str] = &[
+    "src/routingkit_cch_wrapper.h",
+    "src/cch_search.h",
+    "src/omp_threads.h",
+    "src/mapped_file.h",
+];
+
+const WRAPPER_SOURCES: &[&str] = &[
+    "src/routingkit_cch_wrapper.cc",
+    "src/cch_search.cc",
+    "src/cch_alternatives.cc",
+    "src/cch_range.cc",
+    "src/cch_poi.cc",
+    "src/cch_many_to_one.cc",
+    "src/cch_compressed.cc",
+    "src/cch_quantized.cc",
+    "src/cch_numa.cc",
+    "src/cch_arena.cc",
+    "src/ch_parallel.cc",
+    "src/cch_perfect_ch.cc",
+    "src/mapped_file.cc",
+    "src/ch_mapped.cc",
+    "src/ch_batch.cc",
+    "src/ch_hub_labels.cc",
+    "src/spatial_index.cc",
+    "src/query_on_arc.cc",
+    "src/cch_via.cc",
+    "src/cch_map_matching.cc",
+];
+
 /// Collect list of source files (patched versions if needed) to compile.
 fn collect_routingkit_files(src_dir: &Path) -> Vec<PathBuf> {
     let mut out = Vec::new();
@@ -141,7 +174,9 @@ fn main() {
     for f in collect_routingkit_files(&src_dir) {
         build.file(f);
     }
-    build.file("src/routingkit_cch_wrapper.cc");
+    for f in WRAPPER_SOURCES {
+        build.file(f);
+    }
 
     if cfg!(target_env = "msvc") {
         build.define("ROUTING_KIT_NO_GCC_EXTENSIONS", None);
@@ -210,11 +245,11 @@ fn main() {
     for item in ["ROUTINGKIT_DIR"] {
         println!("cargo:rerun-if-env-changed={item}");
     }
-    for file in [
-        "src/lib.rs",
-        "src/routingkit_cch_wrapper.h",
-        "src/routingkit_cch_wrapper.cc",
-    ] {
+    for file in ["src/lib.rs"]
+        .iter()
+        .chain(WRAPPER_HEADERS)
+        .chain(WRAPPER_SOURCES)
+    {
         println!("cargo:rerun-if-changed={file}");
     }
     println!("cargo:rerun-if-changed={}", include_dir.display());
@@ -1,6 +1,7 @@
 from dataclasses import dataclass
 import routingkit_cch as rk
 import geopandas as gpd
+import numpy as np
 from tqdm import tqdm
 import more_itertools
 from concurrent.futures import ThreadPoolExecutor
@@ -112,9 +113,65 @@ def parallel(path: str = "data/beijing_data", max_workers: int = 2):
     return time.time() - start
 
 
+def batch(path: str = "data/beijing_data", threads: int = 0):
+    data = read_data(path)
+    tail = np.asarray(data.tail, dtype=np.uint32)
+    head = np.asarray(data.head, dtype=np.uint32)
+    order = rk.compute_order_inertial(
+        len(data.x),
+        tail,
+        head,
+        np.asarray(data.x, dtype=np.float32),
+        np.asarray(data.y, dtype=np.float32),
+    )
+
+    cch = rk.CCH(order, tail, head, False)
+    metric = rk.CCHMetric(cch, np.asarray(data.weights, dtype=np.uint32))
+    sources = np.array([data.tail[trip[0]] for trip in data.trips], dtype=np.uint32)
+    targets = np.array([data.head[trip[-1]] for trip in data.trips], dtype=np.uint32)
+
+    start = time.time()
+    distances, offsets, paths = map(
+        np.asarray, metric.batch_paths(sources, targets, threads)
+    )
+    elapsed = time.time() - start
+    assert np.array_equal(distances, metric.batch_distances(sources, targets, threads))
+    for i, trip in enumerate(data.trips):
+        node_path = paths[offsets[i] : offsets[i + 1]]
+        assert node_path[0] == sources[i] and node_path[-1] == targets[i]
+        assert sum(data.weights[a] for a in trip) >= distances[i]
+    return elapsed
+
+
+def pooled(path: str = "data/beijing_data", threads: int = 0):
+    data = read_data(path)
+    order = rk.compute_order_inertial(
+        len(data.x),
+        data.tail,
+        data.head,
+        data.x,
+        data.y,
+    )
+
+    cch = rk.CCH(order, data.tail, data.head, False)
+    metric = rk.CCHMetric(cch, data.weights)
+    pool = rk.CCHQueryPool(metric, threads)
+
+    start = time.time()
+    pairs = ((data.tail[trip[0]], data.head[trip[-1]]) for trip in data.trips)
+    trips = iter(data.trips)
+    for distances in pool.map(pairs, chunk_size=4096):
+        for distance, trip in zip(distances, trips):
+            assert sum(data.weights[i] for i in trip) >= distance
+    pool.close()
+    return time.time() - start
+
+
 if __name__ == "__main__":
     for city in os.listdir("data"):
         print(f"Processing city: {city}")
         path = os.path.join("data", city)
         print(f"Sequential took {sequential(path)} seconds")
         print(f"Parallel took {parallel(path)} seconds")
+        print(f"Batch took {batch(path)} seconds")
+        print(f"Pooled took {pooled(path)} seconds")
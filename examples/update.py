@@ -30,7 +30,7 @@ def main():
     start = time.time()
     _ = [future.result() for future in futures]
     assert time.time() - start < 11.0
-    assert metric.weights == [40090, 39965, 39967]
+    assert metric.weights.tolist() == [40090, 39965, 39967]
 
 
 if __name__ == "__main__":
@@ -1,9 +1,17 @@
+from collections.abc import Buffer, Iterable, Sequence
+from typing import Union
+
+# Any 1-d sequence of ints. C-contiguous buffers of the exact dtype (numpy uint32 / float32
+# arrays, array.array('I') / ('f')) are borrowed without copying; anything else is converted.
+U32Array = Union[Buffer, Sequence[int]]
+F32Array = Union[Buffer, Sequence[float]]
+
 class CCH:
     def __init__(
         self,
-        order: list[int],
-        tail: list[int],
-        head: list[int],
+        order: U32Array,
+        tail: U32Array,
+        head: U32Array,
         filter_always_inf_arcs: bool,
     ) -> None: ...
 
@@ -11,13 +19,34 @@ class CCHMetric:
     def __init__(
         self,
         cch: CCH,
-        weights: list[int],
+        weights: U32Array,
     ) -> None:
-        self.weights: list[int]
+        self.weights: memoryview
+        """read-only uint32 view (no copy; `numpy.asarray` wraps it), reflects partial updates."""
+    def batch_distances(
+        self, sources: U32Array, targets: U32Array, threads: int = 0
+    ) -> memoryview:
+        """uint32 distances of the pairs (sources[i], targets[i]); 2**31 - 1 if unreachable.
+
+        Runs on `threads` native threads (0 = all cores) without holding the GIL."""
+    def batch_paths(
+        self,
+        sources: U32Array,
+        targets: U32Array,
+        threads: int = 0,
+        arcs: bool = False,
+    ) -> tuple[memoryview, memoryview, memoryview]:
+        """(distances, offsets, paths): path i is paths[offsets[i]:offsets[i + 1]].
+
+        Paths are node ids, or input arc ids if `arcs`; offsets are uint64."""
 
 class CCHMetricPartialUpdater:
     def __init__(self, cch: CCH) -> None: ...
     def apply(self, metric: CCHMetric, updates: dict[int, int]) -> None: ...
+    def apply_arrays(
+        self, metric: CCHMetric, arc_ids: U32Array, weights: U32Array
+    ) -> None:
+        """weights[i] becomes the weight of arc arc_ids[i]; one native call without the GIL."""
 
 class CCHQueryResult:
     distance: int | None
@@ -32,13 +61,98 @@ class CCHQuery:
     ) -> CCHQueryResult:
         """run query with multiple sources and targets and distances."""
 
+class CCHArenaQuery:
+    """One slot of a CCHQueryArena; the slot is freed when the query is garbage collected."""
+
+    node_path: list[int]
+    arc_path: list[int]
+    def run(self, source: int, target: int) -> int | None:
+        """Distance, None if unreachable; node_path / arc_path hold its path until the next run."""
+
+class CCHQueryArena:
+    """Preallocated labels for up to `capacity` live queries, so a query per request does not
+    allocate. Partial updates of the metric are rejected while the arena is alive."""
+
+    available: int
+    memory_bytes: int
+    def __init__(self, metric: CCHMetric, capacity: int) -> None: ...
+    def query(self) -> CCHArenaQuery | None:
+        """Claim a slot; None while `capacity` queries are alive."""
+
+class CCHQueryPoolIter:
+    def __iter__(self) -> CCHQueryPoolIter: ...
+    def __next__(self) -> memoryview | tuple[memoryview, memoryview, memoryview]: ...
+
+class CCHQueryPool:
+    """Native worker threads, each owning one query on `metric` (threads=0: all cores).
+
+    Partial updates of the metric are rejected until the pool is closed."""
+
+    threads: int
+    def __init__(self, metric: CCHMetric, threads: int = 0) -> None: ...
+    def map(
+        self,
+        pairs: Iterable[tuple[int, int]] | Buffer | U32Array,
+        targets: U32Array | None = None,
+        chunk_size: int = 65536,
+        paths: bool = False,
+        arcs: bool = False,
+    ) -> CCHQueryPoolIter:
+        """Stream results for OD pairs in chunks of `chunk_size`.
+
+        `pairs` is an iterable of (source, target), an (n, 2) uint32 array, or the sources
+        array when `targets` is given. Yields uint32 distances (2**31 - 1 if unreachable), or
+        (distances, offsets, paths) if `paths` (input arc ids if `arcs`). The next chunk is
+        computed while the current one is consumed. Raises RuntimeError for a chunk whose
+        queries panicked; the pool stays usable."""
+    def close(self) -> None: ...
+
+class SpatialIndex:
+    """Grid snapping index over node coordinates and straight arc segments. Distances are
+    meters; batch queries release the GIL. `threads` (0: all cores) needs a build with the
+    `openmp` feature; otherwise they run on one thread."""
+
+    def __init__(
+        self, latitude: F32Array, longitude: F32Array, tail: U32Array, head: U32Array
+    ) -> None: ...
+    def nearest_nodes(
+        self,
+        latitude: F32Array,
+        longitude: F32Array,
+        k: int = 1,
+        max_distance: float = ...,
+        threads: int = 0,
+    ) -> list[list[tuple[int, float]]]:
+        """Up to k (node, distance) per point, nearest first."""
+    def nearest_arcs(
+        self,
+        latitude: F32Array,
+        longitude: F32Array,
+        max_distance: float = ...,
+        threads: int = 0,
+    ) -> list[tuple[int, int, int, float, float] | None]:
+        """(arc, tail, head, fraction, distance) per point; fraction 0 is the tail. A source
+        at the point is (head, (1 - fraction) * weight), a target (tail, fraction * weight)."""
+
 def compute_order_degree(
-    node_count: int, tail: list[int], head: list[int]
+    node_count: int, tail: U32Array, head: U32Array
 ) -> list[int]: ...
+def compute_order_degree_array(
+    node_count: int, tail: U32Array, head: U32Array
+) -> memoryview:
+    """compute_order_degree as a read-only uint32 view (`numpy.asarray` wraps it)."""
 def compute_order_inertial(
     node_count: int,
-    tail: list[int],
-    head: list[int],
-    latitude: list[float],
-    longitude: list[float],
+    tail: U32Array,
+    head: U32Array,
+    latitude: F32Array,
+    longitude: F32Array,
 ) -> list[int]: ...
+def compute_order_inertial_array(
+    node_count: int,
+    tail: U32Array,
+    head: U32Array,
+    latitude: F32Array,
+    longitude: F32Array,
+) -> memoryview:
+    """compute_order_inertial as a read-only uint32 view (`numpy.asarray` wraps it)."""
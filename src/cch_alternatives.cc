@@ -0,0 +1,179 @@
+#include "routingkit_cch_wrapper.h"
+#include "cch_search.h"
+
+#include <routingkit/constants.h>
+#include <algorithm>
+
+using namespace RoutingKit;
+
+// Via-node alternatives (Abraham et al., "Alternative Routes in Road Networks") on the
+// elimination tree search spaces. Every node v settled by both the forward search from s and
+// the backward search from t defines the up-down path s -> v -> t. Candidates are tried by
+// increasing length and accepted if they
+//  * are at most (1 + max_stretch) times longer than the shortest path,
+//  * share at most max_sharing * d(s, t) with the routes accepted so far,
+//  * pass the T-test: the subpath covering local_optimality * d(s, t) on both sides of v is
+//    a shortest path (one extra point-to-point query per tested candidate).
+
+namespace
+{
+    struct ViaCandidate
+    {
+        unsigned length;
+        unsigned rank;
+    };
+
+    unsigned arc_path_length(const unsigned *input_weight, const std::vector<unsigned> &arcs)
+    {
+        unsigned len = 0;
+        for (unsigned a : arcs)
+            len += input_weight[a];
+        return len;
+    }
+
+    bool has_repeated_node(const CCHInputArcs &input, const std::vector<unsigned> &arcs, std::vector<unsigned> &scratch)
+    {
+        scratch.clear();
+        scratch.push_back(input.tail(arcs.front()));
+        for (unsigned a : arcs)
+            scratch.push_back(input.head(a));
+        std::sort(scratch.begin(), scratch.end());
+        return std::adjacent_find(scratch.begin(), scratch.end()) != scratch.end();
+    }
+}
+
+void cch_query_run_alternatives(CCHQuery &query,
+                                uint32_t s,
+                                uint32_t t,
+                                uint32_t max_route_count,
+                                double max_stretch,
+                                double max_sharing,
+                                double local_optimality,
+                                rust::Vec<uint32_t> &distances,
+                                rust::Vec<uint32_t> &arc_first,
+                                rust::Vec<uint32_t> &arcs,
+                                rust::Vec<uint32_t> &nodes)
+{
+    distances.clear();
+    arc_first.clear();
+    arcs.clear();
+    nodes.clear();
+    arc_first.push_back(0);
+    if (max_route_count == 0)
+        return;
+
+    const CustomizableContractionHierarchyMetric &metric = query.metric->inner;
+    const CustomizableContractionHierarchy &cch = *metric.cch;
+    const CCHInputArcs &input = query.metric->cch->input_arcs;
+
+    auto emit = [&](unsigned len, const std::vector<unsigned> &path, unsigned first_node)
+    {
+        distances.push_back(len);
+        nodes.push_back(first_node);
+        for (unsigned a : path)
+        {
+            arcs.push_back(a);
+            nodes.push_back(input.head(a));
+        }
+        arc_first.push_back(arcs.size());
+    };
+
+    if (s == t)
+    {
+        emit(0, {}, s);
+        return;
+    }
+
+    unsigned meeting;
+    const unsigned shortest = cch_point_to_point(metric, query.forward, query.backward, cch.rank[s], cch.rank[t], meeting);
+    if (shortest >= inf_weight)
+        return;
+
+    std::vector<unsigned> shortest_path;
+    cch_unpack_path(metric, input, query.forward, query.backward, meeting, shortest_path);
+    emit(shortest, shortest_path, s);
+    if (max_route_count == 1)
+        return;
+
+    const double max_length = (1.0 + max_stretch) * shortest;
+    const double max_shared = max_sharing * shortest;
+    const double window = local_optimality * shortest;
+
+    std::vector<ViaCandidate> candidates;
+    for (unsigned x : query.forward.search_space())
+    {
+        if (x == meeting)
+            continue;
+        unsigned len = query.forward.distance(x) + query.backward.distance(x);
+        if (len < inf_weight && len <= max_length)
+            candidates.push_back({len, x});
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const ViaCandidate &l, const ViaCandidate &r)
+              { return l.length < r.length; });
+
+    // Input arcs on accepted routes, kept sorted for the sharing test.
+    std::vector<unsigned> accepted_arcs = shortest_path;
+    std::sort(accepted_arcs.begin(), accepted_arcs.end());
+
+    // Each T-test costs about one plain query; bound them to keep the call near 2-3 queries.
+    unsigned tests_left = 2 * (max_route_count - 1);
+    std::vector<unsigned> path, up_arcs, prefix, node_scratch;
+    for (const ViaCandidate &c : candidates)
+    {
+        if (distances.size() == max_route_count || tests_left == 0)
+            break;
+
+        path.clear();
+        up_arcs.clear();
+        for (unsigned x = c.rank; query.forward.predecessor_arc(x) != invalid_id;)
+        {
+            unsigned a = query.forward.predecessor_arc(x);
+            up_arcs.push_back(a);
+            x = cch.up_tail[a];
+        }
+        for (auto i = up_arcs.rbegin(); i != up_arcs.rend(); ++i)
+            cch_unpack_arc(metric, input, *i, true, path);
+        const size_t via_pos = path.size();
+        for (unsigned x = c.rank; query.backward.predecessor_arc(x) != invalid_id;)
+        {
+            unsigned a = query.backward.predecessor_arc(x);
+            cch_unpack_arc(metric, input, a, false, path);
+            x = cch.up_tail[a];
+        }
+        if (path.empty() || has_repeated_node(input, path, node_scratch))
+            continue;
+
+        unsigned shared = 0;
+        for (unsigned a : path)
+            if (std::binary_search(accepted_arcs.begin(), accepted_arcs.end(), a))
+                shared += metric.input_weight[a];
+        if (shared > max_shared)
+            continue;
+
+        // T-test around the via node.
+        prefix.assign(1, 0);
+        for (unsigned a : path)
+            prefix.push_back(prefix.back() + metric.input_weight[a]);
+        size_t from = via_pos;
+        while (from > 0 && prefix[via_pos] - prefix[from] < window)
+            --from;
+        size_t to = via_pos;
+        while (to < path.size() && prefix[to] - prefix[via_pos] < window)
+            ++to;
+        if (from < to)
+        {
+            unsigned from_node = from == 0 ? s : input.head(path[from - 1]);
+            unsigned to_node = input.head(path[to - 1]);
+            unsigned ignored;
+            --tests_left;
+            unsigned d = cch_point_to_point(metric, query.witness_forward, query.witness_backward,
+                                            cch.rank[from_node], cch.rank[to_node], ignored);
+            if (d != prefix[to] - prefix[from])
+                continue;
+        }
+
+        emit(arc_path_length(metric.input_weight, path), path, s);
+        accepted_arcs.insert(accepted_arcs.end(), path.begin(), path.end());
+        std::sort(accepted_arcs.begin(), accepted_arcs.end());
+    }
+}
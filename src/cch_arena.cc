@@ -0,0 +1,200 @@
+#include "routingkit_cch_wrapper.h"
+#include "cch_search.h"
+
+#include <routingkit/constants.h>
+#include <algorithm>
+
+using namespace RoutingKit;
+
+// Arena-backed point-to-point queries. The search space of a single source is the ancestor
+// path of its rank in the elimination tree, so both searches walk their paths upward (the
+// lower one first) until they join and relax the common part together, like the compressed
+// query. Only labels on the two paths are written, and only those are reset.
+
+namespace
+{
+    void relax(const CustomizableContractionHierarchy &cch,
+               const std::vector<unsigned> &weight,
+               CCHQueryArena::Label *label,
+               unsigned CCHQueryArena::Label::*dist,
+               unsigned CCHQueryArena::Label::*pred_arc,
+               unsigned x,
+               unsigned best)
+    {
+        unsigned d = label[x].*dist;
+        if (d >= best)
+            return;
+        for (unsigned a = cch.up_first_out[x]; a < cch.up_first_out[x + 1]; ++a)
+        {
+            unsigned y = cch.up_head[a];
+            unsigned nd = d + weight[a];
+            if (nd < label[y].*dist)
+            {
+                label[y].*dist = nd;
+                label[y].*pred_arc = a;
+            }
+        }
+    }
+
+    void reset_path(const CustomizableContractionHierarchy &cch, CCHQueryArena::Label *label, unsigned x)
+    {
+        for (; x != invalid_id; x = cch.elimination_tree_parent[x])
+            label[x] = {inf_weight, inf_weight, invalid_id, invalid_id};
+    }
+
+    void reset_labels(CCHArenaQuery &query)
+    {
+        if (query.source == invalid_id)
+            return;
+        const CustomizableContractionHierarchy &cch = *query.arena->metric->inner.cch;
+        reset_path(cch, query.label, query.source);
+        reset_path(cch, query.label, query.target);
+        query.source = query.target = query.meeting = invalid_id;
+        query.distance = inf_weight;
+    }
+
+    void unpack_arcs(const CCHArenaQuery &query, std::vector<unsigned> &out)
+    {
+        const CustomizableContractionHierarchyMetric &metric = query.arena->metric->inner;
+        const CCHInputArcs &input = query.arena->metric->cch->input_arcs;
+        const CustomizableContractionHierarchy &cch = *metric.cch;
+
+        std::vector<unsigned> up;
+        for (unsigned x = query.meeting; query.label[x].forward_arc != invalid_id;)
+        {
+            unsigned a = query.label[x].forward_arc;
+            up.push_back(a);
+            x = cch.up_tail[a];
+        }
+        for (auto i = up.rbegin(); i != up.rend(); ++i)
+            cch_unpack_arc(metric, input, *i, true, out);
+        for (unsigned x = query.meeting; query.label[x].backward_arc != invalid_id;)
+        {
+            unsigned a = query.label[x].backward_arc;
+            cch_unpack_arc(metric, input, a, false, out);
+            x = cch.up_tail[a];
+        }
+    }
+}
+
+CCHQueryArena::CCHQueryArena(const CCHMetric &metric, unsigned capacity)
+    : metric(&metric), node_count(metric.inner.cch->node_count()), capacity(capacity),
+      slab(new Label[static_cast<size_t>(capacity) * node_count])
+{
+    std::fill(slab.get(), slab.get() + static_cast<size_t>(capacity) * node_count,
+              Label{inf_weight, inf_weight, invalid_id, invalid_id});
+    for (unsigned i = capacity; i > 0; --i)
+        free_slots.push_back(i - 1);
+}
+
+CCHArenaQuery::CCHArenaQuery(const CCHQueryArena &arena, unsigned slot)
+    : arena(&arena), slot(slot), label(arena.slab.get() + static_cast<size_t>(slot) * arena.node_count) {}
+
+CCHArenaQuery::~CCHArenaQuery()
+{
+    reset_labels(*this);
+    std::lock_guard<std::mutex> guard(arena->lock);
+    arena->free_slots.push_back(slot);
+}
+
+std::unique_ptr<CCHQueryArena> cch_query_arena_new(const CCHMetric &metric, uint32_t capacity)
+{
+    return std::unique_ptr<CCHQueryArena>(new CCHQueryArena(metric, capacity));
+}
+
+uint32_t cch_query_arena_available(const CCHQueryArena &arena)
+{
+    std::lock_guard<std::mutex> guard(arena.lock);
+    return arena.free_slots.size();
+}
+
+size_t cch_query_arena_memory_bytes(const CCHQueryArena &arena)
+{
+    return static_cast<size_t>(arena.capacity) * arena.node_count * sizeof(CCHQueryArena::Label) +
+           arena.capacity * sizeof(unsigned);
+}
+
+std::unique_ptr<CCHArenaQuery> cch_arena_query_new(const CCHQueryArena &arena)
+{
+    unsigned slot;
+    {
+        std::lock_guard<std::mutex> guard(arena.lock);
+        if (arena.free_slots.empty())
+            return nullptr;
+        slot = arena.free_slots.back();
+        arena.free_slots.pop_back();
+    }
+    return std::unique_ptr<CCHArenaQuery>(new CCHArenaQuery(arena, slot));
+}
+
+uint32_t cch_arena_query_run(CCHArenaQuery &query, uint32_t s, uint32_t t)
+{
+    const CustomizableContractionHierarchyMetric &metric = query.arena->metric->inner;
+    const CustomizableContractionHierarchy &cch = *metric.cch;
+    using Label = CCHQueryArena::Label;
+    Label *label = query.label;
+    reset_labels(query);
+
+    query.source = cch.rank[s];
+    query.target = cch.rank[t];
+    label[query.source].forward = 0;
+    label[query.target].backward = 0;
+
+    unsigned best = inf_weight, meeting = invalid_id;
+    unsigned x = query.source, y = query.target;
+    while (x != y)
+    {
+        if (x < y)
+        {
+            relax(cch, metric.forward, label, &Label::forward, &Label::forward_arc, x, best);
+            x = cch.elimination_tree_parent[x];
+        }
+        else
+        {
+            relax(cch, metric.backward, label, &Label::backward, &Label::backward_arc, y, best);
+            y = cch.elimination_tree_parent[y];
+        }
+        if (x == invalid_id || y == invalid_id)
+            break; // different trees: unreachable
+    }
+    for (; x == y && x != invalid_id; x = y = cch.elimination_tree_parent[x])
+    {
+        if (label[x].forward + label[x].backward < best)
+        {
+            best = label[x].forward + label[x].backward;
+            meeting = x;
+        }
+        relax(cch, metric.forward, label, &Label::forward, &Label::forward_arc, x, best);
+        relax(cch, metric.backward, label, &Label::backward, &Label::backward_arc, x, best);
+    }
+
+    query.meeting = meeting;
+    query.distance = best;
+    return best;
+}
+
+rust::Vec<uint32_t> cch_arena_query_arc_path(const CCHArenaQuery &query)
+{
+    rust::Vec<uint32_t> out;
+    if (query.meeting == invalid_id)
+        return out;
+    std::vector<unsigned> arcs;
+    unpack_arcs(query, arcs);
+    for (unsigned a : arcs)
+        out.push_back(a);
+    return out;
+}
+
+rust::Vec<uint32_t> cch_arena_query_node_path(const CCHArenaQuery &query)
+{
+    rust::Vec<uint32_t> out;
+    if (query.meeting == invalid_id)
+        return out;
+    const CCHInputArcs &input = query.arena->metric->cch->input_arcs;
+    std::vector<unsigned> arcs;
+    unpack_arcs(query, arcs);
+    out.push_back(query.arena->metric->inner.cch->order[query.source]);
+    for (unsigned a : arcs)
+        out.push_back(input.head(a));
+    return out;
+}
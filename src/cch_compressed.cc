@@ -0,0 +1,212 @@
+#include "routingkit_cch_wrapper.h"
+
+#include <routingkit/constants.h>
+#include <algorithm>
+
+using namespace RoutingKit;
+
+// Compressed, query-only CCH. A point-to-point query only needs the upward arcs of the
+// elimination tree ancestors of s and t, so the down graph, tails, order and arc ids are not
+// stored; heads are decoded from the gap stream while relaxing.
+
+namespace
+{
+    void encode_varint(std::vector<uint8_t> &out, unsigned v)
+    {
+        while (v >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(v));
+    }
+
+    inline unsigned decode_varint(const uint8_t *&p)
+    {
+        unsigned v = 0, shift = 0;
+        uint8_t b;
+        do
+        {
+            b = *p++;
+            v |= static_cast<unsigned>(b & 0x7f) << shift;
+            shift += 7;
+        } while (b & 0x80);
+        return v;
+    }
+
+    // CCH arcs of x sorted by head; defines the CompressedCCH arc order.
+    void sorted_up_arcs(const CustomizableContractionHierarchy &cch, unsigned x, std::vector<unsigned> &arcs)
+    {
+        arcs.clear();
+        for (unsigned a = cch.up_first_out[x]; a < cch.up_first_out[x + 1]; ++a)
+            arcs.push_back(a);
+        std::stable_sort(arcs.begin(), arcs.end(), [&](unsigned l, unsigned r)
+                         { return cch.up_head[l] < cch.up_head[r]; });
+    }
+
+    template <class T>
+    size_t vector_bytes(const std::vector<T> &v)
+    {
+        return v.size() * sizeof(T);
+    }
+}
+
+unsigned CompressedCCH::parent(unsigned x) const
+{
+    uint64_t bit = static_cast<uint64_t>(x) * parent_width;
+    uint64_t word = bit / 64, offset = bit % 64;
+    uint64_t v = parent_bits[word] >> offset;
+    if (offset + parent_width > 64)
+        v |= parent_bits[word + 1] << (64 - offset);
+    unsigned delta = static_cast<unsigned>(v & ((uint64_t(1) << parent_width) - 1));
+    return delta == 0 ? invalid_id : x + delta;
+}
+
+std::unique_ptr<CompressedCCH> compressed_cch_new(const CCH &cch_wrapper)
+{
+    const CustomizableContractionHierarchy &cch = cch_wrapper.inner;
+    std::unique_ptr<CompressedCCH> c(new CompressedCCH);
+    const unsigned n = cch.node_count();
+    c->node_count = n;
+
+    bool identity = true;
+    for (unsigned v = 0; v < n && identity; ++v)
+        identity = cch.rank[v] == v;
+    if (!identity)
+        c->rank = cch.rank;
+
+    c->up_arc_first.assign(n + 1, 0);
+    c->up_byte_first.assign(n + 1, 0);
+    std::vector<unsigned> arcs;
+    for (unsigned x = 0; x < n; ++x)
+    {
+        sorted_up_arcs(cch, x, arcs);
+        unsigned previous = x;
+        for (unsigned a : arcs)
+        {
+            encode_varint(c->up_gaps, cch.up_head[a] - previous);
+            previous = cch.up_head[a];
+        }
+        c->up_arc_first[x + 1] = c->up_arc_first[x] + arcs.size();
+        c->up_byte_first[x + 1] = c->up_gaps.size();
+    }
+    c->up_gaps.shrink_to_fit();
+
+    unsigned max_delta = 0;
+    for (unsigned x = 0; x < n; ++x)
+        if (cch.elimination_tree_parent[x] != invalid_id)
+            max_delta = std::max(max_delta, cch.elimination_tree_parent[x] - x);
+    while (c->parent_width < 32 && (max_delta >> c->parent_width) != 0)
+        ++c->parent_width;
+    c->parent_bits.assign((static_cast<uint64_t>(n) * c->parent_width + 63) / 64 + 1, 0);
+    for (unsigned x = 0; x < n; ++x)
+    {
+        unsigned p = cch.elimination_tree_parent[x];
+        uint64_t delta = p == invalid_id ? 0 : p - x;
+        uint64_t bit = static_cast<uint64_t>(x) * c->parent_width;
+        c->parent_bits[bit / 64] |= delta << (bit % 64);
+        if (bit % 64 + c->parent_width > 64)
+            c->parent_bits[bit / 64 + 1] |= delta >> (64 - bit % 64);
+    }
+    return c;
+}
+
+size_t compressed_cch_memory_bytes(const CompressedCCH &c)
+{
+    return sizeof(c) + vector_bytes(c.rank) + vector_bytes(c.up_arc_first) + vector_bytes(c.up_byte_first) +
+           vector_bytes(c.up_gaps) + vector_bytes(c.parent_bits);
+}
+
+size_t cch_memory_bytes(const CCH &cch_wrapper)
+{
+    // Topology arrays used by queries and customization, plus the input arc lookups of the
+    // extensions; excludes RoutingKit's own input arc mapping.
+    const CustomizableContractionHierarchy &cch = cch_wrapper.inner;
+    return vector_bytes(cch.up_first_out) + vector_bytes(cch.up_head) + vector_bytes(cch.up_tail) +
+           vector_bytes(cch.down_first_out) + vector_bytes(cch.down_head) + vector_bytes(cch.down_to_up) +
+           vector_bytes(cch.elimination_tree_parent) + vector_bytes(cch.order) + vector_bytes(cch.rank) +
+           cch_wrapper.input_arcs.memory_bytes();
+}
+
+std::unique_ptr<CompressedCCHMetric> compressed_cch_metric_new(const CompressedCCH &c, const CCHMetric &metric)
+{
+    const CustomizableContractionHierarchy &cch = *metric.inner.cch;
+    std::unique_ptr<CompressedCCHMetric> m(new CompressedCCHMetric(c));
+    m->forward.resize(c.up_arc_first.back());
+    m->backward.resize(c.up_arc_first.back());
+    std::vector<unsigned> arcs;
+    for (unsigned x = 0; x < c.node_count; ++x)
+    {
+        sorted_up_arcs(cch, x, arcs);
+        for (unsigned i = 0; i < arcs.size(); ++i)
+        {
+            m->forward[c.up_arc_first[x] + i] = metric.inner.forward[arcs[i]];
+            m->backward[c.up_arc_first[x] + i] = metric.inner.backward[arcs[i]];
+        }
+    }
+    return m;
+}
+
+std::unique_ptr<CompressedCCHQuery> compressed_cch_query_new(const CompressedCCHMetric &metric)
+{
+    std::unique_ptr<CompressedCCHQuery> q(new CompressedCCHQuery(metric));
+    q->forward.assign(metric.cch->node_count, inf_weight);
+    q->backward.assign(metric.cch->node_count, inf_weight);
+    return q;
+}
+
+uint32_t compressed_cch_query_distance(CompressedCCHQuery &query, uint32_t s, uint32_t t)
+{
+    const CompressedCCHMetric &metric = *query.metric;
+    const CompressedCCH &c = *metric.cch;
+    unsigned best = inf_weight;
+
+    auto relax = [&](unsigned x, std::vector<unsigned> &label, const std::vector<unsigned> &weight)
+    {
+        unsigned d = label[x];
+        if (d >= best)
+            return;
+        const uint8_t *p = c.up_gaps.data() + c.up_byte_first[x];
+        unsigned y = x;
+        for (unsigned a = c.up_arc_first[x]; a < c.up_arc_first[x + 1]; ++a)
+        {
+            y += decode_varint(p);
+            unsigned nd = d + weight[a];
+            if (nd < label[y])
+                label[y] = nd;
+        }
+    };
+
+    const unsigned source = c.node_rank(s), target = c.node_rank(t);
+    query.forward[source] = 0;
+    query.backward[target] = 0;
+
+    // Walk both ancestor paths in rank order until they join, then relax the common part.
+    unsigned x = source, y = target;
+    while (x != y)
+    {
+        if (x < y)
+        {
+            relax(x, query.forward, metric.forward);
+            x = c.parent(x);
+        }
+        else
+        {
+            relax(y, query.backward, metric.backward);
+            y = c.parent(y);
+        }
+    }
+    for (; x != invalid_id; x = c.parent(x))
+    {
+        best = std::min(best, query.forward[x] + query.backward[x]);
+        relax(x, query.forward, metric.forward);
+        relax(x, query.backward, metric.backward);
+    }
+
+    // Labels are only written on ancestors.
+    for (x = source; x != invalid_id; x = c.parent(x))
+        query.forward[x] = inf_weight;
+    for (y = target; y != invalid_id; y = c.parent(y))
+        query.backward[y] = inf_weight;
+    return best;
+}
@@ -0,0 +1,99 @@
+#include "routingkit_cch_wrapper.h"
+#include "cch_search.h"
+
+#include <routingkit/constants.h>
+
+using namespace RoutingKit;
+
+// Many-to-one and one-to-many distances against pinned node sets. Every pinned node keeps
+// its upward search space (PinnedSearchSpaces), so a query only runs the upward search of the
+// free endpoint, scatters it into a dense label array and gathers
+// min(pinned label + free label) per slot. Pinned sets can be edited one node at a time.
+
+namespace
+{
+    void run_against_pinned(CCHQuery &query,
+                            const PinnedSearchSpaces &pinned,
+                            const std::vector<unsigned> &weight,
+                            unsigned node,
+                            rust::Slice<uint32_t> dists)
+    {
+        const CustomizableContractionHierarchy &cch = *query.metric->inner.cch;
+        EliminationTreeSearch &search = query.backward;
+        search.init(cch.node_count());
+        if (query.gather_label.size() != cch.node_count())
+            query.gather_label.assign(cch.node_count(), inf_weight);
+
+        search.reset();
+        search.add_source(cch.rank[node], 0);
+        search.run(cch, weight);
+        for (unsigned x : search.search_space())
+            query.gather_label[x] = search.distance(x);
+
+        pinned.gather(query.gather_label.data(), dists.data());
+
+        for (unsigned x : search.search_space())
+            query.gather_label[x] = inf_weight;
+    }
+
+    unsigned add_pinned(CCHQuery &query, PinnedSearchSpaces &pinned, const std::vector<unsigned> &weight, unsigned node)
+    {
+        const CustomizableContractionHierarchy &cch = *query.metric->inner.cch;
+        query.forward.init(cch.node_count());
+        return pinned.add(cch, weight, query.forward, node);
+    }
+}
+
+void cch_query_pin_many_to_one_sources(CCHQuery &query, rust::Slice<const uint32_t> sources)
+{
+    query.pinned_sources.clear();
+    for (uint32_t s : sources)
+        add_pinned(query, query.pinned_sources, query.metric->inner.forward, s);
+}
+
+uint32_t cch_query_add_pinned_source(CCHQuery &query, uint32_t s)
+{
+    return add_pinned(query, query.pinned_sources, query.metric->inner.forward, s);
+}
+
+bool cch_query_remove_pinned_source(CCHQuery &query, uint32_t slot)
+{
+    return query.pinned_sources.remove(slot);
+}
+
+uint32_t cch_query_pinned_source_slots(const CCHQuery &query)
+{
+    return query.pinned_sources.slot_count();
+}
+
+void cch_query_many_to_one(CCHQuery &query, uint32_t t, rust::Slice<uint32_t> dists)
+{
+    run_against_pinned(query, query.pinned_sources, query.metric->inner.backward, t, dists);
+}
+
+void cch_query_pin_one_to_many_targets(CCHQuery &query, rust::Slice<const uint32_t> targets)
+{
+    query.pinned_targets.clear();
+    for (uint32_t t : targets)
+        add_pinned(query, query.pinned_targets, query.metric->inner.backward, t);
+}
+
+uint32_t cch_query_add_pinned_target(CCHQuery &query, uint32_t t)
+{
+    return add_pinned(query, query.pinned_targets, query.metric->inner.backward, t);
+}
+
+bool cch_query_remove_pinned_target(CCHQuery &query, uint32_t slot)
+{
+    return query.pinned_targets.remove(slot);
+}
+
+uint32_t cch_query_pinned_target_slots(const CCHQuery &query)
+{
+    return query.pinned_targets.slot_count();
+}
+
+void cch_query_one_to_many(CCHQuery &query, uint32_t s, rust::Slice<uint32_t> dists)
+{
+    run_against_pinned(query, query.pinned_targets, query.metric->inner.forward, s, dists);
+}
@@ -0,0 +1,191 @@
+#include "routingkit_cch_wrapper.h"
+#include "cch_search.h"
+
+#include <routingkit/constants.h>
+#include <cmath>
+#include <limits>
+
+using namespace RoutingKit;
+
+// HMM map matching (Newson and Krumm, "Hidden Markov Map Matching Through Noise and
+// Sparseness"). Hidden states are the candidate points on arcs of every GPS point.
+//   emission   log p = -0.5 * (gps distance / sigma)^2
+//   transition log p = -|route length / weight_per_meter - great circle distance| / beta
+// Route lengths between two candidate sets come from one-to-many queries: the tails of the
+// next candidates are pinned once, then every current candidate runs one upward search from
+// the head of its arc. A candidate behind another on the same arc also reaches it along the
+// arc. If no candidate of a point is reachable, the HMM breaks: the chain restarts at that
+// point with emissions only, and the route has a gap there.
+
+namespace
+{
+    const double minus_infinity = -std::numeric_limits<double>::infinity();
+
+    double great_circle_meters(double lat1, double lon1, double lat2, double lon2)
+    {
+        const double to_radians = 3.14159265358979323846 / 180.0;
+        double dlat = (lat2 - lat1) * to_radians, dlon = (lon2 - lon1) * to_radians;
+        double a = std::sin(dlat / 2) * std::sin(dlat / 2) +
+                   std::cos(lat1 * to_radians) * std::cos(lat2 * to_radians) * std::sin(dlon / 2) * std::sin(dlon / 2);
+        return 2 * 6371000.0 * std::asin(std::min(1.0, std::sqrt(a)));
+    }
+}
+
+std::unique_ptr<CCHMapMatcher> cch_map_matcher_new(const CCHMetric &metric)
+{
+    std::unique_ptr<CCHMapMatcher> matcher(new CCHMapMatcher);
+    matcher->query = cch_query_new(metric);
+    return matcher;
+}
+
+void cch_map_matcher_run(CCHMapMatcher &matcher,
+                         rust::Slice<const float> latitude,
+                         rust::Slice<const float> longitude,
+                         rust::Slice<const uint32_t> candidate_first,
+                         rust::Slice<const uint32_t> candidate_arc,
+                         rust::Slice<const float> candidate_fraction,
+                         rust::Slice<const float> candidate_distance,
+                         double sigma,
+                         double beta,
+                         double weight_per_meter,
+                         rust::Slice<uint32_t> matched,
+                         rust::Vec<uint32_t> &route,
+                         rust::Slice<uint32_t> route_first)
+{
+    CCHQuery &query = *matcher.query;
+    const CustomizableContractionHierarchyMetric &metric = query.metric->inner;
+    const CustomizableContractionHierarchy &cch = *metric.cch;
+    const CCHInputArcs &input = query.metric->cch->input_arcs;
+    const unsigned *weight = metric.input_weight;
+    const size_t point_count = latitude.size();
+    const unsigned candidate_count = candidate_arc.size();
+
+    std::fill(matched.begin(), matched.end(), invalid_id);
+    std::fill(route_first.begin(), route_first.end(), invalid_id);
+    route.clear();
+    matcher.score.assign(candidate_count, minus_infinity);
+    matcher.parent.assign(candidate_count, invalid_id);
+    matcher.offset.resize(candidate_count);
+    for (unsigned c = 0; c < candidate_count; ++c)
+        matcher.offset[c] = weight[candidate_arc[c]] < inf_weight ? offset_on_arc(weight[candidate_arc[c]], candidate_fraction[c]) : 0;
+    auto emission = [&](unsigned c)
+    {
+        if (weight[candidate_arc[c]] >= inf_weight)
+            return minus_infinity;
+        double z = candidate_distance[c] / sigma;
+        return -0.5 * z * z;
+    };
+    // Length of the route from candidate i to candidate j, inf_weight if there is none;
+    // `graph` is the distance from the head of i's arc to the tail of j's arc.
+    auto route_length = [&](unsigned i, unsigned j, unsigned graph)
+    {
+        unsigned a = candidate_arc[i], b = candidate_arc[j];
+        unsigned long long length = inf_weight;
+        if (graph < inf_weight)
+            length = (unsigned long long)(weight[a] - matcher.offset[i]) + graph + matcher.offset[j];
+        if (a == b && matcher.offset[i] <= matcher.offset[j])
+            length = std::min<unsigned long long>(length, matcher.offset[j] - matcher.offset[i]);
+        return length;
+    };
+
+    // Forward pass. `previous` is the last point with a live candidate.
+    size_t previous = point_count;
+    for (size_t t = 0; t < point_count; ++t)
+    {
+        const unsigned begin = candidate_first[t], end = candidate_first[t + 1];
+        if (begin == end)
+            continue;
+        bool live = false;
+        if (previous != point_count)
+        {
+            const unsigned previous_begin = candidate_first[previous], previous_end = candidate_first[previous + 1];
+            const double straight = great_circle_meters(latitude[previous], longitude[previous], latitude[t], longitude[t]);
+            matcher.tails.clear();
+            for (unsigned j = begin; j < end; ++j)
+                matcher.tails.push_back(input.tail(candidate_arc[j]));
+            cch_query_pin_one_to_many_targets(query, {matcher.tails.data(), matcher.tails.size()});
+            matcher.dists.resize(end - begin);
+            for (unsigned i = previous_begin; i < previous_end; ++i)
+            {
+                if (matcher.score[i] == minus_infinity)
+                    continue;
+                cch_query_one_to_many(query, input.head(candidate_arc[i]), {matcher.dists.data(), matcher.dists.size()});
+                for (unsigned j = begin; j < end; ++j)
+                {
+                    unsigned long long length = route_length(i, j, matcher.dists[j - begin]);
+                    double e = emission(j);
+                    if (length >= inf_weight || e == minus_infinity)
+                        continue;
+                    double s = matcher.score[i] + e - std::abs(length / weight_per_meter - straight) / beta;
+                    if (s > matcher.score[j])
+                    {
+                        matcher.score[j] = s;
+                        matcher.parent[j] = i;
+                        live = true;
+                    }
+                }
+            }
+        }
+        if (!live)
+        {
+            for (unsigned j = begin; j < end; ++j)
+            {
+                matcher.score[j] = emission(j);
+                live |= matcher.score[j] != minus_infinity;
+            }
+        }
+        if (live)
+            previous = t;
+    }
+
+    // Backtrack: the best candidate of the last live point of every chain, then parents.
+    unsigned follow = invalid_id;
+    for (size_t t = point_count; t-- > 0;)
+    {
+        const unsigned begin = candidate_first[t], end = candidate_first[t + 1];
+        unsigned best = invalid_id;
+        if (follow != invalid_id)
+        {
+            if (follow < begin || follow >= end)
+                continue;
+            best = follow;
+        }
+        else
+            for (unsigned j = begin; j < end; ++j)
+                if (matcher.score[j] != minus_infinity && (best == invalid_id || matcher.score[j] > matcher.score[best]))
+                    best = j;
+        if (best == invalid_id)
+            continue;
+        matched[t] = best;
+        follow = matcher.parent[best];
+    }
+
+    // Route: the matched arcs joined by the shortest paths between consecutive matches.
+    unsigned last = invalid_id;
+    for (size_t t = 0; t < point_count; ++t)
+    {
+        const unsigned c = matched[t];
+        if (c == invalid_id)
+            continue;
+        const unsigned a = candidate_arc[c];
+        if (last != invalid_id && matcher.parent[c] == last)
+        {
+            const unsigned b = candidate_arc[last];
+            if (a == b && matcher.offset[last] <= matcher.offset[c])
+            {
+                route_first[t] = route.size() - 1;
+                last = c;
+                continue;
+            }
+            unsigned meeting;
+            cch_point_to_point(metric, query.forward, query.backward, cch.rank[input.head(b)], cch.rank[input.tail(a)], meeting);
+            matcher.leg.clear();
+            cch_unpack_path(metric, input, query.forward, query.backward, meeting, matcher.leg);
+            for (unsigned x : matcher.leg)
+                route.push_back(x);
+        }
+        route.push_back(a);
+        route_first[t] = route.size() - 1;
+        last = c;
+    }
+}
@@ -0,0 +1,176 @@
+#include "routingkit_cch_wrapper.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace RoutingKit;
+
+// NUMA replicas rely on first-touch placement: a thread pinned to the CPUs of a node copies
+// the arrays, so their pages are allocated on that node. Huge pages are transparent huge
+// pages requested per array; RoutingKit owns its arrays as std::vector, so explicit hugetlbfs
+// mappings are not possible without replacing its allocator.
+
+namespace
+{
+#ifdef __linux__
+    std::vector<unsigned> parse_list(const std::string &text)
+    {
+        // Kernel list format, e.g. "0-3,8-11".
+        std::vector<unsigned> out;
+        size_t pos = 0;
+        while (pos < text.size())
+        {
+            size_t end = text.find(',', pos);
+            if (end == std::string::npos)
+                end = text.size();
+            std::string item = text.substr(pos, end - pos);
+            size_t dash = item.find('-');
+            try
+            {
+                unsigned lo = std::stoul(item.substr(0, dash));
+                unsigned hi = dash == std::string::npos ? lo : std::stoul(item.substr(dash + 1));
+                for (unsigned i = lo; i <= hi; ++i)
+                    out.push_back(i);
+            }
+            catch (...)
+            {
+            }
+            pos = end + 1;
+        }
+        return out;
+    }
+
+    std::string read_line(const std::string &path)
+    {
+        std::ifstream in(path);
+        std::string line;
+        std::getline(in, line);
+        return line;
+    }
+
+    // CPUs of every online NUMA node, indexed 0..count-1 in sysfs order.
+    const std::vector<std::vector<unsigned>> &node_cpus()
+    {
+        static const std::vector<std::vector<unsigned>> cpus = []
+        {
+            std::vector<std::vector<unsigned>> result;
+            for (unsigned node : parse_list(read_line("/sys/devices/system/node/online")))
+                result.push_back(parse_list(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist")));
+            if (result.empty())
+                result.emplace_back();
+            return result;
+        }();
+        return cpus;
+    }
+#endif
+
+    template <class T>
+    size_t advise_huge_pages(const std::vector<T> &v)
+    {
+#ifdef __linux__
+        const uintptr_t page = sysconf(_SC_PAGESIZE);
+        uintptr_t begin = reinterpret_cast<uintptr_t>(v.data());
+        uintptr_t end = begin + v.capacity() * sizeof(T);
+        begin = (begin + page - 1) / page * page;
+        end = end / page * page;
+        if (end <= begin || madvise(reinterpret_cast<void *>(begin), end - begin, MADV_HUGEPAGE) != 0)
+            return 0;
+        return end - begin;
+#else
+        (void)v;
+        return 0;
+#endif
+    }
+
+    // Copy into a fresh allocation that is advised before its pages are first touched.
+    void copy_local(std::vector<unsigned> &dst, const std::vector<unsigned> &src, bool huge_pages)
+    {
+        std::vector<unsigned> fresh;
+        fresh.reserve(src.size());
+        if (huge_pages)
+            advise_huge_pages(fresh);
+        fresh.assign(src.begin(), src.end());
+        dst.swap(fresh);
+    }
+}
+
+uint32_t numa_node_count()
+{
+#ifdef __linux__
+    return node_cpus().size();
+#else
+    return 1;
+#endif
+}
+
+uint32_t numa_current_node()
+{
+#ifdef __linux__
+    int cpu = sched_getcpu();
+    const auto &cpus = node_cpus();
+    for (unsigned node = 0; cpu >= 0 && node < cpus.size(); ++node)
+        if (std::find(cpus[node].begin(), cpus[node].end(), static_cast<unsigned>(cpu)) != cpus[node].end())
+            return node;
+#endif
+    return 0;
+}
+
+bool numa_pin_current_thread(uint32_t node)
+{
+#ifdef __linux__
+    const auto &cpus = node_cpus();
+    if (node >= cpus.size() || cpus[node].empty())
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned cpu : cpus[node])
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)node;
+    return false;
+#endif
+}
+
+size_t cch_advise_huge_pages(const CCH &cch)
+{
+    const CustomizableContractionHierarchy &c = cch.inner;
+    return advise_huge_pages(c.up_first_out) + advise_huge_pages(c.up_head) + advise_huge_pages(c.up_tail) +
+           advise_huge_pages(c.down_first_out) + advise_huge_pages(c.down_head) + advise_huge_pages(c.down_to_up) +
+           advise_huge_pages(c.elimination_tree_parent) + advise_huge_pages(c.order) + advise_huge_pages(c.rank);
+}
+
+size_t cch_metric_advise_huge_pages(const CCHMetric &metric)
+{
+    return advise_huge_pages(metric.inner.forward) + advise_huge_pages(metric.inner.backward);
+}
+
+std::unique_ptr<CCHMetric> cch_metric_numa_replica(const CCHMetric &metric, rust::Slice<uint32_t> weight,
+                                                   uint32_t node, bool huge_pages)
+{
+    std::unique_ptr<CCHMetric> replica;
+    std::thread worker([&]
+                       {
+        numa_pin_current_thread(node);
+        std::unique_ptr<CCH> cch(new CCH(*metric.cch));
+        if (huge_pages)
+            cch_advise_huge_pages(*cch);
+        // `weight` is zeroed but untouched memory from the caller; writing it here places it.
+        std::copy(metric.inner.input_weight, metric.inner.input_weight + weight.size(), weight.begin());
+        CustomizableContractionHierarchyMetric inner(cch->inner, reinterpret_cast<const unsigned *>(weight.data()));
+        copy_local(inner.forward, metric.inner.forward, huge_pages);
+        copy_local(inner.backward, metric.inner.backward, huge_pages);
+        replica.reset(new CCHMetric(std::move(inner), *cch));
+        replica->owned_cch = std::move(cch); });
+    worker.join();
+    return replica;
+}
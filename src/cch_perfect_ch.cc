@@ -0,0 +1,274 @@
+#include "routingkit_cch_wrapper.h"
+#include "omp_threads.h"
+
+#include <routingkit/constants.h>
+#include <algorithm>
+#include <vector>
+
+using namespace RoutingKit;
+
+// Parallel perfect-witness CH extraction. Three passes over the CCH triangles, each one
+// parallel over nodes that do not depend on each other:
+//   1. perfect customization, top-down by elimination tree depth: the arcs of x are improved
+//      through upper and intermediate triangles, whose other arcs belong to ancestors of x;
+//   2. an arc is dropped if an upper or intermediate triangle is at least as short (ties only
+//      with two non-zero arcs, so that no two arcs drop each other);
+//   3. bottom-up by elimination tree height: every kept arc is unpacked into an input arc or
+//      a lower triangle of kept arcs; arcs without one (only possible with zero weights) are
+//      dropped as well, their witness is kept.
+// The CH sides are then filled in place, with CCH ranks as CH ranks.
+
+namespace
+{
+    // Nodes grouped by level; level[x] is either the elimination tree depth (roots 0) or
+    // the height (leaves 0). Nodes of one level are never ancestors of each other.
+    void group_by_level(const CustomizableContractionHierarchy &cch, bool by_height,
+                        std::vector<unsigned> &first, std::vector<unsigned> &nodes)
+    {
+        const unsigned n = cch.node_count();
+        std::vector<unsigned> level(n, 0);
+        unsigned level_count = n == 0 ? 0 : 1;
+        if (by_height)
+        {
+            for (unsigned x = 0; x < n; ++x)
+            {
+                unsigned p = cch.elimination_tree_parent[x];
+                if (p != invalid_id)
+                    level[p] = std::max(level[p], level[x] + 1);
+                level_count = std::max(level_count, level[x] + 1);
+            }
+        }
+        else
+        {
+            for (unsigned x = n; x-- > 0;)
+            {
+                unsigned p = cch.elimination_tree_parent[x];
+                level[x] = p == invalid_id ? 0 : level[p] + 1;
+                level_count = std::max(level_count, level[x] + 1);
+            }
+        }
+        first.assign(level_count + 1, 0);
+        for (unsigned x = 0; x < n; ++x)
+            ++first[level[x] + 1];
+        for (unsigned l = 0; l < level_count; ++l)
+            first[l + 1] += first[l];
+        nodes.resize(n);
+        std::vector<unsigned> next(first.begin(), first.end() - 1);
+        for (unsigned x = 0; x < n; ++x)
+            nodes[next[level[x]]++] = x;
+    }
+
+    // Runs f(x) for all nodes, one level after the other, each level in parallel.
+    template <class F>
+    void for_each_by_level(const std::vector<unsigned> &first, const std::vector<unsigned> &nodes, int threads, const F &f)
+    {
+        for (size_t l = 0; l + 1 < first.size(); ++l)
+        {
+            const long long begin = first[l], end = first[l + 1];
+            OMP_PRAGMA(omp parallel for num_threads(threads) schedule(dynamic, 64))
+            for (long long i = begin; i < end; ++i)
+                f(nodes[i]);
+        }
+    }
+
+    // Calls f(xy, yz, xz) for every triangle x < y < z with lowest node x. `slot` maps heads
+    // to arcs of x and is invalid_id everywhere between calls.
+    template <class F>
+    void for_each_triangle_of_lowest(const CustomizableContractionHierarchy &cch, unsigned x,
+                                     std::vector<unsigned> &slot, const F &f)
+    {
+        for (unsigned a = cch.up_first_out[x]; a < cch.up_first_out[x + 1]; ++a)
+            slot[cch.up_head[a]] = a;
+        for (unsigned xy = cch.up_first_out[x]; xy < cch.up_first_out[x + 1]; ++xy)
+        {
+            unsigned y = cch.up_head[xy];
+            for (unsigned yz = cch.up_first_out[y]; yz < cch.up_first_out[y + 1]; ++yz)
+            {
+                unsigned xz = slot[cch.up_head[yz]];
+                if (xz != invalid_id)
+                    f(xy, yz, xz);
+            }
+        }
+        for (unsigned a = cch.up_first_out[x]; a < cch.up_first_out[x + 1]; ++a)
+            slot[cch.up_head[a]] = invalid_id;
+    }
+
+    bool is_witness(unsigned first, unsigned second, unsigned w)
+    {
+        unsigned s = first + second;
+        return s < w || (s == w && first != 0 && second != 0);
+    }
+
+    // How a kept arc unpacks: an input arc, or the lower triangle (z, x, y) as the CCH arcs
+    // of the first (x -> z or y -> z) and second (z -> y or z -> x) half.
+    struct Unpacking
+    {
+        unsigned input_arc = invalid_id;
+        unsigned first = invalid_id, second = invalid_id;
+        bool found() const { return input_arc != invalid_id || first != invalid_id; }
+    };
+}
+
+std::unique_ptr<CH> cch_metric_build_perfect_ch_parallel(const CCHMetric &metric, uint32_t thread_count)
+{
+    const CustomizableContractionHierarchy &cch = *metric.inner.cch;
+    const CCHInputArcs &input = metric.cch->input_arcs;
+    const CCHInputArcs::Index &index = input.index();
+    const unsigned *input_weight = metric.inner.input_weight;
+    const int threads = omp_thread_count(thread_count);
+    const unsigned n = cch.node_count();
+    const unsigned m = cch.up_head.size();
+
+    std::vector<unsigned> forward = metric.inner.forward, backward = metric.inner.backward;
+    std::vector<std::vector<unsigned>> slots(threads, std::vector<unsigned>(n, invalid_id));
+    std::vector<unsigned> level_first, level_nodes;
+
+    group_by_level(cch, false, level_first, level_nodes);
+    for_each_by_level(level_first, level_nodes, threads, [&](unsigned x)
+                      { for_each_triangle_of_lowest(cch, x, slots[omp_thread_id()], [&](unsigned xy, unsigned yz, unsigned xz)
+                                                    {
+            // intermediate triangle of xz, upper triangle of xy
+            forward[xz] = std::min(forward[xz], forward[xy] + forward[yz]);
+            backward[xz] = std::min(backward[xz], backward[yz] + backward[xy]);
+            forward[xy] = std::min(forward[xy], forward[xz] + backward[yz]);
+            backward[xy] = std::min(backward[xy], forward[yz] + backward[xz]); }); });
+
+    std::vector<char> keep_forward(m), keep_backward(m);
+    const long long node_count = n;
+    OMP_PRAGMA(omp parallel for num_threads(threads) schedule(dynamic, 256))
+    for (long long i = 0; i < node_count; ++i)
+    {
+        unsigned x = static_cast<unsigned>(i);
+        for (unsigned a = cch.up_first_out[x]; a < cch.up_first_out[x + 1]; ++a)
+        {
+            keep_forward[a] = forward[a] < inf_weight;
+            keep_backward[a] = backward[a] < inf_weight;
+        }
+        for_each_triangle_of_lowest(cch, x, slots[omp_thread_id()], [&](unsigned xy, unsigned yz, unsigned xz)
+                                    {
+            if (is_witness(forward[xy], forward[yz], forward[xz]))
+                keep_forward[xz] = false;
+            if (is_witness(backward[yz], backward[xy], backward[xz]))
+                keep_backward[xz] = false;
+            if (is_witness(forward[xz], backward[yz], forward[xy]))
+                keep_forward[xy] = false;
+            if (is_witness(forward[yz], backward[xz], backward[xy]))
+                keep_backward[xy] = false; });
+    }
+
+    std::vector<Unpacking> unpack_forward(m), unpack_backward(m);
+    group_by_level(cch, true, level_first, level_nodes);
+    for_each_by_level(level_first, level_nodes, threads, [&](unsigned x)
+                      {
+        std::vector<unsigned> &slot = slots[omp_thread_id()];
+        for (unsigned xy = cch.up_first_out[x]; xy < cch.up_first_out[x + 1]; ++xy)
+        {
+            slot[cch.up_head[xy]] = xy;
+            for (unsigned i = index.first_of_cch_arc[xy]; i < index.first_of_cch_arc[xy + 1]; ++i)
+            {
+                unsigned a = index.input_arc[i];
+                bool upward = input.is_upward(a);
+                if (upward && keep_forward[xy] && input_weight[a] == forward[xy])
+                    unpack_forward[xy].input_arc = a;
+                if (!upward && keep_backward[xy] && input_weight[a] == backward[xy])
+                    unpack_backward[xy].input_arc = a;
+            }
+        }
+        // Lower triangles (z, x, y): zx is a down arc of x, zy an up arc of z.
+        for (unsigned j = cch.down_first_out[x]; j < cch.down_first_out[x + 1]; ++j)
+        {
+            unsigned z = cch.down_head[j], zx = cch.down_to_up[j];
+            for (unsigned zy = cch.up_first_out[z]; zy < cch.up_first_out[z + 1]; ++zy)
+            {
+                unsigned xy = slot[cch.up_head[zy]];
+                if (xy == invalid_id)
+                    continue;
+                Unpacking &f = unpack_forward[xy];
+                if (keep_forward[xy] && !f.found() && keep_backward[zx] && keep_forward[zy] &&
+                    backward[zx] + forward[zy] == forward[xy])
+                    f.first = zx, f.second = zy;
+                Unpacking &b = unpack_backward[xy];
+                if (keep_backward[xy] && !b.found() && keep_backward[zy] && keep_forward[zx] &&
+                    backward[zy] + forward[zx] == backward[xy])
+                    b.first = zy, b.second = zx;
+            }
+        }
+        for (unsigned xy = cch.up_first_out[x]; xy < cch.up_first_out[x + 1]; ++xy)
+        {
+            slot[cch.up_head[xy]] = invalid_id;
+            keep_forward[xy] = keep_forward[xy] && unpack_forward[xy].found();
+            keep_backward[xy] = keep_backward[xy] && unpack_backward[xy].found();
+        } });
+    slots.clear();
+
+    ContractionHierarchy ch;
+    ch.rank = cch.rank;
+    ch.order = cch.order;
+
+    // CH arc id of every kept CCH arc, per side.
+    std::vector<unsigned> forward_id(m, invalid_id), backward_id(m, invalid_id);
+    auto number_side = [&](ContractionHierarchySide &side, const std::vector<char> &keep, std::vector<unsigned> &id)
+    {
+        side.first_out.assign(n + 1, 0);
+        OMP_PRAGMA(omp parallel for num_threads(threads) schedule(static))
+        for (long long i = 0; i < node_count; ++i)
+        {
+            unsigned count = 0;
+            for (unsigned a = cch.up_first_out[i]; a < cch.up_first_out[i + 1]; ++a)
+                count += keep[a];
+            side.first_out[i + 1] = count;
+        }
+        for (unsigned x = 0; x < n; ++x)
+            side.first_out[x + 1] += side.first_out[x];
+        OMP_PRAGMA(omp parallel for num_threads(threads) schedule(static))
+        for (long long i = 0; i < node_count; ++i)
+        {
+            unsigned next = side.first_out[i];
+            for (unsigned a = cch.up_first_out[i]; a < cch.up_first_out[i + 1]; ++a)
+                if (keep[a])
+                    id[a] = next++;
+        }
+    };
+    number_side(ch.forward, keep_forward, forward_id);
+    number_side(ch.backward, keep_backward, backward_id);
+
+    auto fill_side = [&](ContractionHierarchySide &side, const std::vector<unsigned> &weight,
+                         const std::vector<unsigned> &id, const std::vector<Unpacking> &unpack)
+    {
+        const unsigned arc_count = side.first_out[n];
+        side.head.resize(arc_count);
+        side.weight.resize(arc_count);
+        side.shortcut_first_arc.resize(arc_count);
+        side.shortcut_second_arc.resize(arc_count);
+        side.is_shortcut_an_original_arc = BitVector(arc_count);
+        OMP_PRAGMA(omp parallel for num_threads(threads) schedule(static))
+        for (long long i = 0; i < static_cast<long long>(m); ++i)
+        {
+            unsigned a = id[i];
+            if (a == invalid_id)
+                continue;
+            side.head[a] = cch.up_head[i];
+            side.weight[a] = weight[i];
+            const Unpacking &u = unpack[i];
+            if (u.input_arc != invalid_id)
+            {
+                side.shortcut_first_arc[a] = u.input_arc;
+                side.shortcut_second_arc[a] = input.head(u.input_arc);
+            }
+            else
+            {
+                // The first half always runs downward (a backward arc), the second upward.
+                side.shortcut_first_arc[a] = backward_id[u.first];
+                side.shortcut_second_arc[a] = forward_id[u.second];
+            }
+        }
+        // BitVector packs bits into shared words, so it is filled on one thread.
+        for (unsigned i = 0; i < m; ++i)
+            if (id[i] != invalid_id && unpack[i].input_arc != invalid_id)
+                side.is_shortcut_an_original_arc.set(id[i]);
+    };
+    fill_side(ch.forward, forward, forward_id, unpack_forward);
+    fill_side(ch.backward, backward, backward_id, unpack_backward);
+
+    return std::unique_ptr<CH>(new CH(std::move(ch)));
+}
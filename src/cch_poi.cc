@@ -0,0 +1,161 @@
+#include "routingkit_cch_wrapper.h"
+#include "cch_search.h"
+
+#include <routingkit/constants.h>
+#include <algorithm>
+
+using namespace RoutingKit;
+
+// Bucket-based k-nearest POI queries. For every POI p the backward upward search stores
+// (dist(x, p), p) in the bucket of each reached node x, sorted by distance. A query runs one
+// forward upward search from s and scans the buckets of its search space in order of
+// increasing dist(s, x); scanning stops once dist(s, x) alone reaches the k-th best distance,
+// at which point the k results are final.
+
+namespace
+{
+    void add_poi_entries(CCHPOIIndex &index, unsigned node, bool keep_sorted)
+    {
+        const CustomizableContractionHierarchyMetric &metric = index.metric->inner;
+        const CustomizableContractionHierarchy &cch = *metric.cch;
+        index.search.reset();
+        index.search.add_source(cch.rank[node], 0);
+        index.search.run(cch, metric.backward);
+        for (unsigned x : index.search.search_space())
+        {
+            unsigned d = index.search.distance(x);
+            if (d >= inf_weight)
+                continue;
+            if (index.bucket_of_node[x] == invalid_id)
+            {
+                index.bucket_of_node[x] = index.buckets.size();
+                index.buckets.emplace_back();
+            }
+            auto &bucket = index.buckets[index.bucket_of_node[x]];
+            CCHPOIIndex::Entry e = {d, node};
+            if (keep_sorted)
+                bucket.insert(std::upper_bound(bucket.begin(), bucket.end(), e), e);
+            else
+                bucket.push_back(e);
+        }
+    }
+}
+
+std::unique_ptr<CCHPOIIndex> cch_poi_index_new(const CCHMetric &metric, rust::Slice<const uint32_t> pois)
+{
+    std::unique_ptr<CCHPOIIndex> index(new CCHPOIIndex(metric));
+    const unsigned node_count = metric.inner.cch->node_count();
+    index->bucket_of_node.assign(node_count, invalid_id);
+    index->is_poi.assign(node_count, false);
+    index->search.init(node_count);
+    for (uint32_t p : pois)
+    {
+        if (index->is_poi[p])
+            continue;
+        index->is_poi[p] = true;
+        ++index->poi_count;
+        add_poi_entries(*index, p, false);
+    }
+    for (auto &bucket : index->buckets)
+        std::sort(bucket.begin(), bucket.end());
+    return index;
+}
+
+bool cch_poi_index_insert(CCHPOIIndex &index, uint32_t node)
+{
+    if (index.is_poi[node])
+        return false;
+    index.is_poi[node] = true;
+    ++index.poi_count;
+    add_poi_entries(index, node, true);
+    return true;
+}
+
+bool cch_poi_index_remove(CCHPOIIndex &index, uint32_t node)
+{
+    if (!index.is_poi[node])
+        return false;
+    index.is_poi[node] = false;
+    --index.poi_count;
+    // Entries of a POI only exist on its elimination tree ancestors.
+    const CustomizableContractionHierarchy &cch = *index.metric->inner.cch;
+    for (unsigned x = cch.rank[node]; x != invalid_id; x = cch.elimination_tree_parent[x])
+    {
+        if (index.bucket_of_node[x] == invalid_id)
+            continue;
+        auto &bucket = index.buckets[index.bucket_of_node[x]];
+        bucket.erase(std::remove_if(bucket.begin(), bucket.end(), [node](const CCHPOIIndex::Entry &e)
+                                    { return e.poi == node; }),
+                     bucket.end());
+    }
+    return true;
+}
+
+uint32_t cch_poi_index_len(const CCHPOIIndex &index)
+{
+    return index.poi_count;
+}
+
+void cch_poi_index_nearest(const CCHPOIIndex &index,
+                           CCHQuery &query,
+                           uint32_t s,
+                           uint32_t k,
+                           rust::Vec<uint32_t> &pois,
+                           rust::Vec<uint32_t> &distances)
+{
+    pois.clear();
+    distances.clear();
+    if (k == 0)
+        return;
+
+    const CustomizableContractionHierarchyMetric &metric = index.metric->inner;
+    const CustomizableContractionHierarchy &cch = *metric.cch;
+    EliminationTreeSearch &forward = query.forward;
+    forward.init(cch.node_count());
+    forward.reset();
+    forward.add_source(cch.rank[s], 0);
+    forward.run(cch, metric.forward);
+
+    std::vector<std::pair<unsigned, unsigned>> meeting; // (dist(s, x), bucket of x)
+    for (unsigned x : forward.search_space())
+        if (forward.distance(x) < inf_weight && index.bucket_of_node[x] != invalid_id)
+            meeting.push_back({forward.distance(x), index.bucket_of_node[x]});
+    std::sort(meeting.begin(), meeting.end());
+
+    // Current best k distinct POIs, ascending by distance.
+    std::vector<CCHPOIIndex::Entry> best;
+    auto bound = [&]
+    { return best.size() == k ? best.back().distance : inf_weight; };
+
+    for (auto m : meeting)
+    {
+        if (m.first >= bound())
+            break;
+        for (const CCHPOIIndex::Entry &e : index.buckets[m.second])
+        {
+            unsigned d = m.first + e.distance;
+            if (d >= bound())
+                break;
+            auto same = std::find_if(best.begin(), best.end(), [&](const CCHPOIIndex::Entry &b)
+                                     { return b.poi == e.poi; });
+            if (same != best.end())
+            {
+                if (same->distance <= d)
+                    continue;
+                best.erase(same);
+            }
+            else if (best.size() == k)
+            {
+                best.pop_back();
+            }
+            CCHPOIIndex::Entry found = {d, e.poi};
+            best.insert(std::upper_bound(best.begin(), best.end(), found), found);
+        }
+    }
+
+    for (const CCHPOIIndex::Entry &e : best)
+    {
+        pois.push_back(e.poi);
+        distances.push_back(e.distance);
+    }
+}
@@ -0,0 +1,151 @@
+#include "routingkit_cch_wrapper.h"
+#include "cch_search.h"
+
+#include <routingkit/constants.h>
+#include <algorithm>
+
+using namespace RoutingKit;
+
+// Quantized metrics. Customization runs over the lower triangles of every CCH arc in rank
+// order with saturating sums. The u32 labels only live for the duration of the
+// customization; the stored metric keeps 2 or 3 bytes per arc and direction, plus an overflow
+// tier for the (few, mostly high-ranked) arcs whose weight does not fit inline. Input weights
+// are only needed to seed the customization and are not stored.
+
+namespace
+{
+    void pack(QuantizedCCHMetric::Tier &tier, unsigned width, unsigned escape, const std::vector<unsigned> &weight)
+    {
+        const unsigned infinity = escape + 1;
+        tier.inline_weight.assign(weight.size() * width, 0);
+        tier.overflow_arc.clear();
+        tier.overflow_weight.clear();
+        for (unsigned a = 0; a < weight.size(); ++a)
+        {
+            unsigned code = weight[a];
+            if (weight[a] >= inf_weight)
+            {
+                code = infinity;
+            }
+            else if (weight[a] >= escape)
+            {
+                code = escape;
+                tier.overflow_arc.push_back(a);
+                tier.overflow_weight.push_back(weight[a]);
+            }
+            for (unsigned b = 0; b < width; ++b)
+                tier.inline_weight[a * width + b] = static_cast<uint8_t>(code >> (8 * b));
+        }
+    }
+
+    template <class T>
+    size_t vector_bytes(const std::vector<T> &v)
+    {
+        return v.size() * sizeof(T);
+    }
+
+    size_t tier_bytes(const QuantizedCCHMetric::Tier &tier)
+    {
+        return vector_bytes(tier.inline_weight) + vector_bytes(tier.overflow_arc) + vector_bytes(tier.overflow_weight);
+    }
+}
+
+unsigned QuantizedCCHMetric::get(const Tier &tier, unsigned arc) const
+{
+    const uint8_t *p = tier.inline_weight.data() + static_cast<size_t>(arc) * width;
+    unsigned code = p[0] | (p[1] << 8) | (width == 3 ? p[2] << 16 : 0);
+    if (code < escape_code())
+        return code;
+    if (code == infinity_code())
+        return inf_weight;
+    auto i = std::lower_bound(tier.overflow_arc.begin(), tier.overflow_arc.end(), arc);
+    return tier.overflow_weight[i - tier.overflow_arc.begin()];
+}
+
+size_t cch_metric_memory_bytes(const CCHMetric &metric)
+{
+    return vector_bytes(metric.inner.forward) + vector_bytes(metric.inner.backward) +
+           metric.cch->input_arcs.count() * sizeof(unsigned);
+}
+
+std::unique_ptr<QuantizedCCHMetric> quantized_cch_metric_new(const CCH &cch_wrapper,
+                                                             rust::Slice<const uint32_t> weight,
+                                                             uint32_t width_bits)
+{
+    const CustomizableContractionHierarchy &cch = cch_wrapper.inner;
+    const CCHInputArcs &input = cch_wrapper.input_arcs;
+    const CCHInputArcs::Index &index = input.index();
+    std::unique_ptr<QuantizedCCHMetric> m(new QuantizedCCHMetric(cch_wrapper, width_bits / 8));
+    const unsigned escape = m->escape_code();
+
+    const unsigned arc_count = cch.up_head.size();
+    std::vector<unsigned> forward(arc_count, inf_weight), backward(arc_count, inf_weight);
+    for (unsigned c = 0; c < arc_count; ++c)
+    {
+        for (unsigned i = index.first_of_cch_arc[c]; i < index.first_of_cch_arc[c + 1]; ++i)
+        {
+            unsigned a = index.input_arc[i];
+            unsigned &w = input.is_upward(a) ? forward[c] : backward[c];
+            w = std::min({w, weight[a], inf_weight});
+        }
+    }
+
+    // Arcs (x, y) in increasing x: the triangle arcs (z, x) and (z, y) with z < x are final.
+    // Labels are < 2^31, so sums fit and only need clamping to inf_weight.
+    std::vector<unsigned> arc_to_head(cch.node_count(), invalid_id);
+    for (unsigned x = 0; x < cch.node_count(); ++x)
+    {
+        for (unsigned a = cch.up_first_out[x]; a < cch.up_first_out[x + 1]; ++a)
+            arc_to_head[cch.up_head[a]] = a;
+        for (unsigned j = cch.down_first_out[x]; j < cch.down_first_out[x + 1]; ++j)
+        {
+            unsigned z = cch.down_head[j];
+            unsigned zx = cch.down_to_up[j];
+            for (unsigned zy = cch.up_first_out[z]; zy < cch.up_first_out[z + 1]; ++zy)
+            {
+                unsigned xy = arc_to_head[cch.up_head[zy]];
+                if (cch.up_head[zy] <= x || xy == invalid_id)
+                    continue;
+                forward[xy] = std::min({forward[xy], backward[zx] + forward[zy], inf_weight});
+                backward[xy] = std::min({backward[xy], backward[zy] + forward[zx], inf_weight});
+            }
+        }
+        for (unsigned a = cch.up_first_out[x]; a < cch.up_first_out[x + 1]; ++a)
+            arc_to_head[cch.up_head[a]] = invalid_id;
+    }
+
+    pack(m->forward, m->width, escape, forward);
+    pack(m->backward, m->width, escape, backward);
+    return m;
+}
+
+size_t quantized_cch_metric_memory_bytes(const QuantizedCCHMetric &metric)
+{
+    return tier_bytes(metric.forward) + tier_bytes(metric.backward);
+}
+
+std::unique_ptr<QuantizedCCHQuery> quantized_cch_query_new(const QuantizedCCHMetric &metric)
+{
+    return std::unique_ptr<QuantizedCCHQuery>(new QuantizedCCHQuery(metric));
+}
+
+uint32_t quantized_cch_query_distance(QuantizedCCHQuery &query, uint32_t s, uint32_t t)
+{
+    const QuantizedCCHMetric &metric = *query.metric;
+    const CustomizableContractionHierarchy &cch = metric.cch->inner;
+    query.forward.init(cch.node_count());
+    query.backward.init(cch.node_count());
+    query.forward.reset();
+    query.backward.reset();
+    query.forward.add_source(cch.rank[s], 0);
+    query.backward.add_source(cch.rank[t], 0);
+    query.forward.run_with(cch, [&](unsigned a)
+                           { return metric.get(metric.forward, a); });
+    query.backward.run_with(cch, [&](unsigned a)
+                            { return metric.get(metric.backward, a); });
+
+    unsigned best = inf_weight;
+    for (unsigned x : query.forward.search_space())
+        best = std::min(best, query.forward.distance(x) + query.backward.distance(x));
+    return best;
+}
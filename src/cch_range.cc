@@ -0,0 +1,139 @@
+#include "routingkit_cch_wrapper.h"
+#include "cch_search.h"
+
+#include <routingkit/constants.h>
+
+using namespace RoutingKit;
+
+// Bounded PHAST: the upward elimination tree search from the source is followed by a
+// downward sweep in decreasing rank order that only visits nodes pushed by a settled node
+// within the limit. A node is popped after all its upper neighbors (which have higher rank),
+// so its label is final when it is popped, and the sweep costs O(k log k) for k reached
+// nodes instead of O(n).
+
+std::unique_ptr<CCHRangeQuery> cch_range_query_new(const CCHMetric &metric)
+{
+    return std::unique_ptr<CCHRangeQuery>(new CCHRangeQuery(metric));
+}
+
+static void run_range_query(CCHRangeQuery &query,
+                            unsigned source,
+                            unsigned limit,
+                            bool with_boundary,
+                            rust::Vec<uint32_t> &nodes,
+                            rust::Vec<uint32_t> &distances,
+                            rust::Vec<uint32_t> &boundary_arcs,
+                            rust::Vec<uint32_t> &boundary_offsets)
+{
+    const CustomizableContractionHierarchyMetric &metric = query.metric->inner;
+    const CustomizableContractionHierarchy &cch = *metric.cch;
+    const CCHInputArcs &input = query.metric->cch->input_arcs;
+    const CCHInputArcs::Index &index = input.index();
+
+    query.upward.init(cch.node_count());
+    if (query.dist.size() != cch.node_count())
+    {
+        query.dist.assign(cch.node_count(), inf_weight);
+        query.queued.assign(cch.node_count(), false);
+    }
+
+    query.upward.reset();
+    query.upward.add_source(cch.rank[source], 0);
+    query.upward.run(cch, metric.forward);
+    for (unsigned x : query.upward.search_space())
+    {
+        unsigned d = query.upward.distance(x);
+        if (d >= inf_weight)
+            continue;
+        query.dist[x] = d;
+        query.touched.push_back(x);
+        if (d <= limit)
+        {
+            query.queued[x] = true;
+            query.heap.push(x);
+        }
+    }
+
+    auto report_boundary = [&](unsigned cch_arc, unsigned x, unsigned d)
+    {
+        for (unsigned i = index.first_of_cch_arc[cch_arc]; i < index.first_of_cch_arc[cch_arc + 1]; ++i)
+        {
+            unsigned a = index.input_arc[i];
+            if (input.tail(a) == cch.order[x] && d + metric.input_weight[a] > limit)
+            {
+                boundary_arcs.push_back(a);
+                boundary_offsets.push_back(limit - d);
+            }
+        }
+    };
+
+    while (!query.heap.empty())
+    {
+        unsigned x = query.heap.top();
+        query.heap.pop();
+        query.queued[x] = false;
+        unsigned d = query.dist[x];
+        if (d > limit)
+            continue;
+
+        nodes.push_back(cch.order[x]);
+        distances.push_back(d);
+
+        for (unsigned j = cch.down_first_out[x]; j < cch.down_first_out[x + 1]; ++j)
+        {
+            unsigned z = cch.down_head[j];
+            unsigned arc = cch.down_to_up[j];
+            unsigned nd = d + metric.backward[arc];
+            if (nd <= limit && nd < query.dist[z])
+            {
+                if (query.dist[z] == inf_weight)
+                    query.touched.push_back(z);
+                query.dist[z] = nd;
+                if (!query.queued[z])
+                {
+                    query.queued[z] = true;
+                    query.heap.push(z);
+                }
+            }
+        }
+
+        if (with_boundary)
+        {
+            for (unsigned arc = cch.up_first_out[x]; arc < cch.up_first_out[x + 1]; ++arc)
+                report_boundary(arc, x, d);
+            for (unsigned j = cch.down_first_out[x]; j < cch.down_first_out[x + 1]; ++j)
+                report_boundary(cch.down_to_up[j], x, d);
+        }
+    }
+
+    for (unsigned x : query.touched)
+        query.dist[x] = inf_weight;
+    query.touched.clear();
+}
+
+void cch_range_query_run(CCHRangeQuery &query,
+                         rust::Slice<const uint32_t> sources,
+                         rust::Slice<const uint32_t> limits,
+                         bool with_boundary,
+                         rust::Vec<uint32_t> &first,
+                         rust::Vec<uint32_t> &nodes,
+                         rust::Vec<uint32_t> &distances,
+                         rust::Vec<uint32_t> &boundary_first,
+                         rust::Vec<uint32_t> &boundary_arcs,
+                         rust::Vec<uint32_t> &boundary_offsets)
+{
+    first.clear();
+    nodes.clear();
+    distances.clear();
+    boundary_first.clear();
+    boundary_arcs.clear();
+    boundary_offsets.clear();
+    first.push_back(0);
+    boundary_first.push_back(0);
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        run_range_query(query, sources[i], limits[i], with_boundary, nodes, distances, boundary_arcs, boundary_offsets);
+        first.push_back(nodes.size());
+        boundary_first.push_back(boundary_arcs.size());
+    }
+}
@@ -0,0 +1,354 @@
+#include "cch_search.h"
+
+#include <algorithm>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+using namespace RoutingKit;
+
+CCHInputArcs::CCHInputArcs(const CustomizableContractionHierarchy &cch,
+                           const std::vector<unsigned> &tail,
+                           const std::vector<unsigned> &head)
+    : cch(&cch)
+{
+    // Keep the endpoints of every arc that its CCH arc does not reproduce; loops and filtered
+    // arcs have no CCH arc.
+    for (unsigned a = 0; a < tail.size(); ++a)
+    {
+        unsigned c = cch.input_arc_to_cch_arc[a];
+        if (c != invalid_id && endpoint(a, true) == tail[a] && endpoint(a, false) == head[a])
+            continue;
+        unmapped_arc.push_back(a);
+        unmapped_tail.push_back(tail[a]);
+        unmapped_head.push_back(head[a]);
+    }
+}
+
+CCHInputArcs::CCHInputArcs(const CCHInputArcs &other, const CustomizableContractionHierarchy &cch)
+    : cch(&cch), unmapped_arc(other.unmapped_arc), unmapped_tail(other.unmapped_tail), unmapped_head(other.unmapped_head)
+{
+}
+
+const CCHInputArcs::Index &CCHInputArcs::index() const
+{
+    std::call_once(index_once, [&]
+                   {
+        // Counting sort of the input arcs by CCH arc; arcs without one are left out.
+        const unsigned arc_count = count();
+        index_.first_of_cch_arc.assign(cch->cch_arc_count() + 1, 0);
+        for (unsigned a = 0; a < arc_count; ++a)
+            if (cch->input_arc_to_cch_arc[a] != invalid_id)
+                ++index_.first_of_cch_arc[cch->input_arc_to_cch_arc[a] + 1];
+        for (size_t i = 1; i < index_.first_of_cch_arc.size(); ++i)
+            index_.first_of_cch_arc[i] += index_.first_of_cch_arc[i - 1];
+
+        index_.input_arc.resize(index_.first_of_cch_arc.back());
+        std::vector<unsigned> fill(index_.first_of_cch_arc.begin(), index_.first_of_cch_arc.end() - 1);
+        for (unsigned a = 0; a < arc_count; ++a)
+            if (cch->input_arc_to_cch_arc[a] != invalid_id)
+                index_.input_arc[fill[cch->input_arc_to_cch_arc[a]]++] = a;
+        index_built = true; });
+    return index_;
+}
+
+size_t CCHInputArcs::memory_bytes() const
+{
+    size_t bytes = (unmapped_arc.size() + unmapped_tail.size() + unmapped_head.size()) * sizeof(unsigned);
+    if (index_built)
+        bytes += (index_.first_of_cch_arc.size() + index_.input_arc.size()) * sizeof(unsigned);
+    return bytes;
+}
+
+void EliminationTreeSearch::init(unsigned node_count)
+{
+    if (label.size() == node_count)
+        return;
+    label.assign(node_count, {inf_weight, invalid_id, 0});
+    generation = 1;
+    space.clear();
+}
+
+void EliminationTreeSearch::reset()
+{
+    space.clear();
+    if (++generation == 0)
+    {
+        // Wrapped around: stamps from 2^32 resets ago would look current again.
+        for (Label &l : label)
+            l.generation = 0;
+        generation = 1;
+    }
+}
+
+void EliminationTreeSearch::add_source(unsigned r, unsigned d)
+{
+    if (claim(r))
+        space.push_back(r);
+    if (d < label[r].dist)
+    {
+        label[r].dist = d;
+        label[r].pred_arc = invalid_id;
+    }
+}
+
+void EliminationTreeSearch::collect_space(const CustomizableContractionHierarchy &cch)
+{
+    // Collect the union of the ancestor paths; stop a walk once it joins a known path.
+    const size_t source_count = space.size();
+    for (size_t i = 0; i < source_count; ++i)
+    {
+        unsigned x = cch.elimination_tree_parent[space[i]];
+        while (x != invalid_id && claim(x))
+        {
+            space.push_back(x);
+            x = cch.elimination_tree_parent[x];
+        }
+    }
+    if (source_count > 1)
+        std::sort(space.begin(), space.end());
+}
+
+void EliminationTreeSearch::run(const CustomizableContractionHierarchy &cch, const std::vector<unsigned> &weight)
+{
+    run_with(cch, [&](unsigned a)
+             { return weight[a]; });
+}
+
+void EliminationTreeSearch::run_on_space_of(const EliminationTreeSearch &other,
+                                            const CustomizableContractionHierarchy &cch,
+                                            const std::vector<unsigned> &weight)
+{
+    reset();
+    for (unsigned x : other.space)
+        claim(x);
+    space = other.space;
+    if (!space.empty())
+        label[space.front()].dist = 0;
+    relax(cch, [&](unsigned a)
+          { return weight[a]; });
+}
+
+void PinnedSearchSpaces::clear()
+{
+    node.clear();
+    begin.clear();
+    end.clear();
+    rank.clear();
+    dist.clear();
+    free_slots.clear();
+    garbage = 0;
+}
+
+unsigned PinnedSearchSpaces::add(const CustomizableContractionHierarchy &cch,
+                                 const std::vector<unsigned> &weight,
+                                 EliminationTreeSearch &search,
+                                 unsigned n)
+{
+    unsigned slot;
+    if (free_slots.empty())
+    {
+        slot = node.size();
+        node.push_back(n);
+        begin.push_back(0);
+        end.push_back(0);
+    }
+    else
+    {
+        slot = free_slots.back();
+        free_slots.pop_back();
+        node[slot] = n;
+    }
+
+    search.reset();
+    search.add_source(cch.rank[n], 0);
+    search.run(cch, weight);
+    begin[slot] = rank.size();
+    for (unsigned x : search.search_space())
+    {
+        if (search.distance(x) < inf_weight)
+        {
+            rank.push_back(x);
+            dist.push_back(search.distance(x));
+        }
+    }
+    end[slot] = rank.size();
+    return slot;
+}
+
+bool PinnedSearchSpaces::remove(unsigned slot)
+{
+    if (slot >= node.size() || node[slot] == invalid_id)
+        return false;
+    node[slot] = invalid_id;
+    garbage += end[slot] - begin[slot];
+    begin[slot] = end[slot] = 0;
+    free_slots.push_back(slot);
+
+    if (garbage > rank.size() - garbage)
+    {
+        std::vector<unsigned> new_rank, new_dist;
+        new_rank.reserve(rank.size() - garbage);
+        new_dist.reserve(rank.size() - garbage);
+        for (unsigned i = 0; i < node.size(); ++i)
+        {
+            unsigned b = new_rank.size();
+            new_rank.insert(new_rank.end(), rank.begin() + begin[i], rank.begin() + end[i]);
+            new_dist.insert(new_dist.end(), dist.begin() + begin[i], dist.begin() + end[i]);
+            begin[i] = b;
+            end[i] = new_rank.size();
+        }
+        rank.swap(new_rank);
+        dist.swap(new_dist);
+        garbage = 0;
+    }
+    return true;
+}
+
+namespace
+{
+    unsigned min_meeting_distance(const unsigned *rank,
+                                  const unsigned *dist,
+                                  unsigned count,
+                                  const unsigned *label)
+    {
+        // Labels are at most inf_weight = 2^31 - 1, so sums cannot overflow 32 bits.
+        unsigned best = inf_weight;
+        unsigned i = 0;
+#ifdef __AVX2__
+        __m256i best8 = _mm256_set1_epi32(static_cast<int>(inf_weight));
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rank + i));
+            __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dist + i));
+            __m256i l = _mm256_i32gather_epi32(reinterpret_cast<const int *>(label), r, 4);
+            best8 = _mm256_min_epu32(best8, _mm256_add_epi32(d, l));
+        }
+        alignas(32) unsigned lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), best8);
+        for (unsigned l : lanes)
+            best = std::min(best, l);
+#endif
+        for (; i < count; ++i)
+            best = std::min(best, dist[i] + label[rank[i]]);
+        return std::min(best, inf_weight);
+    }
+}
+
+void PinnedSearchSpaces::gather(const unsigned *label, unsigned *out) const
+{
+    for (unsigned i = 0; i < node.size(); ++i)
+        out[i] = min_meeting_distance(rank.data() + begin[i], dist.data() + begin[i], end[i] - begin[i], label);
+}
+
+unsigned cch_point_to_point(const CustomizableContractionHierarchyMetric &metric,
+                            EliminationTreeSearch &forward,
+                            EliminationTreeSearch &backward,
+                            unsigned source_rank,
+                            unsigned target_rank,
+                            unsigned &meeting_rank)
+{
+    const CustomizableContractionHierarchy &cch = *metric.cch;
+    forward.init(cch.node_count());
+    backward.init(cch.node_count());
+    forward.reset();
+    backward.reset();
+    forward.add_source(source_rank, 0);
+    backward.add_source(target_rank, 0);
+    forward.run(cch, metric.forward);
+    backward.run(cch, metric.backward);
+
+    unsigned best = inf_weight;
+    meeting_rank = invalid_id;
+    for (unsigned x : forward.search_space())
+    {
+        unsigned d = forward.distance(x) + backward.distance(x);
+        if (d < best)
+        {
+            best = d;
+            meeting_rank = x;
+        }
+    }
+    return best;
+}
+
+void cch_unpack_arc(const CustomizableContractionHierarchyMetric &metric,
+                    const CCHInputArcs &input,
+                    unsigned arc,
+                    bool upward,
+                    std::vector<unsigned> &out)
+{
+    const CustomizableContractionHierarchy &cch = *metric.cch;
+    const unsigned x = cch.up_tail[arc];
+    const unsigned y = cch.up_head[arc];
+    const unsigned w = upward ? metric.forward[arc] : metric.backward[arc];
+
+    const CCHInputArcs::Index &index = input.index();
+    for (unsigned i = index.first_of_cch_arc[arc]; i < index.first_of_cch_arc[arc + 1]; ++i)
+    {
+        unsigned a = index.input_arc[i];
+        if (input.is_upward(a) == upward && metric.input_weight[a] == w)
+        {
+            out.push_back(a);
+            return;
+        }
+    }
+
+    // Shortcut: find the lower triangle (z, x, y) that realizes the weight.
+    for (unsigned j = cch.down_first_out[x]; j < cch.down_first_out[x + 1]; ++j)
+    {
+        unsigned z = cch.down_head[j];
+        unsigned zx = cch.down_to_up[j];
+        unsigned zy = invalid_id;
+        for (unsigned i = cch.up_first_out[z]; i < cch.up_first_out[z + 1]; ++i)
+        {
+            if (cch.up_head[i] == y)
+            {
+                zy = i;
+                break;
+            }
+        }
+        if (zy == invalid_id)
+            continue;
+        if (upward && metric.backward[zx] + metric.forward[zy] == w)
+        {
+            cch_unpack_arc(metric, input, zx, false, out);
+            cch_unpack_arc(metric, input, zy, true, out);
+            return;
+        }
+        if (!upward && metric.backward[zy] + metric.forward[zx] == w)
+        {
+            cch_unpack_arc(metric, input, zy, false, out);
+            cch_unpack_arc(metric, input, zx, true, out);
+            return;
+        }
+    }
+}
+
+void cch_unpack_path(const CustomizableContractionHierarchyMetric &metric,
+                     const CCHInputArcs &input,
+                     const EliminationTreeSearch &forward,
+                     const EliminationTreeSearch &backward,
+                     unsigned meeting_rank,
+                     std::vector<unsigned> &out)
+{
+    const CustomizableContractionHierarchy &cch = *metric.cch;
+
+    std::vector<unsigned> up;
+    for (unsigned x = meeting_rank; forward.predecessor_arc(x) != invalid_id;)
+    {
+        unsigned a = forward.predecessor_arc(x);
+        up.push_back(a);
+        x = cch.up_tail[a];
+    }
+    for (auto i = up.rbegin(); i != up.rend(); ++i)
+        cch_unpack_arc(metric, input, *i, true, out);
+
+    for (unsigned x = meeting_rank; backward.predecessor_arc(x) != invalid_id;)
+    {
+        unsigned a = backward.predecessor_arc(x);
+        cch_unpack_arc(metric, input, a, false, out);
+        x = cch.up_tail[a];
+    }
+}
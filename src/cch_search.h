@@ -0,0 +1,209 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+#include <routingkit/customizable_contraction_hierarchy.h>
+#include <routingkit/constants.h>
+
+// Building blocks for the query extensions that work directly on the public CCH arrays
+// (up/down graphs, elimination tree, customized forward/backward weights).
+// Node ids are CCH ranks unless stated otherwise.
+
+// Input arc lookups on top of RoutingKit's input_arc_to_cch_arc and is_input_arc_upward, so
+// that unpacked paths can be reported as input arcs and node sequences. Endpoints are read from
+// the CCH arc of an input arc; only arcs for which that does not give them (loops, filtered
+// arcs) keep their own here. The CCH arc -> input arcs index is built on first use.
+class CCHInputArcs
+{
+public:
+    struct Index
+    {
+        std::vector<unsigned> first_of_cch_arc; // size = cch_arc_count + 1
+        std::vector<unsigned> input_arc;        // input arc ids grouped by CCH arc
+    };
+
+    CCHInputArcs(const RoutingKit::CustomizableContractionHierarchy &cch,
+                 const std::vector<unsigned> &tail,
+                 const std::vector<unsigned> &head);
+    // Same lookups for `cch`, a copy of the CCH of `other`.
+    CCHInputArcs(const CCHInputArcs &other, const RoutingKit::CustomizableContractionHierarchy &cch);
+
+    unsigned count() const { return cch->input_arc_count(); }
+    // Input node ids.
+    unsigned tail(unsigned a) const { return endpoint(a, true); }
+    unsigned head(unsigned a) const { return endpoint(a, false); }
+    bool is_upward(unsigned a) const
+    {
+        return is_unmapped(a) ? cch->rank[tail(a)] < cch->rank[head(a)] : cch->is_input_arc_upward.is_set(a);
+    }
+    // Thread-safe; builds the index on the first call.
+    const Index &index() const;
+    size_t memory_bytes() const;
+
+private:
+    bool is_unmapped(unsigned a) const { return std::binary_search(unmapped_arc.begin(), unmapped_arc.end(), a); }
+    unsigned endpoint(unsigned a, bool of_tail) const
+    {
+        if (!unmapped_arc.empty())
+        {
+            auto it = std::lower_bound(unmapped_arc.begin(), unmapped_arc.end(), a);
+            if (it != unmapped_arc.end() && *it == a)
+                return (of_tail ? unmapped_tail : unmapped_head)[it - unmapped_arc.begin()];
+        }
+        unsigned c = cch->input_arc_to_cch_arc[a];
+        return cch->order[cch->is_input_arc_upward.is_set(a) == of_tail ? cch->up_tail[c] : cch->up_head[c]];
+    }
+
+    const RoutingKit::CustomizableContractionHierarchy *cch;
+    std::vector<unsigned> unmapped_arc, unmapped_tail, unmapped_head; // sorted by arc
+    mutable std::once_flag index_once;
+    mutable std::atomic<bool> index_built{false};
+    mutable Index index_;
+};
+
+// One side of a CCH query: relaxes the upward arcs along the elimination tree ancestors of
+// the sources. Labels carry the generation that wrote them; reset() bumps the generation, so it
+// is O(1) and labels of older generations read as inf_weight / not in the search space.
+class EliminationTreeSearch
+{
+public:
+    // Allocate labels for `node_count` nodes; no-op if already sized.
+    void init(unsigned node_count);
+    void reset();
+    // Continue counting from `g` (> 0, after init, not below the current generation), so tests
+    // can reach the wrap-around.
+    void set_generation(unsigned g)
+    {
+        generation = g;
+        space.clear();
+    }
+    void add_source(unsigned r, unsigned dist);
+    // weight: metric.forward for a search from sources, metric.backward towards targets.
+    void run(const RoutingKit::CustomizableContractionHierarchy &cch, const std::vector<unsigned> &weight);
+    // Same as run() with weights read through `weight(arc)`, e.g. from a quantized metric.
+    template <class WeightFn>
+    void run_with(const RoutingKit::CustomizableContractionHierarchy &cch, const WeightFn &weight);
+    // Same as run() from the single source of `other`, which was run from one source in either
+    // direction. The ancestor path does not depend on the direction, so it is copied instead of
+    // walked again.
+    void run_on_space_of(const EliminationTreeSearch &other,
+                         const RoutingKit::CustomizableContractionHierarchy &cch,
+                         const std::vector<unsigned> &weight);
+
+    unsigned distance(unsigned r) const { return label[r].generation == generation ? label[r].dist : RoutingKit::inf_weight; }
+    unsigned predecessor_arc(unsigned r) const { return label[r].generation == generation ? label[r].pred_arc : RoutingKit::invalid_id; }
+    // Ranks of the search space in ascending order (valid after run()).
+    const std::vector<unsigned> &search_space() const { return space; }
+
+private:
+    // Extend the sources to the union of their ancestor paths, in ascending rank order.
+    void collect_space(const RoutingKit::CustomizableContractionHierarchy &cch);
+    // Relax the upward arcs of the collected space in ascending rank order.
+    template <class WeightFn>
+    void relax(const RoutingKit::CustomizableContractionHierarchy &cch, const WeightFn &weight);
+
+    struct Label
+    {
+        unsigned dist;
+        unsigned pred_arc;
+        unsigned generation; // labels of the current generation are exactly the search space
+    };
+    // Start a label of the current generation; returns false if it already is one.
+    bool claim(unsigned r)
+    {
+        if (label[r].generation == generation)
+            return false;
+        label[r] = {RoutingKit::inf_weight, RoutingKit::invalid_id, generation};
+        return true;
+    }
+
+    std::vector<Label> label;
+    unsigned generation = 1;
+    std::vector<unsigned> space;
+};
+
+template <class WeightFn>
+void EliminationTreeSearch::run_with(const RoutingKit::CustomizableContractionHierarchy &cch, const WeightFn &weight)
+{
+    collect_space(cch);
+    relax(cch, weight);
+}
+
+template <class WeightFn>
+void EliminationTreeSearch::relax(const RoutingKit::CustomizableContractionHierarchy &cch, const WeightFn &weight)
+{
+    // Upward heads are ancestors, so every label read here is of the current generation.
+    for (unsigned x : space)
+    {
+        if (label[x].dist >= RoutingKit::inf_weight)
+            continue;
+        for (unsigned a = cch.up_first_out[x]; a < cch.up_first_out[x + 1]; ++a)
+        {
+            unsigned y = cch.up_head[a];
+            unsigned d = label[x].dist + weight(a);
+            if (d < label[y].dist)
+            {
+                label[y].dist = d;
+                label[y].pred_arc = a;
+            }
+        }
+    }
+}
+
+// Upward search spaces of pinned nodes, addressed by stable slots so that single nodes can be
+// added and removed without touching the others. Labels of all slots share one pool; removed
+// slots leave garbage that is compacted once it outweighs the live labels, so updates cost
+// O(search space) amortized. Freed slots are reused by later adds.
+class PinnedSearchSpaces
+{
+public:
+    void clear();
+    // Run `search` (initialized for the CCH) from `node` and store its labels. Returns the slot.
+    unsigned add(const RoutingKit::CustomizableContractionHierarchy &cch,
+                 const std::vector<unsigned> &weight,
+                 EliminationTreeSearch &search,
+                 unsigned node);
+    // Returns false if the slot is not in use.
+    bool remove(unsigned slot);
+
+    unsigned slot_count() const { return node.size(); }
+    // For every slot: min over its labels (r, d) of d + label[r]; inf_weight for free slots.
+    // `label` is a dense per-rank array that is inf_weight outside the other search space.
+    void gather(const unsigned *label, unsigned *out) const;
+
+private:
+    std::vector<unsigned> node;        // per slot, invalid_id if free
+    std::vector<unsigned> begin, end;  // per slot, label range in the pool
+    std::vector<unsigned> rank, dist;  // pool
+    std::vector<unsigned> free_slots;
+    unsigned garbage = 0;
+};
+
+// Run a point-to-point query with the two searches (which are reset first).
+// Returns the distance (inf_weight if unreachable) and stores the meeting rank.
+unsigned cch_point_to_point(const RoutingKit::CustomizableContractionHierarchyMetric &metric,
+                            EliminationTreeSearch &forward,
+                            EliminationTreeSearch &backward,
+                            unsigned source_rank,
+                            unsigned target_rank,
+                            unsigned &meeting_rank);
+
+// Append the input arcs of a CCH arc in travel order. `upward` selects tail->head (forward
+// weight), otherwise head->tail (backward weight).
+void cch_unpack_arc(const RoutingKit::CustomizableContractionHierarchyMetric &metric,
+                    const CCHInputArcs &input,
+                    unsigned arc,
+                    bool upward,
+                    std::vector<unsigned> &out);
+
+// Append the input arcs of the up-down path source -> meeting -> target found by the two
+// searches.
+void cch_unpack_path(const RoutingKit::CustomizableContractionHierarchyMetric &metric,
+                     const CCHInputArcs &input,
+                     const EliminationTreeSearch &forward,
+                     const EliminationTreeSearch &backward,
+                     unsigned meeting_rank,
+                     std::vector<unsigned> &out);
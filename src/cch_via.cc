@@ -0,0 +1,92 @@
+#include "routingkit_cch_wrapper.h"
+#include "cch_search.h"
+
+#include <routingkit/constants.h>
+
+using namespace RoutingKit;
+
+// Routes through a sequence of stops p_0, ..., p_{k-1}. Leg i meets the forward search from
+// p_i with the backward search from p_{i+1}. The forward search of the next leg starts from
+// the same node as that backward search, so it reuses its search space (the elimination tree
+// ancestors of p_{i+1}) and only the relaxation is repeated with the forward weights. Each
+// stop is thus walked up once and searched once per direction, and all legs share the scratch
+// of the query and the output vectors.
+
+void cch_query_run_via(CCHQuery &query,
+                       rust::Slice<const uint32_t> points,
+                       rust::Vec<uint32_t> &distances,
+                       rust::Vec<uint32_t> &arcs,
+                       rust::Vec<uint32_t> &arc_first,
+                       rust::Vec<uint32_t> &nodes,
+                       rust::Vec<uint32_t> &node_first)
+{
+    const CustomizableContractionHierarchyMetric &metric = query.metric->inner;
+    const CustomizableContractionHierarchy &cch = *metric.cch;
+    const CCHInputArcs &input = query.metric->cch->input_arcs;
+    distances.clear();
+    arcs.clear();
+    arc_first.clear();
+    nodes.clear();
+    node_first.clear();
+    if (points.empty())
+        return;
+    distances.reserve(points.size() - 1);
+    arc_first.reserve(points.size());
+    node_first.reserve(points.size());
+
+    EliminationTreeSearch &forward = query.forward;
+    EliminationTreeSearch &backward = query.backward;
+    forward.init(cch.node_count());
+    backward.init(cch.node_count());
+    forward.reset();
+    forward.add_source(cch.rank[points[0]], 0);
+    forward.run(cch, metric.forward);
+
+    std::vector<unsigned> leg;
+    arc_first.push_back(0);
+    node_first.push_back(0);
+    nodes.push_back(points[0]);
+    for (size_t i = 0; i + 1 < points.size(); ++i)
+    {
+        if (points[i] == points[i + 1])
+        {
+            distances.push_back(0);
+            arc_first.push_back(arcs.size());
+            node_first.push_back(nodes.size() - 1);
+            continue;
+        }
+        backward.reset();
+        backward.add_source(cch.rank[points[i + 1]], 0);
+        backward.run(cch, metric.backward);
+
+        unsigned best = inf_weight, meeting = invalid_id;
+        for (unsigned x : forward.search_space())
+        {
+            unsigned d = forward.distance(x) + backward.distance(x);
+            if (d < best)
+            {
+                best = d;
+                meeting = x;
+            }
+        }
+        distances.push_back(best);
+        if (best < inf_weight)
+        {
+            leg.clear();
+            cch_unpack_path(metric, input, forward, backward, meeting, leg);
+            for (unsigned a : leg)
+            {
+                arcs.push_back(a);
+                nodes.push_back(input.head(a));
+            }
+        }
+        else
+        {
+            // Unreachable: the node sequence jumps to the next stop.
+            nodes.push_back(points[i + 1]);
+        }
+        arc_first.push_back(arcs.size());
+        node_first.push_back(nodes.size() - 1);
+        forward.run_on_space_of(backward, cch, metric.forward);
+    }
+}
@@ -0,0 +1,177 @@
+#include "routingkit_cch_wrapper.h"
+
+#include <routingkit/constants.h>
+#include <functional>
+
+using namespace RoutingKit;
+
+// Batched distances on a CH.
+//   Many-to-many: every target runs a backward upward search and leaves (target, distance)
+//   in a bucket at each settled node; every source then runs a forward upward search and
+//   scans the buckets of its settled nodes. Cost is |S| + |T| upward searches plus the bucket
+//   scans, independent of the graph size.
+//   PHAST: one forward upward search from the source, then a single sweep over all nodes in
+//   decreasing rank that pulls the distance of each node from its higher neighbors. Arcs of
+//   the backward side stored at a node y point to higher nodes x and stand for x -> y, so they
+//   are exactly the downward arcs into y and no extra graph is needed.
+
+namespace
+{
+    void ensure_scratch(CHBatchQuery &q)
+    {
+        unsigned node_count = q.ch->inner.node_count();
+        if (q.distance.size() == node_count)
+            return;
+        q.distance.assign(node_count, inf_weight);
+        q.generation_of.assign(node_count, 0);
+        q.bucket_begin.assign(node_count, 0);
+        q.bucket_round_of.assign(node_count, 0);
+        q.generation = 0;
+        q.bucket_round = 0;
+    }
+
+    unsigned &label(CHBatchQuery &q, unsigned x)
+    {
+        if (q.generation_of[x] != q.generation)
+        {
+            q.generation_of[x] = q.generation;
+            q.distance[x] = inf_weight;
+        }
+        return q.distance[x];
+    }
+
+    // Dijkstra on the upward arcs of one side with stall-on-demand. Fills q.settled with the
+    // nodes whose distance is not stalled; stalled nodes can never be the top node of a
+    // shortest up-down path, so dropping them keeps buckets and sweeps exact.
+    void upward_search(CHBatchQuery &q, bool forward, unsigned source)
+    {
+        const ContractionHierarchy &ch = q.ch->inner;
+        const ContractionHierarchySide &up = forward ? ch.forward : ch.backward;
+        const ContractionHierarchySide &down = forward ? ch.backward : ch.forward;
+        if (++q.generation == 0)
+        {
+            std::fill(q.generation_of.begin(), q.generation_of.end(), 0);
+            q.generation = 1;
+        }
+        q.heap.clear();
+        q.settled.clear();
+        label(q, source) = 0;
+        q.heap.push_back({0, source});
+        while (!q.heap.empty())
+        {
+            std::pop_heap(q.heap.begin(), q.heap.end(), std::greater<std::pair<unsigned, unsigned>>());
+            std::pair<unsigned, unsigned> top = q.heap.back();
+            q.heap.pop_back();
+            unsigned x = top.second;
+            if (top.first != q.distance[x])
+                continue;
+            bool stalled = false;
+            for (unsigned a = down.first_out[x]; a < down.first_out[x + 1] && !stalled; ++a)
+            {
+                unsigned y = down.head[a];
+                stalled = q.generation_of[y] == q.generation && q.distance[y] != inf_weight &&
+                          q.distance[y] + down.weight[a] < top.first;
+            }
+            if (stalled)
+                continue;
+            q.settled.push_back({x, top.first});
+            for (unsigned a = up.first_out[x]; a < up.first_out[x + 1]; ++a)
+            {
+                unsigned y = up.head[a];
+                unsigned d = top.first + up.weight[a];
+                unsigned &ly = label(q, y);
+                if (d < ly)
+                {
+                    ly = d;
+                    q.heap.push_back({d, y});
+                    std::push_heap(q.heap.begin(), q.heap.end(), std::greater<std::pair<unsigned, unsigned>>());
+                }
+            }
+        }
+    }
+}
+
+uint32_t ch_node_count(const CH &ch)
+{
+    return ch.inner.node_count();
+}
+
+std::unique_ptr<CHBatchQuery> ch_batch_query_new(const CH &ch)
+{
+    return std::unique_ptr<CHBatchQuery>(new CHBatchQuery(ch));
+}
+
+void ch_batch_query_matrix(CHBatchQuery &q,
+                           rust::Slice<const uint32_t> sources,
+                           rust::Slice<const uint32_t> targets,
+                           rust::Slice<uint32_t> dists)
+{
+    const ContractionHierarchy &ch = q.ch->inner;
+    ensure_scratch(q);
+    std::fill(dists.begin(), dists.end(), inf_weight);
+    if (sources.empty() || targets.empty())
+        return;
+
+    q.buckets.clear();
+    for (unsigned j = 0; j < targets.size(); ++j)
+    {
+        upward_search(q, false, ch.rank[targets[j]]);
+        for (const std::pair<unsigned, unsigned> &s : q.settled)
+            q.buckets.push_back({s.first, j, s.second});
+    }
+    std::sort(q.buckets.begin(), q.buckets.end(), [](const CHBatchQuery::Bucket &l, const CHBatchQuery::Bucket &r)
+              { return l.node < r.node; });
+    if (++q.bucket_round == 0)
+    {
+        std::fill(q.bucket_round_of.begin(), q.bucket_round_of.end(), 0);
+        q.bucket_round = 1;
+    }
+    for (unsigned i = q.buckets.size(); i-- > 0;)
+    {
+        q.bucket_begin[q.buckets[i].node] = i;
+        q.bucket_round_of[q.buckets[i].node] = q.bucket_round;
+    }
+
+    for (unsigned i = 0; i < sources.size(); ++i)
+    {
+        uint32_t *row = dists.data() + (size_t)i * targets.size();
+        upward_search(q, true, ch.rank[sources[i]]);
+        for (const std::pair<unsigned, unsigned> &s : q.settled)
+        {
+            if (q.bucket_round_of[s.first] != q.bucket_round)
+                continue;
+            for (unsigned b = q.bucket_begin[s.first]; b < q.buckets.size() && q.buckets[b].node == s.first; ++b)
+            {
+                unsigned d = s.second + q.buckets[b].distance;
+                if (d < row[q.buckets[b].target])
+                    row[q.buckets[b].target] = d;
+            }
+        }
+    }
+}
+
+void ch_batch_query_one_to_all(CHBatchQuery &q, uint32_t s, rust::Slice<uint32_t> dists)
+{
+    const ContractionHierarchy &ch = q.ch->inner;
+    const ContractionHierarchySide &down = ch.backward;
+    unsigned node_count = ch.node_count();
+    ensure_scratch(q);
+    upward_search(q, true, ch.rank[s]);
+
+    q.sweep.assign(node_count, inf_weight);
+    for (const std::pair<unsigned, unsigned> &x : q.settled)
+        q.sweep[x.first] = x.second;
+    for (unsigned y = node_count; y-- > 0;)
+    {
+        unsigned d = q.sweep[y];
+        for (unsigned a = down.first_out[y]; a < down.first_out[y + 1]; ++a)
+        {
+            unsigned dx = q.sweep[down.head[a]];
+            if (dx != inf_weight && dx + down.weight[a] < d)
+                d = dx + down.weight[a];
+        }
+        q.sweep[y] = d;
+    }
+    for (unsigned v = 0; v < node_count; ++v)
+        dists[v] = q.sweep[ch.rank[v]];
+}
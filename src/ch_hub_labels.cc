@@ -0,0 +1,361 @@
+#include "routingkit_cch_wrapper.h"
+#include "mapped_file.h"
+#include "omp_threads.h"
+
+#include <routingkit/constants.h>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+
+using namespace RoutingKit;
+
+// Hub labels from a CH, built top-down: the forward label of x is (x, 0) plus the labels of
+// its upward neighbors shifted by the arc weight, and an entry (h, d) is dropped when the
+// labels already known prove a shorter x -> h distance through another hub (bootstrapped
+// pruning; the backward label of h is final because h is higher than x). Nodes whose upward
+// neighbors are all done form a level and are labeled in parallel. A query is the minimum of
+// d_f + d_b over the hubs common to the forward label of s and the backward label of t.
+//
+// The mapped format is a header page followed by the six flat label arrays (u64 first, u32 hub,
+// u32 dist per side; not compressed, so queries can intersect them with SIMD), each on a page
+// boundary, like the mapped CH format of ch_mapped.cc. Opening validates like mapped_ch_open.
+
+namespace
+{
+    const char magic[8] = {'R', 'K', 'H', 'U', 'B', 'L', 'B', '1'};
+    const uint32_t format_version = 1;
+    const uint32_t byte_order_mark = 0x01020304;
+    const unsigned section_count = 6; // first, hub, dist; forward side first
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version, byte_order;
+        uint32_t node_count, reserved;
+        uint64_t forward_entry_count, backward_entry_count;
+        uint64_t file_size;
+        MappedFileSection section[section_count];
+        uint64_t header_checksum; // of all bytes above
+    };
+
+    uint64_t header_checksum(const Header &h)
+    {
+        return mapped_file_checksum(&h, offsetof(Header, header_checksum));
+    }
+
+    struct Entry
+    {
+        unsigned hub, dist;
+    };
+    using Label = std::vector<Entry>;
+
+    // Shortest distance through a common hub other than `skip`.
+    unsigned min_via(const Label &a, const Label &b, unsigned skip)
+    {
+        unsigned best = inf_weight;
+        size_t i = 0, j = 0;
+        while (i < a.size() && j < b.size())
+        {
+            if (a[i].hub < b[j].hub)
+                ++i;
+            else if (a[i].hub > b[j].hub)
+                ++j;
+            else
+            {
+                if (a[i].hub != skip)
+                    best = std::min(best, a[i].dist + b[j].dist);
+                ++i;
+                ++j;
+            }
+        }
+        return best;
+    }
+
+    // Label of rank x on one side from the final labels of its upward neighbors, pruned against
+    // the final labels of the other side.
+    void build_label(const ContractionHierarchySide &up, const std::vector<Label> &same, const std::vector<Label> &other,
+                     unsigned x, Label &candidate, Label &out)
+    {
+        candidate.clear();
+        candidate.push_back({x, 0});
+        for (unsigned a = up.first_out[x]; a < up.first_out[x + 1]; ++a)
+            for (const Entry &e : same[up.head[a]])
+                candidate.push_back({e.hub, e.dist + up.weight[a]});
+        std::sort(candidate.begin(), candidate.end(), [](const Entry &l, const Entry &r)
+                  { return l.hub < r.hub || (l.hub == r.hub && l.dist < r.dist); });
+        candidate.erase(std::unique(candidate.begin(), candidate.end(), [](const Entry &l, const Entry &r)
+                                    { return l.hub == r.hub; }),
+                        candidate.end());
+
+        out.clear();
+        for (const Entry &e : candidate)
+            if (e.hub == x || min_via(candidate, other[e.hub], e.hub) >= e.dist)
+                out.push_back(e);
+        out.shrink_to_fit();
+    }
+
+    void flatten(const ContractionHierarchy &ch, const std::vector<Label> &labels, int threads,
+                 std::vector<uint64_t> &first, std::vector<uint32_t> &hub, std::vector<uint32_t> &dist)
+    {
+        const unsigned n = ch.node_count();
+        first.assign(n + 1, 0);
+        for (unsigned v = 0; v < n; ++v)
+            first[v + 1] = first[v] + labels[ch.rank[v]].size();
+        hub.resize(first[n]);
+        dist.resize(first[n]);
+        const long long node_count = n;
+        OMP_PRAGMA(omp parallel for num_threads(threads) schedule(dynamic, 1024))
+        for (long long v = 0; v < node_count; ++v)
+        {
+            uint64_t i = first[v];
+            for (const Entry &e : labels[ch.rank[v]])
+            {
+                hub[i] = e.hub;
+                dist[i] = e.dist;
+                ++i;
+            }
+        }
+    }
+
+    HubLabels::Side side_of(const uint64_t *first, const uint32_t *hub, const uint32_t *dist, uint64_t entry_count)
+    {
+        HubLabels::Side s;
+        s.first = first;
+        s.hub = hub;
+        s.dist = dist;
+        s.entry_count = entry_count;
+        return s;
+    }
+
+    bool side_is_valid(const HubLabels::Side &side, unsigned n)
+    {
+        if (!mapped_file_offsets_valid(side.first, n, side.entry_count))
+            return false;
+        for (unsigned v = 0; v < n; ++v)
+        {
+            for (uint64_t i = side.first[v]; i < side.first[v + 1]; ++i)
+                if (side.hub[i] >= n || (i > side.first[v] && side.hub[i] <= side.hub[i - 1]))
+                    return false;
+        }
+        return true;
+    }
+
+#ifdef __SSE4_1__
+    // Compares the hubs of a against b rotated by `rotation` lanes and folds the distance sums
+    // of the matching lanes into best; other lanes contribute all-ones.
+    template <int rotation>
+    inline __m128i min_of_matches(__m128i best, __m128i hub_a, __m128i dist_a, __m128i hub_b, __m128i dist_b)
+    {
+        __m128i rotated_hub = _mm_shuffle_epi32(hub_b, rotation);
+        __m128i rotated_dist = _mm_shuffle_epi32(dist_b, rotation);
+        __m128i miss = _mm_xor_si128(_mm_cmpeq_epi32(hub_a, rotated_hub), _mm_set1_epi32(-1));
+        return _mm_min_epu32(best, _mm_or_si128(_mm_add_epi32(dist_a, rotated_dist), miss));
+    }
+#endif
+
+    // min(dist_a + dist_b) over the hubs in both sorted arrays.
+    unsigned intersect(const uint32_t *hub_a, const uint32_t *dist_a, size_t size_a,
+                       const uint32_t *hub_b, const uint32_t *dist_b, size_t size_b)
+    {
+        unsigned best = inf_weight;
+        size_t i = 0, j = 0;
+#ifdef __SSE4_1__
+        // Blocks of four against four: all 16 pairs in four rotations, then advance the block
+        // with the smaller last hub (both on a tie).
+        __m128i best4 = _mm_set1_epi32(-1);
+        while (i + 4 <= size_a && j + 4 <= size_b)
+        {
+            __m128i ha = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hub_a + i));
+            __m128i da = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dist_a + i));
+            __m128i hb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hub_b + j));
+            __m128i db = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dist_b + j));
+            best4 = min_of_matches<_MM_SHUFFLE(3, 2, 1, 0)>(best4, ha, da, hb, db);
+            best4 = min_of_matches<_MM_SHUFFLE(0, 3, 2, 1)>(best4, ha, da, hb, db);
+            best4 = min_of_matches<_MM_SHUFFLE(1, 0, 3, 2)>(best4, ha, da, hb, db);
+            best4 = min_of_matches<_MM_SHUFFLE(2, 1, 0, 3)>(best4, ha, da, hb, db);
+            uint32_t last_a = hub_a[i + 3], last_b = hub_b[j + 3];
+            i += last_a <= last_b ? 4 : 0;
+            j += last_b <= last_a ? 4 : 0;
+        }
+        best4 = _mm_min_epu32(best4, _mm_shuffle_epi32(best4, _MM_SHUFFLE(1, 0, 3, 2)));
+        best4 = _mm_min_epu32(best4, _mm_shuffle_epi32(best4, _MM_SHUFFLE(2, 3, 0, 1)));
+        best = std::min(best, static_cast<unsigned>(_mm_cvtsi128_si32(best4)));
+#endif
+        while (i < size_a && j < size_b)
+        {
+            if (hub_a[i] < hub_b[j])
+                ++i;
+            else if (hub_a[i] > hub_b[j])
+                ++j;
+            else
+            {
+                best = std::min(best, dist_a[i] + dist_b[j]);
+                ++i;
+                ++j;
+            }
+        }
+        return best;
+    }
+}
+
+std::unique_ptr<HubLabels> hub_labels_build(const CH &ch_wrapper, uint32_t thread_count)
+{
+    const ContractionHierarchy &ch = ch_wrapper.inner;
+    const unsigned n = ch.node_count();
+    const int threads = omp_thread_count(thread_count);
+
+    // Height above the top of the upward graph, over both sides.
+    std::vector<unsigned> level(n, 0);
+    unsigned level_count = n == 0 ? 0 : 1;
+    for (unsigned x = n; x-- > 0;)
+    {
+        for (const ContractionHierarchySide *side : {&ch.forward, &ch.backward})
+            for (unsigned a = side->first_out[x]; a < side->first_out[x + 1]; ++a)
+                level[x] = std::max(level[x], level[side->head[a]] + 1);
+        level_count = std::max(level_count, level[x] + 1);
+    }
+    std::vector<unsigned> level_first(level_count + 1, 0), level_nodes(n);
+    for (unsigned x = 0; x < n; ++x)
+        ++level_first[level[x] + 1];
+    for (unsigned l = 0; l < level_count; ++l)
+        level_first[l + 1] += level_first[l];
+    {
+        std::vector<unsigned> fill(level_first.begin(), level_first.end() - 1);
+        for (unsigned x = 0; x < n; ++x)
+            level_nodes[fill[level[x]]++] = x;
+    }
+
+    std::vector<Label> forward(n), backward(n);
+    std::vector<Label> candidates(threads);
+    for (unsigned l = 0; l < level_count; ++l)
+    {
+        const long long begin = level_first[l], end = level_first[l + 1];
+        // Forward labels prune against backward labels of higher nodes and vice versa, so both
+        // sides of a level can be built in the same pass.
+        OMP_PRAGMA(omp parallel for num_threads(threads) schedule(dynamic, 16))
+        for (long long i = begin; i < end; ++i)
+        {
+            unsigned x = level_nodes[i];
+            Label &candidate = candidates[omp_thread_id()];
+            build_label(ch.forward, forward, backward, x, candidate, forward[x]);
+            build_label(ch.backward, backward, forward, x, candidate, backward[x]);
+        }
+    }
+
+    std::unique_ptr<HubLabels> labels(new HubLabels);
+    labels->node_count = n;
+    flatten(ch, forward, threads, labels->owned_first[0], labels->owned_hub[0], labels->owned_dist[0]);
+    std::vector<Label>().swap(forward);
+    flatten(ch, backward, threads, labels->owned_first[1], labels->owned_hub[1], labels->owned_dist[1]);
+    labels->forward = side_of(labels->owned_first[0].data(), labels->owned_hub[0].data(),
+                              labels->owned_dist[0].data(), labels->owned_hub[0].size());
+    labels->backward = side_of(labels->owned_first[1].data(), labels->owned_hub[1].data(),
+                               labels->owned_dist[1].data(), labels->owned_hub[1].size());
+    return labels;
+}
+
+HubLabels::~HubLabels()
+{
+    mapped_file_close(data, size);
+}
+
+bool HubLabels::validate() const
+{
+    std::call_once(validated, [this]
+                   {
+        if (data != nullptr &&
+            !mapped_file_sections_intact(data, reinterpret_cast<const Header *>(data)->section, section_count))
+            return;
+        valid = side_is_valid(forward, node_count) && side_is_valid(backward, node_count); });
+    return valid;
+}
+
+void hub_labels_save_mapped_file(const HubLabels &labels, rust::Str file_name)
+{
+    const uint64_t n = labels.node_count;
+    const HubLabels::Side &f = labels.forward, &b = labels.backward;
+    const void *const parts[section_count] = {f.first, f.hub, f.dist, b.first, b.hub, b.dist};
+    const uint64_t part_bytes[section_count] = {
+        8 * (n + 1), 4 * f.entry_count, 4 * f.entry_count,
+        8 * (n + 1), 4 * b.entry_count, 4 * b.entry_count};
+
+    Header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.version = format_version;
+    h.byte_order = byte_order_mark;
+    h.node_count = labels.node_count;
+    h.forward_entry_count = f.entry_count;
+    h.backward_entry_count = b.entry_count;
+    h.file_size = mapped_file_layout(parts, part_bytes, section_count, h.section);
+    h.header_checksum = header_checksum(h);
+    mapped_file_write(std::string(file_name), &h, sizeof(h), parts, h.section, section_count);
+}
+
+std::unique_ptr<HubLabels> hub_labels_open(rust::Str file_name, bool validate)
+{
+    const std::string path(file_name);
+    std::unique_ptr<HubLabels> labels(new HubLabels);
+    mapped_file_open(path, true, labels->data, labels->size); // a query reads two labels
+
+    if (labels->size < sizeof(Header))
+        throw std::runtime_error(path + " is not a hub label file");
+    const Header &h = *reinterpret_cast<const Header *>(labels->data);
+    if (std::memcmp(h.magic, magic, sizeof(magic)) != 0 || h.version != format_version)
+        throw std::runtime_error(path + " is not a hub label file");
+    if (h.byte_order != byte_order_mark)
+        throw std::runtime_error(path + " was written with a different byte order");
+    if (h.header_checksum != header_checksum(h) || h.file_size != labels->size)
+        throw std::runtime_error(path + " is corrupt or truncated");
+
+    const uint64_t n = h.node_count;
+    const uint64_t expected[section_count] = {
+        8 * (n + 1), 4 * h.forward_entry_count, 4 * h.forward_entry_count,
+        8 * (n + 1), 4 * h.backward_entry_count, 4 * h.backward_entry_count};
+    if (!mapped_file_sections_in_bounds(h.section, expected, section_count, labels->size))
+        throw std::runtime_error(path + " is corrupt or truncated");
+
+    auto at = [&](unsigned i)
+    { return labels->data + h.section[i].offset; };
+    labels->node_count = h.node_count;
+    labels->forward = side_of(reinterpret_cast<const uint64_t *>(at(0)), reinterpret_cast<const uint32_t *>(at(1)),
+                              reinterpret_cast<const uint32_t *>(at(2)), h.forward_entry_count);
+    labels->backward = side_of(reinterpret_cast<const uint64_t *>(at(3)), reinterpret_cast<const uint32_t *>(at(4)),
+                               reinterpret_cast<const uint32_t *>(at(5)), h.backward_entry_count);
+    if (validate && !labels->validate())
+        throw std::runtime_error(path + " is corrupt");
+    return labels;
+}
+
+bool hub_labels_validate(const HubLabels &labels)
+{
+    return labels.validate();
+}
+
+uint32_t hub_labels_node_count(const HubLabels &labels)
+{
+    return labels.node_count;
+}
+
+uint64_t hub_labels_entry_count(const HubLabels &labels)
+{
+    return labels.forward.entry_count + labels.backward.entry_count;
+}
+
+size_t hub_labels_memory_bytes(const HubLabels &labels)
+{
+    return 2 * 8 * (size_t(labels.node_count) + 1) + 8 * hub_labels_entry_count(labels);
+}
+
+uint32_t hub_labels_distance(const HubLabels &labels, uint32_t s, uint32_t t)
+{
+    const HubLabels::Side &f = labels.forward, &b = labels.backward;
+    uint64_t fs = f.first[s], bt = b.first[t];
+    unsigned d = intersect(f.hub + fs, f.dist + fs, f.first[s + 1] - fs, b.hub + bt, b.dist + bt, b.first[t + 1] - bt);
+    return d < inf_weight ? d : inf_weight;
+}
@@ -0,0 +1,371 @@
+#include "routingkit_cch_wrapper.h"
+#include "mapped_file.h"
+
+#include <routingkit/constants.h>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+using namespace RoutingKit;
+
+// Page-aligned CH file that is mapped read-only and queried in place. Layout:
+//   header (one page): magic, version, counts, one {offset, bytes, checksum} entry per
+//                      section, and a checksum of the header itself;
+//   sections:          rank, order, then per side first_out, head, weight, shortcut first /
+//                      second arc and the original-arc bits, each starting on a page boundary.
+// Opening checks the header and the section bounds, which costs a few page faults, and unless
+// told otherwise MappedCH::validate(), which reads the whole file once to check the section
+// checksums and the structure that queries rely on. The mapping is shared, so processes that
+// open the same file share its page cache.
+
+namespace
+{
+    const char magic[8] = {'R', 'K', 'C', 'H', 'M', 'A', 'P', '1'};
+    const uint32_t format_version = 1;
+    const uint32_t byte_order_mark = 0x01020304;
+
+    enum Section
+    {
+        rank_section,
+        order_section,
+        side_sections, // first_out, head, weight, first_arc, second_arc, is_original; forward first
+        section_count = side_sections + 2 * 6
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version, byte_order;
+        uint32_t node_count, forward_arc_count, backward_arc_count, reserved;
+        uint64_t file_size;
+        MappedFileSection section[section_count];
+        uint64_t header_checksum; // of all bytes above
+    };
+
+    uint64_t header_checksum(const Header &h)
+    {
+        return mapped_file_checksum(&h, offsetof(Header, header_checksum));
+    }
+
+    std::vector<uint64_t> bits_of(const BitVector &bits, unsigned count)
+    {
+        std::vector<uint64_t> words((count + 63) / 64, 0);
+        for (unsigned i = 0; i < count; ++i)
+            if (bits.is_set(i))
+                words[i / 64] |= uint64_t(1) << (i % 64);
+        return words;
+    }
+
+    // Tail rank of `arc`: the x with first_out[x] <= arc < first_out[x + 1].
+    unsigned tail_of(const MappedCH::Side &side, unsigned node_count, unsigned arc)
+    {
+        return std::upper_bound(side.first_out, side.first_out + node_count + 1, arc) - side.first_out - 1;
+    }
+
+    // Requires the first_out arrays of both sides to be valid (mapped_file_offsets_valid),
+    // since shortcut halves are looked up on the other side.
+    bool side_is_valid(const MappedCH &ch, const MappedCH::Side &side)
+    {
+        const unsigned n = ch.node_count;
+        for (unsigned x = 0; x < n; ++x)
+        {
+            for (unsigned a = side.first_out[x]; a < side.first_out[x + 1]; ++a)
+            {
+                if (side.head[a] <= x || side.head[a] >= n)
+                    return false;
+                if (side.is_original(a))
+                {
+                    if (side.second_arc[a] >= n)
+                        return false;
+                    continue;
+                }
+                // Both halves hang below x, so unpacking terminates.
+                if (side.first_arc[a] >= ch.backward.arc_count || side.second_arc[a] >= ch.forward.arc_count ||
+                    tail_of(ch.backward, n, side.first_arc[a]) >= x || tail_of(ch.forward, n, side.second_arc[a]) >= x)
+                    return false;
+            }
+        }
+        return true;
+    }
+}
+
+void ch_save_mapped_file(const CH &ch_wrapper, rust::Str file_name)
+{
+    const ContractionHierarchy &ch = ch_wrapper.inner;
+    const unsigned n = ch.node_count();
+    std::vector<uint64_t> forward_bits = bits_of(ch.forward.is_shortcut_an_original_arc, ch.forward.head.size());
+    std::vector<uint64_t> backward_bits = bits_of(ch.backward.is_shortcut_an_original_arc, ch.backward.head.size());
+
+    auto data = [](const auto &v)
+    { return static_cast<const void *>(v.data()); };
+    auto bytes = [](const auto &v)
+    { return uint64_t(v.size() * sizeof(v[0])); };
+    const void *const parts[section_count] = {
+        data(ch.rank), data(ch.order),
+        data(ch.forward.first_out), data(ch.forward.head), data(ch.forward.weight),
+        data(ch.forward.shortcut_first_arc), data(ch.forward.shortcut_second_arc), data(forward_bits),
+        data(ch.backward.first_out), data(ch.backward.head), data(ch.backward.weight),
+        data(ch.backward.shortcut_first_arc), data(ch.backward.shortcut_second_arc), data(backward_bits)};
+    const uint64_t part_bytes[section_count] = {
+        bytes(ch.rank), bytes(ch.order),
+        bytes(ch.forward.first_out), bytes(ch.forward.head), bytes(ch.forward.weight),
+        bytes(ch.forward.shortcut_first_arc), bytes(ch.forward.shortcut_second_arc), bytes(forward_bits),
+        bytes(ch.backward.first_out), bytes(ch.backward.head), bytes(ch.backward.weight),
+        bytes(ch.backward.shortcut_first_arc), bytes(ch.backward.shortcut_second_arc), bytes(backward_bits)};
+
+    Header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.version = format_version;
+    h.byte_order = byte_order_mark;
+    h.node_count = n;
+    h.forward_arc_count = ch.forward.head.size();
+    h.backward_arc_count = ch.backward.head.size();
+    h.file_size = mapped_file_layout(parts, part_bytes, section_count, h.section);
+    h.header_checksum = header_checksum(h);
+    mapped_file_write(std::string(file_name), &h, sizeof(h), parts, h.section, section_count);
+}
+
+MappedCH::~MappedCH()
+{
+    mapped_file_close(data, size);
+}
+
+bool MappedCH::validate() const
+{
+    std::call_once(validated, [this]
+                   {
+        const Header &h = *reinterpret_cast<const Header *>(data);
+        if (!mapped_file_sections_intact(data, h.section, section_count))
+            return;
+        for (unsigned v = 0; v < node_count; ++v)
+            if (rank[v] >= node_count || order[rank[v]] != v)
+                return;
+        if (!mapped_file_offsets_valid(forward.first_out, node_count, forward.arc_count) ||
+            !mapped_file_offsets_valid(backward.first_out, node_count, backward.arc_count))
+            return;
+        valid = side_is_valid(*this, forward) && side_is_valid(*this, backward); });
+    return valid;
+}
+
+std::unique_ptr<MappedCH> mapped_ch_open(rust::Str file_name, bool validate)
+{
+    const std::string path(file_name);
+    std::unique_ptr<MappedCH> ch(new MappedCH);
+    mapped_file_open(path, true, ch->data, ch->size); // queries touch few scattered pages
+
+    if (ch->size < sizeof(Header))
+        throw std::runtime_error(path + " is not a mapped CH file");
+    const Header &h = *reinterpret_cast<const Header *>(ch->data);
+    if (std::memcmp(h.magic, magic, sizeof(magic)) != 0 || h.version != format_version)
+        throw std::runtime_error(path + " is not a mapped CH file");
+    if (h.byte_order != byte_order_mark)
+        throw std::runtime_error(path + " was written with a different byte order");
+    if (h.header_checksum != header_checksum(h) || h.file_size != ch->size)
+        throw std::runtime_error(path + " is corrupt or truncated");
+
+    const uint64_t n = h.node_count;
+    const uint64_t expected[section_count] = {
+        4 * n, 4 * n,
+        4 * (n + 1), 4 * uint64_t(h.forward_arc_count), 4 * uint64_t(h.forward_arc_count),
+        4 * uint64_t(h.forward_arc_count), 4 * uint64_t(h.forward_arc_count), 8 * ((uint64_t(h.forward_arc_count) + 63) / 64),
+        4 * (n + 1), 4 * uint64_t(h.backward_arc_count), 4 * uint64_t(h.backward_arc_count),
+        4 * uint64_t(h.backward_arc_count), 4 * uint64_t(h.backward_arc_count), 8 * ((uint64_t(h.backward_arc_count) + 63) / 64)};
+    if (!mapped_file_sections_in_bounds(h.section, expected, section_count, ch->size))
+        throw std::runtime_error(path + " is corrupt or truncated");
+
+    auto u32 = [&](unsigned i)
+    { return reinterpret_cast<const uint32_t *>(ch->data + h.section[i].offset); };
+    auto side = [&](unsigned first, unsigned arc_count)
+    {
+        MappedCH::Side s;
+        s.first_out = u32(first);
+        s.head = u32(first + 1);
+        s.weight = u32(first + 2);
+        s.first_arc = u32(first + 3);
+        s.second_arc = u32(first + 4);
+        s.is_original_bits = reinterpret_cast<const uint64_t *>(ch->data + h.section[first + 5].offset);
+        s.arc_count = arc_count;
+        return s;
+    };
+    ch->node_count = h.node_count;
+    ch->rank = u32(rank_section);
+    ch->order = u32(order_section);
+    ch->forward = side(side_sections, h.forward_arc_count);
+    ch->backward = side(side_sections + 6, h.backward_arc_count);
+    if (validate && !ch->validate())
+        throw std::runtime_error(path + " is corrupt");
+    return ch;
+}
+
+bool mapped_ch_validate(const MappedCH &ch)
+{
+    return ch.validate();
+}
+
+uint32_t mapped_ch_node_count(const MappedCH &ch)
+{
+    return ch.node_count;
+}
+
+size_t mapped_ch_file_bytes(const MappedCH &ch)
+{
+    return ch.size;
+}
+
+// -------- Queries --------
+
+namespace
+{
+    using Label = MappedCHQuery::Label;
+
+    void settle_next(MappedCHQuery &q, bool forward_direction)
+    {
+        const MappedCH &ch = *q.ch;
+        const MappedCH::Side &up = forward_direction ? ch.forward : ch.backward;
+        const MappedCH::Side &down = forward_direction ? ch.backward : ch.forward;
+        unsigned Label::*dist = forward_direction ? &Label::forward : &Label::backward;
+        unsigned Label::*other = forward_direction ? &Label::backward : &Label::forward;
+        unsigned Label::*pred = forward_direction ? &Label::forward_arc : &Label::backward_arc;
+        std::vector<std::pair<unsigned, unsigned>> &heap = forward_direction ? q.forward_heap : q.backward_heap;
+
+        std::pop_heap(heap.begin(), heap.end(), std::greater<std::pair<unsigned, unsigned>>());
+        std::pair<unsigned, unsigned> top = heap.back();
+        heap.pop_back();
+        unsigned x = top.second;
+        const Label &lx = q.label[x];
+        if (top.first != lx.*dist)
+            return;
+        if (lx.*other != inf_weight && top.first + lx.*other < q.distance)
+        {
+            q.distance = top.first + lx.*other;
+            q.meeting = x;
+        }
+        // Stall-on-demand: x is not settled correctly if a higher node reaches it for less.
+        for (unsigned a = down.first_out[x]; a < down.first_out[x + 1]; ++a)
+        {
+            const Label &ly = q.claim(down.head[a]);
+            if (ly.*dist != inf_weight && ly.*dist + down.weight[a] < top.first)
+                return;
+        }
+        for (unsigned a = up.first_out[x]; a < up.first_out[x + 1]; ++a)
+        {
+            unsigned y = up.head[a];
+            unsigned d = top.first + up.weight[a];
+            Label &ly = q.claim(y);
+            if (d < ly.*dist)
+            {
+                ly.*dist = d;
+                ly.*pred = a;
+                heap.push_back({d, y});
+                std::push_heap(heap.begin(), heap.end(), std::greater<std::pair<unsigned, unsigned>>());
+            }
+        }
+    }
+
+    template <class F>
+    void unpack(const MappedCH &ch, bool forward_side, unsigned arc, const F &f)
+    {
+        const MappedCH::Side &side = forward_side ? ch.forward : ch.backward;
+        if (side.is_original(arc))
+        {
+            f(side.first_arc[arc], side.second_arc[arc]);
+            return;
+        }
+        unpack(ch, false, side.first_arc[arc], f);
+        unpack(ch, true, side.second_arc[arc], f);
+    }
+
+    // Calls f(input_arc, head) along the path of the last query.
+    template <class F>
+    void unpack_path(const MappedCHQuery &q, const F &f)
+    {
+        const MappedCH &ch = *q.ch;
+        std::vector<unsigned> up;
+        for (unsigned x = q.meeting; q.label[x].forward_arc != invalid_id;)
+        {
+            unsigned a = q.label[x].forward_arc;
+            up.push_back(a);
+            x = tail_of(ch.forward, ch.node_count, a);
+        }
+        for (auto i = up.rbegin(); i != up.rend(); ++i)
+            unpack(ch, true, *i, f);
+        for (unsigned x = q.meeting; q.label[x].backward_arc != invalid_id;)
+        {
+            unsigned a = q.label[x].backward_arc;
+            unpack(ch, false, a, f);
+            x = tail_of(ch.backward, ch.node_count, a);
+        }
+    }
+}
+
+MappedCHQuery::Label &MappedCHQuery::claim(unsigned x)
+{
+    Label &l = label[x];
+    if (l.generation != generation)
+        l = {inf_weight, inf_weight, invalid_id, invalid_id, generation};
+    return l;
+}
+
+std::unique_ptr<MappedCHQuery> mapped_ch_query_new(const MappedCH &ch)
+{
+    std::unique_ptr<MappedCHQuery> q(new MappedCHQuery(ch));
+    q->label.assign(ch.node_count, Label{inf_weight, inf_weight, invalid_id, invalid_id, 0});
+    return q;
+}
+
+uint32_t mapped_ch_query_run(MappedCHQuery &q, uint32_t s, uint32_t t)
+{
+    const MappedCH &ch = *q.ch;
+    if (++q.generation == 0)
+    {
+        for (Label &l : q.label)
+            l.generation = 0;
+        q.generation = 1;
+    }
+    q.forward_heap.clear();
+    q.backward_heap.clear();
+    q.source = ch.rank[s];
+    q.meeting = invalid_id;
+    q.distance = inf_weight;
+    q.claim(q.source).forward = 0;
+    q.claim(ch.rank[t]).backward = 0;
+    q.forward_heap.push_back({0, q.source});
+    q.backward_heap.push_back({0, ch.rank[t]});
+
+    // Alternate between the directions; a direction stops once its queue cannot improve.
+    for (;;)
+    {
+        bool forward_open = !q.forward_heap.empty() && q.forward_heap.front().first < q.distance;
+        bool backward_open = !q.backward_heap.empty() && q.backward_heap.front().first < q.distance;
+        if (!forward_open && !backward_open)
+            break;
+        if (forward_open && (!backward_open || q.forward_heap.front().first <= q.backward_heap.front().first))
+            settle_next(q, true);
+        else
+            settle_next(q, false);
+    }
+    return q.distance;
+}
+
+rust::Vec<uint32_t> mapped_ch_query_arc_path(const MappedCHQuery &q)
+{
+    rust::Vec<uint32_t> out;
+    if (q.meeting == invalid_id)
+        return out;
+    unpack_path(q, [&](unsigned arc, unsigned)
+                { out.push_back(arc); });
+    return out;
+}
+
+rust::Vec<uint32_t> mapped_ch_query_node_path(const MappedCHQuery &q)
+{
+    rust::Vec<uint32_t> out;
+    if (q.meeting == invalid_id)
+        return out;
+    out.push_back(q.ch->order[q.source]);
+    unpack_path(q, [&](unsigned, unsigned head)
+                { out.push_back(head); });
+    return out;
+}
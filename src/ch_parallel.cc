@@ -0,0 +1,408 @@
+#include "routingkit_cch_wrapper.h"
+#include "omp_threads.h"
+
+#include <routingkit/constants.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace RoutingKit;
+
+// Parallel CH construction. Nodes are contracted in rounds: every round picks the nodes
+// whose priority is lower than that of all their neighbors (an independent set) and
+// contracts them at once. The witness searches of a round run in parallel and treat every
+// node of the round as already contracted, so a shortcut is only dropped if a witness
+// avoids the whole set; this makes the round equivalent to contracting its nodes one by
+// one. Priorities are recomputed for the neighbors of the contracted nodes only.
+
+namespace
+{
+    struct Edge
+    {
+        unsigned node, weight, record;
+    };
+
+    // Every arc ever inserted into the dynamic graph. Original arcs keep their input arc id,
+    // shortcuts u->w via v keep the records of u->v (first) and v->w (second).
+    struct Record
+    {
+        unsigned input_arc, first, second;
+    };
+
+    struct Shortcut
+    {
+        unsigned tail, head, weight, first, second;
+    };
+
+    struct Graph
+    {
+        std::vector<std::vector<Edge>> out, in;
+        std::vector<char> blocked; // contracted, or being contracted in the current round
+    };
+
+    class WitnessSearch
+    {
+    public:
+        explicit WitnessSearch(unsigned node_count) : dist(node_count, inf_weight) {}
+
+        // Distances from `source` in the graph without `skip` and blocked nodes, settled up to
+        // `limit` or until `max_pop_count` nodes were popped.
+        void run(const Graph &g, unsigned source, unsigned skip, unsigned limit, unsigned max_pop_count)
+        {
+            for (unsigned x : reached)
+                dist[x] = inf_weight;
+            reached.clear();
+            heap.clear();
+            set(source, 0);
+            heap.push_back({0, source});
+            unsigned pop_count = 0;
+            while (!heap.empty() && pop_count < max_pop_count)
+            {
+                std::pop_heap(heap.begin(), heap.end(), std::greater<std::pair<unsigned, unsigned>>());
+                std::pair<unsigned, unsigned> top = heap.back();
+                heap.pop_back();
+                unsigned x = top.second;
+                if (top.first != dist[x])
+                    continue;
+                if (top.first > limit)
+                    break;
+                ++pop_count;
+                for (const Edge &e : g.out[x])
+                {
+                    if (e.node == skip || g.blocked[e.node])
+                        continue;
+                    unsigned d = top.first + e.weight;
+                    if (d < dist[e.node])
+                    {
+                        set(e.node, d);
+                        heap.push_back({d, e.node});
+                        std::push_heap(heap.begin(), heap.end(), std::greater<std::pair<unsigned, unsigned>>());
+                    }
+                }
+            }
+        }
+
+        unsigned distance(unsigned x) const { return dist[x]; }
+
+    private:
+        void set(unsigned x, unsigned d)
+        {
+            if (dist[x] == inf_weight)
+                reached.push_back(x);
+            dist[x] = d;
+        }
+
+        std::vector<unsigned> dist, reached;
+        std::vector<std::pair<unsigned, unsigned>> heap;
+    };
+
+    // Calls f(u, w, weight, first_record, second_record) for every shortcut that contracting
+    // v would insert into the current graph.
+    template <class F>
+    void for_each_shortcut(const Graph &g, WitnessSearch &search, unsigned v, unsigned max_pop_count, const F &f)
+    {
+        for (const Edge &in : g.in[v])
+        {
+            bool has_pair = false;
+            unsigned limit = 0;
+            for (const Edge &out : g.out[v])
+                if (out.node != in.node)
+                {
+                    has_pair = true;
+                    limit = std::max(limit, in.weight + out.weight);
+                }
+            if (!has_pair)
+                continue;
+            search.run(g, in.node, v, limit, max_pop_count);
+            for (const Edge &out : g.out[v])
+                if (out.node != in.node && search.distance(out.node) > in.weight + out.weight)
+                    f(in.node, out.node, in.weight + out.weight, in.record, out.record);
+        }
+    }
+
+    // Edge difference plus the number of already contracted neighbors and the level, which
+    // spreads contraction evenly over the graph.
+    int priority(const Graph &g, WitnessSearch &search, unsigned v, unsigned max_pop_count,
+                 unsigned deleted_neighbors, unsigned level)
+    {
+        int shortcut_count = 0;
+        for_each_shortcut(g, search, v, max_pop_count, [&](unsigned, unsigned, unsigned, unsigned, unsigned)
+                          { ++shortcut_count; });
+        return shortcut_count - static_cast<int>(g.in[v].size() + g.out[v].size()) +
+               static_cast<int>(deleted_neighbors) + static_cast<int>(level);
+    }
+
+    // Strict total order on (priority, scrambled id) so that ties do not block each other.
+    bool lower(const std::vector<int> &prio, unsigned x, unsigned y)
+    {
+        if (prio[x] != prio[y])
+            return prio[x] < prio[y];
+        unsigned hx = x * 2654435761u, hy = y * 2654435761u;
+        return hx != hy ? hx < hy : x < y;
+    }
+
+    // Inserts u->w unless a parallel arc is at least as short.
+    void insert_edge(std::vector<Edge> &edges, unsigned node, unsigned weight, unsigned record)
+    {
+        for (Edge &e : edges)
+        {
+            if (e.node == node)
+            {
+                if (weight < e.weight)
+                    e = {node, weight, record};
+                return;
+            }
+        }
+        edges.push_back({node, weight, record});
+    }
+}
+
+std::unique_ptr<CH> ch_build_parallel(
+    uint32_t node_count,
+    rust::Slice<const uint32_t> tail,
+    rust::Slice<const uint32_t> head,
+    rust::Slice<const uint32_t> weight,
+    rust::Fn<void(rust::Str)> log_message,
+    uint32_t max_pop_count,
+    uint32_t thread_count)
+{
+    const int threads = omp_thread_count(thread_count);
+    const long long n = node_count;
+
+    Graph g;
+    g.out.resize(node_count);
+    g.in.resize(node_count);
+    g.blocked.assign(node_count, 0);
+    std::vector<Record> records;
+
+    // Input graph without loops; of several parallel arcs only the shortest is kept.
+    {
+        std::vector<unsigned> arcs;
+        for (unsigned a = 0; a < tail.size(); ++a)
+            if (tail[a] != head[a])
+                arcs.push_back(a);
+        std::sort(arcs.begin(), arcs.end(), [&](unsigned a, unsigned b)
+                  { return std::make_tuple(tail[a], head[a], weight[a], a) < std::make_tuple(tail[b], head[b], weight[b], b); });
+        for (size_t i = 0; i < arcs.size(); ++i)
+        {
+            unsigned a = arcs[i];
+            if (i > 0 && tail[arcs[i - 1]] == tail[a] && head[arcs[i - 1]] == head[a])
+                continue;
+            unsigned r = records.size();
+            records.push_back({a, invalid_id, invalid_id});
+            g.out[tail[a]].push_back({head[a], weight[a], r});
+            g.in[head[a]].push_back({tail[a], weight[a], r});
+        }
+    }
+
+    std::vector<WitnessSearch> searches(threads, WitnessSearch(node_count));
+    std::vector<std::vector<Shortcut>> found(threads);
+    std::vector<int> prio(node_count);
+    std::vector<unsigned> deleted_neighbors(node_count, 0), level(node_count, 0);
+
+    OMP_PRAGMA(omp parallel for num_threads(threads) schedule(dynamic, 256))
+    for (long long i = 0; i < n; ++i)
+        prio[i] = priority(g, searches[omp_thread_id()], static_cast<unsigned>(i), max_pop_count, 0, 0);
+
+    std::vector<unsigned> remaining(node_count), order;
+    for (unsigned x = 0; x < node_count; ++x)
+        remaining[x] = x;
+    order.reserve(node_count);
+    std::vector<char> selected(node_count, 0), touched_flag(node_count, 0);
+    std::vector<unsigned> touched;
+    unsigned round = 0;
+
+    while (!remaining.empty())
+    {
+        const long long remaining_count = remaining.size();
+        OMP_PRAGMA(omp parallel for num_threads(threads) schedule(static))
+        for (long long i = 0; i < remaining_count; ++i)
+        {
+            unsigned v = remaining[i];
+            bool local_minimum = true;
+            for (const Edge &e : g.out[v])
+                local_minimum = local_minimum && lower(prio, v, e.node);
+            for (const Edge &e : g.in[v])
+                local_minimum = local_minimum && lower(prio, v, e.node);
+            selected[v] = local_minimum;
+        }
+
+        const size_t first = order.size();
+        for (unsigned v : remaining)
+            if (selected[v])
+            {
+                order.push_back(v);
+                g.blocked[v] = 1;
+            }
+        const long long set_size = order.size() - first;
+
+        OMP_PRAGMA(omp parallel for num_threads(threads) schedule(dynamic, 16))
+        for (long long i = 0; i < set_size; ++i)
+        {
+            std::vector<Shortcut> &out = found[omp_thread_id()];
+            for_each_shortcut(g, searches[omp_thread_id()], order[first + i], max_pop_count,
+                              [&](unsigned u, unsigned w, unsigned d, unsigned r1, unsigned r2)
+                              { out.push_back({u, w, d, r1, r2}); });
+        }
+
+        // Neighbors drop the contracted nodes and inherit their level.
+        touched.clear();
+        for (size_t i = first; i < order.size(); ++i)
+        {
+            unsigned v = order[i];
+            for (const std::vector<Edge> *edges : {&g.out[v], &g.in[v]})
+                for (const Edge &e : *edges)
+                    if (!touched_flag[e.node])
+                    {
+                        touched_flag[e.node] = 1;
+                        touched.push_back(e.node);
+                    }
+        }
+        const long long touched_count = touched.size();
+        OMP_PRAGMA(omp parallel for num_threads(threads) schedule(dynamic, 64))
+        for (long long i = 0; i < touched_count; ++i)
+        {
+            unsigned u = touched[i];
+            touched_flag[u] = 0;
+            for (std::vector<Edge> *edges : {&g.out[u], &g.in[u]})
+            {
+                auto keep = std::remove_if(edges->begin(), edges->end(), [&](const Edge &e)
+                                           {
+                    if (!selected[e.node])
+                        return false;
+                    level[u] = std::max(level[u], level[e.node] + 1);
+                    return true; });
+                deleted_neighbors[u] += edges->end() - keep;
+                edges->erase(keep, edges->end());
+            }
+        }
+
+        std::vector<Shortcut> shortcuts;
+        for (std::vector<Shortcut> &f : found)
+        {
+            shortcuts.insert(shortcuts.end(), f.begin(), f.end());
+            f.clear();
+        }
+        std::vector<unsigned> shortcut_record(shortcuts.size());
+        for (size_t i = 0; i < shortcuts.size(); ++i)
+        {
+            shortcut_record[i] = records.size();
+            records.push_back({invalid_id, shortcuts[i].first, shortcuts[i].second});
+        }
+
+        // Insert grouped by tail (out lists) and by head (in lists), each group by one thread.
+        // Stable sorting keeps duplicates in the same order on both sides, so both lists
+        // agree on which record wins.
+        for (int side = 0; side < 2; ++side)
+        {
+            auto key = [&](unsigned i)
+            { return side == 0 ? shortcuts[i].tail : shortcuts[i].head; };
+            std::vector<unsigned> by_node(shortcuts.size());
+            for (unsigned i = 0; i < by_node.size(); ++i)
+                by_node[i] = i;
+            std::stable_sort(by_node.begin(), by_node.end(), [&](unsigned a, unsigned b)
+                             { return key(a) < key(b); });
+            std::vector<unsigned> group_begin;
+            for (unsigned i = 0; i < by_node.size(); ++i)
+                if (i == 0 || key(by_node[i]) != key(by_node[i - 1]))
+                    group_begin.push_back(i);
+            group_begin.push_back(by_node.size());
+            const long long group_count = group_begin.size() - 1;
+            OMP_PRAGMA(omp parallel for num_threads(threads) schedule(dynamic, 64))
+            for (long long j = 0; j < group_count; ++j)
+            {
+                for (unsigned i = group_begin[j]; i < group_begin[j + 1]; ++i)
+                {
+                    const Shortcut &s = shortcuts[by_node[i]];
+                    if (side == 0)
+                        insert_edge(g.out[s.tail], s.head, s.weight, shortcut_record[by_node[i]]);
+                    else
+                        insert_edge(g.in[s.head], s.tail, s.weight, shortcut_record[by_node[i]]);
+                }
+            }
+        }
+
+        OMP_PRAGMA(omp parallel for num_threads(threads) schedule(dynamic, 64))
+        for (long long i = 0; i < touched_count; ++i)
+        {
+            unsigned u = touched[i];
+            prio[u] = priority(g, searches[omp_thread_id()], u, max_pop_count, deleted_neighbors[u], level[u]);
+        }
+
+        remaining.erase(std::remove_if(remaining.begin(), remaining.end(), [&](unsigned v)
+                                       { return selected[v] != 0; }),
+                        remaining.end());
+        ++round;
+        log_message("round " + std::to_string(round) + ": contracted " + std::to_string(set_size) +
+                    " nodes, added " + std::to_string(shortcuts.size()) + " shortcuts, " +
+                    std::to_string(remaining.size()) + " nodes left");
+    }
+
+    // The edges a node had when it was contracted all lead to higher ranks: out edges
+    // become its forward arcs, in edges its backward arcs.
+    ContractionHierarchy ch;
+    ch.order = std::move(order);
+    ch.rank.resize(node_count);
+    for (unsigned r = 0; r < node_count; ++r)
+        ch.rank[ch.order[r]] = r;
+
+    std::vector<unsigned> record_arc(records.size(), invalid_id);
+    auto build_side = [&](ContractionHierarchySide &side, const std::vector<std::vector<Edge>> &edges)
+    {
+        side.first_out.assign(node_count + 1, 0);
+        for (unsigned r = 0; r < node_count; ++r)
+            side.first_out[r + 1] = side.first_out[r] + edges[ch.order[r]].size();
+        unsigned arc_count = side.first_out[node_count];
+        side.head.resize(arc_count);
+        side.weight.resize(arc_count);
+        for (unsigned r = 0; r < node_count; ++r)
+        {
+            unsigned a = side.first_out[r];
+            for (const Edge &e : edges[ch.order[r]])
+            {
+                side.head[a] = ch.rank[e.node];
+                side.weight[a] = e.weight;
+                record_arc[e.record] = a;
+                ++a;
+            }
+        }
+    };
+    build_side(ch.forward, g.out);
+    build_side(ch.backward, g.in);
+
+    auto fill_shortcuts = [&](ContractionHierarchySide &side, const std::vector<std::vector<Edge>> &edges)
+    {
+        unsigned arc_count = side.head.size();
+        side.is_shortcut_an_original_arc = BitVector(arc_count);
+        side.shortcut_first_arc.resize(arc_count);
+        side.shortcut_second_arc.resize(arc_count);
+        for (unsigned r = 0; r < node_count; ++r)
+        {
+            unsigned a = side.first_out[r];
+            for (const Edge &e : edges[ch.order[r]])
+            {
+                const Record &rec = records[e.record];
+                if (rec.input_arc != invalid_id)
+                {
+                    side.is_shortcut_an_original_arc.set(a);
+                    side.shortcut_first_arc[a] = rec.input_arc;
+                    side.shortcut_second_arc[a] = head[rec.input_arc];
+                }
+                else
+                {
+                    // first is a backward arc (u->v stored at v), second a forward arc (v->w).
+                    side.shortcut_first_arc[a] = record_arc[rec.first];
+                    side.shortcut_second_arc[a] = record_arc[rec.second];
+                }
+                ++a;
+            }
+        }
+    };
+    fill_shortcuts(ch.forward, g.out);
+    fill_shortcuts(ch.backward, g.in);
+
+    return std::unique_ptr<CH>(new CH(std::move(ch)));
+}
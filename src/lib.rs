@@ -10,8 +10,23 @@ pub mod ffi {
         type CCHMetric; // CustomizableContractionHierarchyMetric
         type CCHQuery; // CustomizableContractionHierarchyQuery
         type CCHPartial; // CustomizableContractionHierarchyPartialCustomization
+        type CCHRangeQuery; // bounded PHAST scratch
+        type CCHPOIIndex; // k-nearest POI target buckets
+        type CCHQueryArena; // label slab shared by short-lived queries
+        type CCHArenaQuery; // one claimed slot of a CCHQueryArena
+        type CompressedCCH; // query-only compressed topology
+        type CompressedCCHMetric; // customized weights for CompressedCCH
+        type CompressedCCHQuery; // labels for CompressedCCH queries
+        type QuantizedCCHMetric; // 16/24-bit customized weights
+        type CCHMapMatcher; // HMM map matching scratch
+        type QuantizedCCHQuery; // labels for QuantizedCCHMetric queries
         type CH; // ContractionHierarchy
         type CHQuery; // ContractionHierarchyQuery
+        type MappedCH; // read-only CH mapped from a page-aligned file
+        type MappedCHQuery; // labels for MappedCH queries
+        type CHBatchQuery; // bucket many-to-many and PHAST scratch for a CH
+        type HubLabels; // hub-label distance oracle built from a CH
+        type SpatialIndex; // grid over node positions and arc segments
 
         /// Build a Customizable Contraction Hierarchy.
         /// Arguments:
@@ -41,6 +56,12 @@ pub mod ffi {
         /// Build a standard Contraction Hierarchy using perfect witness search from the CCH metric.
         unsafe fn cch_metric_build_perfect_ch(metric: Pin<&mut CCHMetric>) -> UniquePtr<CH>;
 
+        /// Multi-threaded perfect witness CH extraction; the metric is left unchanged.
+        unsafe fn cch_metric_build_perfect_ch_parallel(
+            metric: &CCHMetric,
+            thread_count: u32,
+        ) -> UniquePtr<CH>;
+
         /// Build a Contraction Hierarchy.
         unsafe fn ch_build(
             node_count: u32,
@@ -51,12 +72,49 @@ pub mod ffi {
             max_pop_count: u32,
         ) -> UniquePtr<CH>;
 
+        /// Build a Contraction Hierarchy by contracting independent node sets in parallel rounds.
+        unsafe fn ch_build_parallel(
+            node_count: u32,
+            tail: &[u32],
+            head: &[u32],
+            weight: &[u32],
+            log_message: fn(&str),
+            max_pop_count: u32,
+            thread_count: u32,
+        ) -> UniquePtr<CH>;
+
         /// Load a Contraction Hierarchy from a file.
         unsafe fn ch_load_file(file_name: &str) -> UniquePtr<CH>;
 
         /// Save the Contraction Hierarchy to a file.
         unsafe fn ch_save_file(ch: &CH, file_name: &str);
 
+        /// Keep a copy of the input arcs in the CH for endpoints on arcs.
+        unsafe fn ch_set_input_arcs(ch: Pin<&mut CH>, tail: &[u32], head: &[u32], weight: &[u32]);
+
+        /// Save the Contraction Hierarchy in the page-aligned format of `mapped_ch_open`.
+        unsafe fn ch_save_mapped_file(ch: &CH, file_name: &str) -> Result<()>;
+
+        /// Map a file written by `ch_save_mapped_file`; checks the header and section bounds,
+        /// and if `validate` also `mapped_ch_validate`.
+        unsafe fn mapped_ch_open(file_name: &str, validate: bool) -> Result<UniquePtr<MappedCH>>;
+
+        /// Check section checksums and structure (once; the result is cached).
+        unsafe fn mapped_ch_validate(ch: &MappedCH) -> bool;
+
+        unsafe fn mapped_ch_node_count(ch: &MappedCH) -> u32;
+
+        unsafe fn mapped_ch_file_bytes(ch: &MappedCH) -> usize;
+
+        unsafe fn mapped_ch_query_new(ch: &MappedCH) -> UniquePtr<MappedCHQuery>;
+
+        /// Distance from `s` to `t` (inf_weight if unreachable).
+        unsafe fn mapped_ch_query_run(query: Pin<&mut MappedCHQuery>, s: u32, t: u32) -> u32;
+
+        unsafe fn mapped_ch_query_arc_path(query: &MappedCHQuery) -> Vec<u32>;
+
+        unsafe fn mapped_ch_query_node_path(query: &MappedCHQuery) -> Vec<u32>;
+
         /// Allocate a new reusable partial customization helper bound to a CCH.
         unsafe fn cch_partial_new(cch: &CCH) -> UniquePtr<CCHPartial>;
 
@@ -70,6 +128,14 @@ pub mod ffi {
         /// Run partial customization to update shortcut weights affected by the marked arcs.
         unsafe fn cch_partial_customize(partial: Pin<&mut CCHPartial>, metric: Pin<&mut CCHMetric>);
 
+        /// Reset, mark all `arcs` and run partial customization in one call.
+        /// The new weights must already be in the metric's weight vector.
+        unsafe fn cch_partial_apply(
+            partial: Pin<&mut CCHPartial>,
+            metric: Pin<&mut CCHMetric>,
+            arcs: &[u32],
+        );
+
         /// Allocate a new reusable query object bound to a metric.
         unsafe fn cch_query_new(metric: &CCHMetric) -> UniquePtr<CCHQuery>;
 
@@ -89,6 +155,201 @@ pub mod ffi {
         /// Must be called after adding at least one source & target.
         unsafe fn cch_query_run(query: Pin<&mut CCHQuery>);
 
+        /// Compute up to `max_route_count` via-node alternative routes from `s` to `t`, shortest first.
+        /// Outputs are flattened: route i has distance `distances[i]`, arcs
+        /// `arcs[arc_first[i]..arc_first[i + 1]]` and nodes
+        /// `nodes[arc_first[i] + i..arc_first[i + 1] + i + 1]`.
+        /// Independent of sources/targets added to the query.
+        unsafe fn cch_query_run_alternatives(
+            query: Pin<&mut CCHQuery>,
+            s: u32,
+            t: u32,
+            max_route_count: u32,
+            max_stretch: f64,
+            max_sharing: f64,
+            local_optimality: f64,
+            distances: &mut Vec<u32>,
+            arc_first: &mut Vec<u32>,
+            arcs: &mut Vec<u32>,
+            nodes: &mut Vec<u32>,
+        );
+
+        /// Route through `points` in order, all legs in one call. Leg i has distance
+        /// `distances[i]` and arcs `arcs[arc_first[i]..arc_first[i + 1]]`; `nodes` is the
+        /// node sequence of the whole route with point i at `nodes[node_first[i]]`.
+        /// Independent of sources/targets added to the query.
+        unsafe fn cch_query_run_via(
+            query: Pin<&mut CCHQuery>,
+            points: &[u32],
+            distances: &mut Vec<u32>,
+            arcs: &mut Vec<u32>,
+            arc_first: &mut Vec<u32>,
+            nodes: &mut Vec<u32>,
+            node_first: &mut Vec<u32>,
+        );
+
+        /// Allocate map matching scratch for a metric.
+        unsafe fn cch_map_matcher_new(metric: &CCHMetric) -> UniquePtr<CCHMapMatcher>;
+
+        /// Viterbi path of a GPS trace. Point i has the candidates
+        /// `candidate_*[candidate_first[i]..candidate_first[i + 1]]`. Writes per point the
+        /// global index of its matched candidate (u32::MAX if none) and the position of that
+        /// candidate's arc in `route`, the matched arcs joined by shortest paths.
+        unsafe fn cch_map_matcher_run(
+            matcher: Pin<&mut CCHMapMatcher>,
+            latitude: &[f32],
+            longitude: &[f32],
+            candidate_first: &[u32],
+            candidate_arc: &[u32],
+            candidate_fraction: &[f32],
+            candidate_distance: &[f32],
+            sigma: f64,
+            beta: f64,
+            weight_per_meter: f64,
+            matched: &mut [u32],
+            route: &mut Vec<u32>,
+            route_first: &mut [u32],
+        );
+
+        /// Preallocate labels for `capacity` concurrent arena queries on a metric.
+        unsafe fn cch_query_arena_new(
+            metric: &CCHMetric,
+            capacity: u32,
+        ) -> UniquePtr<CCHQueryArena>;
+
+        /// Number of free slots.
+        unsafe fn cch_query_arena_available(arena: &CCHQueryArena) -> u32;
+
+        /// Heap bytes of the slab.
+        unsafe fn cch_query_arena_memory_bytes(arena: &CCHQueryArena) -> usize;
+
+        /// Claim a free slot; null if all slots are in use. Dropping the query frees the slot.
+        unsafe fn cch_arena_query_new(arena: &CCHQueryArena) -> UniquePtr<CCHArenaQuery>;
+
+        /// Shortest distance from `s` to `t`, `i32::MAX` if unreachable. Resets the previous run.
+        unsafe fn cch_arena_query_run(query: Pin<&mut CCHArenaQuery>, s: u32, t: u32) -> u32;
+
+        /// Input arc ids of the path found by the last run (empty if unreachable).
+        unsafe fn cch_arena_query_arc_path(query: &CCHArenaQuery) -> Vec<u32>;
+
+        /// Node ids of the path found by the last run (empty if unreachable).
+        unsafe fn cch_arena_query_node_path(query: &CCHArenaQuery) -> Vec<u32>;
+
+        /// Allocate reusable scratch for range (isochrone) queries on a metric.
+        unsafe fn cch_range_query_new(metric: &CCHMetric) -> UniquePtr<CCHRangeQuery>;
+
+        /// For each `(sources[i], limits[i])` collect all nodes within the limit, and optionally the
+        /// arcs leaving that set. Source i owns `nodes[first[i]..first[i + 1]]` and
+        /// `boundary_arcs[boundary_first[i]..boundary_first[i + 1]]`.
+        unsafe fn cch_range_query_run(
+            query: Pin<&mut CCHRangeQuery>,
+            sources: &[u32],
+            limits: &[u32],
+            with_boundary: bool,
+            first: &mut Vec<u32>,
+            nodes: &mut Vec<u32>,
+            distances: &mut Vec<u32>,
+            boundary_first: &mut Vec<u32>,
+            boundary_arcs: &mut Vec<u32>,
+            boundary_offsets: &mut Vec<u32>,
+        );
+
+        /// Build target buckets for the given POI nodes (duplicates are ignored).
+        unsafe fn cch_poi_index_new(metric: &CCHMetric, pois: &[u32]) -> UniquePtr<CCHPOIIndex>;
+
+        /// Add a POI node; returns false if it was already present.
+        unsafe fn cch_poi_index_insert(index: Pin<&mut CCHPOIIndex>, node: u32) -> bool;
+
+        /// Remove a POI node; returns false if it was not present.
+        unsafe fn cch_poi_index_remove(index: Pin<&mut CCHPOIIndex>, node: u32) -> bool;
+
+        /// Number of POIs in the index.
+        unsafe fn cch_poi_index_len(index: &CCHPOIIndex) -> u32;
+
+        /// The `k` nearest POIs from `s`, ascending by distance. Uses the query's scratch only.
+        unsafe fn cch_poi_index_nearest(
+            index: &CCHPOIIndex,
+            query: Pin<&mut CCHQuery>,
+            s: u32,
+            k: u32,
+            pois: &mut Vec<u32>,
+            distances: &mut Vec<u32>,
+        );
+
+        /// Build the compressed query-only topology of a CCH.
+        unsafe fn compressed_cch_new(cch: &CCH) -> UniquePtr<CompressedCCH>;
+
+        /// Heap bytes of the compressed topology.
+        unsafe fn compressed_cch_memory_bytes(cch: &CompressedCCH) -> usize;
+
+        /// Heap bytes of the CCH topology arrays and the input arc lookups of the extensions
+        /// (excluding RoutingKit's input arc mapping).
+        unsafe fn cch_memory_bytes(cch: &CCH) -> usize;
+
+        /// Copy the customized weights of `metric` (built on the compressed CCH) in compressed arc order.
+        unsafe fn compressed_cch_metric_new(
+            cch: &CompressedCCH,
+            metric: &CCHMetric,
+        ) -> UniquePtr<CompressedCCHMetric>;
+
+        unsafe fn compressed_cch_query_new(
+            metric: &CompressedCCHMetric,
+        ) -> UniquePtr<CompressedCCHQuery>;
+
+        /// Shortest distance from `s` to `t`, `i32::MAX` if unreachable.
+        unsafe fn compressed_cch_query_distance(
+            query: Pin<&mut CompressedCCHQuery>,
+            s: u32,
+            t: u32,
+        ) -> u32;
+
+        /// Heap bytes of the customized weights plus the input weights of a metric.
+        unsafe fn cch_metric_memory_bytes(metric: &CCHMetric) -> usize;
+
+        /// Customize a metric stored in `width_bits` (16 or 24) bits per weight.
+        unsafe fn quantized_cch_metric_new(
+            cch: &CCH,
+            weight: &[u32],
+            width_bits: u32,
+        ) -> UniquePtr<QuantizedCCHMetric>;
+
+        unsafe fn quantized_cch_metric_memory_bytes(metric: &QuantizedCCHMetric) -> usize;
+
+        unsafe fn quantized_cch_query_new(
+            metric: &QuantizedCCHMetric,
+        ) -> UniquePtr<QuantizedCCHQuery>;
+
+        /// Shortest distance from `s` to `t`, `i32::MAX` if unreachable.
+        unsafe fn quantized_cch_query_distance(
+            query: Pin<&mut QuantizedCCHQuery>,
+            s: u32,
+            t: u32,
+        ) -> u32;
+
+        /// Number of online NUMA nodes (1 if unknown or not Linux).
+        unsafe fn numa_node_count() -> u32;
+
+        /// NUMA node of the CPU the calling thread currently runs on.
+        unsafe fn numa_current_node() -> u32;
+
+        /// Restrict the calling thread to the CPUs of `node`. Returns false on failure.
+        unsafe fn numa_pin_current_thread(node: u32) -> bool;
+
+        /// Request transparent huge pages for the CCH topology arrays; returns advised bytes.
+        unsafe fn cch_advise_huge_pages(cch: &CCH) -> usize;
+
+        /// Request transparent huge pages for the customized weights; returns advised bytes.
+        unsafe fn cch_metric_advise_huge_pages(metric: &CCHMetric) -> usize;
+
+        /// Copy `metric` and its CCH topology with first-touch placement on `node`. The input
+        /// weights are copied into `weights` (same length), which must outlive the replica.
+        unsafe fn cch_metric_numa_replica(
+            metric: &CCHMetric,
+            weights: &mut [u32],
+            node: u32,
+            huge_pages: bool,
+        ) -> UniquePtr<CCHMetric>;
+
         /// Get shortest distance after run(). Undefined if run() not called.
         unsafe fn cch_query_distance(query: &CCHQuery) -> u32;
 
@@ -119,6 +380,46 @@ pub mod ffi {
         unsafe fn cch_compute_order_degree(node_count: u32, tail: &[u32], head: &[u32])
         -> Vec<u32>;
 
+        /// Grid snapping index; coordinates are per node, arcs are straight segments.
+        unsafe fn spatial_index_new(
+            latitude: &[f32],
+            longitude: &[f32],
+            tail: &[u32],
+            head: &[u32],
+        ) -> UniquePtr<SpatialIndex>;
+
+        /// Up to `k` nearest nodes per point within `max_distance` meters, `k` entries per point
+        /// ordered by distance; missing entries get `u32::MAX` and an infinite distance.
+        unsafe fn spatial_index_nearest_nodes(
+            index: &SpatialIndex,
+            latitude: &[f32],
+            longitude: &[f32],
+            k: u32,
+            max_distance: f32,
+            thread_count: u32,
+            nodes: &mut [u32],
+            distances: &mut [f32],
+        );
+
+        /// Up to `k` nearest arcs per point within `max_distance` meters, `k` entries per point
+        /// ordered by distance, with the position of the closest point along the arc (0 = tail,
+        /// 1 = head); missing entries get `u32::MAX`.
+        unsafe fn spatial_index_nearest_arcs(
+            index: &SpatialIndex,
+            latitude: &[f32],
+            longitude: &[f32],
+            k: u32,
+            max_distance: f32,
+            thread_count: u32,
+            arcs: &mut [u32],
+            fractions: &mut [f32],
+            distances: &mut [f32],
+        );
+
+        /// End nodes of input arc `arc` of the index.
+        unsafe fn spatial_index_arc_tail(index: &SpatialIndex, arc: u32) -> u32;
+        unsafe fn spatial_index_arc_head(index: &SpatialIndex, arc: u32) -> u32;
+
         /// Pin a set of target nodes for the next query.
         unsafe fn cch_query_pin_targets(query: Pin<&mut CCHQuery>, targets: &[u32]);
 
@@ -143,6 +444,99 @@ pub mod ffi {
         unsafe fn cch_query_reset_source(query: Pin<&mut CCHQuery>);
         unsafe fn cch_query_reset_target(query: Pin<&mut CCHQuery>);
 
+        /// Set the generation counter of the extension searches; for testing the wrap-around.
+        unsafe fn cch_query_set_search_generation(query: Pin<&mut CCHQuery>, generation: u32);
+
+        /// Add sources / targets at `fractions[i]` along input arcs `arcs[i]`, using the
+        /// metric's arc weights for the initial distances.
+        unsafe fn cch_query_add_sources_on_arcs(
+            query: Pin<&mut CCHQuery>,
+            arcs: &[u32],
+            fractions: &[f32],
+        );
+        unsafe fn cch_query_add_targets_on_arcs(
+            query: Pin<&mut CCHQuery>,
+            arcs: &[u32],
+            fractions: &[f32],
+        );
+        /// One query per pair of on-arc endpoints; writes one distance per pair.
+        unsafe fn cch_query_distances_on_arcs(
+            query: Pin<&mut CCHQuery>,
+            source_arcs: &[u32],
+            source_fractions: &[f32],
+            target_arcs: &[u32],
+            target_fractions: &[f32],
+            distances: &mut [u32],
+        );
+
+        /// Replace the many-to-one source set; source i gets slot i.
+        unsafe fn cch_query_pin_many_to_one_sources(query: Pin<&mut CCHQuery>, sources: &[u32]);
+
+        /// Pin one more source and return its slot (freed slots are reused).
+        unsafe fn cch_query_add_pinned_source(query: Pin<&mut CCHQuery>, s: u32) -> u32;
+
+        /// Free a source slot; false if it was not in use.
+        unsafe fn cch_query_remove_pinned_source(query: Pin<&mut CCHQuery>, slot: u32) -> bool;
+
+        unsafe fn cch_query_pinned_source_slots(query: &CCHQuery) -> u32;
+
+        /// Distances from every source slot to `t` (`i32::MAX` for free slots).
+        unsafe fn cch_query_many_to_one(query: Pin<&mut CCHQuery>, t: u32, dists: &mut [u32]);
+
+        /// Replace the one-to-many target set; target i gets slot i.
+        unsafe fn cch_query_pin_one_to_many_targets(query: Pin<&mut CCHQuery>, targets: &[u32]);
+
+        /// Pin one more target and return its slot (freed slots are reused).
+        unsafe fn cch_query_add_pinned_target(query: Pin<&mut CCHQuery>, t: u32) -> u32;
+
+        /// Free a target slot; false if it was not in use.
+        unsafe fn cch_query_remove_pinned_target(query: Pin<&mut CCHQuery>, slot: u32) -> bool;
+
+        unsafe fn cch_query_pinned_target_slots(query: &CCHQuery) -> u32;
+
+        /// Distances from `s` to every target slot (`i32::MAX` for free slots).
+        unsafe fn cch_query_one_to_many(query: Pin<&mut CCHQuery>, s: u32, dists: &mut [u32]);
+
+        /// Top-down hub labels with bootstrapped pruning on `thread_count` threads (0 -> auto).
+        unsafe fn hub_labels_build(ch: &CH, thread_count: u32) -> UniquePtr<HubLabels>;
+
+        /// Save in the page-aligned format read by `hub_labels_open`.
+        unsafe fn hub_labels_save_mapped_file(labels: &HubLabels, file_name: &str) -> Result<()>;
+
+        /// Map a label file read-only; checks header and section bounds, and if `validate` also
+        /// `hub_labels_validate`.
+        unsafe fn hub_labels_open(file_name: &str, validate: bool) -> Result<UniquePtr<HubLabels>>;
+
+        /// Check section checksums and label structure once.
+        unsafe fn hub_labels_validate(labels: &HubLabels) -> bool;
+
+        unsafe fn hub_labels_node_count(labels: &HubLabels) -> u32;
+        unsafe fn hub_labels_entry_count(labels: &HubLabels) -> u64;
+        unsafe fn hub_labels_memory_bytes(labels: &HubLabels) -> usize;
+
+        /// Distance from `s` to `t` (`i32::MAX` if unreachable).
+        unsafe fn hub_labels_distance(labels: &HubLabels, s: u32, t: u32) -> u32;
+
+        unsafe fn ch_node_count(ch: &CH) -> u32;
+
+        /// Scratch is sized on first use.
+        unsafe fn ch_batch_query_new(ch: &CH) -> UniquePtr<CHBatchQuery>;
+
+        /// Row-major `sources.len() x targets.len()` distances (`i32::MAX` if unreachable).
+        unsafe fn ch_batch_query_matrix(
+            query: Pin<&mut CHBatchQuery>,
+            sources: &[u32],
+            targets: &[u32],
+            dists: &mut [u32],
+        );
+
+        /// Distances from `s` to every node, indexed by node id.
+        unsafe fn ch_batch_query_one_to_all(
+            query: Pin<&mut CHBatchQuery>,
+            s: u32,
+            dists: &mut [u32],
+        );
+
         // CH Query API
         unsafe fn ch_query_new(ch: &CH) -> UniquePtr<CHQuery>;
         unsafe fn ch_query_reset_ch(query: Pin<&mut CHQuery>, ch: &CH);
@@ -163,6 +557,17 @@ pub mod ffi {
         unsafe fn ch_query_arc_path(query: &CHQuery) -> Vec<u32>;
         unsafe fn ch_query_reset_source(query: Pin<&mut CHQuery>);
         unsafe fn ch_query_reset_target(query: Pin<&mut CHQuery>);
+        unsafe fn ch_query_input_arc_count(query: &CHQuery) -> u32;
+        unsafe fn ch_query_add_sources_on_arcs(
+            query: Pin<&mut CHQuery>,
+            arcs: &[u32],
+            fractions: &[f32],
+        );
+        unsafe fn ch_query_add_targets_on_arcs(
+            query: Pin<&mut CHQuery>,
+            arcs: &[u32],
+            fractions: &[f32],
+        );
     }
 }
 
@@ -181,8 +586,32 @@ unsafe impl Send for ffi::CCHMetric {}
 unsafe impl Sync for ffi::CCHMetric {}
 unsafe impl Send for ffi::CH {}
 unsafe impl Sync for ffi::CH {}
+unsafe impl Send for ffi::MappedCH {}
+unsafe impl Sync for ffi::MappedCH {}
+unsafe impl Send for ffi::HubLabels {}
+unsafe impl Sync for ffi::HubLabels {}
+unsafe impl Send for ffi::SpatialIndex {}
+unsafe impl Sync for ffi::SpatialIndex {}
+unsafe impl Send for ffi::CCHPOIIndex {}
+unsafe impl Sync for ffi::CCHPOIIndex {}
+unsafe impl Send for ffi::CCHQueryArena {}
+unsafe impl Sync for ffi::CCHQueryArena {}
+unsafe impl Send for ffi::CompressedCCH {}
+unsafe impl Sync for ffi::CompressedCCH {}
+unsafe impl Send for ffi::CompressedCCHMetric {}
+unsafe impl Sync for ffi::CompressedCCHMetric {}
+unsafe impl Send for ffi::QuantizedCCHMetric {}
+unsafe impl Sync for ffi::QuantizedCCHMetric {}
 unsafe impl Send for ffi::CCHQuery {}
-// (No Sync for CCHQuery)
+unsafe impl Send for ffi::CCHRangeQuery {}
+unsafe impl Send for ffi::CCHMapMatcher {}
+unsafe impl Send for ffi::CCHArenaQuery {}
+unsafe impl Send for ffi::CompressedCCHQuery {}
+unsafe impl Send for ffi::QuantizedCCHQuery {}
+unsafe impl Send for ffi::MappedCHQuery {}
+unsafe impl Send for ffi::CHBatchQuery {}
+// (No Sync for CCHQuery / CCHRangeQuery / CCHArenaQuery / CompressedCCHQuery / QuantizedCCHQuery /
+// MappedCHQuery / CHBatchQuery)
 
 // Rust wrapper over FFI
 use cxx::UniquePtr;
@@ -191,6 +620,10 @@ pub use ffi::{
     cch_compute_order_degree as compute_order_degree_unchecked,
     cch_compute_order_inertial as compute_order_inertial_unchecked,
 };
+use std::collections::HashMap;
+use std::hash::BuildHasher;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
 
 fn is_permutation(arr: &[u32]) -> bool {
     let n = arr.len();
@@ -251,13 +684,230 @@ pub fn compute_order_inertial(
     unsafe { cch_compute_order_inertial(node_count, tail, head, latitude, longitude) }
 }
 
+/// A node found by [`SpatialIndex::nearest_nodes`].
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct SnappedNode {
+    pub node: u32,
+    /// Straight-line distance from the query point in meters.
+    pub distance: f32,
+}
+
+/// The point of an arc closest to a query, found by [`SpatialIndex::nearest_arc`].
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct SnappedArc {
+    pub arc: u32,
+    pub tail: u32,
+    pub head: u32,
+    /// Position along the arc: 0 at the tail, 1 at the head.
+    pub fraction: f32,
+    /// Straight-line distance from the query point in meters.
+    pub distance: f32,
+}
+
+impl SnappedArc {
+    /// `(node, initial distance)` for `add_source`: leaving the snapped point means driving
+    /// the rest of the arc, `(1 - fraction) * weight`, to its head.
+    pub fn source(&self, weight: u32) -> (u32, u32) {
+        let rest = (1.0 - self.fraction as f64) * weight as f64;
+        (self.head, rest.round() as u32)
+    }
+
+    /// `(node, initial distance)` for `add_target`: reaching the snapped point means entering
+    /// the arc at its tail and driving `fraction * weight`.
+    pub fn target(&self, weight: u32) -> (u32, u32) {
+        let part = self.fraction as f64 * weight as f64;
+        (self.tail, part.round() as u32)
+    }
+}
+
+/// Snaps GPS coordinates to nodes and arcs.
+///
+/// A uniform grid over the node positions (projected to local meters) and over the arcs as
+/// straight segments between their end nodes. Queries scan rings of cells around the point
+/// until nothing closer can remain, so they touch a handful of cells at city density. The
+/// batch methods run on `thread_count` threads (0 -> auto) with the `openmp` feature, and on
+/// the calling thread without it. `max_distance` is in meters; pass `f32::INFINITY` for no
+/// limit.
+pub struct SpatialIndex {
+    inner: UniquePtr<ffi::SpatialIndex>,
+}
+
+impl SpatialIndex {
+    pub fn new(latitude: &[f32], longitude: &[f32], tail: &[u32], head: &[u32]) -> Self {
+        assert!(
+            latitude.len() == longitude.len(),
+            "latitude/longitude length must equal node count"
+        );
+        assert!(
+            tail.len() == head.len(),
+            "tail and head arrays must have the same length"
+        );
+        assert!(
+            tail.iter()
+                .chain(head)
+                .max()
+                .map_or(true, |&v| (v as usize) < latitude.len()),
+            "tail/head contain node ids outside valid range"
+        );
+        let inner = unsafe { spatial_index_new(latitude, longitude, tail, head) };
+        SpatialIndex { inner }
+    }
+
+    /// Up to `k` nodes within `max_distance`, nearest first.
+    pub fn nearest_nodes(
+        &self,
+        latitude: f32,
+        longitude: f32,
+        k: u32,
+        max_distance: f32,
+    ) -> Vec<SnappedNode> {
+        self.nearest_nodes_batch(&[latitude], &[longitude], k, max_distance, 1)
+            .pop()
+            .unwrap()
+    }
+
+    /// [`SpatialIndex::nearest_nodes`] for every point.
+    pub fn nearest_nodes_batch(
+        &self,
+        latitude: &[f32],
+        longitude: &[f32],
+        k: u32,
+        max_distance: f32,
+        thread_count: u32,
+    ) -> Vec<Vec<SnappedNode>> {
+        assert!(
+            latitude.len() == longitude.len(),
+            "latitude/longitude length must be equal"
+        );
+        let mut nodes = vec![0; latitude.len() * k as usize];
+        let mut distances = vec![0.0; nodes.len()];
+        unsafe {
+            spatial_index_nearest_nodes(
+                &self.inner,
+                latitude,
+                longitude,
+                k,
+                max_distance,
+                thread_count,
+                &mut nodes,
+                &mut distances,
+            )
+        };
+        nodes
+            .chunks(k.max(1) as usize)
+            .zip(distances.chunks(k.max(1) as usize))
+            .map(|(nodes, distances)| {
+                nodes
+                    .iter()
+                    .zip(distances)
+                    .take_while(|&(&node, _)| node != u32::MAX)
+                    .map(|(&node, &distance)| SnappedNode { node, distance })
+                    .collect()
+            })
+            .chain(std::iter::repeat_with(Vec::new))
+            .take(latitude.len())
+            .collect()
+    }
+
+    /// The closest point on any arc within `max_distance`.
+    pub fn nearest_arc(
+        &self,
+        latitude: f32,
+        longitude: f32,
+        max_distance: f32,
+    ) -> Option<SnappedArc> {
+        self.nearest_arcs_batch(&[latitude], &[longitude], max_distance, 1)[0]
+    }
+
+    /// Up to `k` arcs within `max_distance`, nearest first, each with its closest point to the
+    /// query; e.g. the candidates of a GPS point for [`CCHMapMatcher`].
+    pub fn nearest_arcs(
+        &self,
+        latitude: f32,
+        longitude: f32,
+        k: u32,
+        max_distance: f32,
+    ) -> Vec<SnappedArc> {
+        self.nearest_arc_rows(&[latitude], &[longitude], k, max_distance, 1)
+            .pop()
+            .unwrap()
+    }
+
+    /// [`SpatialIndex::nearest_arc`] for every point.
+    pub fn nearest_arcs_batch(
+        &self,
+        latitude: &[f32],
+        longitude: &[f32],
+        max_distance: f32,
+        thread_count: u32,
+    ) -> Vec<Option<SnappedArc>> {
+        self.nearest_arc_rows(latitude, longitude, 1, max_distance, thread_count)
+            .into_iter()
+            .map(|row| row.first().copied())
+            .collect()
+    }
+
+    fn nearest_arc_rows(
+        &self,
+        latitude: &[f32],
+        longitude: &[f32],
+        k: u32,
+        max_distance: f32,
+        thread_count: u32,
+    ) -> Vec<Vec<SnappedArc>> {
+        assert!(
+            latitude.len() == longitude.len(),
+            "latitude/longitude length must be equal"
+        );
+        let mut arcs = vec![0; latitude.len() * k as usize];
+        let mut fractions = vec![0.0; arcs.len()];
+        let mut distances = vec![0.0; arcs.len()];
+        unsafe {
+            spatial_index_nearest_arcs(
+                &self.inner,
+                latitude,
+                longitude,
+                k,
+                max_distance,
+                thread_count,
+                &mut arcs,
+                &mut fractions,
+                &mut distances,
+            )
+        };
+        let k = k.max(1) as usize;
+        arcs.chunks(k)
+            .zip(fractions.chunks(k).zip(distances.chunks(k)))
+            .map(|(arcs, (fractions, distances))| {
+                arcs.iter()
+                    .zip(fractions.iter().zip(distances))
+                    .take_while(|&(&arc, _)| arc != u32::MAX)
+                    .map(|(&arc, (&fraction, &distance))| SnappedArc {
+                        arc,
+                        tail: unsafe { spatial_index_arc_tail(&self.inner, arc) },
+                        head: unsafe { spatial_index_arc_head(&self.inner, arc) },
+                        fraction,
+                        distance,
+                    })
+                    .collect()
+            })
+            .chain(std::iter::repeat_with(Vec::new))
+            .take(latitude.len())
+            .collect()
+    }
+}
+
 /// Immutable Customizable Contraction Hierarchy index.
 pub struct CCH {
     inner: UniquePtr<ffi::CCH>,
     edge_count: usize,
     node_count: usize,
+    // Unique per index, so structures derived from one CCH can recognize metrics of it.
+    id: u64,
 }
 
+static NEXT_CCH_ID: AtomicU64 = AtomicU64::new(0);
+
 impl CCH {
     /// Construct a new immutable Customizable Contraction Hierarchy index.
     ///
@@ -317,8 +967,140 @@ impl CCH {
             inner: cch,
             edge_count: tail.len(),
             node_count: order.len(),
+            id: NEXT_CCH_ID.fetch_add(1, Ordering::Relaxed),
+        }
+    }
+
+    /// Like [`CCH::new`], but first relabels the input nodes according to `renumbering` so that
+    /// per-node data touched by queries sits in contiguous memory.
+    ///
+    /// Returns the index together with the mapping `new_id[input_id]`. Afterwards every node id
+    /// passed to or returned by the index (sources, targets, pinned sets, node paths) is a new
+    /// id; translate your per-node arrays (coordinates, payloads) once with the mapping. Arc ids
+    /// are unchanged, so weight vectors can be used as they are.
+    ///
+    /// Panics under the same conditions as [`CCH::new`], or if the coordinates of
+    /// [`NodeRenumbering::Hilbert`] do not have one entry per node.
+    pub fn new_renumbered(
+        order: &[u32],
+        tail: &[u32],
+        head: &[u32],
+        log_message: fn(&str),
+        filter_always_inf_arcs: bool,
+        renumbering: NodeRenumbering,
+    ) -> (Self, Vec<u32>) {
+        assert!(
+            is_permutation(order),
+            "order array is not a valid permutation"
+        );
+        let new_id = match renumbering {
+            NodeRenumbering::Rank => {
+                let mut new_id = vec![0; order.len()];
+                for (rank, &node) in order.iter().enumerate() {
+                    new_id[node as usize] = rank as u32;
+                }
+                new_id
+            }
+            NodeRenumbering::Hilbert {
+                latitude,
+                longitude,
+            } => {
+                assert!(
+                    latitude.len() == order.len() && longitude.len() == order.len(),
+                    "latitude/longitude length must equal node count"
+                );
+                hilbert_renumbering(latitude, longitude)
+            }
+        };
+        let translate = |ids: &[u32]| -> Vec<u32> {
+            ids.iter()
+                .map(|&v| {
+                    assert!(
+                        (v as usize) < new_id.len(),
+                        "tail/head contain node ids outside valid range"
+                    );
+                    new_id[v as usize]
+                })
+                .collect()
+        };
+        let (order, tail, head) = (translate(order), translate(tail), translate(head));
+        let cch = CCH::new(&order, &tail, &head, log_message, filter_always_inf_arcs);
+        (cch, new_id)
+    }
+
+    /// Heap bytes of the topology arrays (up/down graphs, elimination tree, order) and of the
+    /// index from CCH arcs to input arcs once something that unpacks paths has built it;
+    /// excludes RoutingKit's input arc mapping and metrics. See [`CompressedCCH::memory_bytes`].
+    pub fn memory_bytes(&self) -> usize {
+        unsafe { cch_memory_bytes(&self.inner) }
+    }
+
+    /// Ask the kernel to back the topology arrays with transparent huge pages.
+    /// Returns the number of bytes advised (0 where unsupported). See [`AllocationOptions`].
+    pub fn advise_huge_pages(&self) -> usize {
+        unsafe { cch_advise_huge_pages(&self.inner) }
+    }
+}
+
+/// Node relabeling applied by [`CCH::new_renumbered`].
+#[derive(Debug, Clone, Copy)]
+pub enum NodeRenumbering<'a> {
+    /// New id = rank in the order. The id/rank translation inside the index becomes the
+    /// identity, and nodes visited by the same upward searches get nearby ids.
+    Rank,
+    /// New ids follow a Hilbert curve over the node coordinates, so geographically close
+    /// nodes (e.g. a fleet in one district) are adjacent in every per-node array.
+    Hilbert {
+        latitude: &'a [f32],
+        longitude: &'a [f32],
+    },
+}
+
+/// Position of every node along a Hilbert curve over a 2^16 x 2^16 grid spanning the
+/// bounding box of the coordinates.
+fn hilbert_renumbering(latitude: &[f32], longitude: &[f32]) -> Vec<u32> {
+    const GRID: u32 = 1 << 16;
+    let quantize = |v: &[f32]| -> Vec<u32> {
+        let (lo, hi) = v
+            .iter()
+            .fold((f32::INFINITY, f32::NEG_INFINITY), |(lo, hi), &x| {
+                (lo.min(x), hi.max(x))
+            });
+        let scale = if hi > lo {
+            (GRID - 1) as f32 / (hi - lo)
+        } else {
+            0.0
+        };
+        v.iter()
+            .map(|&x| (((x - lo) * scale) as u32).min(GRID - 1))
+            .collect()
+    };
+    let (xs, ys) = (quantize(longitude), quantize(latitude));
+    let key = |mut x: u32, mut y: u32| -> u64 {
+        let mut d = 0u64;
+        let mut s = GRID / 2;
+        while s > 0 {
+            let rx = (x & s != 0) as u32;
+            let ry = (y & s != 0) as u32;
+            d += (s as u64) * (s as u64) * ((3 * rx) ^ ry) as u64;
+            if ry == 0 {
+                if rx == 1 {
+                    x = GRID - 1 - x;
+                    y = GRID - 1 - y;
+                }
+                std::mem::swap(&mut x, &mut y);
+            }
+            s /= 2;
         }
+        d
+    };
+    let mut nodes: Vec<u32> = (0..xs.len() as u32).collect();
+    nodes.sort_by_key(|&v| (key(xs[v as usize], ys[v as usize]), v));
+    let mut new_id = vec![0; nodes.len()];
+    for (i, &v) in nodes.iter().enumerate() {
+        new_id[v as usize] = i as u32;
     }
+    new_id
 }
 
 /// Standard Contraction Hierarchy index.
@@ -341,72 +1123,411 @@ impl CH {
         CH { inner: ch }
     }
 
+    /// Build a Contraction Hierarchy on `thread_count` threads (0 -> auto).
+    ///
+    /// Each round contracts the nodes whose priority is a local minimum among their neighbors,
+    /// running their witness searches (bounded by `max_pop_count` like [`CH::build`]) in
+    /// parallel. Distances are exact; the node order differs from [`CH::build`], so the number
+    /// of shortcuts and the query speed may differ slightly. Each thread keeps one distance
+    /// array of `node_count` entries. Needs the `openmp` feature, like
+    /// [`CCHMetric::parallel_new`].
+    #[cfg(feature = "openmp")]
+    pub fn build_parallel(
+        node_count: u32,
+        tail: &[u32],
+        head: &[u32],
+        weight: &[u32],
+        log_message: fn(&str),
+        max_pop_count: u32,
+        thread_count: u32,
+    ) -> Self {
+        assert!(
+            tail.len() == head.len() && tail.len() == weight.len(),
+            "tail, head and weight arrays must have the same length"
+        );
+        assert!(
+            tail.iter()
+                .chain(head)
+                .max()
+                .map_or(true, |&v| v < node_count),
+            "tail/head contain node ids outside valid range"
+        );
+        let ch = unsafe {
+            ffi::ch_build_parallel(
+                node_count,
+                tail,
+                head,
+                weight,
+                log_message,
+                max_pop_count,
+                thread_count,
+            )
+        };
+        CH { inner: ch }
+    }
+
     pub fn load_file(file_name: &str) -> Self {
         let ch = unsafe { ffi::ch_load_file(file_name) };
         CH { inner: ch }
     }
 
+    pub fn node_count(&self) -> u32 {
+        unsafe { ffi::ch_node_count(&self.inner) }
+    }
+
+    /// Keep a copy of the arcs and weights the CH was built from, which
+    /// [`CHQuery::add_source_on_arc`] and [`CHQuery::add_target_on_arc`] need. The copy costs
+    /// three `u32` per arc and is not written by [`CH::save_file`] or [`CH::save_mapped_file`],
+    /// so set it again after [`CH::load_file`].
+    pub fn with_input_arcs(mut self, tail: &[u32], head: &[u32], weight: &[u32]) -> Self {
+        assert!(
+            tail.len() == head.len() && tail.len() == weight.len(),
+            "tail, head and weight arrays must have the same length"
+        );
+        let node_count = self.node_count();
+        assert!(
+            tail.iter()
+                .chain(head)
+                .max()
+                .map_or(true, |&v| v < node_count),
+            "tail/head contain node ids outside valid range"
+        );
+        unsafe { ffi::ch_set_input_arcs(self.inner.pin_mut(), tail, head, weight) };
+        self
+    }
+
     pub fn save_file(&self, file_name: &str) {
         unsafe { ffi::ch_save_file(&self.inner, file_name) }
     }
+
+    /// Save in the page-aligned format that [`MappedCH::open`] maps instead of loading it.
+    pub fn save_mapped_file(&self, file_name: &str) -> Result<(), cxx::Exception> {
+        unsafe { ffi::ch_save_mapped_file(&self.inner, file_name) }
+    }
 }
 
-/// A reusable query object for a [`CH`].
-pub struct CHQuery {
-    inner: UniquePtr<ffi::CHQuery>,
+/// Read-only [`CH`] memory-mapped from a file written by [`CH::save_mapped_file`].
+///
+/// Pages are loaded on first access and shared with every other process mapping the same
+/// file. [`MappedCH::open`] checks the header (magic, version, byte order, checksum), the
+/// section bounds, the section checksums and the structure, which reads the file once;
+/// [`MappedCH::open_unchecked`] skips the last two, so it is near-instant regardless of the
+/// file size.
+pub struct MappedCH {
+    inner: UniquePtr<ffi::MappedCH>,
 }
 
-impl CHQuery {
-    pub fn new(ch: &CH) -> Self {
-        let query = unsafe { ch_query_new(&ch.inner) };
-        CHQuery { inner: query }
+impl MappedCH {
+    /// Map and validate a file written by [`CH::save_mapped_file`]. Fails if the file is not
+    /// such a file, is truncated or corrupt.
+    pub fn open(file_name: &str) -> Result<Self, cxx::Exception> {
+        let inner = unsafe { mapped_ch_open(file_name, true)? };
+        Ok(MappedCH { inner })
     }
 
-    pub fn reset(&mut self) {
-        unsafe { ch_query_reset(self.inner.pin_mut()) }
+    /// Map a file checking only its header and section bounds.
+    ///
+    /// # Safety
+    /// Queries trust the section contents: the file must be an intact file written by
+    /// [`CH::save_mapped_file`] (or pass [`MappedCH::validate`] before the first query), and
+    /// must not be modified while it is mapped.
+    pub unsafe fn open_unchecked(file_name: &str) -> Result<Self, cxx::Exception> {
+        let inner = unsafe { mapped_ch_open(file_name, false)? };
+        Ok(MappedCH { inner })
     }
 
-    pub fn reset_with_ch(&mut self, ch: &CH) {
-        unsafe { ch_query_reset_ch(self.inner.pin_mut(), &ch.inner) }
+    /// Verify all section checksums and the CH structure. Runs once; later calls (and
+    /// [`MappedCH::open`]) return the cached result.
+    pub fn validate(&self) -> bool {
+        unsafe { mapped_ch_validate(&self.inner) }
     }
 
-    pub fn add_source(&mut self, s: u32, dist: u32) {
-        unsafe { ch_query_add_source(self.inner.pin_mut(), s, dist) }
+    pub fn node_count(&self) -> u32 {
+        unsafe { mapped_ch_node_count(&self.inner) }
     }
 
-    pub fn add_target(&mut self, t: u32, dist: u32) {
-        unsafe { ch_query_add_target(self.inner.pin_mut(), t, dist) }
+    /// Size of the mapped file.
+    pub fn file_bytes(&self) -> usize {
+        unsafe { mapped_ch_file_bytes(&self.inner) }
     }
+}
 
-    pub fn pin_targets(&mut self, targets: &[u32]) {
-        unsafe { ch_query_pin_targets(self.inner.pin_mut(), targets) }
-    }
+/// Point-to-point query on a [`MappedCH`]: bidirectional upward search with stall-on-demand.
+/// Not `Sync`; use one per thread.
+pub struct MappedCHQuery<'a> {
+    inner: UniquePtr<ffi::MappedCHQuery>,
+    ch: &'a MappedCH,
+}
 
-    pub fn pin_sources(&mut self, sources: &[u32]) {
-        unsafe { ch_query_pin_sources(self.inner.pin_mut(), sources) }
+impl<'a> MappedCHQuery<'a> {
+    pub fn new(ch: &'a MappedCH) -> Self {
+        let inner = unsafe { mapped_ch_query_new(&ch.inner) };
+        MappedCHQuery { inner, ch }
     }
 
-    pub fn reset_source(&mut self) {
-        unsafe { ch_query_reset_source(self.inner.pin_mut()) }
+    /// Shortest distance from `s` to `t`, `None` if unreachable. The path stays available
+    /// through [`MappedCHQuery::node_path`] and [`MappedCHQuery::arc_path`] until the next run.
+    pub fn run(&mut self, s: u32, t: u32) -> Option<u32> {
+        let node_count = self.ch.node_count();
+        assert!(s < node_count, "source node id out of range");
+        assert!(t < node_count, "target node id out of range");
+        let d = unsafe { mapped_ch_query_run(self.inner.pin_mut(), s, t) };
+        if d == (i32::MAX as u32) {
+            None
+        } else {
+            Some(d)
+        }
     }
 
-    pub fn reset_target(&mut self) {
-        unsafe { ch_query_reset_target(self.inner.pin_mut()) }
+    /// Node ids of the last shortest path, empty if unreachable or not run.
+    pub fn node_path(&self) -> Vec<u32> {
+        unsafe { mapped_ch_query_node_path(&self.inner) }
     }
 
-    pub fn run<'b>(&'b mut self) -> CCHQueryResult<'b, 'static> {
-        unsafe { ch_query_run(self.inner.pin_mut()) };
-        CCHQueryResult {
-            query: QueryRef::CH(self),
-        }
+    /// Input arc ids of the last shortest path, empty if unreachable or not run.
+    pub fn arc_path(&self) -> Vec<u32> {
+        unsafe { mapped_ch_query_arc_path(&self.inner) }
     }
+}
 
-    pub fn run_to_pinned_targets<'b>(&'b mut self) -> CCHQueryResult<'b, 'static> {
-        unsafe { ch_query_run_to_pinned_targets(self.inner.pin_mut()) };
-        CCHQueryResult {
-            query: QueryRef::CH(self),
-        }
-    }
+/// Hub-label distance oracle computed from a [`CH`].
+///
+/// Every node keeps a forward and a backward label of (hub, distance) pairs, so a query only
+/// intersects two sorted arrays (with SSE4.1 when the build target has it) instead of running
+/// a search. Labels are stored uncompressed, as u32 hub and u32 distance arrays behind u64
+/// offsets, so that they can be intersected with SIMD. They are typically hundreds of entries
+/// per node, so expect tens of times the memory of the CH; a perfect CH from
+/// [`CCHMetric::build_contraction_hierarchy_using_perfect_witness_search`] gives the smallest
+/// labels. Distances only, no paths. Read-only after construction, so one instance serves all
+/// threads.
+pub struct HubLabels {
+    inner: UniquePtr<ffi::HubLabels>,
+}
+
+impl HubLabels {
+    /// Build labels on `thread_count` threads (0 -> auto). Without the `openmp` feature the
+    /// build runs on one thread and `thread_count` is ignored.
+    pub fn build(ch: &CH, thread_count: u32) -> Self {
+        let inner = unsafe { hub_labels_build(&ch.inner, thread_count) };
+        HubLabels { inner }
+    }
+
+    /// Save in the page-aligned format that [`HubLabels::open`] maps instead of loading it.
+    pub fn save_mapped_file(&self, file_name: &str) -> Result<(), cxx::Exception> {
+        unsafe { hub_labels_save_mapped_file(&self.inner, file_name) }
+    }
+
+    /// Map and validate a file written by [`HubLabels::save_mapped_file`], like
+    /// [`MappedCH::open`]. Fails if the file is not such a file, is truncated or corrupt.
+    pub fn open(file_name: &str) -> Result<Self, cxx::Exception> {
+        let inner = unsafe { hub_labels_open(file_name, true)? };
+        Ok(HubLabels { inner })
+    }
+
+    /// Map a file checking only its header and section bounds.
+    ///
+    /// # Safety
+    /// Queries trust the label offsets and hubs: the file must be an intact file written by
+    /// [`HubLabels::save_mapped_file`] (or pass [`HubLabels::validate`] before the first
+    /// query), and must not be modified while it is mapped.
+    pub unsafe fn open_unchecked(file_name: &str) -> Result<Self, cxx::Exception> {
+        let inner = unsafe { hub_labels_open(file_name, false)? };
+        Ok(HubLabels { inner })
+    }
+
+    /// Verify the section checksums (mapped files) and the label structure. Runs once; later
+    /// calls (and [`HubLabels::open`]) return the cached result.
+    pub fn validate(&self) -> bool {
+        unsafe { hub_labels_validate(&self.inner) }
+    }
+
+    pub fn node_count(&self) -> u32 {
+        unsafe { hub_labels_node_count(&self.inner) }
+    }
+
+    /// Number of (hub, distance) entries over all forward and backward labels.
+    pub fn entry_count(&self) -> u64 {
+        unsafe { hub_labels_entry_count(&self.inner) }
+    }
+
+    /// Bytes of the label arrays.
+    pub fn memory_bytes(&self) -> usize {
+        unsafe { hub_labels_memory_bytes(&self.inner) }
+    }
+
+    /// Shortest distance from `s` to `t`, `None` if unreachable.
+    pub fn distance(&self, s: u32, t: u32) -> Option<u32> {
+        let node_count = self.node_count();
+        assert!(s < node_count, "source node id out of range");
+        assert!(t < node_count, "target node id out of range");
+        let d = unsafe { hub_labels_distance(&self.inner, s, t) };
+        if d == (i32::MAX as u32) {
+            None
+        } else {
+            Some(d)
+        }
+    }
+}
+
+/// Batched distances on a [`CH`]: bucket many-to-many matrices and PHAST one-to-all sweeps.
+///
+/// A matrix runs one upward search per target (leaving its distances in buckets at the
+/// settled nodes) and one per source (scanning those buckets), so it costs `|S| + |T|` upward
+/// searches regardless of the graph size. A PHAST sweep runs one upward search and then visits
+/// every arc of the downward graph once in decreasing rank, which beats repeated one-to-many
+/// queries when most nodes are needed. Both benefit from the small search spaces of a perfect
+/// CH built by [`CCHMetric::build_contraction_hierarchy_using_perfect_witness_search`].
+/// Scratch of a few arrays of `node_count` entries is allocated on first use. Not `Sync`; use
+/// one per thread.
+pub struct CHBatchQuery<'a> {
+    inner: UniquePtr<ffi::CHBatchQuery>,
+    ch: &'a CH,
+}
+
+impl<'a> CHBatchQuery<'a> {
+    pub fn new(ch: &'a CH) -> Self {
+        let inner = unsafe { ch_batch_query_new(&ch.inner) };
+        CHBatchQuery { inner, ch }
+    }
+
+    /// Row-major distance matrix: entry `i * targets.len() + j` is the distance from
+    /// `sources[i]` to `targets[j]`, `i32::MAX` if unreachable.
+    pub fn matrix(&mut self, sources: &[u32], targets: &[u32]) -> Vec<u32> {
+        let mut dists = vec![0; sources.len() * targets.len()];
+        self.matrix_no_alloc(sources, targets, &mut dists);
+        dists
+    }
+
+    /// Like [`CHBatchQuery::matrix`], writing into `dists`.
+    pub fn matrix_no_alloc(&mut self, sources: &[u32], targets: &[u32], dists: &mut [u32]) {
+        let node_count = self.ch.node_count();
+        assert!(
+            sources.iter().all(|&s| s < node_count),
+            "source node id out of range"
+        );
+        assert!(
+            targets.iter().all(|&t| t < node_count),
+            "target node id out of range"
+        );
+        assert_eq!(
+            dists.len(),
+            sources.len() * targets.len(),
+            "dists length must equal sources.len() * targets.len()"
+        );
+        unsafe { ch_batch_query_matrix(self.inner.pin_mut(), sources, targets, dists) }
+    }
+
+    /// Distances from `s` to every node, indexed by node id; `i32::MAX` if unreachable.
+    pub fn one_to_all(&mut self, s: u32) -> Vec<u32> {
+        let mut dists = vec![0; self.ch.node_count() as usize];
+        self.one_to_all_no_alloc(s, &mut dists);
+        dists
+    }
+
+    /// Like [`CHBatchQuery::one_to_all`], writing into `dists` (one entry per node).
+    pub fn one_to_all_no_alloc(&mut self, s: u32, dists: &mut [u32]) {
+        let node_count = self.ch.node_count();
+        assert!(s < node_count, "source node id out of range");
+        assert_eq!(
+            dists.len(),
+            node_count as usize,
+            "dists length must equal node count"
+        );
+        unsafe { ch_batch_query_one_to_all(self.inner.pin_mut(), s, dists) }
+    }
+}
+
+/// A reusable query object for a [`CH`].
+pub struct CHQuery {
+    inner: UniquePtr<ffi::CHQuery>,
+}
+
+impl CHQuery {
+    pub fn new(ch: &CH) -> Self {
+        let query = unsafe { ch_query_new(&ch.inner) };
+        CHQuery { inner: query }
+    }
+
+    /// Reset for the next query. Pushed flags are timestamped, so no per-node state is cleared.
+    pub fn reset(&mut self) {
+        unsafe { ch_query_reset(self.inner.pin_mut()) }
+    }
+
+    pub fn reset_with_ch(&mut self, ch: &CH) {
+        unsafe { ch_query_reset_ch(self.inner.pin_mut(), &ch.inner) }
+    }
+
+    pub fn add_source(&mut self, s: u32, dist: u32) {
+        unsafe { ch_query_add_source(self.inner.pin_mut(), s, dist) }
+    }
+
+    pub fn add_target(&mut self, t: u32, dist: u32) {
+        unsafe { ch_query_add_target(self.inner.pin_mut(), t, dist) }
+    }
+
+    pub fn pin_targets(&mut self, targets: &[u32]) {
+        unsafe { ch_query_pin_targets(self.inner.pin_mut(), targets) }
+    }
+
+    pub fn pin_sources(&mut self, sources: &[u32]) {
+        unsafe { ch_query_pin_sources(self.inner.pin_mut(), sources) }
+    }
+
+    pub fn reset_source(&mut self) {
+        unsafe { ch_query_reset_source(self.inner.pin_mut()) }
+    }
+
+    pub fn reset_target(&mut self) {
+        unsafe { ch_query_reset_target(self.inner.pin_mut()) }
+    }
+
+    /// Add a source at `fraction` (0 = tail, 1 = head) along input arc `arc` of the CH; see
+    /// [`CCHQuery::add_source_on_arc`]. Weights are those given to [`CH::with_input_arcs`],
+    /// which must be called first.
+    pub fn add_source_on_arc(&mut self, arc: u32, fraction: f32) {
+        self.add_sources_on_arcs(&[arc], &[fraction]);
+    }
+
+    /// Add a target at `fraction` along input arc `arc`; see [`CHQuery::add_source_on_arc`].
+    pub fn add_target_on_arc(&mut self, arc: u32, fraction: f32) {
+        self.add_targets_on_arcs(&[arc], &[fraction]);
+    }
+
+    /// Add a source for every `(arcs[i], fractions[i])` in one call.
+    pub fn add_sources_on_arcs(&mut self, arcs: &[u32], fractions: &[f32]) {
+        let arc_count = unsafe { ch_query_input_arc_count(&self.inner) };
+        assert!(
+            arcs.is_empty() || arc_count > 0,
+            "CH has no input arcs; set them with CH::with_input_arcs"
+        );
+        check_on_arc(arcs, fractions, arc_count as usize);
+        unsafe { ch_query_add_sources_on_arcs(self.inner.pin_mut(), arcs, fractions) }
+    }
+
+    /// Add a target for every `(arcs[i], fractions[i])` in one call.
+    pub fn add_targets_on_arcs(&mut self, arcs: &[u32], fractions: &[f32]) {
+        let arc_count = unsafe { ch_query_input_arc_count(&self.inner) };
+        assert!(
+            arcs.is_empty() || arc_count > 0,
+            "CH has no input arcs; set them with CH::with_input_arcs"
+        );
+        check_on_arc(arcs, fractions, arc_count as usize);
+        unsafe { ch_query_add_targets_on_arcs(self.inner.pin_mut(), arcs, fractions) }
+    }
+
+    pub fn run<'b>(&'b mut self) -> CCHQueryResult<'b, 'static> {
+        unsafe { ch_query_run(self.inner.pin_mut()) };
+        CCHQueryResult {
+            query: QueryRef::CH(self),
+        }
+    }
+
+    pub fn run_to_pinned_targets<'b>(&'b mut self) -> CCHQueryResult<'b, 'static> {
+        unsafe { ch_query_run_to_pinned_targets(self.inner.pin_mut()) };
+        CCHQueryResult {
+            query: QueryRef::CH(self),
+        }
+    }
 }
 
 /// A customized metric (weight binding) for a given [`CCH`].
@@ -416,6 +1537,13 @@ pub struct CCHMetric<'a> {
     inner: UniquePtr<ffi::CCHMetric>,
     weights: Box<[u32]>, // The C++ side stores only a raw pointer; it is valid for the lifetime of `self`.
     cch: &'a CCH,
+    epoch: u64,
+}
+
+static NEXT_METRIC_EPOCH: AtomicU64 = AtomicU64::new(0);
+
+fn next_metric_epoch() -> u64 {
+    NEXT_METRIC_EPOCH.fetch_add(1, Ordering::Relaxed)
 }
 
 impl<'a> CCHMetric<'a> {
@@ -437,6 +1565,7 @@ impl<'a> CCHMetric<'a> {
             inner: metric,
             weights: boxed,
             cch,
+            epoch: next_metric_epoch(),
         }
     }
 
@@ -457,6 +1586,7 @@ impl<'a> CCHMetric<'a> {
             inner: metric,
             weights: boxed,
             cch,
+            epoch: next_metric_epoch(),
         }
     }
 
@@ -464,33 +1594,776 @@ impl<'a> CCHMetric<'a> {
     #[cfg(feature = "openmp")]
     pub fn parallel_new(cch: &'a CCH, weights: Vec<u32>, thread_count: u32) -> Self {
         assert!(
-            weights.len() == cch.edge_count,
-            "weights length must equal arc count",
+            weights.len() == cch.edge_count,
+            "weights length must equal arc count",
+        );
+        let boxed: Box<[u32]> = weights.into_boxed_slice();
+        let metric = unsafe {
+            let mut metric = cch_metric_new(&cch.inner, &boxed);
+            cch_metric_parallel_customize(metric.as_mut().unwrap(), thread_count);
+            metric
+        };
+        CCHMetric {
+            inner: metric,
+            weights: boxed,
+            cch,
+            epoch: next_metric_epoch(),
+        }
+    }
+
+    /// Identifies the weights of this metric: unique among all metrics of the process and
+    /// renewed by every [`CCHMetricPartialUpdater`] update. NUMA replicas share the epoch of
+    /// their original. Keys [`CCHQueryCache`] entries.
+    pub fn epoch(&self) -> u64 {
+        self.epoch
+    }
+
+    /// Build a standard Contraction Hierarchy using perfect witness search.
+    /// This converts the CCH metric into a standard CH.
+    pub fn build_contraction_hierarchy_using_perfect_witness_search(&mut self) -> CH {
+        let ch = unsafe { cch_metric_build_perfect_ch(self.inner.as_mut().unwrap()) };
+        CH { inner: ch }
+    }
+
+    /// Same as [`CCHMetric::build_contraction_hierarchy_using_perfect_witness_search`] on
+    /// `thread_count` threads (0 -> auto).
+    ///
+    /// Perfect customization runs top-down and path unpacking bottom-up over the levels of
+    /// the elimination tree, witness pruning over all nodes at once; the CH arrays are filled
+    /// directly with CCH ranks as CH ranks. Takes `&self`, since the metric is not modified.
+    /// Needs the `openmp` feature.
+    #[cfg(feature = "openmp")]
+    pub fn build_contraction_hierarchy_using_perfect_witness_search_parallel(
+        &self,
+        thread_count: u32,
+    ) -> CH {
+        let ch = unsafe { cch_metric_build_perfect_ch_parallel(&self.inner, thread_count) };
+        CH { inner: ch }
+    }
+
+    /// weights slice
+    pub fn weights(&self) -> &[u32] {
+        &self.weights
+    }
+
+    /// Heap bytes of the customized forward/backward weights plus the owned input weights.
+    /// See [`QuantizedCCHMetric::memory_bytes`].
+    pub fn memory_bytes(&self) -> usize {
+        unsafe { cch_metric_memory_bytes(&self.inner) }
+    }
+
+    /// All nodes within `limit` of `source`. Allocates fresh scratch; reuse a [`CCHRangeQuery`]
+    /// for many queries.
+    pub fn range_query(&self, source: u32, limit: u32) -> RangeQueryResult {
+        CCHRangeQuery::new(self).run(source, limit, false)
+    }
+
+    /// Ask the kernel to back the customized weights with transparent huge pages.
+    /// Returns the number of bytes advised (0 where unsupported). See [`AllocationOptions`].
+    pub fn advise_huge_pages(&self) -> usize {
+        unsafe { cch_metric_advise_huge_pages(&self.inner) }
+    }
+
+    /// Distances of the pairs `(sources[i], targets[i])`, computed on `thread_count` threads
+    /// (0 = available parallelism) with one [`CCHQuery`] each. Threads get at least 64 pairs
+    /// each, so small batches use fewer threads and a batch of at most 64 pairs runs on the
+    /// calling thread. Unreachable pairs get `i32::MAX`. For many small batches, a
+    /// [`CCHQuery`] per thread of your own avoids the per-call setup entirely.
+    pub fn batch_distances(
+        &self,
+        sources: &[u32],
+        targets: &[u32],
+        thread_count: usize,
+    ) -> Vec<u32> {
+        let mut distances = vec![0; sources.len()];
+        self.batch_distances_no_alloc(sources, targets, thread_count, &mut distances);
+        distances
+    }
+
+    /// Like [`CCHMetric::batch_distances`], writing into `distances` (one entry per pair).
+    pub fn batch_distances_no_alloc(
+        &self,
+        sources: &[u32],
+        targets: &[u32],
+        thread_count: usize,
+        distances: &mut [u32],
+    ) {
+        self.check_batch(sources, targets);
+        assert_eq!(
+            distances.len(),
+            sources.len(),
+            "distances must have one entry per pair"
+        );
+        let chunk = batch_chunk_len(sources.len(), thread_count);
+        run_batch_chunks(distances.chunks_mut(chunk).enumerate(), |(i, out)| {
+            let pairs = sources[i * chunk..].iter().zip(&targets[i * chunk..]);
+            let mut query = CCHQuery::new(self);
+            for ((&s, &t), d) in pairs.zip(out) {
+                query.add_source(s, 0);
+                query.add_target(t, 0);
+                *d = query.run().distance().unwrap_or(i32::MAX as u32);
+            }
+        });
+    }
+
+    /// Distances of the pairs (point on `source_arcs[i]` at `source_fractions[i]`, point on
+    /// `target_arcs[i]` at `target_fractions[i]`), as with [`CCHQuery::add_source_on_arc`] /
+    /// [`CCHQuery::add_target_on_arc`]. Each thread routes its whole chunk in one native call.
+    /// Threads as in [`CCHMetric::batch_distances`]; unreachable pairs get `i32::MAX`.
+    pub fn batch_distances_on_arcs(
+        &self,
+        source_arcs: &[u32],
+        source_fractions: &[f32],
+        target_arcs: &[u32],
+        target_fractions: &[f32],
+        thread_count: usize,
+    ) -> Vec<u32> {
+        check_on_arc(source_arcs, source_fractions, self.cch.edge_count);
+        check_on_arc(target_arcs, target_fractions, self.cch.edge_count);
+        assert_eq!(
+            source_arcs.len(),
+            target_arcs.len(),
+            "sources and targets must have the same length"
+        );
+        let mut distances = vec![0; source_arcs.len()];
+        let chunk = batch_chunk_len(source_arcs.len(), thread_count);
+        run_batch_chunks(distances.chunks_mut(chunk).enumerate(), |(i, out)| {
+            let range = i * chunk..i * chunk + out.len();
+            let (sa, sf) = (
+                &source_arcs[range.clone()],
+                &source_fractions[range.clone()],
+            );
+            let (ta, tf) = (&target_arcs[range.clone()], &target_fractions[range]);
+            let mut query = CCHQuery::new(self);
+            unsafe {
+                ffi::cch_query_distances_on_arcs(query.inner.as_mut().unwrap(), sa, sf, ta, tf, out)
+            }
+        });
+        distances
+    }
+
+    /// Shortest paths of the pairs `(sources[i], targets[i])` as node ids (or input arc ids if
+    /// `arc_ids`), flattened into one array; see [`BatchPaths`]. Threads as in
+    /// [`CCHMetric::batch_distances`].
+    pub fn batch_paths(
+        &self,
+        sources: &[u32],
+        targets: &[u32],
+        thread_count: usize,
+        arc_ids: bool,
+    ) -> BatchPaths {
+        self.check_batch(sources, targets);
+        let chunk = batch_chunk_len(sources.len(), thread_count);
+        let parts = run_batch_chunks(
+            sources.chunks(chunk).zip(targets.chunks(chunk)),
+            |(sources, targets)| {
+                let mut query = CCHQuery::new(self);
+                let mut part = BatchPaths::default();
+                for (&s, &t) in sources.iter().zip(targets) {
+                    query.add_source(s, 0);
+                    query.add_target(t, 0);
+                    let result = query.run();
+                    part.distances
+                        .push(result.distance().unwrap_or(i32::MAX as u32));
+                    part.paths.extend(if arc_ids {
+                        result.arc_path()
+                    } else {
+                        result.node_path()
+                    });
+                    part.offsets.push(part.paths.len() as u64);
+                }
+                part
+            },
+        );
+
+        let mut paths = BatchPaths {
+            distances: Vec::with_capacity(sources.len()),
+            offsets: Vec::with_capacity(sources.len() + 1),
+            paths: Vec::with_capacity(parts.iter().map(|p| p.paths.len()).sum()),
+        };
+        paths.offsets.push(0);
+        for part in parts {
+            let base = paths.paths.len() as u64;
+            paths.distances.extend(part.distances);
+            paths.offsets.extend(part.offsets.iter().map(|&o| base + o));
+            paths.paths.extend(part.paths);
+        }
+        paths
+    }
+
+    fn check_batch(&self, sources: &[u32], targets: &[u32]) {
+        assert_eq!(
+            sources.len(),
+            targets.len(),
+            "sources and targets must have the same length"
+        );
+        for (&s, &t) in sources.iter().zip(targets) {
+            assert!(
+                (s as usize) < self.cch.node_count,
+                "source node id out of range"
+            );
+            assert!(
+                (t as usize) < self.cch.node_count,
+                "target node id out of range"
+            );
+        }
+    }
+}
+
+/// Number of online NUMA nodes; 1 on single-socket machines and outside Linux.
+pub fn numa_node_count() -> u32 {
+    unsafe { ffi::numa_node_count() }
+}
+
+/// Restrict the calling thread to the CPUs of NUMA `node`. Returns false if the node does not
+/// exist or the affinity could not be set.
+pub fn pin_current_thread_to_numa_node(node: u32) -> bool {
+    unsafe { ffi::numa_pin_current_thread(node) }
+}
+
+/// Memory placement options for [`CCHMetricReplicas`].
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct AllocationOptions {
+    /// Request transparent huge pages (`madvise(MADV_HUGEPAGE)`) for the topology and weight
+    /// arrays, reducing TLB misses of the random accesses queries make. Linux only.
+    pub transparent_huge_pages: bool,
+    /// Keep one copy of the topology and weights (input and customized) per NUMA node, allocated
+    /// by a thread pinned to that node, so that queries read node-local memory.
+    pub numa_replicas: bool,
+}
+
+/// A [`CCHMetric`] together with optional per-NUMA-node copies.
+///
+/// Query threads call [`CCHMetricReplicas::local`] (or [`CCHMetricReplicas::query`]) to get the
+/// copy for the node they run on; pin them with [`pin_current_thread_to_numa_node`] so they do
+/// not migrate. Without `numa_replicas` every call returns the original; with it there is one
+/// copy per node, also on single-node machines, where it only differs from the original in
+/// being allocated after the huge page advice.
+/// Replicas are snapshots: re-create them after re-customizing the original.
+///
+/// Thread-safety: `Send + Sync`.
+pub struct CCHMetricReplicas<'a> {
+    metric: &'a CCHMetric<'a>,
+    replicas: Vec<CCHMetric<'a>>,
+}
+
+impl<'a> CCHMetricReplicas<'a> {
+    pub fn new(metric: &'a CCHMetric<'a>, options: AllocationOptions) -> Self {
+        if options.transparent_huge_pages {
+            metric.cch.advise_huge_pages();
+            metric.advise_huge_pages();
+        }
+        let mut replicas = Vec::new();
+        if options.numa_replicas {
+            for node in 0..numa_node_count() {
+                // Zeroed allocations are not touched yet; the pinned copy places their pages.
+                let mut weights = vec![0; metric.weights.len()].into_boxed_slice();
+                let inner = unsafe {
+                    cch_metric_numa_replica(
+                        &metric.inner,
+                        &mut weights,
+                        node,
+                        options.transparent_huge_pages,
+                    )
+                };
+                replicas.push(CCHMetric {
+                    inner,
+                    weights,
+                    cch: metric.cch,
+                    epoch: metric.epoch,
+                });
+            }
+        }
+        CCHMetricReplicas { metric, replicas }
+    }
+
+    /// Number of NUMA-local copies (0 if the original is used everywhere).
+    pub fn replica_count(&self) -> usize {
+        self.replicas.len()
+    }
+
+    /// The copy for the NUMA node the calling thread currently runs on.
+    pub fn local(&self) -> &CCHMetric<'a> {
+        let node = unsafe { ffi::numa_current_node() } as usize;
+        self.replicas.get(node).unwrap_or(self.metric)
+    }
+
+    /// The copy for NUMA `node`, or the original if there is none.
+    pub fn for_node(&self, node: u32) -> &CCHMetric<'a> {
+        self.replicas.get(node as usize).unwrap_or(self.metric)
+    }
+
+    /// A new query on [`CCHMetricReplicas::local`].
+    pub fn query(&self) -> CCHQuery<'_> {
+        CCHQuery::new(self.local())
+    }
+}
+
+/// Preallocated query scratch shared by many short-lived queries on one [`CCHMetric`].
+///
+/// The arena allocates a single slab with `capacity` slots of per-node labels up front;
+/// [`CCHQueryArena::query`] only claims a free slot, so creating a query per request does not
+/// allocate O(n) memory. Forward and backward labels of a node are stored next to each other.
+/// A query touches only the elimination tree ancestors of its source and target and resets
+/// exactly those labels, so reuse costs O(visited) rather than O(n).
+///
+/// Thread-safety: `Send + Sync`; threads claim their own [`CCHArenaQuery`].
+pub struct CCHQueryArena<'a> {
+    inner: UniquePtr<ffi::CCHQueryArena>,
+    metric: &'a CCHMetric<'a>,
+}
+
+impl<'a> CCHQueryArena<'a> {
+    /// Allocate labels for up to `capacity` queries that are alive at the same time.
+    pub fn new(metric: &'a CCHMetric<'a>, capacity: usize) -> Self {
+        assert!(capacity <= u32::MAX as usize, "arena capacity too large");
+        let inner = unsafe { cch_query_arena_new(&metric.inner, capacity as u32) };
+        CCHQueryArena { inner, metric }
+    }
+
+    /// Claim a slot. Returns `None` if `capacity` queries are already alive.
+    pub fn query(&self) -> Option<CCHArenaQuery<'_>> {
+        let inner = unsafe { cch_arena_query_new(&self.inner) };
+        if inner.is_null() {
+            None
+        } else {
+            Some(CCHArenaQuery { inner, arena: self })
+        }
+    }
+
+    /// Number of slots not claimed by a live query.
+    pub fn available(&self) -> usize {
+        unsafe { cch_query_arena_available(&self.inner) as usize }
+    }
+
+    /// Heap bytes of the label slab.
+    pub fn memory_bytes(&self) -> usize {
+        unsafe { cch_query_arena_memory_bytes(&self.inner) }
+    }
+}
+
+/// Point-to-point query using one slot of a [`CCHQueryArena`]; dropping it frees the slot.
+/// Not `Sync`; use one per thread.
+pub struct CCHArenaQuery<'b> {
+    inner: UniquePtr<ffi::CCHArenaQuery>,
+    arena: &'b CCHQueryArena<'b>,
+}
+
+impl<'b> CCHArenaQuery<'b> {
+    /// Shortest distance from `s` to `t`, `None` if unreachable. The path stays available
+    /// through [`CCHArenaQuery::node_path`] and [`CCHArenaQuery::arc_path`] until the next run.
+    pub fn run(&mut self, s: u32, t: u32) -> Option<u32> {
+        let node_count = self.arena.metric.cch.node_count;
+        assert!((s as usize) < node_count, "source node id out of range");
+        assert!((t as usize) < node_count, "target node id out of range");
+        let d = unsafe { cch_arena_query_run(self.inner.pin_mut(), s, t) };
+        if d == (i32::MAX as u32) {
+            None
+        } else {
+            Some(d)
+        }
+    }
+
+    /// Node ids of the last shortest path, empty if unreachable or not run.
+    pub fn node_path(&self) -> Vec<u32> {
+        unsafe { cch_arena_query_node_path(&self.inner) }
+    }
+
+    /// Input arc ids of the last shortest path, empty if unreachable or not run.
+    pub fn arc_path(&self) -> Vec<u32> {
+        unsafe { cch_arena_query_arc_path(&self.inner) }
+    }
+}
+
+/// Reusable range (isochrone) query bound to a [`CCHMetric`].
+///
+/// Runs an upward search from the source followed by a downward PHAST sweep that is restricted
+/// to nodes pushed by a node within the limit, so the cost grows with the size of the result
+/// rather than the graph. Scratch labels are reset sparsely after every query.
+/// Thread-safety: `Send` but not `Sync`; use one instance per thread.
+pub struct CCHRangeQuery<'a> {
+    inner: UniquePtr<ffi::CCHRangeQuery>,
+    metric: &'a CCHMetric<'a>,
+}
+
+impl<'a> CCHRangeQuery<'a> {
+    pub fn new(metric: &'a CCHMetric<'a>) -> Self {
+        let inner = unsafe { cch_range_query_new(&metric.inner) };
+        CCHRangeQuery { inner, metric }
+    }
+
+    /// All nodes with `distance(source, node) <= limit`. If `with_boundary` is set, also the
+    /// arcs whose tail is within the limit but which cannot be traversed completely.
+    pub fn run(&mut self, source: u32, limit: u32, with_boundary: bool) -> RangeQueryResult {
+        self.run_batch(&[source], &[limit], with_boundary)
+            .pop()
+            .unwrap()
+    }
+
+    /// Run one range query per `(sources[i], limits[i])` in a single native call.
+    /// Panics if the slices differ in length or contain invalid node ids.
+    pub fn run_batch(
+        &mut self,
+        sources: &[u32],
+        limits: &[u32],
+        with_boundary: bool,
+    ) -> Vec<RangeQueryResult> {
+        assert!(
+            sources.len() == limits.len(),
+            "sources and limits must have the same length"
+        );
+        assert!(
+            sources
+                .iter()
+                .all(|&s| (s as usize) < self.metric.cch.node_count),
+            "source node id out of range"
+        );
+        let (mut first, mut nodes, mut distances) = (Vec::new(), Vec::new(), Vec::new());
+        let (mut boundary_first, mut boundary_arcs, mut boundary_offsets) =
+            (Vec::new(), Vec::new(), Vec::new());
+        unsafe {
+            cch_range_query_run(
+                self.inner.pin_mut(),
+                sources,
+                limits,
+                with_boundary,
+                &mut first,
+                &mut nodes,
+                &mut distances,
+                &mut boundary_first,
+                &mut boundary_arcs,
+                &mut boundary_offsets,
+            );
+        }
+        (0..sources.len())
+            .map(|i| {
+                let (b, e) = (first[i] as usize, first[i + 1] as usize);
+                let (bb, be) = (boundary_first[i] as usize, boundary_first[i + 1] as usize);
+                RangeQueryResult {
+                    nodes: nodes[b..e].to_vec(),
+                    distances: distances[b..e].to_vec(),
+                    boundary_arcs: boundary_arcs[bb..be].to_vec(),
+                    boundary_offsets: boundary_offsets[bb..be].to_vec(),
+                }
+            })
+            .collect()
+    }
+}
+
+/// Index for k-nearest POI queries on a [`CCHMetric`].
+///
+/// Stores the backward upward search space of every POI in per-node buckets sorted by distance.
+/// A query runs one upward search from the source and scans buckets until the `k` results are
+/// provably final. POIs can be inserted and removed without a rebuild; a metric update requires
+/// a new index (enforced by the borrow of the metric).
+///
+/// Thread-safety: `Send + Sync`; concurrent queries each bring their own [`CCHQuery`].
+pub struct CCHPOIIndex<'a> {
+    inner: UniquePtr<ffi::CCHPOIIndex>,
+    metric: &'a CCHMetric<'a>,
+}
+
+impl<'a> CCHPOIIndex<'a> {
+    /// Build the index for the given POI nodes. Duplicates are ignored.
+    /// Panics if a node id is out of range.
+    pub fn new(metric: &'a CCHMetric<'a>, pois: &[u32]) -> Self {
+        assert!(
+            pois.iter().all(|&p| (p as usize) < metric.cch.node_count),
+            "POI node id out of range"
+        );
+        let inner = unsafe { cch_poi_index_new(&metric.inner, pois) };
+        CCHPOIIndex { inner, metric }
+    }
+
+    /// Add a POI. Returns `false` if the node already was a POI.
+    pub fn insert(&mut self, node: u32) -> bool {
+        assert!(
+            (node as usize) < self.metric.cch.node_count,
+            "POI node id out of range"
+        );
+        unsafe { cch_poi_index_insert(self.inner.pin_mut(), node) }
+    }
+
+    /// Remove a POI. Returns `false` if the node was not a POI.
+    pub fn remove(&mut self, node: u32) -> bool {
+        assert!(
+            (node as usize) < self.metric.cch.node_count,
+            "POI node id out of range"
+        );
+        unsafe { cch_poi_index_remove(self.inner.pin_mut(), node) }
+    }
+
+    pub fn len(&self) -> usize {
+        unsafe { cch_poi_index_len(&self.inner) as usize }
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// The `k` nearest reachable POIs from `source` as `(poi, distance)`, ascending by distance.
+    /// `query` must be bound to the same metric; only its scratch space is used.
+    pub fn nearest(&self, query: &mut CCHQuery<'_>, source: u32, k: u32) -> Vec<(u32, u32)> {
+        assert!(
+            std::ptr::eq(
+                query.metric.inner.as_ref().unwrap(),
+                self.metric.inner.as_ref().unwrap()
+            ),
+            "query must be bound to the metric of the POI index"
+        );
+        assert!(
+            (source as usize) < self.metric.cch.node_count,
+            "source node id out of range"
+        );
+        let (mut pois, mut distances) = (Vec::new(), Vec::new());
+        unsafe {
+            cch_poi_index_nearest(
+                &self.inner,
+                query.inner.pin_mut(),
+                source,
+                k,
+                &mut pois,
+                &mut distances,
+            );
+        }
+        pois.into_iter().zip(distances).collect()
+    }
+}
+
+/// Query-only compressed copy of a [`CCH`] topology for memory-constrained deployments.
+///
+/// Upward neighbor lists are delta-encoded as variable-width bytes with implicit arc ids,
+/// elimination tree parents are bit-packed deltas, and the down graph, tails and order are not
+/// kept at all; the rank map is dropped too if the node ids already are ranks (see
+/// [`CCH::new_renumbered`] with [`NodeRenumbering::Rank`]). Queries decode on the fly.
+/// Only distances are supported; path unpacking needs the full [`CCH`].
+///
+/// Typical use: build the [`CCH`] and customize the metrics, take
+/// [`CompressedCCHMetric`] snapshots, then drop the full index. Compare
+/// [`CompressedCCH::memory_bytes`] with [`CCH::memory_bytes`] to choose per deployment.
+pub struct CompressedCCH {
+    inner: UniquePtr<ffi::CompressedCCH>,
+    node_count: usize,
+    cch_id: u64,
+}
+
+impl CompressedCCH {
+    pub fn new(cch: &CCH) -> Self {
+        let inner = unsafe { compressed_cch_new(&cch.inner) };
+        CompressedCCH {
+            inner,
+            node_count: cch.node_count,
+            cch_id: cch.id,
+        }
+    }
+
+    /// Heap bytes of the compressed topology (excluding metrics).
+    pub fn memory_bytes(&self) -> usize {
+        unsafe { compressed_cch_memory_bytes(&self.inner) }
+    }
+}
+
+/// Customized weights of one [`CCHMetric`] stored for a [`CompressedCCH`]. Owns its data, so
+/// the source metric (and its [`CCH`]) may be dropped afterwards.
+pub struct CompressedCCHMetric<'a> {
+    inner: UniquePtr<ffi::CompressedCCHMetric>,
+    cch: &'a CompressedCCH,
+}
+
+impl<'a> CompressedCCHMetric<'a> {
+    /// Snapshot the weights of `metric`, which must be customized and belong to the [`CCH`]
+    /// `cch` was built from.
+    pub fn new(cch: &'a CompressedCCH, metric: &CCHMetric<'_>) -> Self {
+        // The snapshot walks the arcs of `cch`, so the metric must have the same arc layout.
+        assert_eq!(
+            metric.cch.id, cch.cch_id,
+            "metric does not belong to the compressed CCH"
+        );
+        let inner = unsafe { compressed_cch_metric_new(&cch.inner, &metric.inner) };
+        CompressedCCHMetric { inner, cch }
+    }
+}
+
+/// Reusable distance query on a [`CompressedCCHMetric`]. Not `Sync`; use one per thread.
+pub struct CompressedCCHQuery<'a> {
+    inner: UniquePtr<ffi::CompressedCCHQuery>,
+    metric: &'a CompressedCCHMetric<'a>,
+}
+
+impl<'a> CompressedCCHQuery<'a> {
+    pub fn new(metric: &'a CompressedCCHMetric<'a>) -> Self {
+        let inner = unsafe { compressed_cch_query_new(&metric.inner) };
+        CompressedCCHQuery { inner, metric }
+    }
+
+    /// Shortest distance from `s` to `t`, `None` if unreachable.
+    pub fn distance(&mut self, s: u32, t: u32) -> Option<u32> {
+        assert!(
+            (s as usize) < self.metric.cch.node_count,
+            "source node id out of range"
+        );
+        assert!(
+            (t as usize) < self.metric.cch.node_count,
+            "target node id out of range"
+        );
+        let d = unsafe { compressed_cch_query_distance(self.inner.pin_mut(), s, t) };
+        if d == (i32::MAX as u32) {
+            None
+        } else {
+            Some(d)
+        }
+    }
+}
+
+/// Storage width of a [`QuantizedCCHMetric`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum WeightWidth {
+    /// 2 bytes per weight; inline values up to 65533.
+    Bits16,
+    /// 3 bytes per weight; inline values up to 16777213.
+    Bits24,
+}
+
+/// Customized metric with weights stored in 16 or 24 bits instead of 32, roughly halving (or
+/// saving a quarter of) the per-metric memory when many metrics are held per region.
+///
+/// Weights use a tiered layout: values that fit are stored inline, the few larger ones (mostly
+/// shortcuts high in the hierarchy) in a sorted overflow tier, so distances are exact. Input
+/// weights are not kept. Customization uses saturating arithmetic and its own 32-bit scratch,
+/// which is freed afterwards. Queries return distances only.
+///
+/// Thread-safety: `Send + Sync`; use one [`QuantizedCCHQuery`] per thread.
+pub struct QuantizedCCHMetric<'a> {
+    inner: UniquePtr<ffi::QuantizedCCHMetric>,
+    cch: &'a CCH,
+}
+
+impl<'a> QuantizedCCHMetric<'a> {
+    /// Customize `weights` (one per input arc) on `cch` and store them with `width`.
+    pub fn new(cch: &'a CCH, weights: &[u32], width: WeightWidth) -> Self {
+        assert!(
+            weights.len() == cch.edge_count,
+            "weights length must equal arc count",
+        );
+        let width_bits = match width {
+            WeightWidth::Bits16 => 16,
+            WeightWidth::Bits24 => 24,
+        };
+        let inner = unsafe { quantized_cch_metric_new(&cch.inner, weights, width_bits) };
+        QuantizedCCHMetric { inner, cch }
+    }
+
+    /// Heap bytes of the customized weights (inline and overflow tiers).
+    /// Compare with [`CCHMetric::memory_bytes`].
+    pub fn memory_bytes(&self) -> usize {
+        unsafe { quantized_cch_metric_memory_bytes(&self.inner) }
+    }
+}
+
+/// Reusable distance query on a [`QuantizedCCHMetric`]. Not `Sync`; use one per thread.
+pub struct QuantizedCCHQuery<'a> {
+    inner: UniquePtr<ffi::QuantizedCCHQuery>,
+    metric: &'a QuantizedCCHMetric<'a>,
+}
+
+impl<'a> QuantizedCCHQuery<'a> {
+    pub fn new(metric: &'a QuantizedCCHMetric<'a>) -> Self {
+        let inner = unsafe { quantized_cch_query_new(&metric.inner) };
+        QuantizedCCHQuery { inner, metric }
+    }
+
+    /// Shortest distance from `s` to `t`, `None` if unreachable.
+    pub fn distance(&mut self, s: u32, t: u32) -> Option<u32> {
+        assert!(
+            (s as usize) < self.metric.cch.node_count,
+            "source node id out of range"
         );
-        let boxed: Box<[u32]> = weights.into_boxed_slice();
-        let metric = unsafe {
-            let mut metric = cch_metric_new(&cch.inner, &boxed);
-            cch_metric_parallel_customize(metric.as_mut().unwrap(), thread_count);
-            metric
-        };
-        CCHMetric {
-            inner: metric,
-            weights: boxed,
-            cch,
+        assert!(
+            (t as usize) < self.metric.cch.node_count,
+            "target node id out of range"
+        );
+        let d = unsafe { quantized_cch_query_distance(self.inner.pin_mut(), s, t) };
+        if d == (i32::MAX as u32) {
+            None
+        } else {
+            Some(d)
         }
     }
+}
 
-    /// Build a standard Contraction Hierarchy using perfect witness search.
-    /// This converts the CCH metric into a standard CH.
-    pub fn build_contraction_hierarchy_using_perfect_witness_search(&mut self) -> CH {
-        let ch = unsafe { cch_metric_build_perfect_ch(self.inner.as_mut().unwrap()) };
-        CH { inner: ch }
-    }
+/// Result of a [`CCHRangeQuery`].
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct RangeQueryResult {
+    /// Reached nodes, in no particular order.
+    pub nodes: Vec<u32>,
+    /// `distances[i]` is the shortest distance to `nodes[i]`.
+    pub distances: Vec<u32>,
+    /// Arcs leaving the reached set (empty unless requested).
+    pub boundary_arcs: Vec<u32>,
+    /// `boundary_offsets[i]` is how far into `boundary_arcs[i]` the limit reaches
+    /// (`limit - distance(tail)`).
+    pub boundary_offsets: Vec<u32>,
+}
 
-    /// weights slice
-    pub fn weights(&self) -> &[u32] {
-        &self.weights
+/// Result of [`CCHMetric::batch_paths`]: path `i` is `paths[offsets[i]..offsets[i + 1]]`
+/// (empty if unreachable) with length `distances[i]` (`i32::MAX` if unreachable).
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct BatchPaths {
+    pub distances: Vec<u32>,
+    /// `distances.len() + 1` entries.
+    pub offsets: Vec<u64>,
+    pub paths: Vec<u32>,
+}
+
+/// Fewest pairs worth a thread of their own: below that, spawning the thread and allocating
+/// its query cost more than the pairs save.
+const BATCH_MIN_CHUNK_LEN: usize = 64;
+
+/// Pairs per thread for a batch of `len` pairs on `thread_count` threads (0 = available
+/// parallelism), at least [`BATCH_MIN_CHUNK_LEN`].
+fn batch_chunk_len(len: usize, thread_count: usize) -> usize {
+    let threads = if thread_count == 0 {
+        std::thread::available_parallelism().map_or(1, |n| n.get())
+    } else {
+        thread_count
+    };
+    len.div_ceil(threads).max(BATCH_MIN_CHUNK_LEN)
+}
+
+/// `work` of every chunk in order, each on its own scoped thread. A single chunk runs on the
+/// calling thread, so small batches spawn nothing.
+fn run_batch_chunks<T: Send, R: Send>(
+    chunks: impl Iterator<Item = T>,
+    work: impl Fn(T) -> R + Sync,
+) -> Vec<R> {
+    let mut chunks = chunks.collect::<Vec<_>>();
+    if chunks.len() <= 1 {
+        return chunks.pop().map(&work).into_iter().collect();
     }
+    let work = &work;
+    std::thread::scope(|scope| {
+        let handles: Vec<_> = chunks
+            .into_iter()
+            .map(|chunk| scope.spawn(move || work(chunk)))
+            .collect();
+        handles.into_iter().map(|h| h.join().unwrap()).collect()
+    })
+}
+
+fn check_on_arc(arcs: &[u32], fractions: &[f32], arc_count: usize) {
+    assert_eq!(
+        arcs.len(),
+        fractions.len(),
+        "arcs and fractions must have the same length"
+    );
+    assert!(
+        arcs.iter().all(|&a| (a as usize) < arc_count),
+        "arc id out of range"
+    );
+    assert!(
+        fractions.iter().all(|f| (0.0..=1.0).contains(f)),
+        "fraction must be in [0, 1]"
+    );
 }
 
 /// Reusable partial customization helper. Construct once if you perform many small incremental
@@ -531,6 +2404,40 @@ impl<'a> CCHMetricPartialUpdater<'a> {
                 metric.inner.as_mut().unwrap(),
             );
         }
+        metric.epoch = next_metric_epoch();
+    }
+
+    /// Like [`CCHMetricPartialUpdater::apply`] with the updates as parallel arrays: arc
+    /// `arc_ids[i]` gets weight `weights[i]` (later entries win for repeated arcs). All arcs are
+    /// marked and customized in a single FFI call.
+    pub fn apply_arrays(&mut self, metric: &mut CCHMetric<'a>, arc_ids: &[u32], weights: &[u32]) {
+        assert!(
+            std::ptr::eq(metric.cch, self.cch),
+            "CCHMetricPartialUpdater must be used with metrics from the same CCH"
+        );
+        assert_eq!(
+            arc_ids.len(),
+            weights.len(),
+            "arc_ids and weights must have the same length"
+        );
+        // Validate every id first so a bad batch leaves the weights untouched.
+        assert!(
+            arc_ids
+                .iter()
+                .all(|&arc| (arc as usize) < metric.weights.len()),
+            "arc id out of range"
+        );
+        for (&arc, &weight) in arc_ids.iter().zip(weights) {
+            metric.weights[arc as usize] = weight;
+        }
+        unsafe {
+            cch_partial_apply(
+                self.partial.as_mut().unwrap(),
+                metric.inner.as_mut().unwrap(),
+                arc_ids,
+            );
+        }
+        metric.epoch = next_metric_epoch();
     }
 }
 
@@ -578,7 +2485,8 @@ impl<'a> CCHQuery<'a> {
         CCHQuery { inner, metric }
     }
 
-    /// Reset the query object to be reused with the same metric.
+    /// Reset the query object to be reused with the same metric. Only the labels the last
+    /// query touched are cleared, so this costs no more than the query itself.
     pub fn reset(&mut self) {
         unsafe {
             cch_query_reset(self.inner.as_mut().unwrap(), &self.metric.inner);
@@ -649,6 +2557,697 @@ impl<'a> CCHQuery<'a> {
     pub fn reset_target(&mut self) {
         unsafe { ffi::cch_query_reset_target(self.inner.as_mut().unwrap()) }
     }
+
+    /// Continue the label generations of the native searches from `generation`, e.g. just
+    /// below `u32::MAX` to exercise the wrap-around. Only for tests.
+    #[doc(hidden)]
+    pub fn set_search_generation(&mut self, generation: u32) {
+        assert!(generation > 0, "generation 0 marks unused labels");
+        unsafe { ffi::cch_query_set_search_generation(self.inner.as_mut().unwrap(), generation) }
+    }
+
+    /// Add a source at `fraction` (0 = tail, 1 = head) along input arc `arc`, e.g. a
+    /// [`SnappedArc`]. Leaving the point means driving the rest of the arc, so this adds the
+    /// head of the arc with initial distance `weight - round(fraction * weight)` under the
+    /// query's metric. Closed arcs (weight `i32::MAX`) add nothing.
+    ///
+    /// If a target lies on the same arc ahead of the source, the route along the arc is
+    /// considered as well: [`CCHQueryResult::distance`] is the shorter of the two, and when
+    /// the arc wins the node path is `[tail, head]` and the arc path `[arc]`. Otherwise paths
+    /// run from the head of the source arc to the tail of the target arc.
+    pub fn add_source_on_arc(&mut self, arc: u32, fraction: f32) {
+        self.add_sources_on_arcs(&[arc], &[fraction]);
+    }
+
+    /// Add a target at `fraction` along input arc `arc`: its tail with initial distance
+    /// `round(fraction * weight)`. See [`CCHQuery::add_source_on_arc`].
+    pub fn add_target_on_arc(&mut self, arc: u32, fraction: f32) {
+        self.add_targets_on_arcs(&[arc], &[fraction]);
+    }
+
+    /// Add a source for every `(arcs[i], fractions[i])` in one call, e.g. all snapping
+    /// candidates of a pickup.
+    pub fn add_sources_on_arcs(&mut self, arcs: &[u32], fractions: &[f32]) {
+        check_on_arc(arcs, fractions, self.metric.cch.edge_count);
+        unsafe { ffi::cch_query_add_sources_on_arcs(self.inner.as_mut().unwrap(), arcs, fractions) }
+    }
+
+    /// Add a target for every `(arcs[i], fractions[i])` in one call.
+    pub fn add_targets_on_arcs(&mut self, arcs: &[u32], fractions: &[f32]) {
+        check_on_arc(arcs, fractions, self.metric.cch.edge_count);
+        unsafe { ffi::cch_query_add_targets_on_arcs(self.inner.as_mut().unwrap(), arcs, fractions) }
+    }
+
+    /// Pin the sources of a many-to-one workload (e.g. all couriers towards one pickup),
+    /// replacing any previously pinned many-to-one sources. Source `i` gets slot `i`.
+    ///
+    /// The upward search space of every source is computed once and stored contiguously, so
+    /// each subsequent [`CCHQuery::many_to_one_no_alloc`] only runs the target's upward search
+    /// and a vectorized gather over the stored labels instead of a full selection sweep.
+    /// Memory is proportional to the summed search space sizes (a few hundred labels per source
+    /// on road networks). Independent of [`CCHQuery::pin_sources`]; stays valid until the next
+    /// call or until the query is dropped.
+    pub fn pin_many_to_one_sources(&mut self, sources: &[u32]) {
+        for &s in sources {
+            assert!(
+                (s as usize) < self.metric.cch.node_count,
+                "source node id out of range"
+            );
+        }
+        unsafe {
+            ffi::cch_query_pin_many_to_one_sources(self.inner.as_mut().unwrap(), sources);
+        }
+    }
+
+    /// Add one source to the many-to-one set without touching the others and return its slot
+    /// (the index of its distance in [`CCHQuery::many_to_one`]). Slots freed by
+    /// [`CCHQuery::remove_pinned_source`] are reused. Costs one upward search, so moving a
+    /// vehicle is a remove plus an add instead of a full re-pin.
+    pub fn add_pinned_source(&mut self, s: u32) -> u32 {
+        assert!(
+            (s as usize) < self.metric.cch.node_count,
+            "source node id out of range",
+        );
+        unsafe { ffi::cch_query_add_pinned_source(self.inner.as_mut().unwrap(), s) }
+    }
+
+    /// Remove the many-to-one source in `slot`. Its distance reads `i32::MAX` until the slot is
+    /// reused. Returns `false` if the slot was not in use.
+    pub fn remove_pinned_source(&mut self, slot: u32) -> bool {
+        unsafe { ffi::cch_query_remove_pinned_source(self.inner.as_mut().unwrap(), slot) }
+    }
+
+    /// Distances from all pinned many-to-one sources to `t`, indexed by slot. Unreachable
+    /// sources and free slots get `i32::MAX`.
+    pub fn many_to_one(&mut self, t: u32) -> Vec<u32> {
+        let mut dists =
+            vec![0; unsafe { ffi::cch_query_pinned_source_slots(&self.inner) } as usize];
+        self.many_to_one_no_alloc(t, &mut dists);
+        dists
+    }
+
+    /// Like [`CCHQuery::many_to_one`], writing into `dists` (one entry per slot).
+    pub fn many_to_one_no_alloc(&mut self, t: u32, dists: &mut [u32]) {
+        assert!(
+            (t as usize) < self.metric.cch.node_count,
+            "target node id out of range",
+        );
+        let slot_count = unsafe { ffi::cch_query_pinned_source_slots(&self.inner) };
+        assert_eq!(
+            dists.len(),
+            slot_count as usize,
+            "dists must have one entry per pinned source slot"
+        );
+        unsafe {
+            ffi::cch_query_many_to_one(self.inner.as_mut().unwrap(), t, dists);
+        }
+    }
+
+    /// Pin the targets of a one-to-many workload, replacing any previously pinned one-to-many
+    /// targets. Target `i` gets slot `i`. Mirror image of [`CCHQuery::pin_many_to_one_sources`].
+    pub fn pin_one_to_many_targets(&mut self, targets: &[u32]) {
+        for &t in targets {
+            assert!(
+                (t as usize) < self.metric.cch.node_count,
+                "target node id out of range"
+            );
+        }
+        unsafe {
+            ffi::cch_query_pin_one_to_many_targets(self.inner.as_mut().unwrap(), targets);
+        }
+    }
+
+    /// Add one target to the one-to-many set and return its slot. See
+    /// [`CCHQuery::add_pinned_source`].
+    pub fn add_pinned_target(&mut self, t: u32) -> u32 {
+        assert!(
+            (t as usize) < self.metric.cch.node_count,
+            "target node id out of range",
+        );
+        unsafe { ffi::cch_query_add_pinned_target(self.inner.as_mut().unwrap(), t) }
+    }
+
+    /// Remove the one-to-many target in `slot`. Returns `false` if the slot was not in use.
+    pub fn remove_pinned_target(&mut self, slot: u32) -> bool {
+        unsafe { ffi::cch_query_remove_pinned_target(self.inner.as_mut().unwrap(), slot) }
+    }
+
+    /// Distances from `s` to all pinned one-to-many targets, indexed by slot. Unreachable
+    /// targets and free slots get `i32::MAX`.
+    pub fn one_to_many(&mut self, s: u32) -> Vec<u32> {
+        let mut dists =
+            vec![0; unsafe { ffi::cch_query_pinned_target_slots(&self.inner) } as usize];
+        self.one_to_many_no_alloc(s, &mut dists);
+        dists
+    }
+
+    /// Like [`CCHQuery::one_to_many`], writing into `dists` (one entry per slot).
+    pub fn one_to_many_no_alloc(&mut self, s: u32, dists: &mut [u32]) {
+        assert!(
+            (s as usize) < self.metric.cch.node_count,
+            "source node id out of range",
+        );
+        let slot_count = unsafe { ffi::cch_query_pinned_target_slots(&self.inner) };
+        assert_eq!(
+            dists.len(),
+            slot_count as usize,
+            "dists must have one entry per pinned target slot"
+        );
+        unsafe {
+            ffi::cch_query_one_to_many(self.inner.as_mut().unwrap(), s, dists);
+        }
+    }
+
+    /// Compute up to `k` alternative routes from `s` to `t` with the default
+    /// [`AlternativeRouteConfig`]. See [`CCHQuery::run_alternatives_with_config`].
+    pub fn run_alternatives(&mut self, s: u32, t: u32, k: u32) -> Vec<AlternativeRoute> {
+        self.run_alternatives_with_config(s, t, k, &AlternativeRouteConfig::default())
+    }
+
+    /// Compute up to `k` alternative routes from `s` to `t` using the via-node method.
+    ///
+    /// The forward and backward elimination tree search spaces of a single `s`-`t` query are
+    /// reused: every node reached by both searches is a via-node candidate, and candidates are
+    /// accepted by increasing length if they satisfy the bounds in `config` (stretch, sharing with
+    /// the routes already accepted, local optimality). The first route is always the shortest
+    /// path; fewer than `k` routes are returned if not enough admissible candidates exist, and
+    /// none if `t` is unreachable. Local optimality tests are capped at `2 * (k - 1)` extra
+    /// point-to-point searches, so one call costs about 2–3 plain queries for `k = 2..3`.
+    ///
+    /// Independent of sources/targets previously added to the query.
+    pub fn run_alternatives_with_config(
+        &mut self,
+        s: u32,
+        t: u32,
+        k: u32,
+        config: &AlternativeRouteConfig,
+    ) -> Vec<AlternativeRoute> {
+        assert!(
+            (s as usize) < self.metric.cch.node_count,
+            "source node id out of range",
+        );
+        assert!(
+            (t as usize) < self.metric.cch.node_count,
+            "target node id out of range",
+        );
+        let (mut distances, mut arc_first, mut arcs, mut nodes) =
+            (Vec::new(), Vec::new(), Vec::new(), Vec::new());
+        unsafe {
+            ffi::cch_query_run_alternatives(
+                self.inner.as_mut().unwrap(),
+                s,
+                t,
+                k,
+                config.max_stretch,
+                config.max_sharing,
+                config.local_optimality,
+                &mut distances,
+                &mut arc_first,
+                &mut arcs,
+                &mut nodes,
+            );
+        }
+        distances
+            .iter()
+            .enumerate()
+            .map(|(i, &distance)| {
+                let (begin, end) = (arc_first[i] as usize, arc_first[i + 1] as usize);
+                AlternativeRoute {
+                    distance,
+                    node_path: nodes[begin + i..end + i + 1].to_vec(),
+                    arc_path: arcs[begin..end].to_vec(),
+                }
+            })
+            .collect()
+    }
+
+    /// Route through `points` in order (e.g. the stops of a delivery tour) in one native call.
+    ///
+    /// Each leg is a point-to-point query. The forward search of leg `i + 1` starts at the
+    /// node where the backward search of leg `i` started, so it reuses that search space instead
+    /// of walking the elimination tree again; all legs share the query's scratch. Consecutive
+    /// equal points give an empty leg of length 0.
+    ///
+    /// Independent of sources/targets previously added to the query.
+    pub fn run_via(&mut self, points: &[u32]) -> ViaRoute {
+        assert!(
+            points
+                .iter()
+                .all(|&p| (p as usize) < self.metric.cch.node_count),
+            "point node id out of range"
+        );
+        let mut route = ViaRoute::default();
+        unsafe {
+            ffi::cch_query_run_via(
+                self.inner.as_mut().unwrap(),
+                points,
+                &mut route.leg_distances,
+                &mut route.arcs,
+                &mut route.arc_offsets,
+                &mut route.nodes,
+                &mut route.node_offsets,
+            );
+        }
+        route
+    }
+}
+
+/// Admissibility bounds for [`CCHQuery::run_alternatives_with_config`], relative to the
+/// shortest distance `d(s, t)`.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct AlternativeRouteConfig {
+    /// An alternative may be at most `(1 + max_stretch) * d(s, t)` long.
+    pub max_stretch: f64,
+    /// An alternative may share at most `max_sharing * d(s, t)` with the routes accepted before it.
+    pub max_sharing: f64,
+    /// The subpath covering `local_optimality * d(s, t)` on both sides of the via node must be a
+    /// shortest path (T-test).
+    pub local_optimality: f64,
+}
+
+impl Default for AlternativeRouteConfig {
+    fn default() -> Self {
+        AlternativeRouteConfig {
+            max_stretch: 0.25,
+            max_sharing: 0.8,
+            local_optimality: 0.25,
+        }
+    }
+}
+
+/// A route returned by [`CCHQuery::run_alternatives`].
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct AlternativeRoute {
+    pub distance: u32,
+    pub node_path: Vec<u32>,
+    pub arc_path: Vec<u32>,
+}
+
+/// A route through several points returned by [`CCHQuery::run_via`].
+///
+/// Leg `i` goes from point `i` to point `i + 1`: its input arcs are
+/// `arcs[arc_offsets[i]..arc_offsets[i + 1]]` and its nodes
+/// `nodes[node_offsets[i]..=node_offsets[i + 1]]`. An unreachable leg has length `i32::MAX`
+/// and no arcs; the node sequence then jumps to the next point.
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct ViaRoute {
+    pub leg_distances: Vec<u32>,
+    pub arcs: Vec<u32>,
+    /// One entry per point.
+    pub arc_offsets: Vec<u32>,
+    pub nodes: Vec<u32>,
+    /// One entry per point: its position in `nodes`.
+    pub node_offsets: Vec<u32>,
+}
+
+impl ViaRoute {
+    /// Total length, or `None` if a leg is unreachable.
+    pub fn distance(&self) -> Option<u32> {
+        self.leg_distances.iter().try_fold(0u32, |sum, &d| {
+            (d != i32::MAX as u32).then(|| sum.saturating_add(d))
+        })
+    }
+}
+
+/// Parameters of [`CCHMapMatcher`], following Newson and Krumm.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct MapMatchConfig {
+    /// Standard deviation of the GPS noise in meters.
+    pub sigma: f64,
+    /// Scale in meters of the difference between route length and straight-line distance
+    /// of two consecutive points.
+    pub beta: f64,
+    /// Metric weight per meter, to convert route lengths (e.g. 1 for weights in meters).
+    pub weight_per_meter: f64,
+}
+
+impl Default for MapMatchConfig {
+    fn default() -> Self {
+        MapMatchConfig {
+            sigma: 4.07,
+            beta: 3.0,
+            weight_per_meter: 1.0,
+        }
+    }
+}
+
+/// The result of [`CCHMapMatcher::match_trace`].
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct MatchedTrace {
+    /// The candidate matched to each point, `None` if the point had no usable candidate.
+    pub arcs: Vec<Option<SnappedArc>>,
+    /// Input arcs of the matched route: the matched arcs joined by shortest paths. A point that
+    /// no candidate of the previous matched point can reach starts a new piece without a
+    /// connecting path.
+    pub route: Vec<u32>,
+    /// One entry per point: the position of its matched arc in `route`, `u32::MAX` if unmatched.
+    pub route_offsets: Vec<u32>,
+}
+
+/// Hidden Markov model map matcher on a [`CCHMetric`].
+///
+/// Hidden states are the candidate arcs of each GPS point (e.g. from
+/// [`SpatialIndex::nearest_arcs`]). Emissions decay with the distance of a candidate to its
+/// point, transitions with the difference between the route length and the straight-line
+/// distance of consecutive points. All route lengths between two consecutive candidate sets
+/// come from one pinned one-to-many CCH query per candidate, and the Viterbi path is computed
+/// and expanded to arcs in one native call. Reuse a matcher for many traces; one per thread.
+pub struct CCHMapMatcher<'a> {
+    inner: UniquePtr<ffi::CCHMapMatcher>,
+    metric: &'a CCHMetric<'a>,
+}
+
+impl<'a> CCHMapMatcher<'a> {
+    pub fn new(metric: &'a CCHMetric<'a>) -> Self {
+        let inner = unsafe { ffi::cch_map_matcher_new(&metric.inner) };
+        CCHMapMatcher { inner, metric }
+    }
+
+    /// Match the trace `(latitude[i], longitude[i])` whose point `i` has the candidates
+    /// `candidates[i]`.
+    pub fn match_trace(
+        &mut self,
+        latitude: &[f32],
+        longitude: &[f32],
+        candidates: &[Vec<SnappedArc>],
+        config: &MapMatchConfig,
+    ) -> MatchedTrace {
+        assert!(
+            latitude.len() == longitude.len() && latitude.len() == candidates.len(),
+            "latitude, longitude and candidates must have the same length"
+        );
+        assert!(
+            config.sigma > 0.0 && config.beta > 0.0 && config.weight_per_meter > 0.0,
+            "sigma, beta and weight_per_meter must be positive"
+        );
+        let mut candidate_first = Vec::with_capacity(candidates.len() + 1);
+        candidate_first.push(0u32);
+        let (mut arcs, mut fractions, mut distances) = (Vec::new(), Vec::new(), Vec::new());
+        for row in candidates {
+            for c in row {
+                arcs.push(c.arc);
+                fractions.push(c.fraction);
+                distances.push(c.distance);
+            }
+            candidate_first.push(arcs.len() as u32);
+        }
+        check_on_arc(&arcs, &fractions, self.metric.cch.edge_count);
+        let mut matched = vec![u32::MAX; candidates.len()];
+        let mut route = Vec::new();
+        let mut route_offsets = vec![u32::MAX; candidates.len()];
+        unsafe {
+            ffi::cch_map_matcher_run(
+                self.inner.pin_mut(),
+                latitude,
+                longitude,
+                &candidate_first,
+                &arcs,
+                &fractions,
+                &distances,
+                config.sigma,
+                config.beta,
+                config.weight_per_meter,
+                &mut matched,
+                &mut route,
+                &mut route_offsets,
+            );
+        }
+        MatchedTrace {
+            arcs: matched
+                .iter()
+                .enumerate()
+                .map(|(i, &c)| {
+                    (c != u32::MAX).then(|| candidates[i][(c - candidate_first[i]) as usize])
+                })
+                .collect(),
+            route,
+            route_offsets,
+        }
+    }
+}
+
+/// Hit and miss counts of a [`CCHQueryCache`].
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct CacheStats {
+    pub hits: u64,
+    pub misses: u64,
+}
+
+impl CacheStats {
+    /// `hits / (hits + misses)`, 0 before the first lookup.
+    pub fn hit_rate(&self) -> f64 {
+        let lookups = self.hits + self.misses;
+        if lookups == 0 {
+            0.0
+        } else {
+            self.hits as f64 / lookups as f64
+        }
+    }
+}
+
+/// A shortest path served by [`CCHQueryCache::route`].
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct CachedRoute {
+    pub distance: u32,
+    /// Input arcs of the path, shared with the cache entry.
+    pub arc_path: Arc<[u32]>,
+}
+
+/// `(source, target, metric epoch)`.
+type CacheKey = (u32, u32, u64);
+
+const CACHE_NIL: usize = usize::MAX;
+
+struct CacheEntry {
+    key: CacheKey,
+    distance: Option<u32>,
+    arc_path: Option<Arc<[u32]>>,
+    prev: usize,
+    next: usize,
+}
+
+/// One LRU list: entries in a slab, linked from most (`head`) to least (`tail`) recently used.
+struct CacheShard {
+    index: HashMap<CacheKey, usize>,
+    entries: Vec<CacheEntry>,
+    head: usize,
+    tail: usize,
+}
+
+impl CacheShard {
+    fn new() -> Self {
+        CacheShard {
+            index: HashMap::new(),
+            entries: Vec::new(),
+            head: CACHE_NIL,
+            tail: CACHE_NIL,
+        }
+    }
+
+    fn unlink(&mut self, i: usize) {
+        let (prev, next) = (self.entries[i].prev, self.entries[i].next);
+        match prev {
+            CACHE_NIL => self.head = next,
+            p => self.entries[p].next = next,
+        }
+        match next {
+            CACHE_NIL => self.tail = prev,
+            n => self.entries[n].prev = prev,
+        }
+    }
+
+    fn push_front(&mut self, i: usize) {
+        self.entries[i].prev = CACHE_NIL;
+        self.entries[i].next = self.head;
+        match self.head {
+            CACHE_NIL => self.tail = i,
+            h => self.entries[h].prev = i,
+        }
+        self.head = i;
+    }
+
+    fn get(&mut self, key: &CacheKey) -> Option<&CacheEntry> {
+        let i = *self.index.get(key)?;
+        self.unlink(i);
+        self.push_front(i);
+        Some(&self.entries[i])
+    }
+
+    fn insert(
+        &mut self,
+        capacity: usize,
+        key: CacheKey,
+        distance: Option<u32>,
+        arc_path: Option<Arc<[u32]>>,
+    ) {
+        let i = if let Some(&i) = self.index.get(&key) {
+            // Another thread filled it meanwhile; keep a path stored by either.
+            self.unlink(i);
+            i
+        } else if self.entries.len() < capacity {
+            self.entries.push(CacheEntry {
+                key,
+                distance,
+                arc_path: None,
+                prev: CACHE_NIL,
+                next: CACHE_NIL,
+            });
+            self.index.insert(key, self.entries.len() - 1);
+            self.entries.len() - 1
+        } else {
+            let i = self.tail;
+            self.unlink(i);
+            self.index.remove(&self.entries[i].key);
+            self.index.insert(key, i);
+            self.entries[i].key = key;
+            self.entries[i].arc_path = None;
+            i
+        };
+        self.entries[i].distance = distance;
+        if arc_path.is_some() {
+            self.entries[i].arc_path = arc_path;
+        }
+        self.push_front(i);
+    }
+}
+
+/// Concurrent LRU cache of point-to-point results in front of [`CCHQuery`], for workloads that
+/// repeat source-target pairs.
+///
+/// Entries are keyed by `(source, target, metric epoch)`. Every metric has its own epoch and
+/// [`CCHMetricPartialUpdater`] renews it, so entries computed before a weight update are never
+/// served again; they simply age out. [`CCHQueryCache::distance`] stores the distance only,
+/// [`CCHQueryCache::route`] also the arc path. Keys are spread over `shard_count` independently
+/// locked LRU lists; the query itself runs outside the lock.
+///
+/// Thread-safety: `Send + Sync`; every thread passes its own [`CCHQuery`].
+pub struct CCHQueryCache {
+    shards: Box<[Mutex<CacheShard>]>,
+    shard_capacity: usize,
+    hasher: std::collections::hash_map::RandomState,
+    hits: AtomicU64,
+    misses: AtomicU64,
+}
+
+impl CCHQueryCache {
+    /// A cache for about `capacity` pairs over `shard_count` shards (0 -> four per available
+    /// thread).
+    pub fn new(capacity: usize, shard_count: usize) -> Self {
+        let shard_count = if shard_count == 0 {
+            4 * std::thread::available_parallelism().map_or(1, |n| n.get())
+        } else {
+            shard_count
+        };
+        CCHQueryCache {
+            shards: (0..shard_count)
+                .map(|_| Mutex::new(CacheShard::new()))
+                .collect(),
+            shard_capacity: capacity.div_ceil(shard_count).max(1),
+            hasher: Default::default(),
+            hits: AtomicU64::new(0),
+            misses: AtomicU64::new(0),
+        }
+    }
+
+    fn shard(&self, key: &CacheKey) -> std::sync::MutexGuard<'_, CacheShard> {
+        let i = self.hasher.hash_one(key) as usize % self.shards.len();
+        self.shards[i].lock().unwrap_or_else(|e| e.into_inner())
+    }
+
+    /// Shortest distance from `s` to `t` on the metric of `query`, `None` if unreachable.
+    /// Runs the query on a miss, so pending sources/targets of the query are discarded.
+    pub fn distance(&self, query: &mut CCHQuery, s: u32, t: u32) -> Option<u32> {
+        let key = (s, t, query.metric.epoch);
+        if let Some(entry) = self.shard(&key).get(&key) {
+            self.hits.fetch_add(1, Ordering::Relaxed);
+            return entry.distance;
+        }
+        self.misses.fetch_add(1, Ordering::Relaxed);
+        query.reset();
+        query.add_source(s, 0);
+        query.add_target(t, 0);
+        let distance = query.run().distance();
+        self.shard(&key)
+            .insert(self.shard_capacity, key, distance, None);
+        distance
+    }
+
+    /// Shortest path from `s` to `t` on the metric of `query`, `None` if unreachable. An entry
+    /// stored by [`CCHQueryCache::distance`] only counts as a hit if `t` is unreachable.
+    pub fn route(&self, query: &mut CCHQuery, s: u32, t: u32) -> Option<CachedRoute> {
+        let key = (s, t, query.metric.epoch);
+        if let Some(entry) = self.shard(&key).get(&key) {
+            match (entry.distance, &entry.arc_path) {
+                (None, _) => {
+                    self.hits.fetch_add(1, Ordering::Relaxed);
+                    return None;
+                }
+                (Some(distance), Some(arc_path)) => {
+                    self.hits.fetch_add(1, Ordering::Relaxed);
+                    return Some(CachedRoute {
+                        distance,
+                        arc_path: arc_path.clone(),
+                    });
+                }
+                (Some(_), None) => {}
+            }
+        }
+        self.misses.fetch_add(1, Ordering::Relaxed);
+        query.reset();
+        query.add_source(s, 0);
+        query.add_target(t, 0);
+        let result = query.run();
+        let route = result.distance().map(|distance| CachedRoute {
+            distance,
+            arc_path: result.arc_path().into(),
+        });
+        drop(result);
+        self.shard(&key).insert(
+            self.shard_capacity,
+            key,
+            route.as_ref().map(|r| r.distance),
+            route.as_ref().map(|r| r.arc_path.clone()),
+        );
+        route
+    }
+
+    /// Lookups since construction or the last [`CCHQueryCache::reset_stats`].
+    pub fn stats(&self) -> CacheStats {
+        CacheStats {
+            hits: self.hits.load(Ordering::Relaxed),
+            misses: self.misses.load(Ordering::Relaxed),
+        }
+    }
+
+    pub fn reset_stats(&self) {
+        self.hits.store(0, Ordering::Relaxed);
+        self.misses.store(0, Ordering::Relaxed);
+    }
+
+    /// Number of stored pairs, including entries of outdated epochs not yet evicted.
+    pub fn len(&self) -> usize {
+        self.shards
+            .iter()
+            .map(|shard| {
+                shard
+                    .lock()
+                    .unwrap_or_else(|e| e.into_inner())
+                    .entries
+                    .len()
+            })
+            .sum()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Drop all entries; the counters are kept.
+    pub fn clear(&self) {
+        for shard in self.shards.iter() {
+            *shard.lock().unwrap_or_else(|e| e.into_inner()) = CacheShard::new();
+        }
+    }
 }
 
 enum QueryRef<'b, 'a> {
@@ -0,0 +1,176 @@
+#include "mapped_file.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    void write_padding(std::ofstream &out, uint64_t &pos)
+    {
+        static const char zeros[mapped_file_alignment] = {};
+        uint64_t pad = (mapped_file_alignment - pos % mapped_file_alignment) % mapped_file_alignment;
+        out.write(zeros, pad);
+        pos += pad;
+    }
+
+    template <class T>
+    bool offsets_valid(const T *first, unsigned node_count, uint64_t entry_count)
+    {
+        if (first[0] != 0 || first[node_count] != entry_count)
+            return false;
+        for (unsigned v = 0; v < node_count; ++v)
+            if (first[v] > first[v + 1])
+                return false;
+        return true;
+    }
+}
+
+uint64_t mapped_file_checksum(const void *data, uint64_t bytes)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    uint64_t h = 0xcbf29ce484222325ull;
+    uint64_t i = 0;
+    for (; i + 8 <= bytes; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, p + i, 8);
+        h = (h ^ word) * 0x100000001b3ull;
+    }
+    for (; i < bytes; ++i)
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    return h;
+}
+
+uint64_t mapped_file_layout(const void *const *data, const uint64_t *bytes, unsigned count, MappedFileSection *sections)
+{
+    uint64_t pos = mapped_file_alignment;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        sections[i] = {pos, bytes[i], mapped_file_checksum(data[i], bytes[i])};
+        pos += (bytes[i] + mapped_file_alignment - 1) / mapped_file_alignment * mapped_file_alignment;
+    }
+    return pos;
+}
+
+void mapped_file_write(const std::string &path,
+                       const void *header,
+                       size_t header_bytes,
+                       const void *const *data,
+                       const MappedFileSection *sections,
+                       unsigned count)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("cannot create " + path);
+    out.write(static_cast<const char *>(header), header_bytes);
+    uint64_t pos = header_bytes;
+    write_padding(out, pos);
+    for (unsigned i = 0; i < count; ++i)
+    {
+        out.write(static_cast<const char *>(data[i]), sections[i].bytes);
+        pos += sections[i].bytes;
+        write_padding(out, pos);
+    }
+    if (!out)
+        throw std::runtime_error("cannot write " + path);
+}
+
+void mapped_file_open(const std::string &path, bool random_access, const uint8_t *&data, size_t &size)
+{
+#ifdef _WIN32
+    (void)random_access;
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("cannot open " + path);
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file, &file_size);
+    HANDLE mapping = file_size.QuadPart == 0 ? nullptr : CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr)
+        throw std::runtime_error("cannot map " + path);
+    data = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(mapping);
+    size = file_size.QuadPart;
+    if (data == nullptr)
+        throw std::runtime_error("cannot map " + path);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("cannot open " + path);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        throw std::runtime_error("cannot map " + path);
+    }
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        throw std::runtime_error("cannot map " + path);
+    data = static_cast<const uint8_t *>(p);
+    size = st.st_size;
+#ifdef __linux__
+    if (random_access)
+        madvise(p, st.st_size, MADV_RANDOM);
+#else
+    (void)random_access;
+#endif
+#endif
+}
+
+void mapped_file_close(const uint8_t *data, size_t size)
+{
+    if (data == nullptr)
+        return;
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(data);
+#else
+    munmap(const_cast<uint8_t *>(data), size);
+#endif
+}
+
+bool mapped_file_sections_in_bounds(const MappedFileSection *sections,
+                                    const uint64_t *expected_bytes,
+                                    unsigned count,
+                                    size_t file_size)
+{
+    for (unsigned i = 0; i < count; ++i)
+    {
+        const MappedFileSection &s = sections[i];
+        if (s.bytes != expected_bytes[i] || s.offset % mapped_file_alignment != 0 || s.offset > file_size ||
+            s.bytes > file_size - s.offset)
+            return false;
+    }
+    return true;
+}
+
+bool mapped_file_sections_intact(const uint8_t *data, const MappedFileSection *sections, unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i)
+        if (mapped_file_checksum(data + sections[i].offset, sections[i].bytes) != sections[i].checksum)
+            return false;
+    return true;
+}
+
+bool mapped_file_offsets_valid(const uint32_t *first, unsigned node_count, uint64_t entry_count)
+{
+    return offsets_valid(first, node_count, entry_count);
+}
+
+bool mapped_file_offsets_valid(const uint64_t *first, unsigned node_count, uint64_t entry_count)
+{
+    return offsets_valid(first, node_count, entry_count);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Shared pieces of the page-aligned file formats (ch_mapped.cc, ch_hub_labels.cc): a header
+// page followed by sections that each start on a page boundary and carry a checksum, mapped
+// read-only and used in place. Errors are thrown as std::runtime_error.
+
+const uint64_t mapped_file_alignment = 4096;
+
+struct MappedFileSection
+{
+    uint64_t offset, bytes, checksum;
+};
+
+// FNV-1a over 64-bit words, then the trailing bytes.
+uint64_t mapped_file_checksum(const void *data, uint64_t bytes);
+
+// Places `count` sections of the given sizes after the header page and checksums them.
+// Returns the file size.
+uint64_t mapped_file_layout(const void *const *data, const uint64_t *bytes, unsigned count, MappedFileSection *sections);
+
+// Writes the header page and the sections placed by mapped_file_layout.
+void mapped_file_write(const std::string &path,
+                       const void *header,
+                       size_t header_bytes,
+                       const void *const *data,
+                       const MappedFileSection *sections,
+                       unsigned count);
+
+// Maps the whole file read-only and shared. `random_access` turns off read-ahead where
+// supported, for files that queries touch at a few scattered pages.
+void mapped_file_open(const std::string &path, bool random_access, const uint8_t *&data, size_t &size);
+void mapped_file_close(const uint8_t *data, size_t size);
+
+// True if every section lies inside the file, starts on a page boundary and has the expected
+// size.
+bool mapped_file_sections_in_bounds(const MappedFileSection *sections,
+                                    const uint64_t *expected_bytes,
+                                    unsigned count,
+                                    size_t file_size);
+
+// True if every section matches its checksum.
+bool mapped_file_sections_intact(const uint8_t *data, const MappedFileSection *sections, unsigned count);
+
+// True if first[0] == 0, first is non-decreasing and first[node_count] == entry_count, so that
+// every range [first[v], first[v + 1]) lies inside an array of entry_count entries. Check this
+// before walking the ranges of a mapped offset array.
+bool mapped_file_offsets_valid(const uint32_t *first, unsigned node_count, uint64_t entry_count);
+bool mapped_file_offsets_valid(const uint64_t *first, unsigned node_count, uint64_t entry_count);
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Thread helpers for the OpenMP loops of the parallel builders; without OpenMP everything
+// runs on one thread.
+
+// `OMP_PRAGMA(omp parallel for ...)` emits the pragma only when compiling with OpenMP, so
+// builds without the `openmp` feature do not warn about unknown pragmas.
+#if defined(_OPENMP) && defined(_MSC_VER) && !defined(__clang__)
+#define OMP_PRAGMA(...) __pragma(__VA_ARGS__)
+#elif defined(_OPENMP)
+#define OMP_PRAGMA(...) _Pragma(#__VA_ARGS__)
+#else
+#define OMP_PRAGMA(...)
+#endif
+
+// Threads to use for a requested `thread_count` (0 -> OpenMP default).
+inline int omp_thread_count(uint32_t thread_count)
+{
+#ifdef _OPENMP
+    return thread_count == 0 ? omp_get_max_threads() : static_cast<int>(thread_count);
+#else
+    (void)thread_count;
+    return 1;
+#endif
+}
+
+// Index of the calling thread within the current parallel region.
+inline unsigned omp_thread_id()
+{
+#ifdef _OPENMP
+    return static_cast<unsigned>(omp_get_thread_num());
+#else
+    return 0;
+#endif
+}
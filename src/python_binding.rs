@@ -1,9 +1,16 @@
 use crate::{
-    CCH, CCHMetric, CCHMetricPartialUpdater, CCHQuery, CCHQueryResult, compute_order_degree,
-    compute_order_inertial,
+    BatchPaths, CCH, CCHArenaQuery, CCHMetric, CCHMetricPartialUpdater, CCHQuery, CCHQueryArena,
+    CCHQueryResult, SpatialIndex, compute_order_degree, compute_order_inertial,
 };
+use pyo3::buffer::{Element, PyBuffer};
+use pyo3::exceptions::{PyBufferError, PyRuntimeError, PyValueError};
 use pyo3::prelude::*;
+use pyo3::types::{PyIterator, PyMemoryView};
 use std::collections::HashMap;
+use std::os::raw::c_int;
+use std::panic::AssertUnwindSafe;
+use std::sync::{Arc, Mutex, mpsc};
+use std::thread::JoinHandle;
 
 unsafe fn extend_lifetime<'a, T>(r: &'a T) -> &'static T {
     unsafe { std::mem::transmute::<&'a T, &'static T>(r) }
@@ -13,22 +20,325 @@ unsafe fn extend_lifetime_mut<'a, T>(r: &'a mut T) -> &'static mut T {
     unsafe { std::mem::transmute::<&'a mut T, &'static mut T>(r) }
 }
 
+/// Array argument: borrows C-contiguous 1-d buffers of the exact element type (numpy arrays,
+/// `array.array`, ...) without copying and converts anything else (lists, other dtypes).
+struct ArrayArg<T: Element> {
+    buffer: Option<PyBuffer<T>>,
+    owned: Vec<T>,
+}
+
+impl<T: Element> ArrayArg<T> {
+    fn new(
+        obj: &Bound<'_, PyAny>,
+        convert: impl FnOnce(&Bound<'_, PyAny>) -> PyResult<Vec<T>>,
+    ) -> PyResult<Self> {
+        if let Ok(buffer) = PyBuffer::<T>::get(obj) {
+            if buffer.dimensions() == 1 && buffer.is_c_contiguous() {
+                return Ok(ArrayArg {
+                    buffer: Some(buffer),
+                    owned: Vec::new(),
+                });
+            }
+        }
+        Ok(ArrayArg {
+            buffer: None,
+            owned: convert(obj)?,
+        })
+    }
+
+    fn as_slice(&self) -> &[T] {
+        match &self.buffer {
+            // SAFETY: contiguous buffer of item_count `T`s, kept alive by `self.buffer`.
+            Some(buffer) => unsafe {
+                std::slice::from_raw_parts(buffer.buf_ptr() as *const T, buffer.item_count())
+            },
+            None => &self.owned,
+        }
+    }
+}
+
+fn u32_array(obj: &Bound<'_, PyAny>) -> PyResult<ArrayArg<u32>> {
+    ArrayArg::new(obj, |obj| obj.extract())
+}
+
+fn f32_array(obj: &Bound<'_, PyAny>) -> PyResult<ArrayArg<f32>> {
+    ArrayArg::new(obj, |obj| obj.extract())
+}
+
+enum ArrayBufferData {
+    U32(Box<[u32]>),
+    U64(Box<[u64]>),
+    MetricWeights(Py<PyCCHMetric>),
+}
+
+/// Read-only 1-d buffer (`uint32` or `uint64`) over Rust-owned data, handed to Python as a
+/// `memoryview` so that `numpy.asarray(...)` wraps it without copying.
+#[pyclass(frozen)]
+struct ArrayBuffer {
+    data: ArrayBufferData,
+    shape: [isize; 1],
+    strides: [isize; 1],
+}
+
+impl ArrayBuffer {
+    fn memoryview(
+        py: Python<'_>,
+        data: ArrayBufferData,
+        len: usize,
+        itemsize: usize,
+    ) -> PyResult<Py<PyMemoryView>> {
+        let buffer = Bound::new(
+            py,
+            ArrayBuffer {
+                data,
+                shape: [len as isize],
+                strides: [itemsize as isize],
+            },
+        )?;
+        Ok(PyMemoryView::from(buffer.as_any())?.unbind())
+    }
+
+    fn u32(py: Python<'_>, v: Vec<u32>) -> PyResult<Py<PyMemoryView>> {
+        let len = v.len();
+        Self::memoryview(py, ArrayBufferData::U32(v.into_boxed_slice()), len, 4)
+    }
+
+    fn u64(py: Python<'_>, v: Vec<u64>) -> PyResult<Py<PyMemoryView>> {
+        let len = v.len();
+        Self::memoryview(py, ArrayBufferData::U64(v.into_boxed_slice()), len, 8)
+    }
+}
+
+#[pymethods]
+impl ArrayBuffer {
+    unsafe fn __getbuffer__(
+        slf: Bound<'_, Self>,
+        view: *mut pyo3::ffi::Py_buffer,
+        flags: c_int,
+    ) -> PyResult<()> {
+        if view.is_null() {
+            return Err(PyBufferError::new_err("view is null"));
+        }
+        if (flags & pyo3::ffi::PyBUF_WRITABLE) == pyo3::ffi::PyBUF_WRITABLE {
+            return Err(PyBufferError::new_err("buffer is read-only"));
+        }
+        let this = slf.get();
+        let (ptr, format) = match &this.data {
+            ArrayBufferData::U32(v) => (v.as_ptr() as *const u8, c"I"),
+            ArrayBufferData::U64(v) => (v.as_ptr() as *const u8, c"Q"),
+            // The weights are a boxed slice that partial updates modify in place, so the
+            // pointer stays valid while the metric (referenced by `this`) is alive.
+            ArrayBufferData::MetricWeights(metric) => (
+                metric
+                    .try_borrow(slf.py())
+                    .map_err(|_| PyBufferError::new_err("metric is being updated"))?
+                    .inner
+                    .weights()
+                    .as_ptr() as *const u8,
+                c"I",
+            ),
+        };
+        unsafe {
+            (*view).obj = slf.clone().into_any().into_ptr();
+            (*view).buf = ptr as *mut std::os::raw::c_void;
+            (*view).len = this.shape[0] * this.strides[0];
+            (*view).readonly = 1;
+            (*view).itemsize = this.strides[0];
+            (*view).format = if (flags & pyo3::ffi::PyBUF_FORMAT) == pyo3::ffi::PyBUF_FORMAT {
+                format.as_ptr().cast_mut()
+            } else {
+                std::ptr::null_mut()
+            };
+            (*view).ndim = 1;
+            (*view).shape = if (flags & pyo3::ffi::PyBUF_ND) == pyo3::ffi::PyBUF_ND {
+                this.shape.as_ptr().cast_mut()
+            } else {
+                std::ptr::null_mut()
+            };
+            (*view).strides = if (flags & pyo3::ffi::PyBUF_STRIDES) == pyo3::ffi::PyBUF_STRIDES {
+                this.strides.as_ptr().cast_mut()
+            } else {
+                std::ptr::null_mut()
+            };
+            (*view).suboffsets = std::ptr::null_mut();
+            (*view).internal = std::ptr::null_mut();
+        }
+        Ok(())
+    }
+
+    unsafe fn __releasebuffer__(&self, _view: *mut pyo3::ffi::Py_buffer) {}
+}
+
+fn check_batch(metric: &CCHMetric, sources: &[u32], targets: &[u32]) -> PyResult<()> {
+    if sources.len() != targets.len() {
+        return Err(PyValueError::new_err(
+            "sources and targets must have the same length",
+        ));
+    }
+    let node_count = metric.cch.node_count;
+    if sources
+        .iter()
+        .chain(targets)
+        .any(|&v| v as usize >= node_count)
+    {
+        return Err(PyValueError::new_err("node id out of range"));
+    }
+    Ok(())
+}
+
 #[pyfunction]
 #[pyo3(name = "compute_order_degree")]
-fn py_compute_order_degree(node_count: u32, tail: Vec<u32>, head: Vec<u32>) -> Vec<u32> {
-    compute_order_degree(node_count, &tail, &head)
+fn py_compute_order_degree(
+    py: Python,
+    node_count: u32,
+    tail: &Bound<'_, PyAny>,
+    head: &Bound<'_, PyAny>,
+) -> PyResult<Vec<u32>> {
+    let (tail, head) = (u32_array(tail)?, u32_array(head)?);
+    let (tail, head) = (tail.as_slice(), head.as_slice());
+    Ok(py.detach(|| compute_order_degree(node_count, tail, head)))
+}
+
+/// `compute_order_degree` returning a read-only uint32 `memoryview` instead of a list.
+#[pyfunction]
+#[pyo3(name = "compute_order_degree_array")]
+fn py_compute_order_degree_array(
+    py: Python,
+    node_count: u32,
+    tail: &Bound<'_, PyAny>,
+    head: &Bound<'_, PyAny>,
+) -> PyResult<Py<PyMemoryView>> {
+    let (tail, head) = (u32_array(tail)?, u32_array(head)?);
+    let (tail, head) = (tail.as_slice(), head.as_slice());
+    let order = py.detach(|| compute_order_degree(node_count, tail, head));
+    ArrayBuffer::u32(py, order)
 }
 
 #[pyfunction]
 #[pyo3(name = "compute_order_inertial")]
 fn py_compute_order_inertial(
+    py: Python,
+    node_count: u32,
+    tail: &Bound<'_, PyAny>,
+    head: &Bound<'_, PyAny>,
+    latitude: &Bound<'_, PyAny>,
+    longitude: &Bound<'_, PyAny>,
+) -> PyResult<Vec<u32>> {
+    let (tail, head) = (u32_array(tail)?, u32_array(head)?);
+    let (latitude, longitude) = (f32_array(latitude)?, f32_array(longitude)?);
+    let (tail, head) = (tail.as_slice(), head.as_slice());
+    let (latitude, longitude) = (latitude.as_slice(), longitude.as_slice());
+    Ok(py.detach(|| compute_order_inertial(node_count, tail, head, latitude, longitude)))
+}
+
+/// `compute_order_inertial` returning a read-only uint32 `memoryview` instead of a list.
+#[pyfunction]
+#[pyo3(name = "compute_order_inertial_array")]
+fn py_compute_order_inertial_array(
+    py: Python,
     node_count: u32,
-    tail: Vec<u32>,
-    head: Vec<u32>,
-    latitude: Vec<f32>,
-    longitude: Vec<f32>,
-) -> Vec<u32> {
-    compute_order_inertial(node_count, &tail, &head, &latitude, &longitude)
+    tail: &Bound<'_, PyAny>,
+    head: &Bound<'_, PyAny>,
+    latitude: &Bound<'_, PyAny>,
+    longitude: &Bound<'_, PyAny>,
+) -> PyResult<Py<PyMemoryView>> {
+    let (tail, head) = (u32_array(tail)?, u32_array(head)?);
+    let (latitude, longitude) = (f32_array(latitude)?, f32_array(longitude)?);
+    let (tail, head) = (tail.as_slice(), head.as_slice());
+    let (latitude, longitude) = (latitude.as_slice(), longitude.as_slice());
+    let order = py.detach(|| compute_order_inertial(node_count, tail, head, latitude, longitude));
+    ArrayBuffer::u32(py, order)
+}
+
+#[pyclass(frozen)]
+#[pyo3(name = "SpatialIndex")]
+struct PySpatialIndex(SpatialIndex);
+
+#[pymethods]
+impl PySpatialIndex {
+    #[new]
+    fn new(
+        py: Python,
+        latitude: &Bound<'_, PyAny>,
+        longitude: &Bound<'_, PyAny>,
+        tail: &Bound<'_, PyAny>,
+        head: &Bound<'_, PyAny>,
+    ) -> PyResult<Self> {
+        let (latitude, longitude) = (f32_array(latitude)?, f32_array(longitude)?);
+        let (tail, head) = (u32_array(tail)?, u32_array(head)?);
+        let (latitude, longitude) = (latitude.as_slice(), longitude.as_slice());
+        let (tail, head) = (tail.as_slice(), head.as_slice());
+        if latitude.len() != longitude.len() || tail.len() != head.len() {
+            return Err(PyValueError::new_err(
+                "latitude/longitude and tail/head must have matching lengths",
+            ));
+        }
+        if tail
+            .iter()
+            .chain(head)
+            .any(|&v| v as usize >= latitude.len())
+        {
+            return Err(PyValueError::new_err("node id out of range"));
+        }
+        Ok(Self(py.detach(|| {
+            SpatialIndex::new(latitude, longitude, tail, head)
+        })))
+    }
+
+    /// Up to `k` (node, meters) per point, nearest first, without the GIL.
+    #[pyo3(signature = (latitude, longitude, k=1, max_distance=f32::INFINITY, threads=0))]
+    fn nearest_nodes(
+        &self,
+        py: Python,
+        latitude: &Bound<'_, PyAny>,
+        longitude: &Bound<'_, PyAny>,
+        k: u32,
+        max_distance: f32,
+        threads: u32,
+    ) -> PyResult<Vec<Vec<(u32, f32)>>> {
+        let (latitude, longitude) = (f32_array(latitude)?, f32_array(longitude)?);
+        let (latitude, longitude) = (latitude.as_slice(), longitude.as_slice());
+        if latitude.len() != longitude.len() {
+            return Err(PyValueError::new_err(
+                "latitude and longitude must have the same length",
+            ));
+        }
+        let snapped = py.detach(|| {
+            self.0
+                .nearest_nodes_batch(latitude, longitude, k, max_distance, threads)
+        });
+        Ok(snapped
+            .into_iter()
+            .map(|nodes| nodes.into_iter().map(|n| (n.node, n.distance)).collect())
+            .collect())
+    }
+
+    /// (arc, tail, head, fraction, meters) per point, or None beyond `max_distance`.
+    #[pyo3(signature = (latitude, longitude, max_distance=f32::INFINITY, threads=0))]
+    fn nearest_arcs(
+        &self,
+        py: Python,
+        latitude: &Bound<'_, PyAny>,
+        longitude: &Bound<'_, PyAny>,
+        max_distance: f32,
+        threads: u32,
+    ) -> PyResult<Vec<Option<(u32, u32, u32, f32, f32)>>> {
+        let (latitude, longitude) = (f32_array(latitude)?, f32_array(longitude)?);
+        let (latitude, longitude) = (latitude.as_slice(), longitude.as_slice());
+        if latitude.len() != longitude.len() {
+            return Err(PyValueError::new_err(
+                "latitude and longitude must have the same length",
+            ));
+        }
+        let snapped = py.detach(|| {
+            self.0
+                .nearest_arcs_batch(latitude, longitude, max_distance, threads)
+        });
+        Ok(snapped
+            .into_iter()
+            .map(|a| a.map(|a| (a.arc, a.tail, a.head, a.fraction, a.distance)))
+            .collect())
+    }
 }
 
 #[pyclass(frozen)]
@@ -38,14 +348,18 @@ struct PyCCH(CCH);
 #[pymethods]
 impl PyCCH {
     #[new]
-    fn new(order: Vec<u32>, tail: Vec<u32>, head: Vec<u32>, filter_always_inf_arcs: bool) -> Self {
-        Self(CCH::new(
-            &order,
-            &tail,
-            &head,
-            |_| {},
-            filter_always_inf_arcs,
-        ))
+    fn new(
+        py: Python,
+        order: &Bound<'_, PyAny>,
+        tail: &Bound<'_, PyAny>,
+        head: &Bound<'_, PyAny>,
+        filter_always_inf_arcs: bool,
+    ) -> PyResult<Self> {
+        let (order, tail, head) = (u32_array(order)?, u32_array(tail)?, u32_array(head)?);
+        let (order, tail, head) = (order.as_slice(), tail.as_slice(), head.as_slice());
+        Ok(Self(py.detach(|| {
+            CCH::new(order, tail, head, |_| {}, filter_always_inf_arcs)
+        })))
     }
 }
 
@@ -60,18 +374,68 @@ struct PyCCHMetric {
 #[pymethods]
 impl PyCCHMetric {
     #[new]
-    fn new(py: Python, cch: Py<PyCCH>, weights: Vec<u32>) -> Self {
+    fn new(py: Python, cch: Py<PyCCH>, weights: &Bound<'_, PyAny>) -> PyResult<Self> {
         let cch_static = unsafe { extend_lifetime(&cch.borrow(py).0) };
-        Self {
-            inner: CCHMetric::new(cch_static, weights),
+        let weights = u32_array(weights)?;
+        let weights = weights.as_slice();
+        // The metric owns its weights for partial updates: one memcpy from a buffer.
+        let inner = py.detach(|| CCHMetric::new(cch_static, weights.to_vec()));
+        Ok(Self {
+            inner,
             _cch: cch,
             query_count: 0,
-        }
+        })
     }
 
+    /// Distances of the pairs `(sources[i], targets[i])` as a `uint32` array (`2**31 - 1` if
+    /// unreachable), computed on `threads` native threads (0 = all cores) without the GIL.
+    #[pyo3(signature = (sources, targets, threads = 0))]
+    fn batch_distances(
+        &self,
+        py: Python,
+        sources: &Bound<'_, PyAny>,
+        targets: &Bound<'_, PyAny>,
+        threads: usize,
+    ) -> PyResult<Py<PyMemoryView>> {
+        let (sources, targets) = (u32_array(sources)?, u32_array(targets)?);
+        let (sources, targets) = (sources.as_slice(), targets.as_slice());
+        check_batch(&self.inner, sources, targets)?;
+        let distances = py.detach(|| self.inner.batch_distances(sources, targets, threads));
+        ArrayBuffer::u32(py, distances)
+    }
+
+    /// Shortest paths of the pairs as `(distances, offsets, paths)`: path `i` is
+    /// `paths[offsets[i]:offsets[i + 1]]` (node ids, or input arc ids if `arcs`).
+    #[pyo3(signature = (sources, targets, threads = 0, arcs = false))]
+    fn batch_paths(
+        &self,
+        py: Python,
+        sources: &Bound<'_, PyAny>,
+        targets: &Bound<'_, PyAny>,
+        threads: usize,
+        arcs: bool,
+    ) -> PyResult<(Py<PyMemoryView>, Py<PyMemoryView>, Py<PyMemoryView>)> {
+        let (sources, targets) = (u32_array(sources)?, u32_array(targets)?);
+        let (sources, targets) = (sources.as_slice(), targets.as_slice());
+        check_batch(&self.inner, sources, targets)?;
+        let result = py.detach(|| self.inner.batch_paths(sources, targets, threads, arcs));
+        Ok((
+            ArrayBuffer::u32(py, result.distances)?,
+            ArrayBuffer::u64(py, result.offsets)?,
+            ArrayBuffer::u32(py, result.paths)?,
+        ))
+    }
+
+    /// Read-only view of the weights; reflects later partial updates.
     #[getter]
-    fn weights(&self) -> Vec<u32> {
-        self.inner.weights().to_vec()
+    fn weights(slf: Bound<'_, Self>) -> PyResult<Py<PyMemoryView>> {
+        let len = slf.borrow().inner.weights().len();
+        ArrayBuffer::memoryview(
+            slf.py(),
+            ArrayBufferData::MetricWeights(slf.unbind()),
+            len,
+            4,
+        )
     }
 }
 
@@ -102,6 +466,38 @@ impl PyCCHMetricPartialUpdater {
         let a = unsafe { extend_lifetime_mut(&mut metric_ref.inner) };
         self.inner.apply(a, &updates);
     }
+
+    /// Set `weights[i]` as the weight of arc `arc_ids[i]` and customize, in one native call
+    /// without the GIL. Accepts numpy arrays without copying.
+    fn apply_arrays(
+        &mut self,
+        py: Python,
+        metric: Py<PyCCHMetric>,
+        arc_ids: &Bound<'_, PyAny>,
+        weights: &Bound<'_, PyAny>,
+    ) -> PyResult<()> {
+        let (arc_ids, weights) = (u32_array(arc_ids)?, u32_array(weights)?);
+        let (arc_ids, weights) = (arc_ids.as_slice(), weights.as_slice());
+        let mut metric_ref = metric.borrow_mut(py);
+        if metric_ref.query_count != 0 {
+            return Err(PyRuntimeError::new_err(
+                "cannot apply updates while there are active CCHQuerys using the metric",
+            ));
+        }
+        if arc_ids.len() != weights.len() {
+            return Err(PyValueError::new_err(
+                "arc_ids and weights must have the same length",
+            ));
+        }
+        let arc_count = metric_ref.inner.weights().len();
+        if arc_ids.iter().any(|&a| a as usize >= arc_count) {
+            return Err(PyValueError::new_err("arc id out of range"));
+        }
+        let a = unsafe { extend_lifetime_mut(&mut metric_ref.inner) };
+        let updater = &mut self.inner;
+        py.detach(|| updater.apply_arrays(a, arc_ids, weights));
+        Ok(())
+    }
 }
 
 #[pyclass(unsendable)]
@@ -198,20 +594,482 @@ impl PyCCHQueryResult {
     }
 }
 
+/// Preallocated labels for up to `capacity` live queries; `query()` claims a slot without
+/// allocating. Partial updates of the metric are rejected while the arena is alive.
+#[pyclass(frozen)]
+#[pyo3(name = "CCHQueryArena")]
+struct PyCCHQueryArena {
+    inner: CCHQueryArena<'static>, // should drop before metric
+    metric: Py<PyCCHMetric>,
+}
+
+#[pymethods]
+impl PyCCHQueryArena {
+    #[new]
+    fn new(py: Python, metric: Py<PyCCHMetric>, capacity: usize) -> PyResult<Self> {
+        if capacity > u32::MAX as usize {
+            return Err(PyValueError::new_err("arena capacity too large"));
+        }
+        metric.borrow_mut(py).query_count += 1;
+        let metric_static = unsafe { extend_lifetime(&metric.borrow(py).inner) };
+        let inner = py.detach(|| CCHQueryArena::new(metric_static, capacity));
+        Ok(Self { inner, metric })
+    }
+
+    /// Claim a slot; None if `capacity` queries are alive.
+    fn query(slf: Py<Self>, py: Python) -> Option<PyCCHArenaQuery> {
+        let arena = unsafe { extend_lifetime(&slf.get().inner) };
+        let inner = arena.query()?;
+        Some(PyCCHArenaQuery {
+            inner,
+            node_count: slf.get().metric.borrow(py).inner.cch.node_count,
+            _arena: slf,
+        })
+    }
+
+    #[getter]
+    fn available(&self) -> usize {
+        self.inner.available()
+    }
+
+    #[getter]
+    fn memory_bytes(&self) -> usize {
+        self.inner.memory_bytes()
+    }
+}
+
+impl Drop for PyCCHQueryArena {
+    fn drop(&mut self) {
+        Python::attach(|py| self.metric.borrow_mut(py).query_count -= 1);
+    }
+}
+
+/// One slot of a `CCHQueryArena`; the slot is freed when the query is garbage collected.
+#[pyclass(unsendable)]
+#[pyo3(name = "CCHArenaQuery")]
+struct PyCCHArenaQuery {
+    inner: CCHArenaQuery<'static>, // should drop before arena
+    node_count: usize,
+    _arena: Py<PyCCHQueryArena>,
+}
+
+#[pymethods]
+impl PyCCHArenaQuery {
+    /// Shortest distance from `source` to `target`, None if unreachable. The path stays
+    /// available through `node_path` / `arc_path` until the next run.
+    fn run(&mut self, py: Python, source: u32, target: u32) -> PyResult<Option<u32>> {
+        if source as usize >= self.node_count || target as usize >= self.node_count {
+            return Err(PyValueError::new_err("node id out of range"));
+        }
+        let query = &mut self.inner;
+        Ok(py.detach(|| query.run(source, target)))
+    }
+
+    #[getter]
+    fn node_path(&self) -> Vec<u32> {
+        self.inner.node_path()
+    }
+
+    #[getter]
+    fn arc_path(&self) -> Vec<u32> {
+        self.inner.arc_path()
+    }
+}
+
+/// Contiguous part of a chunk of OD pairs, run by one pool worker.
+struct PoolJob {
+    pairs: Arc<[(u32, u32)]>,
+    begin: usize,
+    end: usize,
+    paths: bool,
+    arcs: bool,
+    reply: mpsc::Sender<(usize, Option<BatchPaths>)>,
+}
+
+fn pool_worker(metric: &'static CCHMetric<'static>, jobs: Arc<Mutex<mpsc::Receiver<PoolJob>>>) {
+    let mut query = CCHQuery::new(metric);
+    loop {
+        // The guard is dropped at the end of the statement: the lock is only held while
+        // waiting for the next job.
+        let job = jobs.lock().unwrap().recv();
+        let Ok(job) = job else {
+            return;
+        };
+        // A panic fails this job only: the worker reports it and goes on with a fresh query.
+        let out = std::panic::catch_unwind(AssertUnwindSafe(|| {
+            let mut out = BatchPaths {
+                offsets: vec![0],
+                ..Default::default()
+            };
+            for &(s, t) in &job.pairs[job.begin..job.end] {
+                query.add_source(s, 0);
+                query.add_target(t, 0);
+                let result = query.run();
+                out.distances
+                    .push(result.distance().unwrap_or(i32::MAX as u32));
+                if job.paths {
+                    out.paths.extend(if job.arcs {
+                        result.arc_path()
+                    } else {
+                        result.node_path()
+                    });
+                    out.offsets.push(out.paths.len() as u64);
+                }
+            }
+            out
+        }))
+        .ok();
+        if out.is_none() {
+            query = CCHQuery::new(metric);
+        }
+        let _ = job.reply.send((job.begin, out));
+    }
+}
+
+/// A chunk submitted to the pool; `wait` collects the parts in order.
+struct PendingChunk {
+    results: mpsc::Receiver<(usize, Option<BatchPaths>)>,
+    job_count: usize,
+}
+
+impl PendingChunk {
+    /// Fails if a part panicked or was never run.
+    fn wait(self) -> PyResult<BatchPaths> {
+        let mut parts = Vec::with_capacity(self.job_count);
+        for (begin, part) in self.results.iter().take(self.job_count) {
+            let part =
+                part.ok_or_else(|| PyRuntimeError::new_err("CCHQueryPool worker panicked"))?;
+            parts.push((begin, part));
+        }
+        if parts.len() < self.job_count {
+            return Err(PyRuntimeError::new_err(
+                "CCHQueryPool stopped before the chunk was done",
+            ));
+        }
+        parts.sort_by_key(|(begin, _)| *begin);
+        let mut chunk = BatchPaths {
+            offsets: vec![0],
+            ..Default::default()
+        };
+        for (_, part) in parts {
+            let base = chunk.paths.len() as u64;
+            chunk.distances.extend(part.distances);
+            chunk
+                .offsets
+                .extend(part.offsets[1..].iter().map(|&o| base + o));
+            chunk.paths.extend(part.paths);
+        }
+        Ok(chunk)
+    }
+}
+
+/// Native worker threads, each owning one `CCHQuery` on the same metric. Jobs are pulled from
+/// a shared queue, so several Python threads can submit work concurrently.
+#[pyclass(frozen)]
+#[pyo3(name = "CCHQueryPool")]
+struct PyCCHQueryPool {
+    jobs: Mutex<Option<mpsc::Sender<PoolJob>>>,
+    workers: Mutex<Vec<JoinHandle<()>>>,
+    thread_count: usize,
+    metric: Py<PyCCHMetric>,
+}
+
+impl PyCCHQueryPool {
+    fn submit(&self, pairs: Arc<[(u32, u32)]>, paths: bool, arcs: bool) -> PyResult<PendingChunk> {
+        let jobs = self.jobs.lock().unwrap();
+        let jobs = jobs
+            .as_ref()
+            .ok_or_else(|| PyRuntimeError::new_err("CCHQueryPool is closed"))?;
+        // A few parts per worker to balance uneven query costs.
+        let part = pairs.len().div_ceil(4 * self.thread_count).max(1);
+        let (reply, results) = mpsc::channel();
+        let mut job_count = 0;
+        for begin in (0..pairs.len()).step_by(part) {
+            let job = PoolJob {
+                pairs: pairs.clone(),
+                begin,
+                end: (begin + part).min(pairs.len()),
+                paths,
+                arcs,
+                reply: reply.clone(),
+            };
+            jobs.send(job)
+                .map_err(|_| PyRuntimeError::new_err("CCHQueryPool is closed"))?;
+            job_count += 1;
+        }
+        Ok(PendingChunk { results, job_count })
+    }
+
+    fn shutdown(&self, py: Python) {
+        let Some(jobs) = self.jobs.lock().unwrap().take() else {
+            return;
+        };
+        drop(jobs);
+        let workers = std::mem::take(&mut *self.workers.lock().unwrap());
+        py.detach(|| {
+            for worker in workers {
+                let _ = worker.join();
+            }
+        });
+        self.metric.borrow_mut(py).query_count -= self.thread_count;
+    }
+}
+
+#[pymethods]
+impl PyCCHQueryPool {
+    /// `threads` workers (0 = all cores). Partial updates of the metric are rejected until the
+    /// pool is closed.
+    #[new]
+    #[pyo3(signature = (metric, threads = 0))]
+    fn new(py: Python, metric: Py<PyCCHMetric>, threads: usize) -> Self {
+        let thread_count = if threads == 0 {
+            std::thread::available_parallelism().map_or(1, |n| n.get())
+        } else {
+            threads
+        };
+        metric.borrow_mut(py).query_count += thread_count;
+        let metric_static = unsafe { extend_lifetime(&metric.borrow(py).inner) };
+        let (sender, receiver) = mpsc::channel();
+        let receiver = Arc::new(Mutex::new(receiver));
+        let workers = (0..thread_count)
+            .map(|_| {
+                let receiver = receiver.clone();
+                std::thread::spawn(move || pool_worker(metric_static, receiver))
+            })
+            .collect();
+        Self {
+            jobs: Mutex::new(Some(sender)),
+            workers: Mutex::new(workers),
+            thread_count,
+            metric,
+        }
+    }
+
+    #[getter]
+    fn threads(&self) -> usize {
+        self.thread_count
+    }
+
+    /// Stream results for OD pairs in chunks of `chunk_size`. `pairs` is an iterable of
+    /// `(source, target)`, an `(n, 2)` uint32 array, or the sources array when `targets` is
+    /// given. Yields distance arrays, or `(distances, offsets, paths)` if `paths` (arc ids if
+    /// `arcs`). The next chunk is computed while the current one is consumed.
+    #[pyo3(signature = (pairs, targets = None, chunk_size = 65536, paths = false, arcs = false))]
+    fn map(
+        slf: Bound<'_, Self>,
+        pairs: &Bound<'_, PyAny>,
+        targets: Option<&Bound<'_, PyAny>>,
+        chunk_size: usize,
+        paths: bool,
+        arcs: bool,
+    ) -> PyResult<PyCCHQueryPoolIter> {
+        if chunk_size == 0 {
+            return Err(PyValueError::new_err("chunk_size must be positive"));
+        }
+        let input = match targets {
+            Some(targets) => PoolInput::Arrays {
+                sources: u32_array(pairs)?,
+                targets: u32_array(targets)?,
+                next: 0,
+            },
+            None => match PyBuffer::<u32>::get(pairs) {
+                Ok(buffer)
+                    if buffer.dimensions() == 2
+                        && buffer.shape()[1] == 2
+                        && buffer.is_c_contiguous() =>
+                {
+                    PoolInput::Interleaved { buffer, next: 0 }
+                }
+                _ => PoolInput::Pairs(pairs.try_iter()?.unbind()),
+            },
+        };
+        if let PoolInput::Arrays {
+            sources, targets, ..
+        } = &input
+        {
+            if sources.as_slice().len() != targets.as_slice().len() {
+                return Err(PyValueError::new_err(
+                    "sources and targets must have the same length",
+                ));
+            }
+        }
+        Ok(PyCCHQueryPoolIter {
+            pool: slf.unbind(),
+            input,
+            chunk_size,
+            paths,
+            arcs,
+            pending: None,
+            error: None,
+        })
+    }
+
+    /// Stop the workers; also happens when the pool is garbage collected.
+    fn close(&self, py: Python) {
+        self.shutdown(py);
+    }
+}
+
+impl Drop for PyCCHQueryPool {
+    fn drop(&mut self) {
+        Python::attach(|py| self.shutdown(py));
+    }
+}
+
+enum PoolInput {
+    Arrays {
+        sources: ArrayArg<u32>,
+        targets: ArrayArg<u32>,
+        next: usize,
+    },
+    Interleaved {
+        buffer: PyBuffer<u32>,
+        next: usize,
+    },
+    Pairs(Py<PyIterator>),
+}
+
+#[pyclass(unsendable)]
+#[pyo3(name = "CCHQueryPoolIter")]
+struct PyCCHQueryPoolIter {
+    pool: Py<PyCCHQueryPool>,
+    input: PoolInput,
+    chunk_size: usize,
+    paths: bool,
+    arcs: bool,
+    pending: Option<PendingChunk>,
+    /// Error from submitting the chunk after the one last returned, raised on the next call.
+    error: Option<PyErr>,
+}
+
+impl PyCCHQueryPoolIter {
+    fn next_pairs(&mut self, py: Python) -> PyResult<Vec<(u32, u32)>> {
+        let chunk_size = self.chunk_size;
+        Ok(match &mut self.input {
+            PoolInput::Arrays {
+                sources,
+                targets,
+                next,
+            } => {
+                let end = (*next + chunk_size).min(sources.as_slice().len());
+                let pairs = sources.as_slice()[*next..end]
+                    .iter()
+                    .copied()
+                    .zip(targets.as_slice()[*next..end].iter().copied())
+                    .collect();
+                *next = end;
+                pairs
+            }
+            PoolInput::Interleaved { buffer, next } => {
+                // SAFETY: C-contiguous (n, 2) buffer of u32, kept alive by `buffer`.
+                let flat = unsafe {
+                    std::slice::from_raw_parts(buffer.buf_ptr() as *const u32, buffer.item_count())
+                };
+                let end = (*next + chunk_size).min(flat.len() / 2);
+                let pairs = flat[2 * *next..2 * end]
+                    .chunks_exact(2)
+                    .map(|p| (p[0], p[1]))
+                    .collect();
+                *next = end;
+                pairs
+            }
+            PoolInput::Pairs(iter) => {
+                let mut iter = iter.bind(py).clone();
+                let mut pairs = Vec::with_capacity(chunk_size);
+                while pairs.len() < chunk_size {
+                    match iter.next() {
+                        Some(item) => pairs.push(item?.extract::<(u32, u32)>()?),
+                        None => break,
+                    }
+                }
+                pairs
+            }
+        })
+    }
+
+    fn submit_next(&mut self, py: Python) -> PyResult<Option<PendingChunk>> {
+        let pairs = self.next_pairs(py)?;
+        if pairs.is_empty() {
+            return Ok(None);
+        }
+        let pool = self.pool.get();
+        let node_count = pool.metric.borrow(py).inner.cch.node_count;
+        if pairs
+            .iter()
+            .any(|&(s, t)| s as usize >= node_count || t as usize >= node_count)
+        {
+            return Err(PyValueError::new_err("node id out of range"));
+        }
+        pool.submit(pairs.into(), self.paths, self.arcs).map(Some)
+    }
+}
+
+#[pymethods]
+impl PyCCHQueryPoolIter {
+    fn __iter__(slf: PyRef<'_, Self>) -> PyRef<'_, Self> {
+        slf
+    }
+
+    fn __next__(&mut self, py: Python) -> PyResult<Option<Py<PyAny>>> {
+        if let Some(error) = self.error.take() {
+            return Err(error);
+        }
+        if self.pending.is_none() {
+            self.pending = self.submit_next(py)?;
+        }
+        let Some(pending) = self.pending.take() else {
+            return Ok(None);
+        };
+        let chunk = py.detach(move || pending.wait())?;
+        // Queue the next chunk so it runs while this one is consumed; a failure belongs to
+        // the next call, not to the chunk already computed.
+        match self.submit_next(py) {
+            Ok(next) => self.pending = next,
+            Err(error) => self.error = Some(error),
+        }
+        let distances = ArrayBuffer::u32(py, chunk.distances)?;
+        if !self.paths {
+            return Ok(Some(distances.into_any()));
+        }
+        let offsets = ArrayBuffer::u64(py, chunk.offsets)?;
+        let paths = ArrayBuffer::u32(py, chunk.paths)?;
+        Ok(Some(
+            (distances, offsets, paths)
+                .into_pyobject(py)?
+                .into_any()
+                .unbind(),
+        ))
+    }
+}
+
 #[pymodule]
 mod routingkit_cch {
     #[pymodule_export]
     use super::PyCCH;
     #[pymodule_export]
+    use super::PyCCHArenaQuery;
+    #[pymodule_export]
     use super::PyCCHMetric;
     #[pymodule_export]
     use super::PyCCHMetricPartialUpdater;
     #[pymodule_export]
     use super::PyCCHQuery;
     #[pymodule_export]
+    use super::PyCCHQueryArena;
+    #[pymodule_export]
+    use super::PyCCHQueryPool;
+    #[pymodule_export]
+    use super::PyCCHQueryPoolIter;
+    #[pymodule_export]
     use super::PyCCHQueryResult;
     #[pymodule_export]
+    use super::PySpatialIndex;
+    #[pymodule_export]
     use super::py_compute_order_degree;
     #[pymodule_export]
+    use super::py_compute_order_degree_array;
+    #[pymodule_export]
     use super::py_compute_order_inertial;
+    #[pymodule_export]
+    use super::py_compute_order_inertial_array;
 }
@@ -0,0 +1,118 @@
+#include "routingkit_cch_wrapper.h"
+
+#include <routingkit/constants.h>
+#include <cmath>
+
+using namespace RoutingKit;
+
+// Sources and targets in the middle of input arcs. A point at `fraction` along an arc of
+// weight w sits round(fraction * w) after the tail. Leaving it means driving the rest of the arc
+// to the head; reaching it means entering at the tail. Arcs of weight inf_weight are closed and
+// add nothing.
+
+unsigned offset_on_arc(unsigned weight, float fraction)
+{
+    double f = std::min(1.0, std::max(0.0, double(fraction)));
+    return static_cast<unsigned>(std::lround(f * weight));
+}
+
+namespace
+{
+    // `head(a)` / `tail(a)` give the end nodes of input arc a.
+    template <class Query, class NodeOfArc>
+    void add_sources_on_arcs(Query &query, OnArcEndpoints &on_arc,
+                             const NodeOfArc &head, const unsigned *weight,
+                             rust::Slice<const uint32_t> arcs, rust::Slice<const float> fractions)
+    {
+        on_arc.before_add();
+        for (size_t i = 0; i < arcs.size(); ++i)
+        {
+            unsigned a = arcs[i];
+            if (weight[a] >= inf_weight)
+                continue;
+            unsigned offset = offset_on_arc(weight[a], fractions[i]);
+            query.add_source(head(a), weight[a] - offset);
+            on_arc.sources.push_back({a, offset});
+        }
+    }
+
+    template <class Query, class NodeOfArc>
+    void add_targets_on_arcs(Query &query, OnArcEndpoints &on_arc,
+                             const NodeOfArc &tail, const unsigned *weight,
+                             rust::Slice<const uint32_t> arcs, rust::Slice<const float> fractions)
+    {
+        on_arc.before_add();
+        for (size_t i = 0; i < arcs.size(); ++i)
+        {
+            unsigned a = arcs[i];
+            if (weight[a] >= inf_weight)
+                continue;
+            unsigned offset = offset_on_arc(weight[a], fractions[i]);
+            query.add_target(tail(a), offset);
+            on_arc.targets.push_back({a, offset});
+        }
+    }
+}
+
+void OnArcEndpoints::run()
+{
+    ran = true;
+    direct_distance = inf_weight;
+    direct_arc = invalid_id;
+    // Few endpoints per query (a handful of snapping candidates), so pairs are compared directly.
+    for (const std::pair<unsigned, unsigned> &s : sources)
+        for (const std::pair<unsigned, unsigned> &t : targets)
+            if (s.first == t.first && s.second <= t.second && t.second - s.second < direct_distance)
+            {
+                direct_distance = t.second - s.second;
+                direct_arc = s.first;
+            }
+}
+
+void cch_query_add_sources_on_arcs(CCHQuery &query, rust::Slice<const uint32_t> arcs, rust::Slice<const float> fractions)
+{
+    const CCHInputArcs &input = query.metric->cch->input_arcs;
+    add_sources_on_arcs(query.inner, query.on_arc, [&](unsigned a)
+                        { return input.head(a); }, query.metric->inner.input_weight, arcs, fractions);
+}
+
+void cch_query_add_targets_on_arcs(CCHQuery &query, rust::Slice<const uint32_t> arcs, rust::Slice<const float> fractions)
+{
+    const CCHInputArcs &input = query.metric->cch->input_arcs;
+    add_targets_on_arcs(query.inner, query.on_arc, [&](unsigned a)
+                        { return input.tail(a); }, query.metric->inner.input_weight, arcs, fractions);
+}
+
+void cch_query_distances_on_arcs(CCHQuery &query,
+                                 rust::Slice<const uint32_t> source_arcs,
+                                 rust::Slice<const float> source_fractions,
+                                 rust::Slice<const uint32_t> target_arcs,
+                                 rust::Slice<const float> target_fractions,
+                                 rust::Slice<uint32_t> distances)
+{
+    for (size_t i = 0; i < source_arcs.size(); ++i)
+    {
+        cch_query_reset(query, *query.metric);
+        cch_query_add_sources_on_arcs(query, {&source_arcs[i], 1}, {&source_fractions[i], 1});
+        cch_query_add_targets_on_arcs(query, {&target_arcs[i], 1}, {&target_fractions[i], 1});
+        cch_query_run(query);
+        distances[i] = cch_query_distance(query);
+    }
+}
+
+uint32_t ch_query_input_arc_count(const CHQuery &query)
+{
+    return query.ch->input_tail.size();
+}
+
+void ch_query_add_sources_on_arcs(CHQuery &query, rust::Slice<const uint32_t> arcs, rust::Slice<const float> fractions)
+{
+    add_sources_on_arcs(query.inner, query.on_arc, [&](unsigned a)
+                        { return query.ch->input_head[a]; }, query.ch->input_weight.data(), arcs, fractions);
+}
+
+void ch_query_add_targets_on_arcs(CHQuery &query, rust::Slice<const uint32_t> arcs, rust::Slice<const float> fractions)
+{
+    add_targets_on_arcs(query.inner, query.on_arc, [&](unsigned a)
+                        { return query.ch->input_tail[a]; }, query.ch->input_weight.data(), arcs, fractions);
+}
@@ -24,21 +24,23 @@ std::unique_ptr<CCH> cch_new(rust::Slice<const uint32_t> order,
             v.push_back(s[i]);
         return v;
     };
+    std::vector<unsigned> tail_vec = to_vec(tail);
+    std::vector<unsigned> head_vec = to_vec(head);
     CustomizableContractionHierarchy cch(
         to_vec(order),
-        to_vec(tail),
-        to_vec(head),
+        tail_vec,
+        head_vec,
         [log_message](const std::string &msg)
         { log_message(msg); },
         filter_always_inf_arcs);
-    return std::unique_ptr<CCH>(new CCH(std::move(cch)));
+    return std::unique_ptr<CCH>(new CCH(std::move(cch), tail_vec, head_vec));
 }
 
 std::unique_ptr<CCHMetric> cch_metric_new(const CCH &cch, rust::Slice<const uint32_t> weight)
 {
     // Zero-copy: directly use pointer into Rust slice.
     CustomizableContractionHierarchyMetric metric(cch.inner, reinterpret_cast<const unsigned *>(weight.data()));
-    return std::unique_ptr<CCHMetric>(new CCHMetric(std::move(metric)));
+    return std::unique_ptr<CCHMetric>(new CCHMetric(std::move(metric), cch));
 }
 
 void cch_metric_customize(CCHMetric &metric)
@@ -68,32 +70,38 @@ std::unique_ptr<CH> cch_metric_build_perfect_ch(CCHMetric &metric)
 std::unique_ptr<CCHQuery> cch_query_new(const CCHMetric &metric)
 {
     CustomizableContractionHierarchyQuery q(metric.inner);
-    return std::unique_ptr<CCHQuery>(new CCHQuery(std::move(q)));
+    return std::unique_ptr<CCHQuery>(new CCHQuery(std::move(q), metric));
 }
 
 void cch_query_reset(CCHQuery &query, const CCHMetric &metric)
 {
     query.inner.reset(metric.inner);
+    query.metric = &metric;
+    query.on_arc.clear();
 }
 
 void cch_query_add_source(CCHQuery &query, uint32_t s, uint32_t dist)
 {
+    query.on_arc.before_add();
     query.inner.add_source(s, dist);
 }
 
 void cch_query_add_target(CCHQuery &query, uint32_t t, uint32_t dist)
 {
+    query.on_arc.before_add();
     query.inner.add_target(t, dist);
 }
 
 void cch_query_run(CCHQuery &query)
 {
     query.inner.run();
+    query.on_arc.run();
 }
 
 void cch_query_run_to_pinned_targets(CCHQuery &query)
 {
     query.inner.run_to_pinned_targets();
+    query.on_arc.run();
 }
 
 void cch_query_pin_targets(CCHQuery &query, rust::Slice<const uint32_t> targets)
@@ -108,13 +116,18 @@ void cch_query_pin_targets(CCHQuery &query, rust::Slice<const uint32_t> targets)
 uint32_t cch_query_distance(const CCHQuery &query)
 {
     auto &mut_query = const_cast<RoutingKit::CustomizableContractionHierarchyQuery &>(query.inner);
-    return mut_query.get_distance();
+    return std::min(mut_query.get_distance(), query.on_arc.direct_distance);
 }
 
 rust::Vec<uint32_t> cch_query_node_path(const CCHQuery &query)
 {
     auto &mut_query = const_cast<RoutingKit::CustomizableContractionHierarchyQuery &>(query.inner);
-    auto path = mut_query.get_node_path();
+    std::vector<unsigned> path;
+    const CCHInputArcs &input = query.metric->cch->input_arcs;
+    if (query.on_arc.direct_wins(mut_query.get_distance()))
+        path = {input.tail(query.on_arc.direct_arc), input.head(query.on_arc.direct_arc)};
+    else
+        path = mut_query.get_node_path();
     rust::Vec<uint32_t> out;
     out.reserve(path.size());
     for (auto x : path)
@@ -125,7 +138,11 @@ rust::Vec<uint32_t> cch_query_node_path(const CCHQuery &query)
 rust::Vec<uint32_t> cch_query_arc_path(const CCHQuery &query)
 {
     auto &mut_query = const_cast<RoutingKit::CustomizableContractionHierarchyQuery &>(query.inner);
-    auto path = mut_query.get_arc_path();
+    std::vector<unsigned> path;
+    if (query.on_arc.direct_wins(mut_query.get_distance()))
+        path = {query.on_arc.direct_arc};
+    else
+        path = mut_query.get_arc_path();
     rust::Vec<uint32_t> out;
     out.reserve(path.size());
     for (auto x : path)
@@ -154,6 +171,7 @@ void cch_query_get_distances_to_targets_no_alloc(const CCHQuery &query, rust::Sl
 void cch_query_run_to_pinned_sources(CCHQuery &query)
 {
     query.inner.run_to_pinned_sources();
+    query.on_arc.run();
 }
 
 void cch_query_pin_sources(CCHQuery &query, rust::Slice<const uint32_t> sources)
@@ -187,11 +205,25 @@ void cch_query_get_distances_to_sources_no_alloc(const CCHQuery &query, rust::Sl
 void cch_query_reset_source(CCHQuery &query)
 {
     query.inner.reset_source();
+    query.on_arc.sources.clear();
+    query.on_arc.ran = false;
 }
 
 void cch_query_reset_target(CCHQuery &query)
 {
     query.inner.reset_target();
+    query.on_arc.targets.clear();
+    query.on_arc.ran = false;
+}
+
+void cch_query_set_search_generation(CCHQuery &query, uint32_t generation)
+{
+    const unsigned node_count = query.metric->cch->inner.node_count();
+    for (EliminationTreeSearch *search : {&query.forward, &query.backward, &query.witness_forward, &query.witness_backward})
+    {
+        search->init(node_count);
+        search->set_generation(generation);
+    }
 }
 
 rust::Vec<uint32_t> cch_compute_order_inertial(
@@ -281,6 +313,14 @@ void cch_partial_customize(CCHPartial &partial, CCHMetric &metric)
     partial.inner.customize(metric.inner);
 }
 
+void cch_partial_apply(CCHPartial &partial, CCHMetric &metric, rust::Slice<const uint32_t> arcs)
+{
+    partial.inner.reset();
+    for (uint32_t a : arcs)
+        partial.inner.update_arc(a);
+    partial.inner.customize(metric.inner);
+}
+
 std::unique_ptr<CH> ch_build(
     uint32_t node_count,
     rust::Slice<const uint32_t> tail,
@@ -320,37 +360,53 @@ void ch_save_file(const CH &ch, rust::Str file_name)
     ch.inner.save_file(std::string(file_name));
 }
 
+void ch_set_input_arcs(CH &ch,
+                       rust::Slice<const uint32_t> tail,
+                       rust::Slice<const uint32_t> head,
+                       rust::Slice<const uint32_t> weight)
+{
+    ch.input_tail.assign(tail.begin(), tail.end());
+    ch.input_head.assign(head.begin(), head.end());
+    ch.input_weight.assign(weight.begin(), weight.end());
+}
+
 // -------- CH Query wrappers --------
 
 std::unique_ptr<CHQuery> ch_query_new(const CH &ch)
 {
     RoutingKit::ContractionHierarchyQuery q(ch.inner);
-    return std::unique_ptr<CHQuery>(new CHQuery(std::move(q)));
+    return std::unique_ptr<CHQuery>(new CHQuery(std::move(q), ch));
 }
 
 void ch_query_reset(CHQuery &query)
 {
     query.inner.reset();
+    query.on_arc.clear();
 }
 
-void ch_query_reset(CHQuery &query, const CH &ch)
+void ch_query_reset_ch(CHQuery &query, const CH &ch)
 {
     query.inner.reset(ch.inner);
+    query.ch = &ch;
+    query.on_arc.clear();
 }
 
 void ch_query_add_source(CHQuery &query, uint32_t s, uint32_t dist)
 {
+    query.on_arc.before_add();
     query.inner.add_source(s, dist);
 }
 
 void ch_query_add_target(CHQuery &query, uint32_t t, uint32_t dist)
 {
+    query.on_arc.before_add();
     query.inner.add_target(t, dist);
 }
 
 void ch_query_run(CHQuery &query)
 {
     query.inner.run();
+    query.on_arc.run();
 }
 
 void ch_query_pin_targets(CHQuery &query, rust::Slice<const uint32_t> targets)
@@ -365,6 +421,7 @@ void ch_query_pin_targets(CHQuery &query, rust::Slice<const uint32_t> targets)
 void ch_query_run_to_pinned_targets(CHQuery &query)
 {
     query.inner.run_to_pinned_targets();
+    query.on_arc.run();
 }
 
 rust::Vec<uint32_t> ch_query_get_distances_to_targets(const CHQuery &query)
@@ -396,6 +453,7 @@ void ch_query_pin_sources(CHQuery &query, rust::Slice<const uint32_t> sources)
 void ch_query_run_to_pinned_sources(CHQuery &query)
 {
     query.inner.run_to_pinned_sources();
+    query.on_arc.run();
 }
 
 rust::Vec<uint32_t> ch_query_get_distances_to_sources(const CHQuery &query)
@@ -418,13 +476,17 @@ void ch_query_get_distances_to_sources_no_alloc(const CHQuery &query, rust::Slic
 uint32_t ch_query_distance(const CHQuery &query)
 {
     auto &mut_query = const_cast<RoutingKit::ContractionHierarchyQuery &>(query.inner);
-    return mut_query.get_distance();
+    return std::min(mut_query.get_distance(), query.on_arc.direct_distance);
 }
 
 rust::Vec<uint32_t> ch_query_node_path(const CHQuery &query)
 {
     auto &mut_query = const_cast<RoutingKit::ContractionHierarchyQuery &>(query.inner);
-    auto path = mut_query.get_node_path();
+    std::vector<unsigned> path;
+    if (query.on_arc.direct_wins(mut_query.get_distance()))
+        path = {query.ch->input_tail[query.on_arc.direct_arc], query.ch->input_head[query.on_arc.direct_arc]};
+    else
+        path = mut_query.get_node_path();
     rust::Vec<uint32_t> out;
     out.reserve(path.size());
     for (auto x : path)
@@ -435,7 +497,11 @@ rust::Vec<uint32_t> ch_query_node_path(const CHQuery &query)
 rust::Vec<uint32_t> ch_query_arc_path(const CHQuery &query)
 {
     auto &mut_query = const_cast<RoutingKit::ContractionHierarchyQuery &>(query.inner);
-    auto path = mut_query.get_arc_path();
+    std::vector<unsigned> path;
+    if (query.on_arc.direct_wins(mut_query.get_distance()))
+        path = {query.on_arc.direct_arc};
+    else
+        path = mut_query.get_arc_path();
     rust::Vec<uint32_t> out;
     out.reserve(path.size());
     for (auto x : path)
@@ -446,9 +512,13 @@ rust::Vec<uint32_t> ch_query_arc_path(const CHQuery &query)
 void ch_query_reset_source(CHQuery &query)
 {
     query.inner.reset_source();
+    query.on_arc.sources.clear();
+    query.on_arc.ran = false;
 }
 
 void ch_query_reset_target(CHQuery &query)
 {
     query.inner.reset_target();
+    query.on_arc.targets.clear();
+    query.on_arc.ran = false;
 }
@@ -3,40 +3,335 @@
 #include <vector>
 #include <cstdint>
 #include <algorithm>
+#include <queue>
+#include <mutex>
 #include "rust/cxx.h"
 
 // RoutingKit headers
 #include <routingkit/customizable_contraction_hierarchy.h>
 #include <routingkit/contraction_hierarchy.h>
 
+#include "cch_search.h"
+
 struct CCH
 {
     RoutingKit::CustomizableContractionHierarchy inner;
-    explicit CCH(RoutingKit::CustomizableContractionHierarchy &&x) : inner(std::move(x)) {}
+    CCHInputArcs input_arcs;
+    CCH(RoutingKit::CustomizableContractionHierarchy &&x, const std::vector<unsigned> &tail, const std::vector<unsigned> &head)
+        : inner(std::move(x)), input_arcs(inner, tail, head) {}
+    CCH(const CCH &other) : inner(other.inner), input_arcs(other.input_arcs, inner) {}
 };
 
 struct CH
 {
     RoutingKit::ContractionHierarchy inner;
+    // Input arcs for endpoints on arcs, only if set with ch_set_input_arcs; neither save_file
+    // nor the mapped format stores them.
+    std::vector<unsigned> input_tail, input_head, input_weight;
     explicit CH(RoutingKit::ContractionHierarchy &&x) : inner(std::move(x)) {}
 };
 
+// round(fraction * weight), the distance from the tail of the point at `fraction` along an arc.
+unsigned offset_on_arc(unsigned weight, float fraction);
+
+// Sources and targets inside input arcs (query_on_arc.cc), stored as (arc, offset from the
+// tail). Each one is also added to the query as an ordinary endpoint: a source at the head
+// with the rest of the arc as initial distance, a target at the tail with the offset. A source
+// behind a target on the same arc reaches it along the arc without passing either node, which
+// no graph path covers, so run() checks those pairs here and results take the shorter route.
+struct OnArcEndpoints
+{
+    std::vector<std::pair<unsigned, unsigned>> sources, targets;
+    unsigned direct_distance = RoutingKit::inf_weight;
+    unsigned direct_arc = RoutingKit::invalid_id;
+    bool ran = false;
+
+    // Endpoints added after a run belong to the next query.
+    void before_add()
+    {
+        if (ran)
+            clear();
+    }
+    void clear()
+    {
+        sources.clear();
+        targets.clear();
+        direct_distance = RoutingKit::inf_weight;
+        direct_arc = RoutingKit::invalid_id;
+        ran = false;
+    }
+    void run();
+    bool direct_wins(unsigned graph_distance) const { return direct_distance != RoutingKit::inf_weight && direct_distance <= graph_distance; }
+};
+
 struct CHQuery
 {
     RoutingKit::ContractionHierarchyQuery inner;
-    explicit CHQuery(RoutingKit::ContractionHierarchyQuery &&x) : inner(std::move(x)) {}
+    const CH *ch;
+    OnArcEndpoints on_arc;
+    CHQuery(RoutingKit::ContractionHierarchyQuery &&x, const CH &ch) : inner(std::move(x)), ch(&ch) {}
 };
 
 struct CCHMetric
 {
     RoutingKit::CustomizableContractionHierarchyMetric inner;
-    explicit CCHMetric(RoutingKit::CustomizableContractionHierarchyMetric &&x) : inner(std::move(x)) {}
+    const CCH *cch;
+    std::unique_ptr<CCH> owned_cch; // set for NUMA replicas, which carry their own topology copy
+    CCHMetric(RoutingKit::CustomizableContractionHierarchyMetric &&x, const CCH &cch) : inner(std::move(x)), cch(&cch) {}
 };
 
 struct CCHQuery
 {
     RoutingKit::CustomizableContractionHierarchyQuery inner;
-    explicit CCHQuery(RoutingKit::CustomizableContractionHierarchyQuery &&x) : inner(std::move(x)) {}
+    const CCHMetric *metric;
+    // Scratch for the extensions in cch_search.h; labels are allocated on first use.
+    EliminationTreeSearch forward, backward;
+    EliminationTreeSearch witness_forward, witness_backward;
+    // Many-to-one / one-to-many: search spaces of the pinned nodes, and dense labels of the
+    // free endpoint (inf_weight between queries).
+    PinnedSearchSpaces pinned_sources, pinned_targets;
+    std::vector<unsigned> gather_label;
+    OnArcEndpoints on_arc;
+    CCHQuery(RoutingKit::CustomizableContractionHierarchyQuery &&x, const CCHMetric &metric) : inner(std::move(x)), metric(&metric) {}
+};
+
+// HMM map matching scratch (cch_map_matching.cc); `query` provides the search scratch and the
+// pinned one-to-many targets. Per-candidate arrays are sized per trace.
+struct CCHMapMatcher
+{
+    std::unique_ptr<CCHQuery> query;
+    std::vector<double> score;
+    std::vector<unsigned> parent, offset;
+    std::vector<unsigned> tails, dists, leg;
+};
+
+struct CCHRangeQuery
+{
+    const CCHMetric *metric;
+    EliminationTreeSearch upward;
+    std::vector<unsigned> dist;
+    std::vector<bool> queued;
+    std::vector<unsigned> touched;
+    std::priority_queue<unsigned> heap; // max-heap on rank: downward sweep order
+    explicit CCHRangeQuery(const CCHMetric &metric) : metric(&metric) {}
+};
+
+// Preallocated scratch shared by short-lived point-to-point queries. One slab holds
+// `capacity` slots of per-rank labels with both directions interleaved; creating a query only
+// claims a free slot. Queries walk the elimination tree ancestors of s and t and reset exactly
+// those labels, so labels are inf_weight / invalid_id whenever a slot is free.
+struct CCHQueryArena
+{
+    struct Label
+    {
+        unsigned forward, backward;
+        unsigned forward_arc, backward_arc;
+    };
+    const CCHMetric *metric;
+    unsigned node_count;
+    unsigned capacity;
+    std::unique_ptr<Label[]> slab; // capacity * node_count
+    mutable std::mutex lock;
+    mutable std::vector<unsigned> free_slots;
+    CCHQueryArena(const CCHMetric &metric, unsigned capacity);
+};
+
+struct CCHArenaQuery
+{
+    const CCHQueryArena *arena;
+    unsigned slot;
+    CCHQueryArena::Label *label;
+    // Ranks of the last run (invalid_id once its labels are reset) and its result.
+    unsigned source = RoutingKit::invalid_id, target = RoutingKit::invalid_id;
+    unsigned meeting = RoutingKit::invalid_id, distance = RoutingKit::inf_weight;
+    CCHArenaQuery(const CCHQueryArena &arena, unsigned slot);
+    ~CCHArenaQuery(); // resets the labels and returns the slot
+};
+
+struct CCHPOIIndex
+{
+    struct Entry
+    {
+        unsigned distance;
+        unsigned poi;
+        bool operator<(const Entry &o) const { return distance < o.distance || (distance == o.distance && poi < o.poi); }
+    };
+    const CCHMetric *metric;
+    std::vector<unsigned> bucket_of_node; // by rank; invalid_id if the node has no bucket
+    std::vector<std::vector<Entry>> buckets;
+    std::vector<bool> is_poi; // by node id
+    unsigned poi_count = 0;
+    EliminationTreeSearch search; // backward search used by insert
+    explicit CCHPOIIndex(const CCHMetric &metric) : metric(&metric) {}
+};
+
+// Query-only CCH topology for memory-constrained deployments. Upward heads are stored as
+// LEB128 gaps in ascending order with implicit arc ids, elimination tree parents as
+// bit-packed deltas, and the rank map is dropped if node ids already are ranks.
+struct CompressedCCH
+{
+    unsigned node_count = 0;
+    std::vector<unsigned> rank;          // by node id; empty if rank[v] == v
+    std::vector<unsigned> up_arc_first;  // node_count + 1; arcs of x sorted by head
+    std::vector<unsigned> up_byte_first; // node_count + 1; offsets into up_gaps
+    std::vector<uint8_t> up_gaps;        // head - previous head, starting from the tail
+    std::vector<uint64_t> parent_bits;   // parent(x) - x in parent_width bits, 0 for roots
+    unsigned parent_width = 1;
+
+    unsigned node_rank(unsigned v) const { return rank.empty() ? v : rank[v]; }
+    unsigned parent(unsigned x) const;
+};
+
+// Customized weights of one metric in CompressedCCH arc order. Independent of the CCHMetric it
+// was taken from.
+struct CompressedCCHMetric
+{
+    const CompressedCCH *cch;
+    std::vector<unsigned> forward, backward;
+    explicit CompressedCCHMetric(const CompressedCCH &cch) : cch(&cch) {}
+};
+
+struct CompressedCCHQuery
+{
+    const CompressedCCHMetric *metric;
+    std::vector<unsigned> forward, backward; // labels by rank, inf_weight between queries
+    explicit CompressedCCHQuery(const CompressedCCHMetric &metric) : metric(&metric) {}
+};
+
+// Metric with weights stored in 16 or 24 bits. Values below the escape code are stored
+// inline; larger weights go to a sorted overflow tier, and the all-ones code is infinity.
+// Customized with saturating arithmetic.
+struct QuantizedCCHMetric
+{
+    struct Tier
+    {
+        std::vector<uint8_t> inline_weight;             // width bytes per arc, little endian
+        std::vector<unsigned> overflow_arc, overflow_weight; // sorted by arc
+    };
+    const CCH *cch;
+    unsigned width; // bytes per inline weight: 2 or 3
+    Tier forward, backward;
+
+    QuantizedCCHMetric(const CCH &cch, unsigned width) : cch(&cch), width(width) {}
+    unsigned infinity_code() const { return (1u << (8 * width)) - 1; }
+    unsigned escape_code() const { return infinity_code() - 1; }
+    unsigned get(const Tier &tier, unsigned arc) const;
+};
+
+struct QuantizedCCHQuery
+{
+    const QuantizedCCHMetric *metric;
+    EliminationTreeSearch forward, backward;
+    explicit QuantizedCCHQuery(const QuantizedCCHMetric &metric) : metric(&metric) {}
+};
+
+// CH in the page-aligned file format of ch_mapped.cc, mapped read-only and used in place.
+// Arrays point into the mapping; validate() checks checksums and structure once.
+struct MappedCH
+{
+    struct Side
+    {
+        const uint32_t *first_out, *head, *weight;
+        const uint32_t *first_arc, *second_arc; // input arc and head node for original arcs
+        const uint64_t *is_original_bits;
+        unsigned arc_count;
+        bool is_original(unsigned a) const { return (is_original_bits[a / 64] >> (a % 64)) & 1; }
+    };
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    unsigned node_count = 0;
+    const uint32_t *rank = nullptr, *order = nullptr;
+    Side forward{}, backward{};
+    mutable std::once_flag validated;
+    mutable bool valid = false;
+
+    MappedCH() = default;
+    MappedCH(const MappedCH &) = delete;
+    MappedCH &operator=(const MappedCH &) = delete;
+    ~MappedCH(); // unmaps the file
+    bool validate() const;
+};
+
+// Bidirectional upward search with stall-on-demand on a MappedCH. Labels carry the generation
+// of the query that wrote them, so starting a query is O(1).
+struct MappedCHQuery
+{
+    struct Label
+    {
+        unsigned forward, backward;
+        unsigned forward_arc, backward_arc;
+        unsigned generation;
+    };
+    const MappedCH *ch;
+    std::vector<Label> label; // by rank
+    unsigned generation = 0;
+    std::vector<std::pair<unsigned, unsigned>> forward_heap, backward_heap; // (distance, rank)
+    unsigned source = RoutingKit::invalid_id, meeting = RoutingKit::invalid_id;
+    unsigned distance = RoutingKit::inf_weight;
+    explicit MappedCHQuery(const MappedCH &ch) : ch(&ch) {}
+    Label &claim(unsigned x); // label of x, reset if it belongs to an older query
+};
+
+// Hub labels computed from a CH (ch_hub_labels.cc). The forward (backward) label of node v is
+// hub[first[v]..first[v + 1]) with the matching dist entries; hubs are CH ranks in increasing
+// order, so a query intersects two sorted arrays. Arrays point into the owned vectors or into
+// a mapped file; validate() checks a mapped file once.
+struct HubLabels
+{
+    struct Side
+    {
+        const uint64_t *first;
+        const uint32_t *hub, *dist;
+        uint64_t entry_count;
+    };
+    unsigned node_count = 0;
+    Side forward{}, backward{};
+    std::vector<uint64_t> owned_first[2]; // forward, backward
+    std::vector<uint32_t> owned_hub[2], owned_dist[2];
+    const uint8_t *data = nullptr; // file mapping, if opened from a file
+    size_t size = 0;
+    mutable std::once_flag validated;
+    mutable bool valid = false;
+
+    HubLabels() = default;
+    HubLabels(const HubLabels &) = delete;
+    HubLabels &operator=(const HubLabels &) = delete;
+    ~HubLabels(); // unmaps the file
+    bool validate() const;
+};
+
+// Uniform grid over node positions and straight arc segments (spatial_index.cc). Coordinates
+// are projected to local meters (equirectangular around the mean latitude); every arc is
+// listed in each cell its segment may touch.
+struct SpatialIndex
+{
+    std::vector<double> x, y; // projected node positions, meters
+    std::vector<unsigned> tail, head; // arc end nodes, also read by Rust through spatial_index_arc_*
+    double meters_per_degree_lat = 0, meters_per_degree_lon = 0;
+    double min_x = 0, min_y = 0, cell_size = 1;
+    unsigned columns = 0, rows = 0;
+    std::vector<unsigned> node_cell_first, node_cell_items; // nodes grouped by cell
+    std::vector<unsigned> arc_cell_first, arc_cell_items;   // arcs grouped by cell
+};
+
+// Scratch for bucket many-to-many and PHAST one-to-all on a CH (ch_batch.cc). Arrays are
+// sized on first use; upward search labels carry a generation so each search starts in O(1).
+struct CHBatchQuery
+{
+    struct Bucket
+    {
+        unsigned node, target, distance; // node is a rank
+    };
+    const CH *ch;
+    std::vector<unsigned> distance, generation_of; // upward search labels by rank
+    unsigned generation = 0;
+    std::vector<std::pair<unsigned, unsigned>> heap;    // (distance, rank)
+    std::vector<std::pair<unsigned, unsigned>> settled; // (rank, distance) of the last search
+    std::vector<Bucket> buckets;                        // target search spaces, sorted by node
+    std::vector<unsigned> bucket_begin, bucket_round_of; // first bucket of a rank, by rank
+    unsigned bucket_round = 0;
+    std::vector<unsigned> sweep; // PHAST distances by rank
+    explicit CHBatchQuery(const CH &ch) : ch(&ch) {}
 };
 
 struct CCHPartial
@@ -54,6 +349,8 @@ std::unique_ptr<CCHMetric> cch_metric_new(const CCH &cch, rust::Slice<const uint
 void cch_metric_customize(CCHMetric &metric);
 void cch_metric_parallel_customize(CCHMetric &metric, uint32_t thread_count);
 std::unique_ptr<CH> cch_metric_build_perfect_ch(CCHMetric &metric);
+// Multi-threaded variant that reads the metric without modifying it (cch_perfect_ch.cc).
+std::unique_ptr<CH> cch_metric_build_perfect_ch_parallel(const CCHMetric &metric, uint32_t thread_count);
 std::unique_ptr<CCHQuery> cch_query_new(const CCHMetric &metric);
 void cch_query_reset(CCHQuery &query, const CCHMetric &metric);
 void cch_query_add_source(CCHQuery &query, uint32_t s, uint32_t dist);
@@ -71,10 +368,146 @@ void cch_query_get_distances_to_sources_no_alloc(const CCHQuery &query, rust::Sl
 
 void cch_query_reset_source(CCHQuery &query);
 void cch_query_reset_target(CCHQuery &query);
+// Set the generation counter of the elimination tree searches (testing only).
+void cch_query_set_search_generation(CCHQuery &query, uint32_t generation);
+
+// Sources / targets at `fractions[i]` along input arcs `arcs[i]`, weighted by the metric
+// (query_on_arc.cc). distances_on_arcs runs one query per pair (source_arcs[i], target_arcs[i]).
+void cch_query_add_sources_on_arcs(CCHQuery &query, rust::Slice<const uint32_t> arcs, rust::Slice<const float> fractions);
+void cch_query_add_targets_on_arcs(CCHQuery &query, rust::Slice<const uint32_t> arcs, rust::Slice<const float> fractions);
+void cch_query_distances_on_arcs(CCHQuery &query,
+                                 rust::Slice<const uint32_t> source_arcs,
+                                 rust::Slice<const float> source_fractions,
+                                 rust::Slice<const uint32_t> target_arcs,
+                                 rust::Slice<const float> target_fractions,
+                                 rust::Slice<uint32_t> distances);
+
+// Many-to-one / one-to-many: pin once (or slot by slot), then each query costs one upward
+// search plus a vectorized gather over the stored search spaces. Results are per slot.
+// Independent of the RoutingKit pinned sources/targets.
+void cch_query_pin_many_to_one_sources(CCHQuery &query, rust::Slice<const uint32_t> sources);
+uint32_t cch_query_add_pinned_source(CCHQuery &query, uint32_t s);
+bool cch_query_remove_pinned_source(CCHQuery &query, uint32_t slot);
+uint32_t cch_query_pinned_source_slots(const CCHQuery &query);
+void cch_query_many_to_one(CCHQuery &query, uint32_t t, rust::Slice<uint32_t> dists);
+void cch_query_pin_one_to_many_targets(CCHQuery &query, rust::Slice<const uint32_t> targets);
+uint32_t cch_query_add_pinned_target(CCHQuery &query, uint32_t t);
+bool cch_query_remove_pinned_target(CCHQuery &query, uint32_t slot);
+uint32_t cch_query_pinned_target_slots(const CCHQuery &query);
+void cch_query_one_to_many(CCHQuery &query, uint32_t s, rust::Slice<uint32_t> dists);
+
+// Via-node alternative routes. Outputs are flattened: route i has distances[i], arcs
+// [arc_first[i], arc_first[i + 1]) and nodes [arc_first[i] + i, arc_first[i + 1] + i + 1).
+void cch_query_run_alternatives(CCHQuery &query,
+                                uint32_t s,
+                                uint32_t t,
+                                uint32_t max_route_count,
+                                double max_stretch,
+                                double max_sharing,
+                                double local_optimality,
+                                rust::Vec<uint32_t> &distances,
+                                rust::Vec<uint32_t> &arc_first,
+                                rust::Vec<uint32_t> &arcs,
+                                rust::Vec<uint32_t> &nodes);
+
+// Match a GPS trace; candidates of point i are candidate_*[candidate_first[i]..candidate_first[i + 1]]
+// with their distance to the point in meters. Writes per point the global index of the matched
+// candidate (invalid_id if none) and the position of its arc in `route`, which lists the
+// matched arcs joined by shortest paths.
+std::unique_ptr<CCHMapMatcher> cch_map_matcher_new(const CCHMetric &metric);
+void cch_map_matcher_run(CCHMapMatcher &matcher,
+                         rust::Slice<const float> latitude,
+                         rust::Slice<const float> longitude,
+                         rust::Slice<const uint32_t> candidate_first,
+                         rust::Slice<const uint32_t> candidate_arc,
+                         rust::Slice<const float> candidate_fraction,
+                         rust::Slice<const float> candidate_distance,
+                         double sigma,
+                         double beta,
+                         double weight_per_meter,
+                         rust::Slice<uint32_t> matched,
+                         rust::Vec<uint32_t> &route,
+                         rust::Slice<uint32_t> route_first);
+
+// Route through `points` in order (cch_via.cc). Per leg i: distances[i] (inf_weight if
+// unreachable) and input arcs arcs[arc_first[i]..arc_first[i + 1]]. nodes is the node sequence
+// of the whole route with point i at nodes[node_first[i]].
+void cch_query_run_via(CCHQuery &query,
+                       rust::Slice<const uint32_t> points,
+                       rust::Vec<uint32_t> &distances,
+                       rust::Vec<uint32_t> &arcs,
+                       rust::Vec<uint32_t> &arc_first,
+                       rust::Vec<uint32_t> &nodes,
+                       rust::Vec<uint32_t> &node_first);
 
 uint32_t cch_query_distance(const CCHQuery &query);
+
+// k-nearest POI index (target buckets). Queries borrow the forward scratch of a CCHQuery.
+std::unique_ptr<CCHPOIIndex> cch_poi_index_new(const CCHMetric &metric, rust::Slice<const uint32_t> pois);
+bool cch_poi_index_insert(CCHPOIIndex &index, uint32_t node);
+bool cch_poi_index_remove(CCHPOIIndex &index, uint32_t node);
+uint32_t cch_poi_index_len(const CCHPOIIndex &index);
+void cch_poi_index_nearest(const CCHPOIIndex &index,
+                           CCHQuery &query,
+                           uint32_t s,
+                           uint32_t k,
+                           rust::Vec<uint32_t> &pois,
+                           rust::Vec<uint32_t> &distances);
+
+// Arena-backed point-to-point queries. cch_arena_query_new returns null if all slots are
+// taken; the slot is returned when the query is destroyed.
+std::unique_ptr<CCHQueryArena> cch_query_arena_new(const CCHMetric &metric, uint32_t capacity);
+uint32_t cch_query_arena_available(const CCHQueryArena &arena);
+size_t cch_query_arena_memory_bytes(const CCHQueryArena &arena);
+std::unique_ptr<CCHArenaQuery> cch_arena_query_new(const CCHQueryArena &arena);
+uint32_t cch_arena_query_run(CCHArenaQuery &query, uint32_t s, uint32_t t);
+rust::Vec<uint32_t> cch_arena_query_arc_path(const CCHArenaQuery &query);
+rust::Vec<uint32_t> cch_arena_query_node_path(const CCHArenaQuery &query);
+
+// Range (isochrone) queries. For source i, the reached nodes are [first[i], first[i + 1]) and
+// the boundary arcs [boundary_first[i], boundary_first[i + 1]).
+std::unique_ptr<CCHRangeQuery> cch_range_query_new(const CCHMetric &metric);
+void cch_range_query_run(CCHRangeQuery &query,
+                         rust::Slice<const uint32_t> sources,
+                         rust::Slice<const uint32_t> limits,
+                         bool with_boundary,
+                         rust::Vec<uint32_t> &first,
+                         rust::Vec<uint32_t> &nodes,
+                         rust::Vec<uint32_t> &distances,
+                         rust::Vec<uint32_t> &boundary_first,
+                         rust::Vec<uint32_t> &boundary_arcs,
+                         rust::Vec<uint32_t> &boundary_offsets);
 rust::Vec<uint32_t> cch_query_node_path(const CCHQuery &query);
 rust::Vec<uint32_t> cch_query_arc_path(const CCHQuery &query);
+
+// Compressed query-only representation (distances only; paths need the full CCH).
+std::unique_ptr<CompressedCCH> compressed_cch_new(const CCH &cch);
+size_t compressed_cch_memory_bytes(const CompressedCCH &cch);
+size_t cch_memory_bytes(const CCH &cch);
+std::unique_ptr<CompressedCCHMetric> compressed_cch_metric_new(const CompressedCCH &cch, const CCHMetric &metric);
+std::unique_ptr<CompressedCCHQuery> compressed_cch_query_new(const CompressedCCHMetric &metric);
+uint32_t compressed_cch_query_distance(CompressedCCHQuery &query, uint32_t s, uint32_t t);
+
+// Memory placement. On Linux huge pages are requested with madvise(MADV_HUGEPAGE) and NUMA
+// topology is read from sysfs; elsewhere there is a single node and the advice is a no-op.
+uint32_t numa_node_count();
+uint32_t numa_current_node();
+bool numa_pin_current_thread(uint32_t node);
+size_t cch_advise_huge_pages(const CCH &cch);
+size_t cch_metric_advise_huge_pages(const CCHMetric &metric);
+// Copy of the metric and its topology, allocated (first-touched) by a thread on `node`. The
+// input weights are copied into `weight`, which the replica then points at.
+std::unique_ptr<CCHMetric> cch_metric_numa_replica(const CCHMetric &metric, rust::Slice<uint32_t> weight,
+                                                   uint32_t node, bool huge_pages);
+
+// Quantized metrics (width_bits = 16 or 24).
+size_t cch_metric_memory_bytes(const CCHMetric &metric);
+std::unique_ptr<QuantizedCCHMetric> quantized_cch_metric_new(const CCH &cch,
+                                                             rust::Slice<const uint32_t> weight,
+                                                             uint32_t width_bits);
+size_t quantized_cch_metric_memory_bytes(const QuantizedCCHMetric &metric);
+std::unique_ptr<QuantizedCCHQuery> quantized_cch_query_new(const QuantizedCCHMetric &metric);
+uint32_t quantized_cch_query_distance(QuantizedCCHQuery &query, uint32_t s, uint32_t t);
 rust::Vec<uint32_t> cch_compute_order_inertial(
     uint32_t node_count,
     rust::Slice<const uint32_t> tail,
@@ -92,6 +525,8 @@ std::unique_ptr<CCHPartial> cch_partial_new(const CCH &cch);
 void cch_partial_reset(CCHPartial &partial);
 void cch_partial_update_arc(CCHPartial &partial, uint32_t arc);
 void cch_partial_customize(CCHPartial &partial, CCHMetric &metric);
+// reset + update_arc for every arc + customize; the new weights must already be in place.
+void cch_partial_apply(CCHPartial &partial, CCHMetric &metric, rust::Slice<const uint32_t> arcs);
 
 std::unique_ptr<CH> ch_build(
     uint32_t node_count,
@@ -101,8 +536,79 @@ std::unique_ptr<CH> ch_build(
     rust::Fn<void(rust::Str)> log_message,
     uint32_t max_pop_count);
 
+// Contracts independent node sets in rounds with parallel witness searches (ch_parallel.cc).
+std::unique_ptr<CH> ch_build_parallel(
+    uint32_t node_count,
+    rust::Slice<const uint32_t> tail,
+    rust::Slice<const uint32_t> head,
+    rust::Slice<const uint32_t> weight,
+    rust::Fn<void(rust::Str)> log_message,
+    uint32_t max_pop_count,
+    uint32_t thread_count);
+
 std::unique_ptr<CH> ch_load_file(rust::Str file_name);
 void ch_save_file(const CH &ch, rust::Str file_name);
+// Copy the input arcs into the CH so that CHQuery accepts endpoints on arcs.
+void ch_set_input_arcs(CH &ch,
+                       rust::Slice<const uint32_t> tail,
+                       rust::Slice<const uint32_t> head,
+                       rust::Slice<const uint32_t> weight);
+
+// Mapped CH format (ch_mapped.cc); errors are thrown as std::runtime_error.
+void ch_save_mapped_file(const CH &ch, rust::Str file_name);
+std::unique_ptr<MappedCH> mapped_ch_open(rust::Str file_name, bool validate);
+bool mapped_ch_validate(const MappedCH &ch);
+uint32_t mapped_ch_node_count(const MappedCH &ch);
+size_t mapped_ch_file_bytes(const MappedCH &ch);
+std::unique_ptr<MappedCHQuery> mapped_ch_query_new(const MappedCH &ch);
+uint32_t mapped_ch_query_run(MappedCHQuery &query, uint32_t s, uint32_t t);
+rust::Vec<uint32_t> mapped_ch_query_arc_path(const MappedCHQuery &query);
+rust::Vec<uint32_t> mapped_ch_query_node_path(const MappedCHQuery &query);
+
+// Hub labels (ch_hub_labels.cc); file errors are thrown as std::runtime_error.
+std::unique_ptr<HubLabels> hub_labels_build(const CH &ch, uint32_t thread_count);
+void hub_labels_save_mapped_file(const HubLabels &labels, rust::Str file_name);
+std::unique_ptr<HubLabels> hub_labels_open(rust::Str file_name, bool validate);
+bool hub_labels_validate(const HubLabels &labels);
+uint32_t hub_labels_node_count(const HubLabels &labels);
+uint64_t hub_labels_entry_count(const HubLabels &labels);
+size_t hub_labels_memory_bytes(const HubLabels &labels);
+uint32_t hub_labels_distance(const HubLabels &labels, uint32_t s, uint32_t t);
+
+// Coordinate snapping (spatial_index.cc). Batch queries run on `thread_count` threads and
+// write one row per point; missing results get invalid_id and an infinite distance.
+std::unique_ptr<SpatialIndex> spatial_index_new(rust::Slice<const float> latitude,
+                                                rust::Slice<const float> longitude,
+                                                rust::Slice<const uint32_t> tail,
+                                                rust::Slice<const uint32_t> head);
+void spatial_index_nearest_nodes(const SpatialIndex &index,
+                                 rust::Slice<const float> latitude,
+                                 rust::Slice<const float> longitude,
+                                 uint32_t k,
+                                 float max_distance,
+                                 uint32_t thread_count,
+                                 rust::Slice<uint32_t> nodes,
+                                 rust::Slice<float> distances);
+void spatial_index_nearest_arcs(const SpatialIndex &index,
+                                rust::Slice<const float> latitude,
+                                rust::Slice<const float> longitude,
+                                uint32_t k,
+                                float max_distance,
+                                uint32_t thread_count,
+                                rust::Slice<uint32_t> arcs,
+                                rust::Slice<float> fractions,
+                                rust::Slice<float> distances);
+uint32_t spatial_index_arc_tail(const SpatialIndex &index, uint32_t arc);
+uint32_t spatial_index_arc_head(const SpatialIndex &index, uint32_t arc);
+
+// Bucket many-to-many and PHAST (ch_batch.cc); outputs are filled in place.
+uint32_t ch_node_count(const CH &ch);
+std::unique_ptr<CHBatchQuery> ch_batch_query_new(const CH &ch);
+void ch_batch_query_matrix(CHBatchQuery &query,
+                           rust::Slice<const uint32_t> sources,
+                           rust::Slice<const uint32_t> targets,
+                           rust::Slice<uint32_t> dists);
+void ch_batch_query_one_to_all(CHBatchQuery &query, uint32_t s, rust::Slice<uint32_t> dists);
 
 std::unique_ptr<CHQuery> ch_query_new(const CH &ch);
 void ch_query_reset_ch(CHQuery &query, const CH &ch);
@@ -125,3 +631,8 @@ rust::Vec<uint32_t> ch_query_node_path(const CHQuery &query);
 rust::Vec<uint32_t> ch_query_arc_path(const CHQuery &query);
 void ch_query_reset_source(CHQuery &query);
 void ch_query_reset_target(CHQuery &query);
+// Same as the CCH versions, weighted by the arcs set with ch_set_input_arcs; input_arc_count is
+// 0 if there are none.
+uint32_t ch_query_input_arc_count(const CHQuery &query);
+void ch_query_add_sources_on_arcs(CHQuery &query, rust::Slice<const uint32_t> arcs, rust::Slice<const float> fractions);
+void ch_query_add_targets_on_arcs(CHQuery &query, rust::Slice<const uint32_t> arcs, rust::Slice<const float> fractions);
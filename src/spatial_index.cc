@@ -0,0 +1,287 @@
+#include "routingkit_cch_wrapper.h"
+#include "omp_threads.h"
+
+#include <routingkit/constants.h>
+#include <cmath>
+#include <limits>
+#include <tuple>
+
+using namespace RoutingKit;
+
+// Snapping of GPS coordinates to nodes and arcs. Positions are projected once to local
+// meters, which is accurate to well under a percent at city scale. The grid has about two
+// nodes per cell; a query scans rings of cells around the cell of the point and stops as soon
+// as everything outside the scanned box is provably farther than the current k-th result
+// (or than max_distance). Arcs are straight segments between their end nodes.
+
+namespace
+{
+    const double meters_per_degree = 6371000.0 * 3.14159265358979323846 / 180.0;
+    const double infinity = std::numeric_limits<double>::infinity();
+
+    void group_by_cell(unsigned cell_count, const std::vector<std::pair<unsigned, unsigned>> &cell_item,
+                       std::vector<unsigned> &first, std::vector<unsigned> &items)
+    {
+        first.assign(cell_count + 1, 0);
+        for (const std::pair<unsigned, unsigned> &p : cell_item)
+            ++first[p.first + 1];
+        for (unsigned c = 0; c < cell_count; ++c)
+            first[c + 1] += first[c];
+        items.resize(cell_item.size());
+        std::vector<unsigned> fill(first.begin(), first.end() - 1);
+        for (const std::pair<unsigned, unsigned> &p : cell_item)
+            items[fill[p.first]++] = p.second;
+    }
+
+    unsigned clamp_cell(double v, double min, double cell_size, unsigned count)
+    {
+        double c = std::floor((v - min) / cell_size);
+        if (!(c > 0))
+            return 0;
+        return c >= count ? count - 1 : static_cast<unsigned>(c);
+    }
+
+    // Distance from p to the segment a-b; t is the position of the closest point along a-b.
+    double segment_distance(double ax, double ay, double bx, double by, double px, double py, double &t)
+    {
+        double dx = bx - ax, dy = by - ay;
+        double length_sq = dx * dx + dy * dy;
+        t = length_sq > 0 ? ((px - ax) * dx + (py - ay) * dy) / length_sq : 0;
+        t = std::min(1.0, std::max(0.0, t));
+        return std::hypot(ax + t * dx - px, ay + t * dy - py);
+    }
+
+    // Ring search around the cell of (px, py): scan(cell) for every cell at Chebyshev
+    // distance r = 0, 1, ... until limit() is no larger than a lower bound on the distance to
+    // anything outside the scanned cells. Sides of the scanned box at the grid border bound
+    // nothing, so the search ends once the box covers the grid.
+    template <class Scan, class Limit>
+    void ring_search(const SpatialIndex &index, double px, double py, const Scan &scan, const Limit &limit)
+    {
+        const long long columns = index.columns, rows = index.rows;
+        const long long cx = clamp_cell(px, index.min_x, index.cell_size, index.columns);
+        const long long cy = clamp_cell(py, index.min_y, index.cell_size, index.rows);
+        for (long long r = 0;; ++r)
+        {
+            auto visit = [&](long long x, long long y)
+            {
+                if (x >= 0 && x < columns && y >= 0 && y < rows)
+                    scan(static_cast<unsigned>(y * columns + x));
+            };
+            if (r == 0)
+                visit(cx, cy);
+            for (long long x = std::max(cx - r, 0ll); r > 0 && x <= std::min(cx + r, columns - 1); ++x)
+            {
+                visit(x, cy - r);
+                visit(x, cy + r);
+            }
+            for (long long y = std::max(cy - r + 1, 0ll); r > 0 && y <= std::min(cy + r - 1, rows - 1); ++y)
+            {
+                visit(cx - r, y);
+                visit(cx + r, y);
+            }
+            double bound = infinity;
+            if (cx - r > 0)
+                bound = std::min(bound, std::max(0.0, px - (index.min_x + (cx - r) * index.cell_size)));
+            if (cx + r + 1 < columns)
+                bound = std::min(bound, std::max(0.0, index.min_x + (cx + r + 1) * index.cell_size - px));
+            if (cy - r > 0)
+                bound = std::min(bound, std::max(0.0, py - (index.min_y + (cy - r) * index.cell_size)));
+            if (cy + r + 1 < rows)
+                bound = std::min(bound, std::max(0.0, index.min_y + (cy + r + 1) * index.cell_size - py));
+            if (bound >= limit())
+                return;
+        }
+    }
+
+    // Distance from (px, py) to the grid area; nothing indexed is closer.
+    double distance_to_grid(const SpatialIndex &index, double px, double py)
+    {
+        double max_x = index.min_x + index.columns * index.cell_size;
+        double max_y = index.min_y + index.rows * index.cell_size;
+        double dx = std::max({index.min_x - px, 0.0, px - max_x});
+        double dy = std::max({index.min_y - py, 0.0, py - max_y});
+        return std::hypot(dx, dy);
+    }
+}
+
+std::unique_ptr<SpatialIndex> spatial_index_new(rust::Slice<const float> latitude,
+                                                rust::Slice<const float> longitude,
+                                                rust::Slice<const uint32_t> tail,
+                                                rust::Slice<const uint32_t> head)
+{
+    std::unique_ptr<SpatialIndex> index(new SpatialIndex);
+    const unsigned n = latitude.size();
+    index->tail.assign(tail.begin(), tail.end());
+    index->head.assign(head.begin(), head.end());
+    if (n == 0)
+        return index;
+
+    double mean_latitude = 0;
+    for (float lat : latitude)
+        mean_latitude += lat;
+    mean_latitude /= n;
+    index->meters_per_degree_lat = meters_per_degree;
+    index->meters_per_degree_lon = meters_per_degree * std::cos(mean_latitude * 3.14159265358979323846 / 180.0);
+    index->x.resize(n);
+    index->y.resize(n);
+    double max_x = -infinity, max_y = -infinity;
+    index->min_x = infinity;
+    index->min_y = infinity;
+    for (unsigned v = 0; v < n; ++v)
+    {
+        index->x[v] = longitude[v] * index->meters_per_degree_lon;
+        index->y[v] = latitude[v] * index->meters_per_degree_lat;
+        index->min_x = std::min(index->min_x, index->x[v]);
+        index->min_y = std::min(index->min_y, index->y[v]);
+        max_x = std::max(max_x, index->x[v]);
+        max_y = std::max(max_y, index->y[v]);
+    }
+
+    // About two nodes per cell; the second term keeps thin (line-like) extents bounded.
+    const double width = max_x - index->min_x, height = max_y - index->min_y;
+    const double target_cells = std::max(1.0, n / 2.0);
+    index->cell_size = std::max({std::sqrt(width * height / target_cells), std::max(width, height) / target_cells, 1.0});
+    index->columns = static_cast<unsigned>(width / index->cell_size) + 1;
+    index->rows = static_cast<unsigned>(height / index->cell_size) + 1;
+    const unsigned cell_count = index->columns * index->rows;
+
+    std::vector<std::pair<unsigned, unsigned>> cell_item(n);
+    for (unsigned v = 0; v < n; ++v)
+    {
+        unsigned cx = clamp_cell(index->x[v], index->min_x, index->cell_size, index->columns);
+        unsigned cy = clamp_cell(index->y[v], index->min_y, index->cell_size, index->rows);
+        cell_item[v] = {cy * index->columns + cx, v};
+    }
+    group_by_cell(cell_count, cell_item, index->node_cell_first, index->node_cell_items);
+
+    // A cell may touch a segment if the segment passes within half a diagonal of its center.
+    cell_item.clear();
+    const double reach = index->cell_size * 0.7072;
+    for (unsigned a = 0; a < index->tail.size(); ++a)
+    {
+        double ax = index->x[tail[a]], ay = index->y[tail[a]], bx = index->x[head[a]], by = index->y[head[a]];
+        unsigned x0 = clamp_cell(std::min(ax, bx), index->min_x, index->cell_size, index->columns);
+        unsigned x1 = clamp_cell(std::max(ax, bx), index->min_x, index->cell_size, index->columns);
+        unsigned y0 = clamp_cell(std::min(ay, by), index->min_y, index->cell_size, index->rows);
+        unsigned y1 = clamp_cell(std::max(ay, by), index->min_y, index->cell_size, index->rows);
+        for (unsigned cy = y0; cy <= y1; ++cy)
+            for (unsigned cx = x0; cx <= x1; ++cx)
+            {
+                double t;
+                double center_x = index->min_x + (cx + 0.5) * index->cell_size;
+                double center_y = index->min_y + (cy + 0.5) * index->cell_size;
+                if (segment_distance(ax, ay, bx, by, center_x, center_y, t) <= reach)
+                    cell_item.push_back({cy * index->columns + cx, a});
+            }
+    }
+    group_by_cell(cell_count, cell_item, index->arc_cell_first, index->arc_cell_items);
+    return index;
+}
+
+void spatial_index_nearest_nodes(const SpatialIndex &index,
+                                 rust::Slice<const float> latitude,
+                                 rust::Slice<const float> longitude,
+                                 uint32_t k,
+                                 float max_distance,
+                                 uint32_t thread_count,
+                                 rust::Slice<uint32_t> nodes,
+                                 rust::Slice<float> distances)
+{
+    std::fill(nodes.begin(), nodes.end(), invalid_id);
+    std::fill(distances.begin(), distances.end(), std::numeric_limits<float>::infinity());
+    if (index.x.empty() || k == 0)
+        return;
+    const long long point_count = latitude.size();
+    OMP_PRAGMA(omp parallel for num_threads(omp_thread_count(thread_count)) schedule(dynamic, 64))
+    for (long long i = 0; i < point_count; ++i)
+    {
+        double px = longitude[i] * index.meters_per_degree_lon, py = latitude[i] * index.meters_per_degree_lat;
+        if (distance_to_grid(index, px, py) > max_distance)
+            continue;
+        std::vector<std::pair<double, unsigned>> best; // (distance, node), sorted, at most k
+        auto limit = [&]
+        { return best.size() < k ? double(max_distance) : std::min(double(max_distance), best.back().first); };
+        ring_search(index, px, py, [&](unsigned cell)
+                    {
+            for (unsigned j = index.node_cell_first[cell]; j < index.node_cell_first[cell + 1]; ++j)
+            {
+                unsigned v = index.node_cell_items[j];
+                std::pair<double, unsigned> candidate(std::hypot(index.x[v] - px, index.y[v] - py), v);
+                if (candidate.first > max_distance || (best.size() == k && !(candidate < best.back())))
+                    continue;
+                if (best.size() == k)
+                    best.pop_back();
+                best.insert(std::upper_bound(best.begin(), best.end(), candidate), candidate);
+            } }, limit);
+        for (size_t j = 0; j < best.size(); ++j)
+        {
+            nodes[i * k + j] = best[j].second;
+            distances[i * k + j] = best[j].first;
+        }
+    }
+}
+
+void spatial_index_nearest_arcs(const SpatialIndex &index,
+                                rust::Slice<const float> latitude,
+                                rust::Slice<const float> longitude,
+                                uint32_t k,
+                                float max_distance,
+                                uint32_t thread_count,
+                                rust::Slice<uint32_t> arcs,
+                                rust::Slice<float> fractions,
+                                rust::Slice<float> distances)
+{
+    std::fill(arcs.begin(), arcs.end(), invalid_id);
+    std::fill(fractions.begin(), fractions.end(), 0.0f);
+    std::fill(distances.begin(), distances.end(), std::numeric_limits<float>::infinity());
+    if (index.x.empty() || k == 0)
+        return;
+    const long long point_count = latitude.size();
+    OMP_PRAGMA(omp parallel for num_threads(omp_thread_count(thread_count)) schedule(dynamic, 64))
+    for (long long i = 0; i < point_count; ++i)
+    {
+        double px = longitude[i] * index.meters_per_degree_lon, py = latitude[i] * index.meters_per_degree_lat;
+        if (distance_to_grid(index, px, py) > max_distance)
+            continue;
+        // (distance, arc, fraction), sorted, at most k. An arc lies in several cells, so it is
+        // found repeatedly with the same distance and kept once.
+        std::vector<std::tuple<double, unsigned, double>> best;
+        auto limit = [&]
+        { return best.size() < k ? double(max_distance) : std::min(double(max_distance), std::get<0>(best.back())); };
+        ring_search(index, px, py, [&](unsigned cell)
+                    {
+            for (unsigned j = index.arc_cell_first[cell]; j < index.arc_cell_first[cell + 1]; ++j)
+            {
+                unsigned a = index.arc_cell_items[j];
+                double t;
+                double d = segment_distance(index.x[index.tail[a]], index.y[index.tail[a]],
+                                            index.x[index.head[a]], index.y[index.head[a]], px, py, t);
+                std::tuple<double, unsigned, double> candidate(d, a, t);
+                if (d > max_distance || (best.size() == k && !(candidate < best.back())))
+                    continue;
+                auto pos = std::lower_bound(best.begin(), best.end(), candidate);
+                if (pos != best.end() && std::get<1>(*pos) == a)
+                    continue;
+                if (best.size() == k)
+                    best.pop_back();
+                best.insert(std::upper_bound(best.begin(), best.end(), candidate), candidate);
+            } }, limit);
+        for (size_t j = 0; j < best.size(); ++j)
+        {
+            arcs[i * k + j] = std::get<1>(best[j]);
+            fractions[i * k + j] = std::get<2>(best[j]);
+            distances[i * k + j] = std::get<0>(best[j]);
+        }
+    }
+}
+
+uint32_t spatial_index_arc_tail(const SpatialIndex &index, uint32_t arc)
+{
+    return index.tail[arc];
+}
+
+uint32_t spatial_index_arc_head(const SpatialIndex &index, uint32_t arc)
+{
+    return index.head[arc];
+}
@@ -7,10 +7,16 @@ use rand::seq::SliceRandom;
 use rand::{Rng, SeedableRng, rngs::StdRng};
 use rayon::prelude::*;
 use routingkit_cch::{
-    CCH, CCHMetric, CCHMetricPartialUpdater, CCHQuery, compute_order_degree, compute_order_inertial,
+    AllocationOptions, AlternativeRouteConfig, CCH, CCHMapMatcher, CCHMetric,
+    CCHMetricPartialUpdater, CCHMetricReplicas, CCHPOIIndex, CCHQuery, CCHQueryArena,
+    CCHQueryCache, CCHRangeQuery, CH, CHBatchQuery, CHQuery, CompressedCCH, CompressedCCHMetric,
+    CompressedCCHQuery, HubLabels, MapMatchConfig, MappedCH, MappedCHQuery, NodeRenumbering,
+    QuantizedCCHMetric, QuantizedCCHQuery, SnappedArc, SpatialIndex, WeightWidth,
+    compute_order_degree, compute_order_inertial, numa_node_count, pin_current_thread_to_numa_node,
 };
 use std::{
     collections::{BTreeMap, HashMap},
+    ops::RangeInclusive,
     sync::LazyLock,
 };
 
@@ -21,6 +27,68 @@ const STYLE: LazyLock<indicatif::ProgressStyle> = LazyLock::new(|| {
     .unwrap()
 });
 
+/// Random graph shared by the query tests: a spine `i -> i - 1` reaching node 0 from every
+/// node, plus random arcs up to `arc_count` with weights from `weight_range`. `rng` continues
+/// the seeded stream for the samples of the test.
+struct RandomGraph {
+    rng: StdRng,
+    node_count: u32,
+    tail: Vec<u32>,
+    head: Vec<u32>,
+    weights: Vec<u32>,
+    order: Vec<u32>,
+}
+
+fn random_graph(
+    seed: u64,
+    node_count: u32,
+    arc_count: usize,
+    weight_range: RangeInclusive<u32>,
+) -> RandomGraph {
+    let mut rng = StdRng::seed_from_u64(seed);
+    let mut tail: Vec<u32> = (1..node_count).collect();
+    let mut head: Vec<u32> = (0..node_count - 1).collect();
+    while tail.len() < arc_count {
+        tail.push(rng.gen_range(0..node_count));
+        head.push(rng.gen_range(0..node_count));
+    }
+    let weights: Vec<u32> = (0..tail.len())
+        .map(|_| rng.gen_range(weight_range.clone()))
+        .collect();
+    let order = compute_order_degree(node_count, &tail, &head);
+    RandomGraph {
+        rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        order,
+    }
+}
+
+fn adjacency(node_count: u32, tail: &[u32], head: &[u32], weights: &[u32]) -> Vec<Vec<(u32, u32)>> {
+    let mut adj = vec![Vec::new(); node_count as usize];
+    for i in 0..tail.len() {
+        adj[tail[i] as usize].push((head[i], weights[i]));
+    }
+    adj
+}
+
+/// Reference distance from `s` to `t`, `None` if unreachable.
+#[cfg(feature = "openmp")]
+fn dijkstra_distance(adj: &[Vec<(u32, u32)>], s: u32, t: u32) -> Option<u32> {
+    dijkstra(&s, |&u| adj[u as usize].iter().copied(), |&u| u == t).map(|(_, d)| d)
+}
+
+/// Reference distances from `s` to every reachable node, `s` included.
+fn dijkstra_distances(adj: &[Vec<(u32, u32)>], s: u32) -> HashMap<u32, u32> {
+    pathfinding::prelude::dijkstra_all(&s, |&u| adj[u as usize].clone())
+        .into_iter()
+        .map(|(v, (_, d))| (v, d))
+        .chain([(s, 0)])
+        .collect()
+}
+
 #[test]
 fn compare_with_pathfinding() {
     for city in ["beijing", "chengdu", "cityindia", "harbin", "porto"] {
@@ -344,6 +412,1272 @@ fn partial_update_with_reusable_updater() {
     assert_eq!(metric.weights(), vec![6, 10, 20]);
 }
 
+#[test]
+fn alternatives_on_parallel_chains() {
+    // Two disjoint chains 0 -> 1: 0-2-3-4-5-6-1 (length 6) and 0-7-8-9-10-11-1 (length 7).
+    // Their midpoints 4 and 9 are contracted last, so both are via-node candidates. The loop at
+    // 4 has no CCH arc.
+    let tail = vec![0, 2, 3, 4, 5, 6, 0, 7, 8, 9, 10, 11, 4];
+    let head = vec![2, 3, 4, 5, 6, 1, 7, 8, 9, 10, 11, 1, 4];
+    let weights = vec![1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1];
+    let order = vec![0, 1, 2, 3, 5, 6, 7, 8, 10, 11, 4, 9];
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let metric = CCHMetric::new(&cch, weights.clone());
+    let mut query = CCHQuery::new(&metric);
+    let topology_bytes = cch.memory_bytes();
+
+    let routes = query.run_alternatives(0, 1, 3);
+    // Unpacking the routes built the CCH arc -> input arc index.
+    assert!(cch.memory_bytes() > topology_bytes);
+    assert_eq!(routes.len(), 2);
+    assert_eq!(routes[0].distance, 6);
+    assert_eq!(routes[0].node_path, vec![0, 2, 3, 4, 5, 6, 1]);
+    assert_eq!(routes[1].distance, 7);
+    assert_eq!(routes[1].node_path, vec![0, 7, 8, 9, 10, 11, 1]);
+    for route in &routes {
+        let sum = route
+            .arc_path
+            .iter()
+            .map(|&a| weights[a as usize])
+            .sum::<u32>();
+        assert_eq!(sum, route.distance);
+    }
+
+    // A tighter stretch bound leaves only the shortest path.
+    let config = AlternativeRouteConfig {
+        max_stretch: 0.1,
+        ..Default::default()
+    };
+    assert_eq!(
+        query.run_alternatives_with_config(0, 1, 3, &config).len(),
+        1
+    );
+}
+
+#[test]
+fn range_query_matches_dijkstra() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        order,
+        ..
+    } = random_graph(7, 1_000, 5_000, 1..=100);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let metric = CCHMetric::new(&cch, weights.clone());
+    let adj = adjacency(node_count, &tail, &head, &weights);
+
+    let sources: Vec<u32> = (0..20).map(|_| rng.gen_range(0..node_count)).collect();
+    let limits: Vec<u32> = (0..20).map(|_| rng.gen_range(0..300)).collect();
+    let results = CCHRangeQuery::new(&metric).run_batch(&sources, &limits, true);
+    for ((&s, &limit), res) in sources.iter().zip(&limits).zip(&results) {
+        let mut expected: Vec<(u32, u32)> = dijkstra_distances(&adj, s)
+            .into_iter()
+            .filter(|&(_, d)| d <= limit)
+            .collect();
+        expected.sort();
+        let mut got: Vec<(u32, u32)> = res
+            .nodes
+            .iter()
+            .copied()
+            .zip(res.distances.iter().copied())
+            .collect();
+        got.sort();
+        assert_eq!(got, expected, "range query mismatch s={s} limit={limit}");
+        for (&a, &offset) in res.boundary_arcs.iter().zip(&res.boundary_offsets) {
+            let d = limit - offset;
+            assert!(d + weights[a as usize] > limit);
+            assert!(got.contains(&(tail[a as usize], d)));
+        }
+    }
+    assert_eq!(
+        metric.range_query(sources[0], limits[0]).nodes.len(),
+        results[0].nodes.len()
+    );
+}
+
+#[test]
+fn many_to_one_without_pinned_sources_is_empty() {
+    let (tail, head) = (vec![0, 1], vec![1, 2]);
+    let order = compute_order_degree(3, &tail, &head);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let metric = CCHMetric::new(&cch, vec![1, 1]);
+    let mut query = CCHQuery::new(&metric);
+    assert!(query.many_to_one(2).is_empty());
+    query.many_to_one_no_alloc(2, &mut []);
+    query.pin_many_to_one_sources(&[]);
+    assert!(query.many_to_one(2).is_empty());
+    query.pin_many_to_one_sources(&[0]);
+    assert_eq!(query.many_to_one(2), vec![2]);
+}
+
+#[test]
+fn many_to_one_matches_dijkstra() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        order,
+        ..
+    } = random_graph(9, 1_000, 5_000, 1..=100);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let metric = CCHMetric::new(&cch, weights.clone());
+    let adj = adjacency(node_count, &tail, &head, &weights);
+
+    let sources: Vec<u32> = (0..30).map(|_| rng.gen_range(0..node_count)).collect();
+    let reference: Vec<HashMap<u32, u32>> = sources
+        .iter()
+        .map(|&s| dijkstra_distances(&adj, s))
+        .collect();
+
+    let mut query = CCHQuery::new(&metric);
+    query.pin_many_to_one_sources(&sources);
+    let mut dists = vec![0; sources.len()];
+    for _ in 0..20 {
+        let t = rng.gen_range(0..node_count);
+        query.many_to_one_no_alloc(t, &mut dists);
+        for (i, &d) in dists.iter().enumerate() {
+            let expected = reference[i].get(&t).copied().unwrap_or(i32::MAX as u32);
+            assert_eq!(d, expected, "many-to-one mismatch s={} t={t}", sources[i]);
+        }
+        assert_eq!(query.many_to_one(t), dists);
+    }
+}
+
+#[test]
+fn pinned_target_updates_match_full_pin() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        order,
+        ..
+    } = random_graph(10, 1_000, 5_000, 1..=100);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let metric = CCHMetric::new(&cch, weights);
+
+    // Vehicles move between queries: one query edits slots, the other re-pins everything.
+    let mut fleet: Vec<u32> = (0..50).map(|_| rng.gen_range(0..node_count)).collect();
+    let mut incremental = CCHQuery::new(&metric);
+    let mut full = CCHQuery::new(&metric);
+    incremental.pin_one_to_many_targets(&fleet);
+    incremental.pin_many_to_one_sources(&fleet);
+    for _ in 0..20 {
+        for _ in 0..5 {
+            let vehicle = rng.gen_range(0..fleet.len());
+            fleet[vehicle] = rng.gen_range(0..node_count);
+            assert!(incremental.remove_pinned_target(vehicle as u32));
+            assert!(incremental.remove_pinned_source(vehicle as u32));
+            assert!(!incremental.remove_pinned_target(vehicle as u32));
+            assert_eq!(
+                incremental.add_pinned_target(fleet[vehicle]),
+                vehicle as u32
+            );
+            assert_eq!(
+                incremental.add_pinned_source(fleet[vehicle]),
+                vehicle as u32
+            );
+        }
+        full.pin_one_to_many_targets(&fleet);
+        full.pin_many_to_one_sources(&fleet);
+        let node = rng.gen_range(0..node_count);
+        assert_eq!(incremental.one_to_many(node), full.one_to_many(node));
+        assert_eq!(incremental.many_to_one(node), full.many_to_one(node));
+    }
+}
+
+#[test]
+fn renumbered_cch_matches_original() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        order,
+        ..
+    } = random_graph(12, 1_000, 5_000, 1..=100);
+    let lat: Vec<f32> = (0..node_count).map(|_| rng.gen_range(30.0..31.0)).collect();
+    let lon: Vec<f32> = (0..node_count)
+        .map(|_| rng.gen_range(120.0..121.0))
+        .collect();
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let metric = CCHMetric::new(&cch, weights.clone());
+    let mut query = CCHQuery::new(&metric);
+
+    for renumbering in [
+        NodeRenumbering::Rank,
+        NodeRenumbering::Hilbert {
+            latitude: &lat,
+            longitude: &lon,
+        },
+    ] {
+        let (renumbered, new_id) =
+            CCH::new_renumbered(&order, &tail, &head, |_| {}, false, renumbering);
+        let mut seen = vec![false; node_count as usize];
+        new_id.iter().for_each(|&v| seen[v as usize] = true);
+        assert!(seen.into_iter().all(|x| x), "mapping is not a permutation");
+        if let NodeRenumbering::Rank = renumbering {
+            for (rank, &node) in order.iter().enumerate() {
+                assert_eq!(new_id[node as usize], rank as u32);
+            }
+        }
+
+        let renumbered_metric = CCHMetric::new(&renumbered, weights.clone());
+        let mut renumbered_query = CCHQuery::new(&renumbered_metric);
+        for _ in 0..100 {
+            let s = rng.gen_range(0..node_count);
+            let t = rng.gen_range(0..node_count);
+            query.add_source(s, 0);
+            query.add_target(t, 0);
+            let (distance, arcs) = {
+                let res = query.run();
+                (res.distance(), res.arc_path())
+            };
+            renumbered_query.add_source(new_id[s as usize], 0);
+            renumbered_query.add_target(new_id[t as usize], 0);
+            let res = renumbered_query.run();
+            assert_eq!(res.distance(), distance);
+            let renumbered_arcs = res.arc_path();
+            let length = |arcs: &[u32]| arcs.iter().map(|&a| weights[a as usize]).sum::<u32>();
+            assert_eq!(length(&renumbered_arcs), length(&arcs));
+        }
+    }
+}
+
+#[test]
+fn compressed_cch_matches_full() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        order,
+        ..
+    } = random_graph(13, 1_000, 3_000, 1..=100);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let metric = CCHMetric::new(&cch, weights);
+    let compressed = CompressedCCH::new(&cch);
+    assert!(compressed.memory_bytes() < cch.memory_bytes());
+    let compressed_metric = CompressedCCHMetric::new(&compressed, &metric);
+
+    let mut query = CCHQuery::new(&metric);
+    let mut compressed_query = CompressedCCHQuery::new(&compressed_metric);
+    for _ in 0..500 {
+        let s = rng.gen_range(0..node_count);
+        let t = rng.gen_range(0..node_count);
+        query.add_source(s, 0);
+        query.add_target(t, 0);
+        let expected = query.run().distance();
+        assert_eq!(compressed_query.distance(s, t), expected, "s={s} t={t}");
+    }
+}
+
+#[test]
+#[should_panic(expected = "metric does not belong to the compressed CCH")]
+fn compressed_cch_rejects_metric_of_other_cch() {
+    // Same node count, different arcs: only the owning index may be snapshotted.
+    let a = random_graph(13, 200, 600, 1..=100);
+    let b = random_graph(15, 200, 900, 1..=100);
+    let cch_a = CCH::new(&a.order, &a.tail, &a.head, |_| {}, false);
+    let cch_b = CCH::new(&b.order, &b.tail, &b.head, |_| {}, false);
+    let metric_b = CCHMetric::new(&cch_b, b.weights);
+    let compressed = CompressedCCH::new(&cch_a);
+    CompressedCCHMetric::new(&compressed, &metric_b);
+}
+
+#[test]
+fn quantized_metric_matches_full() {
+    // Long paths overflow 16 bits, so shortcut weights also exercise the overflow tier; so does
+    // one input arc.
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        mut weights,
+        order,
+        ..
+    } = random_graph(14, 1_000, 3_000, 1..=5_000);
+    weights[7] = 100_000; // does not fit inline in 16-bit mode
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let metric = CCHMetric::new(&cch, weights.clone());
+
+    for width in [WeightWidth::Bits16, WeightWidth::Bits24] {
+        let quantized = QuantizedCCHMetric::new(&cch, &weights, width);
+        if width == WeightWidth::Bits24 {
+            assert!(quantized.memory_bytes() < metric.memory_bytes());
+        }
+
+        let mut query = CCHQuery::new(&metric);
+        let mut quantized_query = QuantizedCCHQuery::new(&quantized);
+        for i in 0..300 {
+            let (s, t) = if i == 0 {
+                (tail[7], head[7])
+            } else {
+                (rng.gen_range(0..node_count), rng.gen_range(0..node_count))
+            };
+            query.add_source(s, 0);
+            query.add_target(t, 0);
+            let expected = query.run().distance();
+            assert_eq!(quantized_query.distance(s, t), expected, "s={s} t={t}");
+        }
+    }
+}
+
+#[test]
+fn numa_replicas_match_original() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        order,
+        ..
+    } = random_graph(15, 1_000, 3_000, 1..=100);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let metric = CCHMetric::new(&cch, weights);
+    let replicas = CCHMetricReplicas::new(
+        &metric,
+        AllocationOptions {
+            transparent_huge_pages: true,
+            numa_replicas: true,
+        },
+    );
+    // Replicas are made on single-node machines too, so node 0 always has its own copy.
+    let numa_nodes = numa_node_count();
+    assert_eq!(replicas.replica_count(), numa_nodes as usize);
+    let replica = replicas.for_node(0);
+    assert!(!std::ptr::eq(replica, &metric));
+    assert_eq!(replica.weights(), metric.weights());
+    assert_ne!(replica.weights().as_ptr(), metric.weights().as_ptr());
+
+    let pairs: Vec<(u32, u32)> = (0..200)
+        .map(|_| (rng.gen_range(0..node_count), rng.gen_range(0..node_count)))
+        .collect();
+    let mut query = CCHQuery::new(&metric);
+    let expected: Vec<Option<u32>> = pairs
+        .iter()
+        .map(|&(s, t)| {
+            query.add_source(s, 0);
+            query.add_target(t, 0);
+            query.run().distance()
+        })
+        .collect();
+
+    std::thread::scope(|scope| {
+        for node in 0..numa_nodes {
+            let (replicas, pairs, expected) = (&replicas, &pairs, &expected);
+            scope.spawn(move || {
+                pin_current_thread_to_numa_node(node);
+                let mut query = CCHQuery::new(replicas.for_node(node));
+                let mut local_query = replicas.query();
+                for (&(s, t), &d) in pairs.iter().zip(expected) {
+                    query.add_source(s, 0);
+                    query.add_target(t, 0);
+                    assert_eq!(query.run().distance(), d, "node={node} s={s} t={t}");
+                    local_query.add_source(s, 0);
+                    local_query.add_target(t, 0);
+                    assert_eq!(local_query.run().distance(), d, "s={s} t={t}");
+                }
+            });
+        }
+    });
+}
+
+#[test]
+fn arena_queries_match_cch_query() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        order,
+        ..
+    } = random_graph(16, 1_000, 3_000, 1..=100);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let metric = CCHMetric::new(&cch, weights.clone());
+    let arena = CCHQueryArena::new(&metric, 2);
+
+    {
+        let _first = arena.query().unwrap();
+        let _second = arena.query().unwrap();
+        assert!(arena.query().is_none());
+        assert_eq!(arena.available(), 0);
+    }
+    assert_eq!(arena.available(), 2);
+
+    let mut query = CCHQuery::new(&metric);
+    for _ in 0..300 {
+        let s = rng.gen_range(0..node_count);
+        let t = rng.gen_range(0..node_count);
+        query.add_source(s, 0);
+        query.add_target(t, 0);
+        let expected = query.run().distance();
+
+        // A fresh claim per query, as a request handler would do.
+        let mut arena_query = arena.query().unwrap();
+        assert_eq!(arena_query.run(s, t), expected, "s={s} t={t}");
+        let nodes = arena_query.node_path();
+        let arcs = arena_query.arc_path();
+        if let Some(d) = expected {
+            assert_eq!(nodes.first(), Some(&s));
+            assert_eq!(nodes.last(), Some(&t));
+            assert_eq!(nodes.len(), arcs.len() + 1);
+            assert_eq!(arcs.iter().map(|&a| weights[a as usize]).sum::<u32>(), d);
+        } else {
+            assert!(nodes.is_empty());
+        }
+    }
+}
+
+#[test]
+fn batch_queries_match_cch_query() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        order,
+        ..
+    } = random_graph(17, 1_000, 3_000, 1..=100);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let metric = CCHMetric::new(&cch, weights.clone());
+
+    let sources: Vec<u32> = (0..500).map(|_| rng.gen_range(0..node_count)).collect();
+    let targets: Vec<u32> = (0..500).map(|_| rng.gen_range(0..node_count)).collect();
+    let mut query = CCHQuery::new(&metric);
+    let expected: Vec<u32> = sources
+        .iter()
+        .zip(&targets)
+        .map(|(&s, &t)| {
+            query.add_source(s, 0);
+            query.add_target(t, 0);
+            query.run().distance().unwrap_or(i32::MAX as u32)
+        })
+        .collect();
+
+    for threads in [0, 1, 3] {
+        assert_eq!(
+            metric.batch_distances(&sources, &targets, threads),
+            expected
+        );
+        let nodes = metric.batch_paths(&sources, &targets, threads, false);
+        let arcs = metric.batch_paths(&sources, &targets, threads, true);
+        assert_eq!(nodes.distances, expected);
+        assert_eq!(nodes.offsets.len(), sources.len() + 1);
+        for i in 0..sources.len() {
+            let path = &nodes.paths[nodes.offsets[i] as usize..nodes.offsets[i + 1] as usize];
+            let arc_path = &arcs.paths[arcs.offsets[i] as usize..arcs.offsets[i + 1] as usize];
+            if expected[i] == i32::MAX as u32 {
+                assert!(path.is_empty() && arc_path.is_empty());
+                continue;
+            }
+            assert_eq!(path.first(), Some(&sources[i]));
+            assert_eq!(path.last(), Some(&targets[i]));
+            assert_eq!(
+                arc_path.iter().map(|&a| weights[a as usize]).sum::<u32>(),
+                expected[i]
+            );
+        }
+    }
+}
+
+#[test]
+fn partial_update_arrays_match_full_customization() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        mut weights,
+        order,
+        ..
+    } = random_graph(18, 1_000, 3_000, 1..=100);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let mut metric = CCHMetric::new(&cch, weights.clone());
+    let mut updater = CCHMetricPartialUpdater::new(&cch);
+
+    for _ in 0..5 {
+        // Repeated arcs included: the later entry wins.
+        let arc_ids: Vec<u32> = (0..200)
+            .map(|_| rng.gen_range(0..tail.len() as u32))
+            .collect();
+        let new_weights: Vec<u32> = (0..200).map(|_| rng.gen_range(1..=300)).collect();
+        for (&a, &w) in arc_ids.iter().zip(&new_weights) {
+            weights[a as usize] = w;
+        }
+        updater.apply_arrays(&mut metric, &arc_ids, &new_weights);
+        assert_eq!(metric.weights(), weights);
+
+        let reference = CCHMetric::new(&cch, weights.clone());
+        let mut query = CCHQuery::new(&metric);
+        let mut reference_query = CCHQuery::new(&reference);
+        for _ in 0..100 {
+            let s = rng.gen_range(0..node_count);
+            let t = rng.gen_range(0..node_count);
+            query.add_source(s, 0);
+            query.add_target(t, 0);
+            reference_query.add_source(s, 0);
+            reference_query.add_target(t, 0);
+            assert_eq!(
+                query.run().distance(),
+                reference_query.run().distance(),
+                "s={s} t={t}"
+            );
+        }
+    }
+}
+
+#[test]
+fn partial_update_arrays_reject_bad_ids_before_writing() {
+    let RandomGraph {
+        tail,
+        head,
+        weights,
+        order,
+        ..
+    } = random_graph(19, 100, 300, 1..=100);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let mut metric = CCHMetric::new(&cch, weights.clone());
+    let mut updater = CCHMetricPartialUpdater::new(&cch);
+    let result = std::panic::catch_unwind(std::panic::AssertUnwindSafe(|| {
+        updater.apply_arrays(&mut metric, &[0, tail.len() as u32], &[weights[0] + 1, 1]);
+    }));
+    assert!(result.is_err());
+    assert_eq!(metric.weights(), weights);
+}
+
+#[cfg(feature = "openmp")]
+#[test]
+fn parallel_ch_build_matches_dijkstra() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        ..
+    } = random_graph(41, 2_000, 6_000, 0..=100);
+    let adj = adjacency(node_count, &tail, &head, &weights);
+
+    for threads in [1, 4] {
+        let ch = CH::build_parallel(node_count, &tail, &head, &weights, |_| {}, 500, threads);
+        let mut query = CHQuery::new(&ch);
+        for _ in 0..200 {
+            let s = rng.gen_range(0..node_count);
+            let t = rng.gen_range(0..node_count);
+            let expected = dijkstra_distance(&adj, s, t);
+            query.reset();
+            query.add_source(s, 0);
+            query.add_target(t, 0);
+            let res = query.run();
+            assert_eq!(res.distance(), expected, "s={s} t={t}");
+            if expected.is_some() {
+                let arcs = res.arc_path();
+                assert_eq!(res.node_path().first(), Some(&s));
+                assert_eq!(
+                    arcs.iter().map(|&a| weights[a as usize]).sum::<u32>(),
+                    res.distance().unwrap()
+                );
+            }
+        }
+    }
+}
+
+#[cfg(feature = "openmp")]
+#[test]
+fn parallel_perfect_ch_matches_cch_query() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        order,
+        ..
+    } = random_graph(42, 2_000, 6_000, 1..=100);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let metric = CCHMetric::new(&cch, weights.clone());
+    let mut cch_query = CCHQuery::new(&metric);
+
+    for threads in [1, 4] {
+        let ch = metric.build_contraction_hierarchy_using_perfect_witness_search_parallel(threads);
+        let mut query = CHQuery::new(&ch);
+        for _ in 0..200 {
+            let s = rng.gen_range(0..node_count);
+            let t = rng.gen_range(0..node_count);
+            cch_query.add_source(s, 0);
+            cch_query.add_target(t, 0);
+            let expected = cch_query.run().distance();
+            query.reset();
+            query.add_source(s, 0);
+            query.add_target(t, 0);
+            let res = query.run();
+            assert_eq!(res.distance(), expected, "s={s} t={t}");
+            if let Some(d) = expected {
+                let arcs = res.arc_path();
+                assert_eq!(arcs.iter().map(|&a| weights[a as usize]).sum::<u32>(), d);
+            }
+        }
+    }
+}
+
+#[test]
+fn mapped_ch_matches_ch_query() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        ..
+    } = random_graph(43, 2_000, 6_000, 1..=100);
+    let ch = CH::build(node_count, &tail, &head, &weights, |_| {}, 500);
+    let path =
+        std::env::temp_dir().join(format!("routingkit_cch_mapped_{}.rkch", std::process::id()));
+    let path = path.to_str().unwrap();
+    ch.save_mapped_file(path).unwrap();
+
+    let mapped = MappedCH::open(path).unwrap();
+    assert_eq!(mapped.node_count(), node_count);
+    assert!(mapped.validate());
+    let mut mapped_query = MappedCHQuery::new(&mapped);
+    let mut query = CHQuery::new(&ch);
+    for _ in 0..200 {
+        let s = rng.gen_range(0..node_count);
+        let t = rng.gen_range(0..node_count);
+        query.reset();
+        query.add_source(s, 0);
+        query.add_target(t, 0);
+        let res = query.run();
+        assert_eq!(mapped_query.run(s, t), res.distance(), "s={s} t={t}");
+        if let Some(d) = res.distance() {
+            let arcs = mapped_query.arc_path();
+            assert_eq!(arcs.iter().map(|&a| weights[a as usize]).sum::<u32>(), d);
+            let nodes = mapped_query.node_path();
+            assert_eq!((nodes[0], *nodes.last().unwrap()), (s, t));
+        }
+    }
+    drop(mapped_query);
+    drop(mapped);
+
+    // A flipped payload byte fails to open, unless unchecked; validate() still catches it.
+    let mut bytes = std::fs::read(path).unwrap();
+    bytes[3 * 4096 + 5] ^= 0x55;
+    std::fs::write(path, &bytes).unwrap();
+    assert!(MappedCH::open(path).is_err());
+    assert!(
+        !unsafe { MappedCH::open_unchecked(path) }
+            .unwrap()
+            .validate()
+    );
+    // A truncated file fails either way.
+    std::fs::write(path, &bytes[..5000]).unwrap();
+    assert!(MappedCH::open(path).is_err());
+    assert!(unsafe { MappedCH::open_unchecked(path) }.is_err());
+    std::fs::remove_file(path).unwrap();
+}
+
+#[test]
+fn ch_batch_queries_match_cch_query() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        order,
+        ..
+    } = random_graph(44, 2_000, 6_000, 1..=100);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let mut metric = CCHMetric::new(&cch, weights.clone());
+    let ch = metric.build_contraction_hierarchy_using_perfect_witness_search();
+    let mut cch_query = CCHQuery::new(&metric);
+    let mut distance = |s: u32, t: u32| {
+        cch_query.add_source(s, 0);
+        cch_query.add_target(t, 0);
+        cch_query.run().distance().unwrap_or(i32::MAX as u32)
+    };
+
+    let mut batch = CHBatchQuery::new(&ch);
+    for _ in 0..3 {
+        let sources: Vec<u32> = (0..20).map(|_| rng.gen_range(0..node_count)).collect();
+        let targets: Vec<u32> = (0..30).map(|_| rng.gen_range(0..node_count)).collect();
+        let matrix = batch.matrix(&sources, &targets);
+        for (i, &s) in sources.iter().enumerate() {
+            for (j, &t) in targets.iter().enumerate() {
+                assert_eq!(matrix[i * targets.len() + j], distance(s, t), "s={s} t={t}");
+            }
+        }
+    }
+
+    let mut dists = vec![0; node_count as usize];
+    for _ in 0..5 {
+        let s = rng.gen_range(0..node_count);
+        batch.one_to_all_no_alloc(s, &mut dists);
+        for t in 0..node_count {
+            assert_eq!(dists[t as usize], distance(s, t), "s={s} t={t}");
+        }
+    }
+}
+
+#[test]
+fn hub_labels_match_ch_query() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        order,
+        ..
+    } = random_graph(45, 2_000, 6_000, 1..=100);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let mut metric = CCHMetric::new(&cch, weights);
+    let ch = metric.build_contraction_hierarchy_using_perfect_witness_search();
+    let labels = HubLabels::build(&ch, 0);
+    assert_eq!(labels.node_count(), node_count);
+    assert!(labels.validate());
+
+    let path =
+        std::env::temp_dir().join(format!("routingkit_hub_labels_{}.rkhl", std::process::id()));
+    let path = path.to_str().unwrap();
+    labels.save_mapped_file(path).unwrap();
+    let mapped = HubLabels::open(path).unwrap();
+    assert!(mapped.validate());
+    assert_eq!(mapped.entry_count(), labels.entry_count());
+
+    let mut query = CHQuery::new(&ch);
+    for _ in 0..500 {
+        let s = rng.gen_range(0..node_count);
+        let t = rng.gen_range(0..node_count);
+        query.reset();
+        query.add_source(s, 0);
+        query.add_target(t, 0);
+        let expected = query.run().distance();
+        assert_eq!(labels.distance(s, t), expected, "s={s} t={t}");
+        assert_eq!(mapped.distance(s, t), expected, "s={s} t={t}");
+    }
+    drop(mapped);
+
+    let mut bytes = std::fs::read(path).unwrap();
+    bytes[2 * 4096 + 5] ^= 0x55;
+    std::fs::write(path, &bytes).unwrap();
+    assert!(HubLabels::open(path).is_err());
+    assert!(
+        !unsafe { HubLabels::open_unchecked(path) }
+            .unwrap()
+            .validate()
+    );
+    std::fs::write(path, &bytes[..5000]).unwrap();
+    assert!(HubLabels::open(path).is_err());
+    assert!(unsafe { HubLabels::open_unchecked(path) }.is_err());
+    std::fs::remove_file(path).unwrap();
+}
+
+#[test]
+fn spatial_index_matches_brute_force() {
+    let mut rng = StdRng::seed_from_u64(46);
+    let node_count = 3_000;
+    let latitude: Vec<f32> = (0..node_count)
+        .map(|_| rng.gen_range(30.60..30.75))
+        .collect();
+    let longitude: Vec<f32> = (0..node_count)
+        .map(|_| rng.gen_range(104.0..104.2))
+        .collect();
+    let (mut tail, mut head) = (vec![], vec![]);
+    while tail.len() < 8_000 {
+        let (a, b) = (rng.gen_range(0..node_count), rng.gen_range(0..node_count));
+        if a != b {
+            tail.push(a as u32);
+            head.push(b as u32);
+        }
+    }
+    let index = SpatialIndex::new(&latitude, &longitude, &tail, &head);
+
+    // Same local projection as the index: equirectangular around the mean latitude.
+    let meters_per_degree = 6_371_000.0 * std::f64::consts::PI / 180.0;
+    let mean_latitude = latitude.iter().map(|&l| l as f64).sum::<f64>() / node_count as f64;
+    let kx = meters_per_degree * mean_latitude.to_radians().cos();
+    let xy = |lat: f32, lon: f32| (lon as f64 * kx, lat as f64 * meters_per_degree);
+
+    let points: Vec<(f32, f32)> = (0..300)
+        .map(|_| (rng.gen_range(30.55..30.80), rng.gen_range(103.95..104.25)))
+        .collect();
+    let (lats, lons): (Vec<f32>, Vec<f32>) = points.iter().copied().unzip();
+    for max_distance in [f32::INFINITY, 300.0] {
+        let nodes = index.nearest_nodes_batch(&lats, &lons, 4, max_distance, 0);
+        let arcs = index.nearest_arcs_batch(&lats, &lons, max_distance, 0);
+        for (i, &(lat, lon)) in points.iter().enumerate() {
+            let (px, py) = xy(lat, lon);
+            let mut expected: Vec<(f64, u32)> = (0..node_count)
+                .map(|v| {
+                    let (x, y) = xy(latitude[v], longitude[v]);
+                    ((x - px).hypot(y - py), v as u32)
+                })
+                .filter(|&(d, _)| d <= max_distance as f64)
+                .collect();
+            expected.sort_by(|a, b| a.partial_cmp(b).unwrap());
+            expected.truncate(4);
+            let got: Vec<u32> = nodes[i].iter().map(|n| n.node).collect();
+            let want: Vec<u32> = expected.iter().map(|&(_, v)| v).collect();
+            assert_eq!(got, want, "point {i}");
+
+            let best_arc = (0..tail.len())
+                .map(|a| {
+                    let (ax, ay) = xy(latitude[tail[a] as usize], longitude[tail[a] as usize]);
+                    let (bx, by) = xy(latitude[head[a] as usize], longitude[head[a] as usize]);
+                    let (dx, dy) = (bx - ax, by - ay);
+                    let t =
+                        (((px - ax) * dx + (py - ay) * dy) / (dx * dx + dy * dy)).clamp(0.0, 1.0);
+                    (ax + t * dx - px).hypot(ay + t * dy - py)
+                })
+                .fold(f64::INFINITY, f64::min);
+            match arcs[i] {
+                Some(a) => assert!((a.distance as f64 - best_arc).abs() < 1e-2, "point {i}"),
+                None => assert!(best_arc > max_distance as f64, "point {i}"),
+            }
+        }
+    }
+
+    // A point in the middle of an arc snaps onto it; the offsets split the weight.
+    let (a, b) = (tail[0] as usize, head[0] as usize);
+    let snapped = index
+        .nearest_arc(
+            0.75 * latitude[a] + 0.25 * latitude[b],
+            0.75 * longitude[a] + 0.25 * longitude[b],
+            f32::INFINITY,
+        )
+        .unwrap();
+    assert!(snapped.distance < 0.5);
+    if snapped.arc == 0 {
+        assert!((snapped.fraction - 0.25).abs() < 1e-3);
+        assert_eq!(snapped.source(1000), (head[0], 750));
+        assert_eq!(snapped.target(1000), (tail[0], 250));
+    }
+    let own = index.nearest_nodes(latitude[a], longitude[a], 1, f32::INFINITY);
+    assert_eq!(own[0].distance, 0.0);
+}
+
+#[test]
+fn on_arc_endpoints_match_split_endpoints() {
+    let RandomGraph {
+        mut rng,
+        tail,
+        head,
+        weights,
+        order,
+        ..
+    } = random_graph(47, 2_000, 6_000, 1..=100);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let mut metric = CCHMetric::new(&cch, weights.clone());
+    let ch = metric
+        .build_contraction_hierarchy_using_perfect_witness_search()
+        .with_input_arcs(&tail, &head, &weights);
+    let offset = |a: u32, f: f32| (f as f64 * weights[a as usize] as f64).round() as u32;
+
+    // Half of the pairs share an arc, in either order along it.
+    let pair_count = 400;
+    let source_arcs: Vec<u32> = (0..pair_count)
+        .map(|_| rng.gen_range(0..tail.len() as u32))
+        .collect();
+    let target_arcs: Vec<u32> = (0..pair_count)
+        .map(|i| {
+            if i % 2 == 0 {
+                source_arcs[i]
+            } else {
+                rng.gen_range(0..tail.len() as u32)
+            }
+        })
+        .collect();
+    let source_fractions: Vec<f32> = (0..pair_count).map(|_| rng.gen_range(0.0..=1.0)).collect();
+    let target_fractions: Vec<f32> = (0..pair_count).map(|_| rng.gen_range(0.0..=1.0)).collect();
+
+    let mut cch_query = CCHQuery::new(&metric);
+    let mut ch_query = CHQuery::new(&ch);
+    let mut expected = vec![];
+    for i in 0..pair_count {
+        let (sa, ta) = (source_arcs[i], target_arcs[i]);
+        let (so, to) = (
+            offset(sa, source_fractions[i]),
+            offset(ta, target_fractions[i]),
+        );
+        cch_query.add_source(head[sa as usize], weights[sa as usize] - so);
+        cch_query.add_target(tail[ta as usize], to);
+        let mut want = cch_query.run().distance().unwrap_or(i32::MAX as u32);
+        let direct = (sa == ta && so <= to).then(|| to - so);
+        if let Some(d) = direct {
+            want = want.min(d);
+        }
+        expected.push(want);
+
+        cch_query.add_source_on_arc(sa, source_fractions[i]);
+        cch_query.add_target_on_arc(ta, target_fractions[i]);
+        let result = cch_query.run();
+        assert_eq!(
+            result.distance().unwrap_or(i32::MAX as u32),
+            want,
+            "pair {i}"
+        );
+        if direct == Some(want) {
+            assert_eq!(result.arc_path(), vec![sa], "pair {i}");
+            assert_eq!(
+                result.node_path(),
+                vec![tail[sa as usize], head[sa as usize]],
+                "pair {i}"
+            );
+        }
+        drop(result);
+        cch_query.reset();
+
+        ch_query.add_source_on_arc(sa, source_fractions[i]);
+        ch_query.add_target_on_arc(ta, target_fractions[i]);
+        let got = ch_query.run().distance().unwrap_or(i32::MAX as u32);
+        assert_eq!(got, want, "pair {i}");
+        ch_query.reset();
+    }
+
+    let batch = metric.batch_distances_on_arcs(
+        &source_arcs,
+        &source_fractions,
+        &target_arcs,
+        &target_fractions,
+        3,
+    );
+    assert_eq!(batch, expected);
+}
+
+#[test]
+#[should_panic(expected = "CH has no input arcs")]
+fn ch_on_arc_endpoints_need_input_arcs() {
+    let g = random_graph(49, 200, 600, 1..=100);
+    let ch = CH::build(200, &g.tail, &g.head, &g.weights, |_| {}, 500);
+    CHQuery::new(&ch).add_source_on_arc(0, 0.5);
+}
+
+#[test]
+fn run_via_matches_leg_queries() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        order,
+        ..
+    } = random_graph(48, 2_000, 6_000, 1..=100);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let metric = CCHMetric::new(&cch, weights.clone());
+    let mut query = CCHQuery::new(&metric);
+    let mut leg_query = CCHQuery::new(&metric);
+
+    for _ in 0..10 {
+        let mut points: Vec<u32> = (0..30).map(|_| rng.gen_range(0..node_count)).collect();
+        points[7] = points[6];
+        let route = query.run_via(&points);
+        assert_eq!(route.leg_distances.len(), points.len() - 1);
+        assert_eq!(route.arc_offsets.len(), points.len());
+        assert_eq!(route.node_offsets.len(), points.len());
+        for (i, leg) in points.windows(2).enumerate() {
+            leg_query.add_source(leg[0], 0);
+            leg_query.add_target(leg[1], 0);
+            let want = leg_query.run().distance().unwrap_or(i32::MAX as u32);
+            assert_eq!(route.leg_distances[i], want, "leg {i}");
+
+            let arcs =
+                &route.arcs[route.arc_offsets[i] as usize..route.arc_offsets[i + 1] as usize];
+            let nodes =
+                &route.nodes[route.node_offsets[i] as usize..=route.node_offsets[i + 1] as usize];
+            assert_eq!(nodes[0], leg[0], "leg {i}");
+            assert_eq!(*nodes.last().unwrap(), leg[1], "leg {i}");
+            if want != i32::MAX as u32 {
+                let length: u32 = arcs.iter().map(|&a| weights[a as usize]).sum();
+                assert_eq!(length, want, "leg {i}");
+                assert_eq!(nodes.len(), arcs.len() + 1, "leg {i}");
+                for (j, &a) in arcs.iter().enumerate() {
+                    assert_eq!(tail[a as usize], nodes[j], "leg {i}");
+                    assert_eq!(head[a as usize], nodes[j + 1], "leg {i}");
+                }
+            }
+        }
+        let total = route
+            .leg_distances
+            .iter()
+            .try_fold(0u32, |sum, &d| (d != i32::MAX as u32).then_some(sum + d));
+        assert_eq!(route.distance(), total);
+    }
+}
+
+#[test]
+fn search_generation_wrap_around_drops_stale_labels() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        order,
+        ..
+    } = random_graph(50, 400, 1_400, 1..=100);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let metric = CCHMetric::new(&cch, weights);
+    let mut query = CCHQuery::new(&metric);
+    let mut reference = CCHQuery::new(&metric);
+
+    for _ in 0..20 {
+        let [u, v, w, x, y] = [(); 5].map(|_| rng.gen_range(0..node_count));
+        // Stamps labels with small generations. From u32::MAX the next reset wraps the counter
+        // around, so the second route counts through the same generations again and would read
+        // stale labels (e.g. of the earlier search from v) as part of its own searches.
+        query.run_via(&[u, v, w]);
+        query.set_search_generation(u32::MAX);
+        let points = [x, y, v, w];
+        let route = query.run_via(&points);
+        for (i, leg) in points.windows(2).enumerate() {
+            reference.add_source(leg[0], 0);
+            reference.add_target(leg[1], 0);
+            let want = reference.run().distance().unwrap_or(i32::MAX as u32);
+            assert_eq!(route.leg_distances[i], want, "leg {i}");
+        }
+    }
+}
+
+#[test]
+fn map_matcher_finds_best_viterbi_path() {
+    let mut rng = StdRng::seed_from_u64(49);
+    let node_count: u32 = 2_000;
+    let latitude: Vec<f32> = (0..node_count)
+        .map(|_| rng.gen_range(30.60..30.70))
+        .collect();
+    let longitude: Vec<f32> = (0..node_count)
+        .map(|_| rng.gen_range(104.0..104.1))
+        .collect();
+    let great_circle = |lat1: f32, lon1: f32, lat2: f32, lon2: f32| {
+        let (lat1, lon1, lat2, lon2) = (lat1 as f64, lon1 as f64, lat2 as f64, lon2 as f64);
+        let (dlat, dlon) = ((lat2 - lat1).to_radians(), (lon2 - lon1).to_radians());
+        let a = (dlat / 2.0).sin().powi(2)
+            + lat1.to_radians().cos() * lat2.to_radians().cos() * (dlon / 2.0).sin().powi(2);
+        2.0 * 6_371_000.0 * a.sqrt().min(1.0).asin()
+    };
+    // A path in both directions keeps the graph strongly connected.
+    let mut tail: Vec<u32> = (1..node_count).chain(0..node_count - 1).collect();
+    let mut head: Vec<u32> = (0..node_count - 1).chain(1..node_count).collect();
+    while tail.len() < 8_000 {
+        let (a, b) = (rng.gen_range(0..node_count), rng.gen_range(0..node_count));
+        if a != b {
+            tail.push(a);
+            head.push(b);
+        }
+    }
+    let weights: Vec<u32> = (0..tail.len())
+        .map(|a| {
+            let (t, h) = (tail[a] as usize, head[a] as usize);
+            (great_circle(latitude[t], longitude[t], latitude[h], longitude[h]).round() as u32)
+                .max(1)
+        })
+        .collect();
+    let order = compute_order_inertial(node_count, &tail, &head, &latitude, &longitude);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let metric = CCHMetric::new(&cch, weights.clone());
+    let index = SpatialIndex::new(&latitude, &longitude, &tail, &head);
+    let config = MapMatchConfig::default();
+    let mut matcher = CCHMapMatcher::new(&metric);
+    let mut query = CCHQuery::new(&metric);
+
+    for _ in 0..5 {
+        // A noisy point in the middle of every third arc of a random route.
+        let stops: Vec<u32> = (0..3).map(|_| rng.gen_range(0..node_count)).collect();
+        let route = query.run_via(&stops);
+        let (mut lat, mut lon) = (vec![], vec![]);
+        for &a in route.arcs.iter().step_by(3) {
+            let (t, h) = (tail[a as usize] as usize, head[a as usize] as usize);
+            lat.push((latitude[t] + latitude[h]) / 2.0 + rng.gen_range(-0.0001..0.0001));
+            lon.push((longitude[t] + longitude[h]) / 2.0 + rng.gen_range(-0.0001..0.0001));
+        }
+        let candidates: Vec<Vec<_>> = lat
+            .iter()
+            .zip(&lon)
+            .map(|(&la, &lo)| index.nearest_arcs(la, lo, 4, f32::INFINITY))
+            .collect();
+        let matched = matcher.match_trace(&lat, &lon, &candidates, &config);
+
+        // Reference Viterbi from single on-arc queries.
+        let emission = |c: &SnappedArc| -0.5 * (c.distance as f64 / config.sigma).powi(2);
+        let mut transition = |t: usize, i: usize, j: usize| {
+            let (a, b) = (&candidates[t - 1][i], &candidates[t][j]);
+            query.add_source_on_arc(a.arc, a.fraction);
+            query.add_target_on_arc(b.arc, b.fraction);
+            let length = query.run().distance()?;
+            let straight = great_circle(lat[t - 1], lon[t - 1], lat[t], lon[t]);
+            Some(-(length as f64 / config.weight_per_meter - straight).abs() / config.beta)
+        };
+        let mut score: Vec<f64> = candidates[0].iter().map(emission).collect();
+        for t in 1..candidates.len() {
+            score = (0..candidates[t].len())
+                .map(|j| {
+                    (0..candidates[t - 1].len())
+                        .filter_map(|i| Some(score[i] + transition(t, i, j)?))
+                        .fold(f64::NEG_INFINITY, f64::max)
+                        + emission(&candidates[t][j])
+                })
+                .collect();
+        }
+        let best = score.iter().copied().fold(f64::NEG_INFINITY, f64::max);
+
+        let position = |t: usize| {
+            let c = matched.arcs[t].expect("every point is matched");
+            candidates[t].iter().position(|x| *x == c).unwrap()
+        };
+        let mut found = emission(&candidates[0][position(0)]);
+        for t in 1..candidates.len() {
+            found += transition(t, position(t - 1), position(t)).unwrap()
+                + emission(&candidates[t][position(t)]);
+        }
+        assert!(
+            (found - best).abs() <= 1e-6 * best.abs().max(1.0),
+            "{found} vs {best}"
+        );
+
+        assert_eq!(matched.route_offsets.len(), lat.len());
+        for t in 0..lat.len() {
+            let offset = matched.route_offsets[t] as usize;
+            assert_eq!(matched.route[offset], matched.arcs[t].unwrap().arc);
+        }
+        for w in matched.route.windows(2) {
+            assert_eq!(head[w[0] as usize], tail[w[1] as usize]);
+        }
+    }
+}
+
+#[test]
+fn query_cache_serves_current_epoch() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        order,
+        ..
+    } = random_graph(50, 1_000, 3_000, 1..=100);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let mut metric = CCHMetric::new(&cch, weights);
+    let mut updater = CCHMetricPartialUpdater::new(&cch);
+    // Room for two rounds of pairs: entries of older epochs are evicted.
+    let cache = CCHQueryCache::new(400, 4);
+    let pairs: Vec<(u32, u32)> = (0..200)
+        .map(|_| (rng.gen_range(0..node_count), rng.gen_range(0..node_count)))
+        .collect();
+
+    for round in 0..3 {
+        let epoch = metric.epoch();
+        let expected: Vec<Option<u32>> = {
+            let mut query = CCHQuery::new(&metric);
+            pairs
+                .iter()
+                .map(|&(s, t)| {
+                    query.add_source(s, 0);
+                    query.add_target(t, 0);
+                    query.run().distance()
+                })
+                .collect()
+        };
+        cache.reset_stats();
+        (0..4).into_par_iter().for_each(|thread| {
+            let mut query = CCHQuery::new(&metric);
+            for i in 0..2_000 {
+                let j = (i * 7 + thread) % pairs.len();
+                let (s, t) = pairs[j];
+                if i % 2 == 0 {
+                    assert_eq!(cache.distance(&mut query, s, t), expected[j], "s={s} t={t}");
+                } else {
+                    let route = cache.route(&mut query, s, t);
+                    assert_eq!(route.as_ref().map(|r| r.distance), expected[j]);
+                    if let Some(route) = route {
+                        let length: u32 = route
+                            .arc_path
+                            .iter()
+                            .map(|&a| metric.weights()[a as usize])
+                            .sum();
+                        assert_eq!(length, route.distance, "s={s} t={t}");
+                    }
+                }
+            }
+        });
+        let stats = cache.stats();
+        assert_eq!(stats.hits + stats.misses, 4 * 2_000);
+        assert!(stats.hit_rate() > 0.5, "round {round}: {stats:?}");
+        assert!(cache.len() <= 400);
+
+        let arc_ids: Vec<u32> = (0..300)
+            .map(|_| rng.gen_range(0..tail.len() as u32))
+            .collect();
+        let new_weights: Vec<u32> = (0..300).map(|_| rng.gen_range(1..=300)).collect();
+        updater.apply_arrays(&mut metric, &arc_ids, &new_weights);
+        assert_ne!(metric.epoch(), epoch);
+    }
+}
+
+#[test]
+fn poi_index_nearest_with_updates() {
+    let RandomGraph {
+        mut rng,
+        node_count,
+        tail,
+        head,
+        weights,
+        order,
+        ..
+    } = random_graph(11, 1_000, 5_000, 1..=100);
+    let cch = CCH::new(&order, &tail, &head, |_| {}, false);
+    let metric = CCHMetric::new(&cch, weights.clone());
+    let adj = adjacency(node_count, &tail, &head, &weights);
+
+    let mut pois: Vec<u32> = (0..50).map(|_| rng.gen_range(0..node_count)).collect();
+    pois.sort();
+    pois.dedup();
+    let mut index = CCHPOIIndex::new(&metric, &pois);
+    assert_eq!(index.len(), pois.len());
+    let mut query = CCHQuery::new(&metric);
+    for round in 0..40 {
+        if round % 4 == 1 {
+            let p = pois.swap_remove(rng.gen_range(0..pois.len()));
+            assert!(index.remove(p));
+        } else if round % 4 == 3 {
+            let p = rng.gen_range(0..node_count);
+            assert_eq!(index.insert(p), !pois.contains(&p));
+            if !pois.contains(&p) {
+                pois.push(p);
+            }
+        }
+        let s = rng.gen_range(0..node_count);
+        let reference = dijkstra_distances(&adj, s);
+        let mut expected: Vec<u32> = pois
+            .iter()
+            .filter_map(|p| reference.get(p).copied())
+            .collect();
+        expected.sort();
+        expected.truncate(5);
+        let nearest = index.nearest(&mut query, s, 5);
+        assert_eq!(
+            nearest.iter().map(|&(_, d)| d).collect::<Vec<_>>(),
+            expected,
+            "nearest POI mismatch s={s}"
+        );
+    }
+}
+
 // fn test_phast_to_targets() {
 //     // Build a tiny graph: 0 -> 1 -> 2, weights 1
 //     let order = vec![0, 1, 2];